@@ -40,8 +40,10 @@
 
  **********************************************************************/
 
-CRGB leftLeds[NUM_LEDS_PER_STRIP];
-CRGB rightLeds[NUM_LEDS_PER_STRIP];
+// Strips sized for the role of the device, carved from the arena in setup()
+uint16_t ledsPerStrip = NUM_LEDS_PER_STRIP;
+CRGB *leftLeds = NULL;
+CRGB *rightLeds = NULL;
 
 #define STATE_START          0
 #define STATE_WIFI_SCAN      1
@@ -65,21 +67,6 @@ String tempString;
 const i2s_port_t I2S_PORT = I2S_NUM_0;
 boolean i2sEnabled = false;
 
-uint32_t i2s_rolling_mean[I2S_ROLLING_MEAN_SIZE];
-uint32_t i2s_rollingmaxInput = 0;
-uint32_t i2s_sampleCounter = 0;
-uint32_t i2s_long_term_mean = 0;
-uint32_t i2s_biggestInput = 0;
-uint32_t i2s_maxInput = 0;
-uint32_t i2s_maxInputTime = 0;
-uint32_t i2s_secondtMaxInput = 0;
-uint32_t i2s_inputFlushTime = 1000000; // was 2 seconds, in microseconds
-uint32_t i2s_maxInputFlushTime = 2000000; // was 4 seconds, in microseconds
-uint32_t lastEdgeDectionTime = 0; // in microseconds
-uint32_t lastEdgeDectionLevel = 0;
-boolean overLastEdgeDectionLevel = false;
-uint32_t minEdgeDetectionGap = 300000; // was 100 milliseconds, in microseconds
-uint32_t maxEdgeDetectionGap = 600000; // was 300 milliseconds, in microseconds
 uint16_t detectedBeatCounter = 0;
 
 boolean result = false;
@@ -107,12 +94,16 @@ boolean flashLastState = false;
 
 boolean MLS_masterMode = false;
 boolean MLS_remoteControl = false;
+boolean MLS_fastResume = false;   // Master restarted during the show, with its devices registry
 
 boolean LoraIsUp = false;
 
 boolean OneEspNowPacketReceived = false;
+volatile uint16_t mlsmeshRejectedPackets = 0; // Packets rejected by the ESP-NOW callback (size or header)
 
 uint32_t mlsmeshLastPacketSentMs = 0;
+boolean mlsmeshRebootPending = false;        // Restart once the relay of the reboot request is sent (protocol task)
+uint32_t mlsmeshRebootRequestMs = 0;
 
 uint8_t bleEffect = 0;
 char bleParams[JSON_SIZE];
@@ -126,6 +117,9 @@ uint32_t simulatorBeatSpeed = 1000; // (in ms, = 1s
 uint8_t simulatorEffect = EFFECT_NONE;
 
 TaskHandle_t TaskUpdateLightHandle = NULL;
+TaskHandle_t TaskMlsMeshHandle = NULL;
+TaskHandle_t TaskI2sCaptureHandle = NULL;
+esp_timer_handle_t mlsmeshRepeaterTimer = NULL; // Wakes up the protocol task in the repeater time slot
 
 String lora_rssi = "--";
 String lora_packSize = "--";
@@ -140,16 +134,21 @@ uint32_t startStateRunningTS = 0; // in ms
 
 boolean sendResult;
 
-uint8_t announced_devices = 1;
-struct DEVICE_INFO devices[210];
 struct DEVICE_INFO my_device;
 
-boolean nextEffectBeatEnabled = false;
+boolean nextEffectBeatEnabled = false;     // The beat effect is armed, the beats are sent as FIRE DATA
+uint8_t mlsmeshArmId = 0;                  // Id of the last armed effect
+uint8_t armRepeatsLeft = 0;                // ARM DATA copies still to send before the first FIRE DATA
+uint32_t lastArmSentMs = 0;
+volatile uint16_t mlsmeshUnarmedFires = 0; // FIRE DATA received without the ARM DATA of the effect
 uint8_t current_beat_effect = 0;
 
 struct LIGHT_PACKET light_packet;
 struct LIGHT_PACKET next_light_packet_to_send;
-struct LIGHT_PACKET last_light_packet;
+struct LIGHT_PACKET armed_light_packet;     // Last armed effect, repeat_counter is the arm id
+struct LIGHT_PACKET last_light_packet;      // Last LIGHT DATA sent (master) or received (slave), for the state beacon
+uint32_t lastLightPacketMasterTime = 0;     // MASTER_TIME of the last LIGHT DATA
+boolean lastLightPacketValid = false;
 
 struct ACTION_PACKET action_packet;
 uint8_t dummy_payload[20];
@@ -157,7 +156,6 @@ uint8_t dummy_payload[20];
 struct TOPOLOGY_PACKET topology_packet;
 
 uint8_t last_effect_played = 0;
-uint16_t last_packet_played = 0;
 
 uint16_t last_packet_sent = 65535;
 uint16_t last_packet_received = 65535;
@@ -183,12 +181,26 @@ uint8_t lastCommand = 0;
 uint8_t lastCommandSenderId = 0;
 uint16_t lastCommandPacketId = 0;
 
-uint16_t mlsmeshLastPackedId = 0;
+uint16_t mlsmeshLastPackedId = 0;  // Last packet id of the master (network sequence of the commands)
+uint16_t mlsmeshMyPacketId = 0;    // Packet id of my own packets (slaves)
+uint32_t mlsmeshLastMasterTime = 0;
 
 uint16_t checkCounter = 0;
 
 uint32_t lastdisplayUpdateTime = 0;
 
 uint32_t lastSubscribeTimeMs = 0;
+uint32_t subscribeBackoffMs = SUBSCRIBE_RETRY_TIME_MS;
+uint32_t subscribeDelayMs = 0;
+volatile boolean subscribeRequestSent = false; // A batch reply is only for a device which has sent a request
+uint32_t lastTopologyBatchMs = 0;
+uint32_t lastRegistrySaveMs = 0;
+
+int8_t mlsmeshLastRssi = -127;
+uint8_t mlsmeshLastRssiMac[6];
+uint32_t lastElectionTimeMs = 0;
+uint32_t lastRssiReportMs = 0;
+uint32_t lastMlsMeshStatsMs = 0;
+struct MLS_PACKET repeater_packet;
 
 #endif
@@ -116,6 +116,7 @@ const String ACTUAL_FIRMWARE = "1.1.1.1";
 #include <esp_now.h>
 #include <WiFi.h>
 #include "esp_wifi.h"
+#include "esp_timer.h"
 #if defined(I2S_WS_PIN) && defined(I2S_SCK_PIN) && defined(I2S_SD_PIN)
   #include "driver/i2s.h"
 #endif
@@ -124,7 +125,21 @@ const String ACTUAL_FIRMWARE = "1.1.1.1";
 #include "mls_tools.h"
 #include "mls_ota.h"
 #include "mls_mesh.h"
+#include "mls_repeater.h"
+#include "mls_clock.h"
 #include "mls_light_effects.h"
+#include "mls_render.h"
+#include "mls_led_driver.h"
+#include "mls_arena.h"
+#include "mls_ring.h"
+#include "mls_replay.h"
+#include "mls_registry.h"
+#include "mls_wire.h"
+#include "mls_groups.h"
+#include "mls_tx.h"
+#include "mls_beacon.h"
+#include "mls_beat_detector.h"
+#include "mls_tempo.h"
 
 #ifdef BLE_SERVER
   #include <BLEDevice.h>
@@ -195,7 +210,29 @@ const String ACTUAL_FIRMWARE = "1.1.1.1";
 /// Classes instantiation /// Classes instantiation /// Classes instantiation /// Classes instantiation ///
 MlsOta mlsota(OTA_URL, ACTUAL_FIRMWARE);
 MlsTools mlstools;
-MlsLightEffects mlslighteffects(NUM_LEDS_PER_STRIP, leftLeds, rightLeds);
+MlsArena mlsarena;
+MlsLightEffects mlslighteffects(ledsPerStrip, leftLeds, rightLeds);
+MlsRepeater mlsrepeater;
+MlsClock mlsclock;
+MlsRender mlsrender(NUM_LEDS_PER_STRIP);
+MlsRing<struct RECEIVED_PACKET, MLSMESH_RX_RING_SIZE> mlsmeshRxRing;
+MlsReplayWindow mlsreplay;
+MlsRegistry mlsregistry;
+MlsWire mlswire;
+MlsGroups mlsgroups;
+MlsTxScheduler mlstx;
+MlsStateBeacon mlsbeacon;
+MlsBeatDetector mlsbeatdetector;
+#if defined(I2S_WS_PIN) && defined(I2S_SCK_PIN) && defined(I2S_SD_PIN)
+  MlsI2sSampleSource i2ssource(I2S_PORT);
+#endif
+MlsMailbox<struct I2S_BEAT, I2S_BEAT_MAILBOX_SIZE> i2sBeats; // Written by TaskI2sCapture, read by the loop
+MlsTempo mlstempo;
+#ifdef LED_DRIVER_RMT
+  MlsRmtLedDriver mlsleddriver;
+#else
+  MlsFastLedDriver mlsleddriver;
+#endif
 
 AiEsp32RotaryEncoder rotaryEncoder = AiEsp32RotaryEncoder(ROTARY_ENCODER_A_PIN, ROTARY_ENCODER_B_PIN, ROTARY_ENCODER_BUTTON_PIN, ROTARY_ENCODER_VCC_PIN, ROTARY_ENCODER_STEPS);
 
@@ -324,12 +361,9 @@ void mlsmesh_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
   if ((ACTION_SUBTYPE == (hdr->frame_ctrl & 0xFF)) &&
       (memcmp(hdr->oui, ESPRESSIF_OUI, 3) == 0)) {
 
-      int8_t rssi = ppkt->rx_ctrl.rssi;
-
-    char macStr[18];
-
-    snprintf(macStr, sizeof(macStr), "%02x:%02x:%02x:%02x:%02x:%02x",
-    hdr->addr2[0], hdr->addr2[1], hdr->addr2[2], hdr->addr2[3], hdr->addr2[4], hdr->addr2[5]);
+    // RSSI of the last ESPNOW frame, used by mlsmesh_receive_packet_cb (called just after in the same task)
+    mlsmeshLastRssi = ppkt->rx_ctrl.rssi;
+    memcpy(mlsmeshLastRssiMac, hdr->addr2, 6);
 
 /*
     for (uint8_t i = 0; i < 100; i++) {
@@ -348,15 +382,6 @@ void mlsmesh_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
       }
     }
 */
-    DEBUG_PRINT("mlsmesh_promiscuous_rx_cb running on core ");
-    DEBUG_PRINTLN(xPortGetCoreID());
-  
-    DEBUG_PRINT("Sender RSSI: ");
-    DEBUG_PRINTLN(macStr);
-
-    DEBUG_PRINT("RSSI level: ");
-    DEBUG_PRINTLN(rssi);
-
     //for (int i = 0; i <= 199; i++) {
     //  Serial.print(char(ppkt->payload[i]));
     //}
@@ -364,26 +389,92 @@ void mlsmesh_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
 }
 
 
-boolean mlsmesh_send_packet(const uint8_t packetType, const uint8_t *data) {
+// Priority class of a packet in the transmit scheduler
+uint8_t mlsmesh_tx_class(struct MLS_PACKET *packet) {
+  switch (MlsGroups::getType(packet->TYPE)) {
+    case MLS_TYPE_LIGHT_DATA:
+      return (EFFECT_CHECK == ((struct LIGHT_PACKET *) packet->DATA)->effect) ? MLS_TX_COMMAND : MLS_TX_BEAT;
+    case MLS_TYPE_ARM_DATA:
+    case MLS_TYPE_FIRE_DATA:
+      return MLS_TX_BEAT;
+    case MLS_TYPE_TOPOLOGY_DATA:
+      return MLS_TX_TOPOLOGY;
+    case MLS_TYPE_ACTION_DATA:
+      if ((MLS_ACTION_KEEP_ALIVE == packet->DATA[0]) || (MLS_ACTION_STATE_BEACON == packet->DATA[0]) || (MLS_ACTION_STATE_FADES == packet->DATA[0])) {
+        return MLS_TX_KEEP_ALIVE;
+      }
+      return MLS_TX_COMMAND;
+    default:
+      return MLS_TX_COMMAND;
+  }
+}
+
+
+// Queue a packet in the transmit scheduler, in the compact wire format or in the fixed format
+// (the MASTER_TIME of an original packet is stamped by the scheduler when it is sent, not the one of a forwarded
+// packet or of a packet with a fixed MASTER_TIME)
+esp_err_t mlsmesh_send_raw(struct MLS_PACKET *packet, boolean original) {
+  boolean queued;
+  #ifdef MLSMESH_WIRE_COMPACT
+    uint8_t buffer[MLSMESH_WIRE_MAX_SIZE];
+    uint8_t length = mlswire.encode(packet, buffer);
+    queued = mlstx.enqueue(mlsmesh_tx_class(packet), buffer, length, original ? MLSMESH_WIRE_MASTER_TIME : MLS_TX_NO_TIME);
+  #else
+    queued = mlstx.enqueue(mlsmesh_tx_class(packet), packet->raw, MLS_PACKET_SIZE, original ? offsetof(struct MLS_PACKET, MASTER_TIME) : MLS_TX_NO_TIME);
+  #endif
+  return queued ? ESP_OK : ESP_FAIL;
+}
+
+
+// Original packet with the addressing modifiers of packetType (destinationId is only used with a modifier)
+// Its MASTER_TIME is the time of the send (stamped), or a fixed master time
+// (predicted beat: the packet is played at mlsmesh_playout_time(master_time), and it is sent before)
+boolean mlsmesh_send_original(const uint8_t packetType, const uint8_t destinationId, const uint8_t *data, boolean stamped, uint32_t master_time) {
   if (MLS_masterMode) {
     mlsmeshLastPackedId++;
+  } else {
+    mlsmeshMyPacketId++;
   }
   mlsmeshLastPacketSentMs = millis();
 
   boolean sendResult = false;
   struct MLS_PACKET mls_packet;
+  memset(mls_packet.raw, 0, MLS_PACKET_SIZE);
   memcpy(mls_packet.IID, mlstools.config.iid, 3);
   mls_packet.TYPE = packetType;
-  mls_packet.PACKET_ID = mlsmeshLastPackedId;
+  if (packetType & MLS_TYPE_MODIFIERS) {
+    mls_packet.DESTINATION_ID = destinationId;
+  }
+  mls_packet.PACKET_ID = MLS_masterMode ? mlsmeshLastPackedId : mlsmeshMyPacketId;
   mls_packet.SENDER_ID = my_device.id;
   mls_packet.NUMBER_OF_COLUMNS = mlslighteffects.getColumns();
   mls_packet.NUMBER_OF_RANKS = mlslighteffects.getRanks();
   mls_packet.COMMAND = lastCommand;
   mls_packet.COMMAND_SENDER_ID = lastCommandSenderId;
   mls_packet.COMMAND_PACKET_ID = lastCommandPacketId;
+  mls_packet.RSSI0 = my_device.rssi;
+  // Master time of the enqueue, the transmit scheduler adds the time spent in its queue
+  if (!stamped) {
+    mls_packet.MASTER_TIME = master_time;
+  } else if (MLS_masterMode) {
+    mls_packet.MASTER_TIME = micros();
+  } else {
+    mls_packet.MASTER_TIME = mlsclock.localToMaster(micros());
+  }
+  mlsmeshLastMasterTime = mls_packet.MASTER_TIME;
+  if (MLS_masterMode) {
+    mlsrepeater.fillPacket(&mls_packet);
+  } else {
+    memset(mls_packet.REPEATERS_ID, MLSMESH_NO_REPEATER, MLSMESH_MAX_REPEATERS);
+  }
 
   memcpy(mls_packet.DATA, data, MLS_DATA_SIZE);
-  esp_err_t result = esp_now_send(espnowBroadcastAddress, (uint8_t *) &mls_packet.raw, MLS_PACKET_SIZE);
+  if (MLS_masterMode && (MLS_TYPE_LIGHT_DATA == packetType) && (EFFECT_KEEP_ALIVE != ((struct LIGHT_PACKET *) data)->effect)) {
+    memcpy(last_light_packet.raw, data, LIGHT_PACKET_SIZE);
+    lastLightPacketMasterTime = mls_packet.MASTER_TIME;
+    lastLightPacketValid = true;
+  }
+  esp_err_t result = mlsmesh_send_raw(&mls_packet, stamped);
   sendResult = (result == ESP_OK);
   if (sendResult) {
   } else {
@@ -396,154 +487,478 @@ boolean mlsmesh_send_packet(const uint8_t packetType, const uint8_t *data) {
 }
 
 
-// callback when ESPNOW data is received
+// Packet with the addressing modifiers of packetType (destinationId is only used with a modifier)
+boolean mlsmesh_send_packet_to(const uint8_t packetType, const uint8_t destinationId, const uint8_t *data) {
+  return mlsmesh_send_original(packetType, destinationId, data, true, 0);
+}
+
+
+// Broadcast packet
+boolean mlsmesh_send_packet(const uint8_t packetType, const uint8_t *data) {
+  return mlsmesh_send_packet_to(packetType, 0, data);
+}
+
+
+// Packet for the members of a group only (see mls_groups.h for the group ids)
+boolean mlsmesh_send_group_packet(const uint8_t packetType, const uint8_t groupId, const uint8_t *data) {
+  return mlsmesh_send_packet_to(packetType | MLS_TYPE_MODIFIER_GROUP, groupId, data);
+}
+
+
+// Packet for one device only
+boolean mlsmesh_send_unicast_packet(const uint8_t packetType, const uint8_t deviceId, const uint8_t *data) {
+  return mlsmesh_send_packet_to(packetType | MLS_TYPE_MODIFIER_UNICAST, deviceId, data);
+}
+
+
+// Light effect with one palette color per column (master): one packet per column group, and the light of its own column played by the master
+boolean mlsmesh_send_column_light(struct LIGHT_PACKET *light, const uint8_t palette[][3], uint8_t palette_size) {
+  struct LIGHT_PACKET column_light;
+  uint8_t columns = mlslighteffects.getColumns();
+  uint8_t sent = MlsGroups::sendColumnLights(mlsmesh_send_group_packet, light, columns, palette, palette_size);
+
+  if ((mlstools.config.column > 0) && mlsgroups.isMember(MLS_GROUP_COLUMN(mlstools.config.column))) {
+    MlsGroups::getColumnLight(light, mlstools.config.column, palette, palette_size, &column_light);
+    mlslighteffects.setLightDataMasterTime(mlsmeshLastPackedId, &column_light, mlsmesh_playout_time(mlsmeshLastMasterTime));
+  }
+  return (sent == min(columns, (uint8_t) MLS_GROUP_MAX_COLUMN));
+}
+
+
+// Arm the next beat effect (master): the ARM DATA is sent MLSMESH_ARM_REPEATS times by the loop before the first FIRE DATA
+void mlsmesh_arm_effect(struct LIGHT_PACKET *light) {
+  struct LIGHT_PACKET compiled_packet;
+
+  mlsmeshArmId++;
+  memcpy(armed_light_packet.raw, light->raw, LIGHT_PACKET_SIZE);
+  armed_light_packet.repeat_counter = mlsmeshArmId;
+  memcpy(compiled_packet.raw, armed_light_packet.raw, LIGHT_PACKET_SIZE);
+  mlslighteffects.armLightData(mlsmeshArmId, &compiled_packet);
+  armRepeatsLeft = MLSMESH_ARM_REPEATS;
+  lastArmSentMs = millis() - MLSMESH_ARM_REPEAT_MS - 1;
+  nextEffectBeatEnabled = true;
+}
+
+
+// Play the armed effect on the beat (master), only the arm id and the beat counter are sent
+// (MASTER_TIME stamped when it is sent, or a fixed master time, like mlsmesh_send_original())
+boolean mlsmesh_send_fire(uint16_t repeat_counter, boolean stamped, uint32_t master_time) {
+  struct MLS_FIRE_PACKET fire_packet;
+  boolean sendResult = false;
+
+  mlsmeshLastPackedId++;
+  mlsmeshLastPacketSentMs = millis();
+  memcpy(fire_packet.IID, mlstools.config.iid, 3);
+  fire_packet.TYPE = MLS_TYPE_FIRE_DATA;
+  fire_packet.SENDER_ID = my_device.id;
+  fire_packet.PACKET_ID = mlsmeshLastPackedId;
+  fire_packet.REPEATER_POSITION = 0;
+  fire_packet.MASTER_TIME = stamped ? micros() : master_time;
+  fire_packet.ARM_ID = mlsmeshArmId;
+  fire_packet.REPEAT_COUNTER = repeat_counter;
+  mlsmeshLastMasterTime = fire_packet.MASTER_TIME;
+
+  memcpy(last_light_packet.raw, armed_light_packet.raw, LIGHT_PACKET_SIZE);
+  last_light_packet.repeat_counter = repeat_counter;
+  lastLightPacketMasterTime = fire_packet.MASTER_TIME;
+  lastLightPacketValid = true;
+
+  sendResult = mlstx.enqueue(MLS_TX_BEAT, fire_packet.raw, MLS_FIRE_PACKET_SIZE, stamped ? offsetof(struct MLS_FIRE_PACKET, MASTER_TIME) : MLS_TX_NO_TIME);
+  if (!sendResult) {
+    #ifdef DEBUG_MLS
+      DEBUG_PRINTLN("ESPNOW: Error sending fire packet");
+    #endif
+  }
+  return sendResult;
+}
+
+
+// Keep alive packet of the master, with the state of the current effect if any (colors and fade times in alternate beacons)
+boolean mlsmesh_send_state_beacon() {
+  struct STATE_BEACON_PACKET beacon_packet;
+
+  if (!lastLightPacketValid) {
+    action_packet.action = MLS_ACTION_KEEP_ALIVE;
+    return mlsmesh_send_packet(MLS_TYPE_ACTION_DATA, (uint8_t *) &action_packet);
+  }
+  // Absolute start time: the MASTER_TIME of the beacon is stamped when it is sent, after its wait in the queue
+  mlsbeacon.fill(&beacon_packet, &last_light_packet, lastLightPacketMasterTime);
+  return mlsmesh_send_packet(MLS_TYPE_ACTION_DATA, (uint8_t *) &beacon_packet);
+}
+
+
+// Master time when an effect sent at master_time is played by all the devices
+// (after the time slot of the last repeater, to be sure that every device has received it)
+uint32_t mlsmesh_playout_time(uint32_t master_time) {
+  return master_time + ((mlsrepeater.getNumberOfRepeaters() + 1) * MLSMESH_REPEATER_SLOT_US);
+}
+
+
+// Beat of the current beat effect (master), played on all the devices mlsmesh_playout_time() after now (reactive mode),
+// or on the predicted beat (beat_micros, local time of the master which is the master time)
+// The MASTER_TIME of a predicted beat is the playout time minus the playout delay: it is not later than the send
+// (isBeatDue() with the playout delay as lead time), so the clock of the devices is never set in advance by it
+void mlsmesh_send_beat(boolean predicted, uint32_t beat_micros) {
+  uint32_t master_time = beat_micros - mlsmesh_playout_time(0);
+  uint32_t playout_master_time;
+
+  if (last_effect_played != current_beat_effect) {
+    detectedBeatCounter = 0;
+  }
+  last_effect_played = current_beat_effect;
+  if (nextEffectBeatEnabled && (0 == armRepeatsLeft) && (armed_light_packet.effect == current_beat_effect)) {
+    // The effect is armed on all the devices, only the beat is sent
+    boolean sendResult = mlsmesh_send_fire(detectedBeatCounter, !predicted, master_time);
+    playout_master_time = predicted ? beat_micros : mlsmesh_playout_time(mlsmeshLastMasterTime);
+    mlslighteffects.fireLightData(mlsmeshArmId, detectedBeatCounter, detectedBeatCounter, playout_master_time);
+  } else {
+    light_packet = (LIGHT_PACKET){current_beat_effect, 0, detectedBeatCounter, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    // light_packet = (LIGHT_PACKET){EFFECT_FLASH, MODIFIER_FLIP_FLOP, detectedBeatCounter, 0, 0, 255, 0, 0, 0, 3, 35, 0, 255, 0, 0, 3, 35}; // RED/GREEN FLASH FLIP-FLOP
+    boolean sendResult = mlsmesh_send_original(MLS_TYPE_LIGHT_DATA, 0, (uint8_t *) &light_packet, !predicted, master_time);
+    playout_master_time = predicted ? beat_micros : mlsmesh_playout_time(mlsmeshLastMasterTime);
+    mlslighteffects.setLightDataMasterTime(detectedBeatCounter, &light_packet, playout_master_time);
+  }
+  detectedBeatCounter++;
+}
+
+
+// Send the waiting topology replies (master), MLS_TOPOLOGY_BATCH_SIZE replies per packet
+// (a device with the same MAC suffix as another one gets a reply with its full MAC address)
+boolean mlsmesh_send_topology_batch() {
+  struct TOPOLOGY_BATCH_PACKET batch_packet;
+  struct TOPOLOGY_PACKET reply_packet;
+  uint8_t full_reply_id;
+  boolean sendResult = false;
+
+  if (mlsregistry.fillBatch(&batch_packet, &full_reply_id) > 0) {
+    sendResult = mlsmesh_send_packet(MLS_TYPE_TOPOLOGY_DATA, (uint8_t *) &batch_packet);
+  }
+  if (MLSMESH_UNKNOWN_DEVICE != full_reply_id) {
+    mlsregistry.fillReply(full_reply_id, &reply_packet);
+    sendResult = mlsmesh_send_packet(MLS_TYPE_TOPOLOGY_DATA, (uint8_t *) &reply_packet);
+  }
+  return sendResult;
+}
+
+
+// Forward an original master packet in my repeater time slot
+boolean mlsmesh_forward_packet(struct MLS_PACKET *packet) {
+  esp_err_t result;
+
+  if (MLS_TYPE_FIRE_DATA == packet->TYPE) {
+    struct MLS_FIRE_PACKET fire_packet;
+    struct FIRE_PACKET *fire_data = (struct FIRE_PACKET *) packet->DATA;
+    memcpy(fire_packet.IID, packet->IID, 3);
+    fire_packet.TYPE = packet->TYPE;
+    fire_packet.SENDER_ID = packet->SENDER_ID;
+    fire_packet.PACKET_ID = packet->PACKET_ID;
+    fire_packet.REPEATER_POSITION = packet->REPEATER_POSITION;
+    fire_packet.MASTER_TIME = packet->MASTER_TIME;
+    fire_packet.ARM_ID = fire_data->arm_id;
+    fire_packet.REPEAT_COUNTER = fire_data->repeat_counter;
+    result = mlstx.enqueue(MLS_TX_BEAT, fire_packet.raw, MLS_FIRE_PACKET_SIZE) ? ESP_OK : ESP_FAIL;
+  } else {
+    result = mlsmesh_send_raw(packet, false);
+  }
+  if (result != ESP_OK) {
+    DEBUG_PRINT("ESPNOW: Error forwarding packet ");
+    DEBUG_PRINTLN(packet->PACKET_ID);
+    return false;
+  }
+  return true;
+}
+
+
+// callback when ESPNOW data is received (Wi-Fi task)
+// Only validate and enqueue the packet, the protocol task TaskMlsMesh does the rest
 void mlsmesh_receive_packet_cb(const uint8_t * mac_addr, const uint8_t *incomingData, int len) {
-    uint8_t received_mac[6];
-    boolean isNewCommand = false;
+  uint32_t received_micros = micros();
+  struct RECEIVED_PACKET *received;
+
+  // TODO enhance the packet detection
+  if ((len < 4) || ((len != MLS_PACKET_SIZE) && (!MlsWire::isCompact(incomingData, len)) && ((len != MLS_FIRE_PACKET_SIZE) || (MLS_TYPE_FIRE_DATA != incomingData[3]))) || (memcmp(mlstools.config.iid, incomingData, 3) != 0)) {
+    mlsmeshRejectedPackets++;
+    return;
+  }
+  received = mlsmeshRxRing.reserve();
+  if (NULL == received) {
+    return;
+  }
+  received->received_micros = received_micros;
+  memcpy(received->mac, mac_addr, 6);
+  // Group or unicast packet for other devices, dropped before any parsing (except by the repeaters, which forward it)
+  if (0 == mlsrepeater.getMyPosition()) {
+    uint8_t type;
+    uint8_t destination_id;
+    MlsWire::peekAddress(incomingData, len, &type, &destination_id);
+    if (!mlsgroups.accepts(type, destination_id, my_device.id)) {
+      mlsgroups.countFiltered();
+      return;
+    }
+  }
+  // RSSI of the last ESPNOW frame, set by mlsmesh_promiscuous_rx_cb just before
+  received->rssi = (memcmp(mlsmeshLastRssiMac, mac_addr, 6) == 0) ? mlsmeshLastRssi : -127;
+  if (MlsWire::isCompact(incomingData, len)) {
+    // Compact packet (or fixed packet of a firmware without the compact wire format, below)
+    if (!mlswire.decode(incomingData, len, &received->packet)) {
+      mlsmeshRejectedPackets++;
+      return;
+    }
+  } else if (MLS_FIRE_PACKET_SIZE == len) {
+    // Short fire packet, expanded in a regular packet for the protocol task
+    struct MLS_FIRE_PACKET *fire_packet = (struct MLS_FIRE_PACKET *) incomingData;
+    struct FIRE_PACKET *fire_data = (struct FIRE_PACKET *) received->packet.DATA;
+    memset(received->packet.raw, 0, MLS_PACKET_SIZE);
+    memcpy(received->packet.IID, fire_packet->IID, 3);
+    received->packet.TYPE = fire_packet->TYPE;
+    received->packet.SENDER_ID = fire_packet->SENDER_ID;
+    received->packet.PACKET_ID = fire_packet->PACKET_ID;
+    received->packet.REPEATER_POSITION = fire_packet->REPEATER_POSITION;
+    received->packet.MASTER_TIME = fire_packet->MASTER_TIME;
+    fire_data->arm_id = fire_packet->ARM_ID;
+    fire_data->repeat_counter = fire_packet->REPEAT_COUNTER;
+  } else {
+    memcpy(received->packet.raw, incomingData, MLS_PACKET_SIZE);
+  }
+  mlsmeshRxRing.commit();
+  if (NULL != TaskMlsMeshHandle) {
+    xTaskNotifyGive(TaskMlsMeshHandle);
+  }
+}
 
-    memcpy(received_mac, mac_addr, 6);
 
+// Handle a received packet (TaskMlsMesh)
+void mlsmesh_process_packet(struct RECEIVED_PACKET *received) {
+  uint32_t received_micros = received->received_micros;
+  int8_t received_rssi = received->rssi;
+  struct MLS_PACKET *mls_received_packet = &received->packet;
+  uint8_t packet_type = MlsGroups::getType(mls_received_packet->TYPE);
+  boolean isNewCommand = false;
+  uint32_t hop_latency_micros = 0;
+
+  #ifdef DEBUG_MLS
     char macStr[18];
     snprintf(macStr, sizeof(macStr), "%02x:%02x:%02x:%02x:%02x:%02x",
-             mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-    DEBUG_PRINT("ESPNOW: mlsmesh_receive_packet_cb packet of ");
-    DEBUG_PRINT(len);
-    DEBUG_PRINT(" bytes received from: ");
+             received->mac[0], received->mac[1], received->mac[2], received->mac[3], received->mac[4], received->mac[5]);
+    DEBUG_PRINT("ESPNOW: MLS packet of type ");
+    DEBUG_PRINT(mls_received_packet->TYPE);
+    DEBUG_PRINT(" received from: ");
     DEBUG_PRINT(macStr);
     DEBUG_PRINT(", time: ");
-    DEBUG_PRINT(micros()/1000);
+    DEBUG_PRINT(received_micros/1000);
     DEBUG_PRINTLN("ms");
-  
-  // TODO enhance the packet detection
-  if (len != MLS_PACKET_SIZE) {
-    DEBUG_PRINTLN("ESPNOW: wrong packet size");
-  } else if (memcmp(mlstools.config.iid, incomingData, 3) != 0) {
-    DEBUG_PRINTLN("ESPNOW: packet received is not a valid MLS packet (bad header)");
-  } else {
-    OneEspNowPacketReceived = true;
-    struct MLS_PACKET mls_received_packet;
-    memcpy(mls_received_packet.raw, incomingData, MLS_PACKET_SIZE);
-    DEBUG_PRINT("ESPNOW: packet received is a valid MLS packet of type ");
-    DEBUG_PRINTLN(mls_received_packet.TYPE);
-
-    // Update the last command if it is a new one
-    if ((mls_received_packet.COMMAND_PACKET_ID - lastCommandPacketId) > 0) {
-      isNewCommand = true;
-      lastCommand = mls_received_packet.COMMAND;
-      lastCommandSenderId = mls_received_packet.COMMAND_SENDER_ID;
-      lastCommandPacketId = mls_received_packet.COMMAND_PACKET_ID;
+  #endif
+
+  OneEspNowPacketReceived = true;
+
+  // Copy of my own packet, forwarded by a repeater
+  if (MLS_masterMode && (0 == mls_received_packet->SENDER_ID)) {
+    return;
+  }
+
+  // Only the first copy of each packet of a sender is handled (the unregistered devices have all the id 0xFF)
+  if ((0xFF != mls_received_packet->SENDER_ID) && (!mlsreplay.isNew(mls_received_packet->SENDER_ID, mls_received_packet->PACKET_ID))) {
+    DEBUG_PRINTLN("ESPNOW: duplicate or old packet ignored");
+    return;
+  }
+
+  if (0 == mls_received_packet->SENDER_ID) {
+    if (0 == (mls_received_packet->REPEATER_POSITION & MLSMESH_REPEATER_POSITION_MASK)) {
+      my_device.rssi = received_rssi;
+      my_device.rssi_time = millis();
     }
-    DEBUG_PRINT("Received ESPNOW PACKET_ID: ");
-    DEBUG_PRINTLN(mls_received_packet.PACKET_ID);
-    if ((mls_received_packet.PACKET_ID > mlsmeshLastPackedId) || (abs(mls_received_packet.PACKET_ID - mlsmeshLastPackedId) > 10000)) {
-      mlsmeshLastPackedId = mls_received_packet.PACKET_ID;
+    // A fire packet has no repeaters list, the list of the last packet is kept
+    if (MLS_TYPE_FIRE_DATA != mls_received_packet->TYPE) {
+      mlsrepeater.learnRepeaters(mls_received_packet, my_device.id);
     }
+    mlsrepeater.schedule(mls_received_packet, received_micros);
+    hop_latency_micros = mlsrepeater.getHopLatencyMicros(mls_received_packet);
+    mlsclock.addSample(mls_received_packet->MASTER_TIME + hop_latency_micros, received_micros);
+  } else if (MLS_masterMode) {
+    mlsregistry.setRssi(mls_received_packet->SENDER_ID, received_rssi, millis());
+  }
 
-    struct LIGHT_PACKET receivedLightPacket;
+  // Update the last command if it is a new one
+  if ((MLS_TYPE_FIRE_DATA != mls_received_packet->TYPE) && MlsReplayWindow::isNewer(mls_received_packet->COMMAND_PACKET_ID, lastCommandPacketId)) {
+    isNewCommand = true;
+    lastCommand = mls_received_packet->COMMAND;
+    lastCommandSenderId = mls_received_packet->COMMAND_SENDER_ID;
+    lastCommandPacketId = mls_received_packet->COMMAND_PACKET_ID;
+  }
+  DEBUG_PRINT("Received ESPNOW PACKET_ID: ");
+  DEBUG_PRINTLN(mls_received_packet->PACKET_ID);
+  if (0 == mls_received_packet->SENDER_ID) {
+    mlsmeshLastPackedId = mlsreplay.getNewestId(0);
+  }
 
-    // LIGHT DATA
-    if (MLS_TYPE_LIGHT_DATA == mls_received_packet.TYPE) {
+  // Group or unicast packet for other devices (only received here by the repeaters, which have forwarded it)
+  if (!mlsgroups.accepts(mls_received_packet->TYPE, mls_received_packet->DESTINATION_ID, my_device.id)) {
+    return;
+  }
 
-      if (last_packet_played != mls_received_packet.PACKET_ID) {
-        last_packet_played = mls_received_packet.PACKET_ID;
+  struct LIGHT_PACKET receivedLightPacket;
 
-        // Extract number of columns and ranks
-        if (!MLS_masterMode) {
-          mlslighteffects.setColumns(mls_received_packet.NUMBER_OF_COLUMNS);
-          mlslighteffects.setRanks(mls_received_packet.NUMBER_OF_RANKS);
-        }
-          
-        if (!MLS_masterMode) {
-          memcpy(receivedLightPacket.raw, mls_received_packet.DATA, LIGHT_PACKET_SIZE);
-          #ifdef DEBUG_MLS
-            DEBUG_PRINT("ESPNOW: MLS_TYPE_LIGHT_DATA MLS effect: ");
-            DEBUG_PRINTLN(receivedLightPacket.effect);
-            DEBUG_PRINT("LIGHT INFO: Left color (RGB): ");
-            DEBUG_PRINT(receivedLightPacket.left_color_r);
-            DEBUG_PRINT(" ");
-            DEBUG_PRINT(receivedLightPacket.left_color_g);
-            DEBUG_PRINT(" ");
-            DEBUG_PRINTLN(receivedLightPacket.left_color_b);
-            DEBUG_PRINT("LIGHT INFO: Left on time: ");
-            DEBUG_PRINTLN(receivedLightPacket.left_on_time);
-          #endif
-          if (last_effect_played != current_beat_effect) {
-            detectedBeatCounter = 0;
-          }
-          mlslighteffects.setLightData(millis(), &receivedLightPacket); // Max latency: 39000, not used yet.
-          detectedBeatCounter++;
-        }
-      } // if (last_packet_played != mls_received_packet.PACKET_ID)
+  // LIGHT DATA
+  if (MLS_TYPE_LIGHT_DATA == packet_type) {
 
-    // ACK LIGHT DATA
-    } else if (MLS_TYPE_ACK_LIGHT_DATA == mls_received_packet.TYPE) {
-      if (MLS_masterMode) {
-        if (isNewCommand) {
-          // Is the effect of the command synced with bass drum ?
-          if ((lastCommand >= 100) && (lastCommand <= 199)) {
-            current_beat_effect = lastCommand;
+    // Extract number of columns and ranks
+    if (!MLS_masterMode) {
+      mlslighteffects.setColumns(mls_received_packet->NUMBER_OF_COLUMNS);
+      mlslighteffects.setRanks(mls_received_packet->NUMBER_OF_RANKS);
+    }
+      
+    if (!MLS_masterMode) {
+      memcpy(receivedLightPacket.raw, mls_received_packet->DATA, LIGHT_PACKET_SIZE);
+      #ifdef DEBUG_MLS
+        DEBUG_PRINT("ESPNOW: MLS_TYPE_LIGHT_DATA MLS effect: ");
+        DEBUG_PRINTLN(receivedLightPacket.effect);
+        DEBUG_PRINT("LIGHT INFO: Left color (RGB): ");
+        DEBUG_PRINT(receivedLightPacket.left_color_r);
+        DEBUG_PRINT(" ");
+        DEBUG_PRINT(receivedLightPacket.left_color_g);
+        DEBUG_PRINT(" ");
+        DEBUG_PRINTLN(receivedLightPacket.left_color_b);
+        DEBUG_PRINT("LIGHT INFO: Left on time: ");
+        DEBUG_PRINTLN(receivedLightPacket.left_on_time);
+      #endif
+      if (last_effect_played != current_beat_effect) {
+        detectedBeatCounter = 0;
+      }
+      mlslighteffects.setLightDataMasterTime(millis(), &receivedLightPacket, mlsmesh_playout_time(mls_received_packet->MASTER_TIME));
+      detectedBeatCounter++;
+      memcpy(last_light_packet.raw, receivedLightPacket.raw, LIGHT_PACKET_SIZE);
+      lastLightPacketMasterTime = mls_received_packet->MASTER_TIME;
+      lastLightPacketValid = true;
+    }
+
+  // ARM DATA: the effect is compiled now, and played by the next FIRE DATA
+  } else if (MLS_TYPE_ARM_DATA == packet_type) {
+    if (!MLS_masterMode) {
+      mlslighteffects.setColumns(mls_received_packet->NUMBER_OF_COLUMNS);
+      mlslighteffects.setRanks(mls_received_packet->NUMBER_OF_RANKS);
+      memcpy(receivedLightPacket.raw, mls_received_packet->DATA, LIGHT_PACKET_SIZE);
+      // Copies of the same armed effect are ignored
+      if ((armed_light_packet.repeat_counter != receivedLightPacket.repeat_counter) || (armed_light_packet.effect != receivedLightPacket.effect)) {
+        memcpy(armed_light_packet.raw, receivedLightPacket.raw, LIGHT_PACKET_SIZE);
+        mlslighteffects.armLightData(receivedLightPacket.repeat_counter, &receivedLightPacket);
+      }
+    }
+
+  // FIRE DATA
+  } else if (MLS_TYPE_FIRE_DATA == packet_type) {
+    if (!MLS_masterMode) {
+      struct FIRE_PACKET *receivedFirePacket = (struct FIRE_PACKET *) mls_received_packet->DATA;
+      if (mlslighteffects.fireLightData(receivedFirePacket->arm_id, receivedFirePacket->repeat_counter, mls_received_packet->PACKET_ID, mlsmesh_playout_time(mls_received_packet->MASTER_TIME))) {
+        memcpy(last_light_packet.raw, armed_light_packet.raw, LIGHT_PACKET_SIZE);
+        last_light_packet.repeat_counter = receivedFirePacket->repeat_counter;
+        lastLightPacketMasterTime = mls_received_packet->MASTER_TIME;
+        lastLightPacketValid = true;
+      } else {
+        mlsmeshUnarmedFires++;
+      }
+    }
+
+  // ACK LIGHT DATA
+  } else if (MLS_TYPE_ACK_LIGHT_DATA == packet_type) {
+    if (MLS_masterMode) {
+      if (isNewCommand) {
+        // Is the effect of the command synced with bass drum ?
+        if ((lastCommand >= 100) && (lastCommand <= 199)) {
+          current_beat_effect = lastCommand;
+        } else {
+          if (EFFECT_CHECK == lastCommand) {
+            receivedLightPacket = (LIGHT_PACKET){lastCommand, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
           } else {
-            if (EFFECT_CHECK == lastCommand) {
-              receivedLightPacket = (LIGHT_PACKET){lastCommand, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-            } else {
-              receivedLightPacket = (LIGHT_PACKET){lastCommand, 0, millis(), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-            }
-            boolean sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &receivedLightPacket);
-            mlslighteffects.setLightData(millis(), &receivedLightPacket); // Max latency: 39000, not used yet.
-            current_beat_effect = EFFECT_KEEP_ALIVE;
+            receivedLightPacket = (LIGHT_PACKET){lastCommand, 0, millis(), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
           }
+          boolean sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &receivedLightPacket);
+          mlslighteffects.setLightDataMasterTime(millis(), &receivedLightPacket, mlsmesh_playout_time(mlsmeshLastMasterTime));
+          current_beat_effect = EFFECT_KEEP_ALIVE;
         }
       }
-    } else if (MLS_TYPE_ACTION_DATA == mls_received_packet.TYPE) {
-      struct ACTION_PACKET receivedActionPacket;
-      memcpy(receivedActionPacket.raw, mls_received_packet.DATA, ACTION_PACKET_SIZE);
-      if (receivedActionPacket.action == MLS_ACTION_FORCE_UPDATE) {
-        DEBUG_PRINTLN("ESPNOW: Force firmware updated received");
-        forceFirmwareUpdate = true;
-        forceFirmwareUpdateTrial = 0;
-      } else if (receivedActionPacket.action == MLS_ACTION_REBOOT) {
+    }
+  } else if (MLS_TYPE_ACTION_DATA == packet_type) {
+    struct ACTION_PACKET receivedActionPacket;
+    memcpy(receivedActionPacket.raw, mls_received_packet->DATA, ACTION_PACKET_SIZE);
+    if (receivedActionPacket.action == MLS_ACTION_FORCE_UPDATE) {
+      DEBUG_PRINTLN("ESPNOW: Force firmware updated received");
+      forceFirmwareUpdate = true;
+      forceFirmwareUpdateTrial = 0;
+    } else if (receivedActionPacket.action == MLS_ACTION_REBOOT) {
+      // Relay the request, the protocol task restarts once the scheduler has sent it
+      if (!mlsmeshRebootPending) {
         action_packet.action = MLS_ACTION_REBOOT;
         boolean sendResult = mlsmesh_send_packet(MLS_TYPE_ACTION_DATA, (uint8_t *) &action_packet);
-        delay(500);
-        ESP.restart();
+        mlsmeshRebootRequestMs = millis();
+        mlsmeshRebootPending = true;
       }
-    } else if (MLS_TYPE_TOPOLOGY_DATA == mls_received_packet.TYPE) {
-      struct TOPOLOGY_PACKET receivedTopologyPacket;
-      uint8_t device_id;
-      memcpy(receivedTopologyPacket.raw, mls_received_packet.DATA, ACTION_PACKET_SIZE);
-      DEBUG_PRINT("receivedTopologyPacket.type: ");DEBUG_PRINTLN(receivedTopologyPacket.type);
-      DEBUG_PRINT("receivedTopologyPacket.device_id: ");DEBUG_PRINTLN(receivedTopologyPacket.device_id);
-      DEBUG_PRINT("receivedTopologyPacket.rank: ");DEBUG_PRINTLN(receivedTopologyPacket.rank);
-      DEBUG_PRINT("receivedTopologyPacket.column: ");DEBUG_PRINTLN(receivedTopologyPacket.column);
-      if ((MLS_masterMode) && (MLS_TOPOLOGY_REQUEST == receivedTopologyPacket.type)) {
-        device_id = searchDevice(devices, announced_devices, received_mac);
-        if (0xFF == device_id) {
-          memcpy(devices[announced_devices].mac, receivedTopologyPacket.mac, 6);
-          devices[announced_devices].rank   = receivedTopologyPacket.rank;
-          devices[announced_devices].column = receivedTopologyPacket.column;
-          announced_devices++;
-          device_id = announced_devices; // We do that after ++ because the master as the id 0 !
-          if (receivedTopologyPacket.column > mlslighteffects.getColumns()) {
-            mlslighteffects.setColumns(receivedTopologyPacket.column);
-          }
-          if (receivedTopologyPacket.rank > mlslighteffects.getRanks()) {
-            mlslighteffects.setRanks(receivedTopologyPacket.rank);
-          }
+    } else if ((!MLS_masterMode) && ((receivedActionPacket.action == MLS_ACTION_STATE_BEACON) || (receivedActionPacket.action == MLS_ACTION_STATE_FADES))) {
+      struct STATE_BEACON_PACKET receivedBeaconPacket;
+      memcpy(receivedBeaconPacket.raw, mls_received_packet->DATA, STATE_BEACON_PACKET_SIZE);
+      uint32_t phase_micros = mls_received_packet->MASTER_TIME - receivedBeaconPacket.start_master_time;
+      // Late join (or missed LIGHT DATA): restart the current effect of the master with its phase,
+      // and again when the other half of the beacon completes it
+      if (MlsStateBeacon::merge(&receivedBeaconPacket, &last_light_packet, &lastLightPacketMasterTime, lastLightPacketValid)) {
+        memcpy(receivedLightPacket.raw, last_light_packet.raw, LIGHT_PACKET_SIZE);
+        mlslighteffects.setColumns(mls_received_packet->NUMBER_OF_COLUMNS);
+        mlslighteffects.setRanks(mls_received_packet->NUMBER_OF_RANKS);
+        if (mlsclock.isSynchronized()) {
+          mlslighteffects.setLightDataMasterTime(millis(), &receivedLightPacket, mlsmesh_playout_time(receivedBeaconPacket.start_master_time));
+        } else {
+          mlslighteffects.setLightData(millis(), &receivedLightPacket, phase_micros + hop_latency_micros);
+        }
+        lastLightPacketValid = true;
+        DEBUG_PRINT("ESPNOW: state beacon applied, effect: ");
+        DEBUG_PRINT(receivedBeaconPacket.effect);
+        DEBUG_PRINT(", phase (ms): ");
+        DEBUG_PRINTLN(phase_micros / 1000);
+      }
+    }
+  } else if (MLS_TYPE_TOPOLOGY_DATA == packet_type) {
+    struct TOPOLOGY_PACKET receivedTopologyPacket;
+    uint8_t device_id;
+    memcpy(receivedTopologyPacket.raw, mls_received_packet->DATA, ACTION_PACKET_SIZE);
+    DEBUG_PRINT("receivedTopologyPacket.type: ");DEBUG_PRINTLN(receivedTopologyPacket.type);
+    DEBUG_PRINT("receivedTopologyPacket.device_id: ");DEBUG_PRINTLN(receivedTopologyPacket.device_id);
+    DEBUG_PRINT("receivedTopologyPacket.rank: ");DEBUG_PRINTLN(receivedTopologyPacket.rank);
+    DEBUG_PRINT("receivedTopologyPacket.column: ");DEBUG_PRINTLN(receivedTopologyPacket.column);
+    if ((MLS_masterMode) && (MLS_TOPOLOGY_REQUEST == receivedTopologyPacket.type)) {
+      device_id = mlsregistry.search(receivedTopologyPacket.mac);
+      if (MLSMESH_UNKNOWN_DEVICE == device_id) {
+        // The master has the id 0, the position in the registry is the id
+        device_id = mlsregistry.add(receivedTopologyPacket.mac, receivedTopologyPacket.rank, receivedTopologyPacket.column);
+        if (MLSMESH_UNKNOWN_DEVICE == device_id) {
+          // Registry full: the full reply without id takes back an id taken from the batch reply of a device with the same MAC suffix
+          struct TOPOLOGY_PACKET refusal_packet;
+          MlsRegistry::fillRefusal(receivedTopologyPacket.mac, &refusal_packet);
+          mlsmesh_send_packet(MLS_TYPE_TOPOLOGY_DATA, (uint8_t *) &refusal_packet);
+          return;
         }
-        // Send back the id info with the mac address;
-        topology_packet.device_id = device_id;
-        memcpy(topology_packet.mac, devices[device_id].mac, 6);
-        topology_packet.type   = MLS_TOPOLOGY_REPLY;
-        topology_packet.rank   = devices[device_id].rank;
-        topology_packet.column = devices[device_id].column;
-        boolean sendResult = mlsmesh_send_packet(MLS_TYPE_TOPOLOGY_DATA, (uint8_t *) &topology_packet);
-      } else if ((!MLS_masterMode) && (MLS_TOPOLOGY_REPLY == receivedTopologyPacket.type)) {
-        if (0xFF == my_device.id) {
-          memcpy(devices[receivedTopologyPacket.device_id].mac, receivedTopologyPacket.mac, 6);
-          devices[receivedTopologyPacket.device_id].rank   = receivedTopologyPacket.rank;
-          devices[receivedTopologyPacket.device_id].column = receivedTopologyPacket.column;
-          if (memcmp(my_device.mac, receivedTopologyPacket.mac, 6) == 0) { // It's for me :-)
-            my_device.id = receivedTopologyPacket.device_id;
+        mlsreplay.clear(device_id);
+        mlsregistry.setRssi(device_id, received_rssi, millis());
+        if (receivedTopologyPacket.column > mlslighteffects.getColumns()) {
+          mlslighteffects.setColumns(receivedTopologyPacket.column);
+        }
+        if (receivedTopologyPacket.rank > mlslighteffects.getRanks()) {
+          mlslighteffects.setRanks(receivedTopologyPacket.rank);
+        }
+      }
+      // The id info is sent back in the next topology batch reply
+      mlsregistry.queueReply(device_id);
+    } else if ((!MLS_masterMode) && (MLS_TOPOLOGY_REPLY == receivedTopologyPacket.type)) {
+      // The full MAC reply always wins: it corrects an id taken from a batch reply for another device with the same MAC suffix
+      if (memcmp(my_device.mac, receivedTopologyPacket.mac, 6) == 0) { // It's for me :-)
+        my_device.id = receivedTopologyPacket.device_id;
+      }
+    } else if ((!MLS_masterMode) && (MLS_TOPOLOGY_BATCH_REPLY == receivedTopologyPacket.type)) {
+      if ((0xFF == my_device.id) && subscribeRequestSent) {
+        struct TOPOLOGY_BATCH_PACKET receivedBatchPacket;
+        memcpy(receivedBatchPacket.raw, mls_received_packet->DATA, TOPOLOGY_BATCH_PACKET_SIZE);
+        for (uint8_t i = 0; i < MLS_TOPOLOGY_BATCH_SIZE; i++) {
+          // Same MAC suffix, and my rank and column (the request of another device with my MAC suffix may have been lost)
+          if ((0xFF != receivedBatchPacket.replies[i].device_id) && (memcmp(&my_device.mac[3], receivedBatchPacket.replies[i].mac_suffix, 3) == 0) &&
+              (mlslighteffects.getMyRank() == receivedBatchPacket.replies[i].rank) && (mlslighteffects.getMyColumn() == receivedBatchPacket.replies[i].column)) { // It's for me :-)
+            my_device.id = receivedBatchPacket.replies[i].device_id;
           }
         }
       }
@@ -553,7 +968,12 @@ void mlsmesh_receive_packet_cb(const uint8_t * mac_addr, const uint8_t *incoming
 
  
 // Callback when ESPNOW data is sent
+// The next frame of the transmit scheduler is sent by the protocol task
 void OnEspNowDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
+  mlstx.onSent(ESP_NOW_SEND_SUCCESS == status);
+  if (NULL != TaskMlsMeshHandle) {
+    xTaskNotifyGive(TaskMlsMeshHandle);
+  }
   #ifdef DEBUG_MLS
     if (status == ESP_NOW_SEND_SUCCESS) {
       DEBUG_PRINTLN("ESPNOW: Delivery Success");
@@ -564,12 +984,78 @@ void OnEspNowDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
 }
 
 
+// Callback of the repeater timer (esp_timer task): the time slot is reached
+void mlsmesh_repeater_timer_cb(void *arg) {
+  if (NULL != TaskMlsMeshHandle) {
+    xTaskNotifyGive(TaskMlsMeshHandle);
+  }
+}
+
+
+/// PROTOCOL TASK /// PROTOCOL TASK /// PROTOCOL TASK /// PROTOCOL TASK ///
+void TaskMlsMesh( void * pvParameters ){
+  struct RECEIVED_PACKET *received;
+  uint32_t slot_wait_micros;
+  while(true) {
+    // Wait for the ESP-NOW callbacks, the repeater timer (or the next rate limited frame)
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MLS_TX_PUMP_MS));
+    while (NULL != (received = mlsmeshRxRing.peek())) {
+      mlsmesh_process_packet(received);
+      mlsmeshRxRing.release();
+    }
+    // Forward the pending master packet in my repeater time slot, or wake up at its deadline
+    if ((!MLS_masterMode) && (mlsrepeater.nextPacket(&repeater_packet, micros()))) {
+      mlsmesh_forward_packet(&repeater_packet);
+    }
+    slot_wait_micros = mlsrepeater.getWaitMicros(micros());
+    if ((MLSMESH_REPEATER_NO_SLOT != slot_wait_micros) && (NULL != mlsmeshRepeaterTimer)) {
+      esp_timer_stop(mlsmeshRepeaterTimer);
+      esp_timer_start_once(mlsmeshRepeaterTimer, (slot_wait_micros > 0) ? slot_wait_micros : 1);
+    }
+    mlstx.pump();
+    // Reboot request relayed (or not sent in time)
+    if (mlsmeshRebootPending && (mlstx.isIdle() || ((millis() - mlsmeshRebootRequestMs) > MLSMESH_REBOOT_FLUSH_MS))) {
+      DEBUG_PRINTLN("ESPNOW: Reboot request relayed, restart");
+      ESP.restart();
+    }
+  }
+}
+
+
 /// PERMANENT TASK /// PERMANENT TASK /// PERMANENT TASK /// PERMANENT TASK ///
 void TaskUpdateLight( void * pvParameters ){
+  uint32_t frame_time_micros;
+  uint32_t waiting_start_micros = 0;
+  boolean waiting;
   while(true) {
-    mlslighteffects.updateLight();
-    yield();
-    delayMicroseconds(50); // Changed from 100 microseconds to 50 microseconds (2021-11-09)
+    frame_time_micros = micros();
+    mlsrender.startFrame(frame_time_micros);
+    mlslighteffects.updateLight(frame_time_micros);
+    mlsrender.endFrame(micros());
+    // Idle until the next frame, the start of a waiting effect, or a new light data
+    waiting = mlslighteffects.getWaitingStartTime(&waiting_start_micros);
+    ulTaskNotifyTake(pdTRUE, mlsrender.getWaitTicks(micros(), waiting, waiting_start_micros));
+  }
+}
+
+
+/// AUDIO TASK /// AUDIO TASK /// AUDIO TASK /// AUDIO TASK ///
+// Beat detection on the hops of the sample source given as parameter, the beats are sent by the loop
+void TaskI2sCapture( void * pvParameters ){
+  MlsSampleSource *source = (MlsSampleSource *) pvParameters;
+  int32_t samples[I2S_BLOCK_SIZE];
+  uint32_t hop_end_micros;
+  uint16_t samples_read;
+  struct I2S_BEAT beat;
+  while(true) {
+    samples_read = source->read(samples, I2S_BLOCK_SIZE, &hop_end_micros);
+    if (0 == samples_read) {
+      vTaskDelay(1);
+      continue;
+    }
+    if (mlsbeatdetector.process(samples, samples_read, hop_end_micros, &beat)) {
+      i2sBeats.push(&beat);
+    }
   }
 }
 
@@ -606,18 +1092,62 @@ void setup() {
     pinMode(ONBOARD_LED, OUTPUT);
   #endif
 
-  FastLED.addLeds<LED_TYPE, LEFT_LEDS_PIN, LED_COLOR_ORDER>(leftLeds, NUM_LEDS_PER_STRIP);
-  FastLED.addLeds<LED_TYPE, RIGHT_LEDS_PIN, LED_COLOR_ORDER>(rightLeds, NUM_LEDS_PER_STRIP);
-  FastLED.clear();
-
-  FastLED.setBrightness(LED_TEST_BRIGHTNESS);
-
   // Initialize SPIFFS
   mlstools.spiffs_init();
 
   // Load non-volatile configuration
   mlstools.loadConfiguration(INITIAL_IID);
 
+  // The role of the device gives the length of the strips
+  #ifdef FORCE_SLAVE
+    MLS_masterMode = false;
+  #else
+    #ifdef FORCE_MASTER
+      MLS_masterMode = true;
+    #else
+      if (MASTER_PIN > 0) {  
+        MLS_masterMode = (0 == digitalRead(MASTER_PIN));
+	    }
+    #endif
+  #endif
+
+  // Master restarted by a brownout, a crash or a watchdog: resume the show with the saved devices registry
+  if (MLS_masterMode) {
+    esp_reset_reason_t reset_reason = esp_reset_reason();
+    if ((ESP_RST_BROWNOUT == reset_reason) || (ESP_RST_PANIC == reset_reason) || (ESP_RST_INT_WDT == reset_reason) || (ESP_RST_TASK_WDT == reset_reason) || (ESP_RST_WDT == reset_reason)) {
+      WiFi.macAddress(my_device.mac);
+      MLS_fastResume = mlsregistry.load(MLSMESH_REGISTRY_FILE, my_device.mac);
+    }
+    if (MLS_fastResume) {
+      DEBUG_PRINTLN("SETUP: Master fast resume");
+      for (uint8_t id = 1; id < mlsregistry.getNumberOfDevices(); id++) {
+        if (mlsregistry.getColumn(id) > mlslighteffects.getColumns()) {
+          mlslighteffects.setColumns(mlsregistry.getColumn(id));
+        }
+        if (mlsregistry.getRank(id) > mlslighteffects.getRanks()) {
+          mlslighteffects.setRanks(mlsregistry.getRank(id));
+        }
+      }
+    }
+  }
+
+  ledsPerStrip = MLS_masterMode ? mlstools.config.masterleds : mlstools.config.leds;
+  if ((0 == ledsPerStrip) || (ledsPerStrip > NUM_LEDS_PER_STRIP_MASTER)) {
+    ledsPerStrip = MLS_masterMode ? NUM_LEDS_PER_STRIP_MASTER : NUM_LEDS_PER_STRIP;
+  }
+
+  // All the per-strip buffers are carved from the arena, no heap allocation after setup()
+  leftLeds  = (CRGB *) mlsarena.allocate(ledsPerStrip * sizeof(CRGB));
+  rightLeds = (CRGB *) mlsarena.allocate(ledsPerStrip * sizeof(CRGB));
+  mlslighteffects.setStrips(leftLeds, rightLeds);
+  mlslighteffects.begin(&mlsarena, ledsPerStrip);
+  mlsrender.setLedsPerStrip(ledsPerStrip);
+  mlsleddriver.begin(leftLeds, rightLeds, ledsPerStrip, &mlsarena);
+  mlslighteffects.setLedDriver(&mlsleddriver);
+  DEBUG_PRINTLN("SETUP: " + String(ledsPerStrip) + " LEDs per strip, arena: " + String(mlsarena.getHighWater()) + "/" + String(mlsarena.getSize()) + " bytes used");
+
+  FastLED.setBrightness(LED_TEST_BRIGHTNESS);
+
   #ifdef ARDUINO_TTGO_LoRa32_v21new
     // Initialize the 128x64 OLED display using Wire library
 
@@ -678,6 +1208,13 @@ DEBUG_PRINTLN(", 10");
 
   // Default is 0xFF (unregistered)
   my_device.id = 0xFF;
+  // Random first packet ids, the other devices must not take the packets after a reboot for old ones
+  mlsmeshLastPackedId = random(0, 65536);
+  mlsmeshMyPacketId = random(0, 65536);
+  my_device.rssi = -127;
+  my_device.rssi_time = 0;
+  mlslighteffects.setClock(&mlsclock);
+  mlslighteffects.setNotifyTask(&TaskUpdateLightHandle);
 
   TIMERG0.wdt_wprotect=TIMG_WDT_WKEY_VALUE;
   TIMERG0.wdt_feed=1;
@@ -691,11 +1228,37 @@ DEBUG_PRINTLN(", 10");
                       "TaskUpdateLight",      // name of task.
                       10000,                  // Stack size of task
                       NULL,                   // parameter of the task
-                      1,                      // priority of the task
+                      2,                      // priority of the task (higher than loop, idle most of the time)
                       &TaskUpdateLightHandle, // Task handle to keep track of created task
                       1);                     // Do the TaskLed job on the separate core 1
   }
 
+  // Transmit scheduler: the beats are never rate limited
+  mlstx.setRate(MLS_TX_COMMAND, MLS_TX_COMMAND_RATE, MLS_TX_BURST);
+  mlstx.setRate(MLS_TX_TOPOLOGY, MLS_TX_TOPOLOGY_RATE, MLS_TX_BURST);
+  mlstx.setRate(MLS_TX_KEEP_ALIVE, MLS_TX_KEEP_ALIVE_RATE, 1);
+
+  // One shot timer of the repeater time slots (started by the protocol task)
+  if (mlsmeshRepeaterTimer == NULL) {
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = mlsmesh_repeater_timer_cb;
+    timer_args.name = "MlsRepeater";
+    esp_timer_create(&timer_args, &mlsmeshRepeaterTimer);
+  }
+
+  // Start the TaskMlsMesh if needed (before the registration of the ESP-NOW callback)
+  if (TaskMlsMeshHandle == NULL) {
+    DEBUG_PRINTLN("SETUP: Start TaskMlsMeshHandle");
+    xTaskCreatePinnedToCore(
+                      TaskMlsMesh,            // Task function.
+                      "TaskMlsMesh",          // name of task.
+                      10000,                  // Stack size of task
+                      NULL,                   // parameter of the task
+                      3,                      // priority of the task (below the Wi-Fi task, idle most of the time)
+                      &TaskMlsMeshHandle,     // Task handle to keep track of created task
+                      0);                     // Do the protocol job on the core 0, with the Wi-Fi task
+  }
+
   #ifdef DEBUG_MLS
     // Additional tests at boot
 
@@ -737,6 +1300,30 @@ DEBUG_PRINTLN(", 10");
       while(true);
     }
 
+    struct TOPOLOGY_BATCH_PACKET test_topology_batch_packet;
+    if (TOPOLOGY_BATCH_PACKET_SIZE != sizeof(test_topology_batch_packet.raw)) {
+      DEBUG_PRINT("Topology batch packet size error!");
+      while(true);
+    }
+
+    struct FIRE_PACKET test_fire_packet;
+    if (FIRE_PACKET_SIZE != sizeof(test_fire_packet.raw)) {
+      DEBUG_PRINT("Fire packet size error!");
+      while(true);
+    }
+
+    struct MLS_FIRE_PACKET test_mls_fire_packet;
+    if (MLS_FIRE_PACKET_SIZE != sizeof(test_mls_fire_packet.raw)) {
+      DEBUG_PRINT("MLS fire packet size error!");
+      while(true);
+    }
+
+    struct STATE_BEACON_PACKET test_state_beacon_packet;
+    if (STATE_BEACON_PACKET_SIZE != sizeof(test_state_beacon_packet.raw)) {
+      DEBUG_PRINT("State beacon packet size error!");
+      while(true);
+    }
+
     // Some light effects at the beginning...
     /*
     DEBUG_PRINTLN("PROGRESS4 test for 2 seconds");
@@ -755,27 +1342,18 @@ DEBUG_PRINTLN(", 10");
   #endif
 
   // Rainbow check for at least 1 second + WIFI connection time
-  light_packet = (LIGHT_PACKET){EFFECT_PROGRESS_RAINBOW, MODIFIER_REPEAT, millis(), 1212, 0, 0, 255, 0, 12, 5, 12, 0, 255, 0, 12, 5, 12}; // RAINBOW 1212
-  mlslighteffects.setLightData(millis(), &light_packet);
-  delay(1000);
-
-  #ifdef FORCE_SLAVE
-    MLS_masterMode = false;
-  #else
-    #ifdef FORCE_MASTER
-      MLS_masterMode = true;
-    #else
-      if (MASTER_PIN > 0) {  
-        MLS_masterMode = (0 == digitalRead(MASTER_PIN));
-	    }
-    #endif
-  #endif
+  if (!MLS_fastResume) {
+    light_packet = (LIGHT_PACKET){EFFECT_PROGRESS_RAINBOW, MODIFIER_REPEAT, millis(), 1212, 0, 0, 255, 0, 12, 5, 12, 0, 255, 0, 12, 5, 12}; // RAINBOW 1212
+    mlslighteffects.setLightData(millis(), &light_packet);
+    delay(1000);
+  }
 
   DEBUG_PRINTLN();
   DEBUG_PRINTLN("Board: " + String(ARDUINO_BOARD));
   
   if (MLS_masterMode) {
     my_device.id = 0;
+    mlsclock.setMaster();
     
     DEBUG_PRINTLN("Mode: Bass drum (ESPNOW master)");
     #ifdef ARDUINO_TTGO_LoRa32_v21new
@@ -809,7 +1387,7 @@ DEBUG_PRINTLN(", 10");
             .communication_format = i2s_comm_format_t(I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB),
             .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,     // Interrupt level 1
             .dma_buf_count = I2S_BUFFERS,                 // number of buffers
-            .dma_buf_len = I2S_BLOCK_SIZE                 // samples per buffer (minimum 8)
+            .dma_buf_len = I2S_BLOCK_SIZE                 // samples per buffer (minimum 8), one hop per buffer
         };
       
         const i2s_pin_config_t pin_config = {
@@ -860,10 +1438,46 @@ void loop() {
 
   // Always : ESPNOW keep alive packet from the master if needed
   if ((MLS_masterMode) && ((millis() - mlsmeshLastPacketSentMs) > MLSMESH_MASTER_TIMEOUT_MS)) {
-    mlsmeshLastPacketSentMs = mlsmeshLastPacketSentMs + 2000; // Set next trial in 2 seconds
+    mlsmeshLastPacketSentMs = mlsmeshLastPacketSentMs + MLSMESH_STATE_BEACON_MS; // Set next trial in 2 seconds
     DEBUG_PRINTLN("LOOP: ESPNOW keep alive packet sent, because timeout check time is now over.");
-    action_packet.action = MLS_ACTION_KEEP_ALIVE;
-    boolean sendResult = mlsmesh_send_packet(MLS_TYPE_ACTION_DATA, (uint8_t *) &action_packet);
+    boolean sendResult = mlsmesh_send_state_beacon();
+  }
+
+  // Always : arm the beat effect of the master in advance, and send the copies of the ARM DATA
+  if (MLS_masterMode) {
+    if ((current_beat_effect >= 100) && (current_beat_effect <= 199)) {
+      if ((!nextEffectBeatEnabled) || (armed_light_packet.effect != current_beat_effect)) {
+        light_packet = (LIGHT_PACKET){current_beat_effect, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        mlsmesh_arm_effect(&light_packet);
+      }
+    } else {
+      nextEffectBeatEnabled = false;
+    }
+    if (nextEffectBeatEnabled && (((armRepeatsLeft > 0) && ((millis() - lastArmSentMs) > MLSMESH_ARM_REPEAT_MS)) || ((millis() - lastArmSentMs) > MLSMESH_ARM_REFRESH_MS))) {
+      lastArmSentMs = millis();
+      if (armRepeatsLeft > 0) {
+        armRepeatsLeft--;
+      }
+      sendResult = mlsmesh_send_packet(MLS_TYPE_ARM_DATA, (uint8_t *) &armed_light_packet);
+    }
+  }
+
+  // Always : MLSmesh repeaters election by the master
+  if ((MLS_masterMode) && (state == STATE_RUNNING) && ((millis() - lastElectionTimeMs) > MLSMESH_ELECTION_TIME_MS)) {
+    lastElectionTimeMs = millis();
+    mlsrepeater.elect(&mlsregistry, lastElectionTimeMs);
+  }
+
+  // Always : topology replies of the master, several replies per packet on a fixed cadence
+  if ((MLS_masterMode) && ((millis() - lastTopologyBatchMs) > MLSMESH_TOPOLOGY_BATCH_MS)) {
+    lastTopologyBatchMs = millis();
+    mlsmesh_send_topology_batch();
+  }
+
+  // Always : new devices appended to the registry file of the master
+  if ((MLS_masterMode) && (state == STATE_RUNNING) && ((millis() - lastRegistrySaveMs) > MLSMESH_REGISTRY_SAVE_MS)) {
+    lastRegistrySaveMs = millis();
+    mlsregistry.save(MLSMESH_REGISTRY_FILE);
   }
 
   // STATE_START // STATE_START // STATE_START // STATE_START //
@@ -889,9 +1503,11 @@ void loop() {
 
     WiFi.macAddress(my_device.mac);
     if (MLS_masterMode) {
-      announced_devices = 1;
       my_device.id = 0;
-      WiFi.macAddress(devices[my_device.id].mac);
+      if (!MLS_fastResume) {
+        mlsregistry.clear();
+        mlsregistry.add(my_device.mac, 0, 0);
+      }
     } else {
       WiFi.macAddress(my_device.mac);
     }
@@ -913,6 +1529,11 @@ void loop() {
     wifiStep = WIFI_SCAN_START;
     stateStartTime = micros();
     ssidScanStartTime = stateStartTime;
+
+    // Fast resume of the master: no WiFi connection, no configuration
+    if (MLS_fastResume) {
+      state = STATE_CONFIG_DONE;
+    }
   }
 
   // STATE_WIFI_SCAN // STATE_WIFI_SCAN // STATE_WIFI_SCAN // STATE_WIFI_SCAN //
@@ -991,8 +1612,8 @@ void loop() {
       FastLED.setBrightness(LED_CONFIG_BRIGHTNESS);
       mlslighteffects.stopUpdate();
       delay(10);
-      mlslighteffects.fill(CRGB::Green, NUM_LEDS_PER_STRIP, leftLeds);
-      mlslighteffects.fill(CRGB::Green, NUM_LEDS_PER_STRIP, rightLeds);
+      mlslighteffects.fill(CRGB::Green, ledsPerStrip, leftLeds);
+      mlslighteffects.fill(CRGB::Green, ledsPerStrip, rightLeds);
       mlslighteffects.showLeds();
       light_packet = (LIGHT_PACKET){EFFECT_FLASH, MODIFIER_REPEAT, millis(), 300, 0, 0, 255, 0, 12, 5, 12, 0, 255, 0, 12, 5, 12}; // GREEN/GREEN FLASH (wave) 300
       mlslighteffects.setLightData(millis(), &light_packet);
@@ -1042,8 +1663,8 @@ void loop() {
       FastLED.setBrightness(LED_CONFIG_BRIGHTNESS);
       mlslighteffects.stopUpdate();
       delay(10);
-      mlslighteffects.fill(CRGB::Blue, NUM_LEDS_PER_STRIP, leftLeds);
-      mlslighteffects.fill(CRGB::Blue, NUM_LEDS_PER_STRIP, rightLeds);
+      mlslighteffects.fill(CRGB::Blue, ledsPerStrip, leftLeds);
+      mlslighteffects.fill(CRGB::Blue, ledsPerStrip, rightLeds);
       mlslighteffects.showLeds();
       light_packet = (LIGHT_PACKET){EFFECT_PROGRESS4, MODIFIER_REPEAT, millis(), 600, 0, 0, 0, 255, 45, 10, 45, 0, 0, 255, 45, 10, 45}; // BLUE/BLUE PROGRESS4 600
       mlslighteffects.setLightData(millis(), &light_packet);
@@ -1051,8 +1672,8 @@ void loop() {
       mlsota.otaUpdates();
       mlslighteffects.stopUpdate();
       delay(10);
-      mlslighteffects.fill(CRGB::Black, NUM_LEDS_PER_STRIP, leftLeds);
-      mlslighteffects.fill(CRGB::Black, NUM_LEDS_PER_STRIP, rightLeds);
+      mlslighteffects.fill(CRGB::Black, ledsPerStrip, leftLeds);
+      mlslighteffects.fill(CRGB::Black, ledsPerStrip, rightLeds);
       mlslighteffects.showLeds();
     }
     mlstools.importConfiguration(mlsota.otaDownloadOptions(mlstools.config));
@@ -1191,8 +1812,8 @@ void loop() {
       mlstools.config.ssid1validated = 0;
       mlstools.config.ssid2validated = 0;
       FastLED.setBrightness(LED_CONFIG_BRIGHTNESS);
-      mlslighteffects.fill(MLS_DARK_ORANGE, NUM_LEDS_PER_STRIP, leftLeds);
-      mlslighteffects.fill(MLS_DARK_ORANGE, NUM_LEDS_PER_STRIP, rightLeds);
+      mlslighteffects.fill(MLS_DARK_ORANGE, ledsPerStrip, leftLeds);
+      mlslighteffects.fill(MLS_DARK_ORANGE, ledsPerStrip, rightLeds);
       mlslighteffects.showLeds();
       light_packet = (LIGHT_PACKET){EFFECT_PROGRESS, MODIFIER_FLIP_FLOP, millis(), 300, 0, 255, 140, 0, 45, 10, 45, 255, 140, 0, 45, 10, 45}; // MLS_DARK_ORANGE
       mlslighteffects.setLightData(millis(), &light_packet);
@@ -1234,10 +1855,10 @@ void loop() {
           DEBUG_PRINTLN("Column selected: " + String(rotaryEncoder.readEncoder()));
           mlstools.config.column = rotaryEncoder.readEncoder();
           #ifdef ROTARY_ENCODER_A_PIN
-            rotaryEncoder.setBoundaries(0, NUM_LEDS_PER_STRIP, false);
+            rotaryEncoder.setBoundaries(0, ledsPerStrip, false);
             rotaryEncoder.setEncoderValue(mlstools.config.rank);
             // Set already the next selection color
-            mlslighteffects.setValueThree(mlstools.config.rank, NUM_LEDS_PER_STRIP, MLS_FADED_BLUE, MLS_WHITE192, CRGB::Green, MLS_RED224, leftLeds);
+            mlslighteffects.setValueThree(mlstools.config.rank, ledsPerStrip, MLS_FADED_BLUE, MLS_WHITE192, CRGB::Green, MLS_RED224, leftLeds);
             mlslighteffects.showLeds();
           #endif
           configStep = CONFIG_RANK;
@@ -1256,7 +1877,7 @@ void loop() {
       #ifdef ROTARY_ENCODER_A_PIN
         if (rotaryEncoder.encoderChanged()) {
           DEBUG_PRINTLN("Rank: " + String(rotaryEncoder.readEncoder()));
-          mlslighteffects.setValueThree(rotaryEncoder.readEncoder(), NUM_LEDS_PER_STRIP, MLS_FADED_BLUE, MLS_WHITE192, CRGB::Green, MLS_RED224, leftLeds);
+          mlslighteffects.setValueThree(rotaryEncoder.readEncoder(), ledsPerStrip, MLS_FADED_BLUE, MLS_WHITE192, CRGB::Green, MLS_RED224, leftLeds);
           mlslighteffects.showLeds();
         }
         if (rotaryEncoder.isEncoderButtonClicked()) {
@@ -1273,6 +1894,7 @@ void loop() {
   if (state == STATE_CONFIG_DONE) {
     mlslighteffects.setMyColumn(mlstools.config.column);
     mlslighteffects.setMyRank(mlstools.config.rank);
+    mlsgroups.setMembership(mlstools.config.rank, mlstools.config.column, mlstools.config.sections);
     mlslighteffects.stopUpdate();
     delay(10);
     mlslighteffects.clearLeds();
@@ -1353,9 +1975,7 @@ void loop() {
           DEBUG_PRINTLN("LOOP: STATE_SUBSCRIBE: Error initializing ESP-NOW");
           ESP.restart();
         } else {
-          #ifdef DEBU_MLS
-            esp_now_register_send_cb(OnEspNowDataSent);
-          #endif
+          esp_now_register_send_cb(OnEspNowDataSent);
           esp_now_register_recv_cb(mlsmesh_receive_packet_cb);
       
           // register peer
@@ -1374,7 +1994,14 @@ void loop() {
         }
       }
   
-      if (MLS_masterMode) {
+      // The first subscription request is sent at a random time, to spread the requests when all the devices start together
+      subscribeBackoffMs = SUBSCRIBE_RETRY_TIME_MS;
+      subscribeDelayMs = random(0, SUBSCRIBE_FIRST_WINDOW_MS);
+      subscribeRequestSent = false;
+      lastSubscribeTimeMs = millis();
+
+      // The devices are not rebooted for a fast resume, they keep their ids
+      if (MLS_masterMode && (!MLS_fastResume)) {
         delay(1000);
         DEBUG_PRINTLN("LOOP: STATE_SUBSCRIBE: Send reboot request");
         action_packet.action = MLS_ACTION_REBOOT;
@@ -1397,15 +2024,21 @@ void loop() {
       state = STATE_RUNNING;
       startStateRunningTS = millis();
     } else {
-      if ((millis() - lastSubscribeTimeMs) > SUBSCRIBE_RETRY_TIME_MS) {
+      if ((millis() - lastSubscribeTimeMs) > subscribeDelayMs) {
         topology_packet.type = MLS_TOPOLOGY_REQUEST;
         topology_packet.device_id = my_device.id;
         memcpy(topology_packet.mac, my_device.mac, 6);
         topology_packet.rank = mlslighteffects.getMyRank();
         topology_packet.column = mlslighteffects.getMyColumn();
         sendResult = mlsmesh_send_packet(MLS_TYPE_TOPOLOGY_DATA, (uint8_t *) &topology_packet);
+        subscribeRequestSent = true;
+        lastSubscribeTimeMs = millis();
+        // Exponential backoff with a random jitter (between half and the full backoff)
+        subscribeDelayMs = random(subscribeBackoffMs / 2, subscribeBackoffMs);
+        if (subscribeBackoffMs < SUBSCRIBE_MAX_BACKOFF_MS) {
+          subscribeBackoffMs = 2 * subscribeBackoffMs;
+        }
       }
-      lastSubscribeTimeMs = millis();
     }
   }
 
@@ -1415,6 +2048,20 @@ void loop() {
 
     if (lastState != state) {
       DEBUG_PRINTLN("STATE_RUNNING");
+      #if defined(I2S_WS_PIN) && defined(I2S_SCK_PIN) && defined(I2S_SD_PIN)
+        // Start the TaskI2sCapture if needed (master with a microphone), the loop never waits for the audio
+        if (MLS_masterMode && i2sEnabled && (TaskI2sCaptureHandle == NULL)) {
+          DEBUG_PRINTLN("LOOP: STATE_RUNNING: Start TaskI2sCaptureHandle");
+          xTaskCreatePinnedToCore(
+                            TaskI2sCapture,         // Task function.
+                            "TaskI2sCapture",       // name of task.
+                            10000,                  // Stack size of task
+                            (MlsSampleSource *) &i2ssource, // parameter of the task: the sample source
+                            3,                      // priority of the task (above TaskUpdateLight, waiting for the DMA most of the time)
+                            &TaskI2sCaptureHandle,  // Task handle to keep track of created task
+                            1);                     // Do the audio job on the core 1, the Wi-Fi task is on the core 0
+        }
+      #endif
     }
 
     #ifdef ARDUINO_TTGO_LoRa32_v21new
@@ -1435,6 +2082,42 @@ void loop() {
     #endif
 
 
+    // RSSI report to the master (topology keep alive), spread in time based on the device id
+    if ((!MLS_masterMode) && (!MLS_remoteControl) && ((millis() - lastRssiReportMs) > (MLSMESH_RSSI_REPORT_MS + ((37 * my_device.id) % 1000)))) {
+      lastRssiReportMs = millis();
+      topology_packet.type = MLS_TOPOLOGY_KEEP_ALIVE;
+      topology_packet.device_id = my_device.id;
+      memcpy(topology_packet.mac, my_device.mac, 6);
+      topology_packet.rank = mlslighteffects.getMyRank();
+      topology_packet.column = mlslighteffects.getMyColumn();
+      sendResult = mlsmesh_send_packet(MLS_TYPE_TOPOLOGY_DATA, (uint8_t *) &topology_packet);
+    }
+
+    #ifdef DEBUG_MLS
+      // Receive ring statistics of the protocol task
+      if ((millis() - lastMlsMeshStatsMs) > MLSMESH_STATS_REPORT_MS) {
+        lastMlsMeshStatsMs = millis();
+        DEBUG_PRINTLN("ESPNOW: receive ring high-water: " + String(mlsmeshRxRing.getHighWater()) + "/" + String(MLSMESH_RX_RING_SIZE) + ", drops: " + String(mlsmeshRxRing.getDrops()) + ", rejected: " + String(mlsmeshRejectedPackets) + ", duplicates: " + String(mlsreplay.getDuplicates()) + ", too old: " + String(mlsreplay.getTooOld()) + ", unarmed fires: " + String(mlsmeshUnarmedFires) + ", decode errors: " + String(mlswire.getDecodeErrors()) + ", other groups: " + String(mlsgroups.getFiltered()));
+        // Light data mailbox between the protocol task and TaskUpdateLight
+        DEBUG_PRINTLN("LIGHT: mailbox high-water: " + String(mlslighteffects.getMailboxHighWater()) + "/" + String(MLS_LIGHT_MAILBOX_SIZE) + ", overruns: " + String(mlslighteffects.getMailboxOverruns()) + ", torn reads: " + String(mlslighteffects.getMailboxRetries()) + ", render compilations: " + String(mlslighteffects.getRenderCompilations()));
+        // Transmit scheduler, per priority class (last second)
+        for (uint8_t tx_class = 0; tx_class < MLS_TX_CLASSES; tx_class++) {
+          struct MLS_TX_STATS tx_stats;
+          mlstx.getLastSecond(tx_class, &tx_stats);
+          DEBUG_PRINTLN("ESPNOW: tx class " + String(tx_class) + ": " + String(tx_stats.sent) + " sent, " + String(tx_stats.drops) + " drops, " + String(tx_stats.failures) + " failures, airtime: " + String(tx_stats.airtime_micros) + " us/s, max queue delay: " + String(tx_stats.max_delay_micros) + " us");
+        }
+        DEBUG_PRINTLN("ESPNOW: tx timeouts: " + String(mlstx.getTimeouts()) + ", late completions: " + String(mlstx.getLateCompletions()));
+        // Airtime of the compact wire format, per packet type (the fixed format is MLS_PACKET_SIZE bytes)
+        for (uint8_t type = 0; type < MLSMESH_WIRE_TYPES; type++) {
+          if (mlswire.getEncodedPackets(type) > 0) {
+            DEBUG_PRINTLN("ESPNOW: type " + String(type) + ": " + String(mlswire.getEncodedPackets(type)) + " packets, average size: " + String(mlswire.getAverageSize(type)) + "/" + String(MLS_PACKET_SIZE) + " bytes");
+          }
+        }
+        // Render clock of TaskUpdateLight
+        DEBUG_PRINTLN("LIGHT: " + String(mlsrender.getFps()) + " fps (frame period: " + String(mlsrender.getFramePeriodMicros()) + " us), frame time min/avg/max: " + String(mlsrender.getFrameMinMicros()) + "/" + String(mlsrender.getFrameAvgMicros()) + "/" + String(mlsrender.getFrameMaxMicros()) + " us, missed deadlines: " + String(mlsrender.getMissedDeadlines()));
+      }
+    #endif
+
     // Repeat last CHECK command
     if (MLS_masterMode) {
       if (EFFECT_CHECK == lastCommand) {
@@ -1450,117 +2133,29 @@ void loop() {
 
     #if defined(I2S_WS_PIN) && defined(I2S_SCK_PIN) && defined(I2S_SD_PIN)
       if (MLS_masterMode) {
-        if (i2sEnabled) {
-          // https://github.com/maspetsberger/esp32-i2s-mems/tree/master/examples/NoiseLevel
-          // https://diyi0t.com/i2s-sound-tutorial-for-esp32/
-          int32_t samples[I2S_BLOCK_SIZE];
-          int32_t num_bytes_read = i2s_read_bytes(I2S_PORT, 
-                                                  (char *)samples, 
-                                                  I2S_BLOCK_SIZE, // the doc says bytes, but its elements.
-                                                  portMAX_DELAY); // no timeout
-          if (num_bytes_read > 0) {
-            int samples_read = num_bytes_read / 8;
-            int32_t mean = 0;
-            for (int i = 0; i < samples_read; ++i) {
-              mean += (abs(samples[i]) / samples_read);
-            }
-            mean = abs(mean);
-            // Ignore incorrect values
-            if (mean > 0x10000000) {
-              mean = 0x10000000;
-            }
-            if (mean < 1) {
-              mean = 1;
-            }
-            
-            if (mean > i2s_biggestInput) {
-              i2s_biggestInput = mean;
-            }
-  
-            i2s_rolling_mean[i2s_sampleCounter % I2S_ROLLING_MEAN_SIZE] = mean;
-            // i2s_long_term_mean = ((I2S_ROLLING_MEAN_SIZE * i2s_long_term_mean) + mean) / (I2S_ROLLING_MEAN_SIZE + 1);
-            i2s_long_term_mean = 0;
-            for (int i = 0; i < I2S_ROLLING_MEAN_SIZE; ++i) {
-              i2s_long_term_mean = i2s_long_term_mean + (i2s_rolling_mean[i] / I2S_ROLLING_MEAN_SIZE);
-              if (i2s_rolling_mean[i] > i2s_rollingmaxInput) {
-                i2s_rollingmaxInput = i2s_rolling_mean[i];
-              }
-            }
-  
-            if (mean > i2s_maxInput) {
-              i2s_maxInput = mean;
-              i2s_maxInputTime = micros();
-              i2s_secondtMaxInput = 0;
-            } else if (((micros() - i2s_maxInputTime) > (i2s_maxInputFlushTime / 2)) && (mean > i2s_secondtMaxInput)) {
-              i2s_secondtMaxInput = mean;
-            }
-            if ((micros() - i2s_maxInputTime) > i2s_maxInputFlushTime) {
-              if (i2s_secondtMaxInput < (0.5 * i2s_maxInput)) {
-                i2s_secondtMaxInput = 0.5 * i2s_maxInput;
-              } else {
-                i2s_maxInput = i2s_secondtMaxInput;
-              }
-              i2s_maxInputTime = micros();
-              i2s_secondtMaxInput = 0;
-            } else if ((micros() - i2s_maxInputTime) > i2s_inputFlushTime) {
-              if (i2s_secondtMaxInput > (0.5 * i2s_maxInput)) {
-                i2s_maxInput = i2s_secondtMaxInput;
-                i2s_maxInputTime = micros();
-                i2s_secondtMaxInput = 0;
-              }
-            }
-  
-            if (i2s_maxInput < (i2s_biggestInput / 4)) {
-              i2s_maxInput = i2s_biggestInput / 4;
-            }
-  
-            if (mean < lastEdgeDectionLevel) {
-              overLastEdgeDectionLevel = false;
-            }
-  
-            // if ((((!overLastEdgeDectionLevel) && ((micros() - lastEdgeDectionTime) > minEdgeDetectionGap)) || ((micros() - lastEdgeDectionTime) > maxEdgeDetectionGap)) && (((mean / i2s_long_term_mean) > I2S_EDGE_RATIO_LONG_TERM) || (mean > (i2s_maxInput / I2S_EDGE_RATIO_INSTANT)))) {
-            if ((((!overLastEdgeDectionLevel) && ((micros() - lastEdgeDectionTime) > minEdgeDetectionGap)) || ((micros() - lastEdgeDectionTime) > maxEdgeDetectionGap)) && ((i2s_rollingmaxInput / mean) < I2S_EDGE_ROLLING_MAX)) {
-  
-              lastEdgeDectionLevel = mean;
-              overLastEdgeDectionLevel = true;
-              lastEdgeDectionTime = micros();
-              DEBUG_PRINT("BOOM :-), time (ms): ");
-              DEBUG_PRINT(micros()/1000);
-              DEBUG_PRINT(", level: ");
-              DEBUG_PRINTLN(mean);
-              DEBUG_PRINT("detectedBeatCounter: ");
-              DEBUG_PRINTLN(detectedBeatCounter);
-
-              if (last_effect_played != current_beat_effect) {
-                detectedBeatCounter = 0;
-              }
-              last_effect_played = current_beat_effect;
-              light_packet = (LIGHT_PACKET){current_beat_effect, 0, detectedBeatCounter, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-              // light_packet = (LIGHT_PACKET){EFFECT_FLASH, MODIFIER_FLIP_FLOP, detectedBeatCounter, 0, 0, 255, 0, 0, 0, 3, 35, 0, 255, 0, 0, 3, 35}; // RED/GREEN FLASH FLIP-FLOP
-              mlslighteffects.setLightData(detectedBeatCounter, &light_packet);
-              boolean sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &light_packet);
-              detectedBeatCounter++;
-              /*
-              DEBUG_PRINT("BOOM :-) ");
-              DEBUG_PRINT(detectedBeatCounter);
-              DEBUG_PRINT(" value: ");
-              DEBUG_PRINT(mean);
-              DEBUG_PRINT(", biggest: ");
-              DEBUG_PRINT(i2s_biggestInput);
-              DEBUG_PRINT(", max: ");
-              DEBUG_PRINT(i2s_maxInput);
-              DEBUG_PRINT(", 2max: ");
-              DEBUG_PRINT(i2s_secondtMaxInput);
-              DEBUG_PRINT(", long term mean: ");
-              DEBUG_PRINT(i2s_long_term_mean);
-              DEBUG_PRINT(", ratio: ");
-              DEBUG_PRINTLN((mean / i2s_long_term_mean));
-              */
-            }
-              // DEBUG_PRINTLN(mean);
-            i2s_sampleCounter++;
+        // Beats detected by the audio task
+        struct I2S_BEAT i2s_beat;
+        uint32_t predicted_beat_micros;
+        while (i2sBeats.pop(&i2s_beat)) {
+          boolean predicted = mlstempo.isLocked(i2s_beat.onset_micros);
+          mlstempo.addOnset(i2s_beat.onset_micros);
+          DEBUG_PRINT("LOOP: beat ");
+          DEBUG_PRINT(detectedBeatCounter);
+          DEBUG_PRINT(", onset to send (us): ");
+          DEBUG_PRINT(micros() - i2s_beat.onset_micros);
+          DEBUG_PRINT(", BPM: ");
+          DEBUG_PRINT(mlstempo.getBpm());
+          DEBUG_PRINT(", confidence: ");
+          DEBUG_PRINTLN(mlstempo.getConfidence());
+          // Reactive mode: the beat is sent after its detection
+          if (!(predicted && mlstempo.isLocked(i2s_beat.onset_micros))) {
+            mlsmesh_send_beat(false, 0);
           }
         }
+        // Predictive mode: the beat is sent in advance, to be played on the predicted beat
+        if (mlstempo.isBeatDue(micros(), mlsmesh_playout_time(0), &predicted_beat_micros)) {
+          mlsmesh_send_beat(true, predicted_beat_micros);
+        }
       } // if (MLS_masterMode)
     #endif
 
@@ -1592,9 +2187,9 @@ void loop() {
         lastCommandPacketId = mlsmeshLastPackedId;
 
         if (!MLS_masterMode) {
-          // Send the command as in an ACK LIGHT packet
+          // Send the command as in an ACK LIGHT packet, for the master only (id 0)
           light_packet = (LIGHT_PACKET){lastCommand, 0, millis(), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-          mlsmesh_send_packet(MLS_TYPE_ACK_LIGHT_DATA, (uint8_t *) &light_packet);
+          mlsmesh_send_unicast_packet(MLS_TYPE_ACK_LIGHT_DATA, 0, (uint8_t *) &light_packet);
           DEBUG_PRINT("MLS_TYPE_ACK_LIGHT_DATA packet sent based on LoRa, command: ");
           DEBUG_PRINTLN(cmd_to_send);
         } else {
@@ -1611,7 +2206,7 @@ void loop() {
             boolean sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &light_packet);
             DEBUG_PRINT("MLS_TYPE_LIGHT_DATA packet sent based on LoRa, command: ");
             DEBUG_PRINTLN(cmd_to_send);
-            mlslighteffects.setLightData(millis(), &light_packet); // Max latency: 39000, not used yet.
+            mlslighteffects.setLightDataMasterTime(millis(), &light_packet, mlsmesh_playout_time(mlsmeshLastMasterTime));
             current_beat_effect = EFFECT_KEEP_ALIVE;
           }
         }
@@ -1644,7 +2239,7 @@ void loop() {
         if (deviceConnected) {
           if ((millis() - lastBleNotificationTS) > BLE_NOTIF_HEARTBEAT_MS) {
             lastBleNotificationTS = millis();
-            itoa(announced_devices, tempStr, 10);
+            itoa(mlsregistry.getNumberOfDevices(), tempStr, 10);
             strcpy(bleFeedback, tempStr);
             strcat(bleFeedback, ",");
             strcat(bleFeedback, bleLastCmdInfo);
@@ -1677,32 +2272,39 @@ void loop() {
 
     #ifdef DEBUG_MLS
       #ifdef MLS_DEMO
-        if (millis() - startStateRunningTS < (( (4*5) * 4) * 1000)) {
+        if (millis() - startStateRunningTS < (( (4*5) * 5) * 1000)) {
           if (simulatorLastBeat != simulatorBeat) {
             if (MLS_masterMode) {
-              demoStep = (int(simulatorBeat / (4*5)) % 4);
+              demoStep = (int(simulatorBeat / (4*5)) % 5);
               switch (demoStep) {
                 case 0:
                   light_packet = (LIGHT_PACKET){EFFECT_HEARTBEAT, 0, millis(), simulatorBeatSpeed, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // HEARTBEAT
-                  mlslighteffects.setLightData(simulatorBeat, &light_packet);
                   sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &light_packet);
+                  mlslighteffects.setLightDataMasterTime(simulatorBeat, &light_packet, mlsmesh_playout_time(mlsmeshLastMasterTime));
                   break;
                 case 1:
                   if (0 == (simulatorBeat % 5)) {
                     light_packet = (LIGHT_PACKET){EFFECT_BREATH, 0, millis(), 5 * simulatorBeatSpeed, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // BLUE BREATH
-                    mlslighteffects.setLightData(simulatorBeat, &light_packet);
                     sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &light_packet);
+                    mlslighteffects.setLightDataMasterTime(simulatorBeat, &light_packet, mlsmesh_playout_time(mlsmeshLastMasterTime));
                   }
                   break;
                 case 2:
                   light_packet = (LIGHT_PACKET){EFFECT_CHECK, 0, simulatorBeat, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // CHECK
-                  mlslighteffects.setLightData(simulatorBeat, &light_packet);
                   sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &light_packet);
+                  mlslighteffects.setLightDataMasterTime(simulatorBeat, &light_packet, mlsmesh_playout_time(mlsmeshLastMasterTime));
                   break;
                 case 3:
                   light_packet = (LIGHT_PACKET){EFFECT_FLASH_ALTERNATE, MODIFIER_FLIP_FLOP, simulatorBeat, 0, 0, 0, 0, 0, 0, 3, 35, 0, 0, 0, 0, 3, 35}; // RED/GREEN FLASH FLIP-FLOP
-                  mlslighteffects.setLightData(simulatorBeat, &light_packet);
                   sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &light_packet);
+                  mlslighteffects.setLightDataMasterTime(simulatorBeat, &light_packet, mlsmesh_playout_time(mlsmeshLastMasterTime));
+                  break;
+                case 4:
+                  {
+                    static const uint8_t demo_palette[][3] = {{255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 0}};
+                    light_packet = (LIGHT_PACKET){EFFECT_FLASH, 0, simulatorBeat, 0, 0, 0, 0, 0, 0, 3, 35, 0, 0, 0, 0, 3, 35}; // FLASH, ONE COLOR PER COLUMN
+                    sendResult = mlsmesh_send_column_light(&light_packet, demo_palette, 4);
+                  }
                   break;
                 default:
                   break;
@@ -1712,8 +2314,8 @@ void loop() {
           }
         } else {
           light_packet = (LIGHT_PACKET){EFFECT_BLANK, 0, simulatorBeat, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // CHECK
-          mlslighteffects.setLightData(simulatorBeat, &light_packet);
           sendResult = mlsmesh_send_packet(MLS_TYPE_LIGHT_DATA, (uint8_t *) &light_packet);
+          mlslighteffects.setLightDataMasterTime(simulatorBeat, &light_packet, mlsmesh_playout_time(mlsmeshLastMasterTime));
           break;
         }
       #endif // MLS_DEMO
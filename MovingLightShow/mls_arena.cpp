@@ -0,0 +1,50 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_arena.cpp
+ * @brief Static memory arena for the per-strip buffers
+ *
+ **********************************************************************/
+#include "mls_arena.h"
+
+
+// MlsArena constructor
+MlsArena::MlsArena() {
+  this->used = 0;
+  this->failures = 0;
+}
+
+
+// Carve an aligned and cleared buffer from the arena (NULL if the arena is full)
+void *MlsArena::allocate(size_t size) {
+  void *allocated;
+
+  size = (size + MLS_ARENA_ALIGNMENT - 1) & ~((size_t) (MLS_ARENA_ALIGNMENT - 1));
+  if (size > (MLS_ARENA_SIZE - this->used)) {
+    this->failures++;
+    DEBUG_PRINTLN("MLS arena: not enough memory for " + String(size) + " bytes");
+    return NULL;
+  }
+  allocated = &this->buffer[this->used];
+  memset(allocated, 0, size);
+  this->used += size;
+  return allocated;
+}
+
+
+size_t MlsArena::getSize() {
+  return MLS_ARENA_SIZE;
+}
+
+
+// The allocations are never released: the used size is the high-water mark
+size_t MlsArena::getHighWater() {
+  return this->used;
+}
+
+
+uint16_t MlsArena::getFailures() {
+  return this->failures;
+}
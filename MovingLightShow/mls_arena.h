@@ -0,0 +1,42 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_arena.h
+ * @brief Static memory arena for the per-strip buffers
+ *
+ * The number of LEDs depends on the role of the device (bass drum master
+ * or musician), which is known only at boot. All the per-strip buffers
+ * (strips, shown strips, output buffers) are carved from this static
+ * arena in setup(). The allocations are never released, so the used size
+ * is also the high-water mark, and there is no heap allocation after setup().
+ *
+ **********************************************************************/
+#ifndef MLS_ARENA_H
+#define MLS_ARENA_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "DebugTools.h"
+  #include <stdint.h>
+
+  #define MLS_ARENA_ALIGNMENT 4 // Alignment of each allocation (RMT items are 32 bits)
+
+
+  class MlsArena {
+
+    private:
+      uint8_t buffer[MLS_ARENA_SIZE] __attribute__((aligned(MLS_ARENA_ALIGNMENT)));
+      size_t used;
+      uint16_t failures;
+
+    public:
+      MlsArena();
+      void *allocate(size_t size);
+      size_t getSize();
+      size_t getHighWater();
+      uint16_t getFailures();
+  };
+
+#endif
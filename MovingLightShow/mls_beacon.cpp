@@ -0,0 +1,100 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_beacon.cpp
+ * @brief State beacon of the master, for the late joining devices
+ *
+ **********************************************************************/
+#include "mls_beacon.h"
+
+
+// MlsStateBeacon constructor
+MlsStateBeacon::MlsStateBeacon() {
+  this->next_action = MLS_ACTION_STATE_BEACON;
+}
+
+
+boolean MlsStateBeacon::isZero(const uint8_t *data, uint8_t size) {
+  for (uint8_t i = 0; i < size; i++) {
+    if (0 != data[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// Next beacon of the master (the colors and the fade times alternate)
+void MlsStateBeacon::fill(struct STATE_BEACON_PACKET *beacon_packet, const struct LIGHT_PACKET *light_packet, uint32_t start_master_time) {
+  memset(beacon_packet->raw, 0, MLS_DATA_SIZE);
+  beacon_packet->action = this->next_action;
+  beacon_packet->effect = light_packet->effect;
+  beacon_packet->effect_modifier = light_packet->effect_modifier;
+  beacon_packet->repeat_counter = light_packet->repeat_counter;
+  beacon_packet->duration_ms = light_packet->duration_ms;
+  beacon_packet->option = light_packet->option;
+  if (MLS_ACTION_STATE_BEACON == this->next_action) {
+    memcpy(beacon_packet->left_color_raw, light_packet->left_color_raw, 3);
+    memcpy(beacon_packet->right_color_raw, light_packet->right_color_raw, 3);
+    this->next_action = MLS_ACTION_STATE_FADES;
+  } else {
+    beacon_packet->left_times[0] = light_packet->left_fadein_time;
+    beacon_packet->left_times[1] = light_packet->left_on_time;
+    beacon_packet->left_times[2] = light_packet->left_fadeout_time;
+    beacon_packet->right_times[0] = light_packet->right_fadein_time;
+    beacon_packet->right_times[1] = light_packet->right_on_time;
+    beacon_packet->right_times[2] = light_packet->right_fadeout_time;
+    this->next_action = MLS_ACTION_STATE_BEACON;
+  }
+  beacon_packet->start_master_time = start_master_time;
+}
+
+
+// Merge a received beacon in the last light packet of a device (valid: the light packet is known),
+// true if the effect must be (re)started with the light packet and its start time
+boolean MlsStateBeacon::merge(const struct STATE_BEACON_PACKET *beacon_packet, struct LIGHT_PACKET *light_packet, uint32_t *start_master_time, boolean valid) {
+  uint8_t times[6];
+
+  // New effect (late join, or missed LIGHT DATA): only the fields of this half are known
+  if ((!valid) || (light_packet->effect != beacon_packet->effect) || (light_packet->repeat_counter != beacon_packet->repeat_counter)) {
+    memset(light_packet->raw, 0, LIGHT_PACKET_SIZE);
+    light_packet->effect = beacon_packet->effect;
+    light_packet->effect_modifier = beacon_packet->effect_modifier;
+    light_packet->repeat_counter = beacon_packet->repeat_counter;
+    light_packet->duration_ms = beacon_packet->duration_ms;
+    light_packet->option = beacon_packet->option;
+  } else if (MLS_ACTION_STATE_BEACON == beacon_packet->action) {
+    // Same effect: restart only if the colors are still unknown
+    if ((!isZero(light_packet->left_color_raw, 3)) || (!isZero(light_packet->right_color_raw, 3)) ||
+        (isZero(beacon_packet->left_color_raw, 3) && isZero(beacon_packet->right_color_raw, 3))) {
+      return false;
+    }
+  } else {
+    // Same effect: restart only if the fade times are still unknown
+    times[0] = light_packet->left_fadein_time;
+    times[1] = light_packet->left_on_time;
+    times[2] = light_packet->left_fadeout_time;
+    times[3] = light_packet->right_fadein_time;
+    times[4] = light_packet->right_on_time;
+    times[5] = light_packet->right_fadeout_time;
+    if ((!isZero(times, 6)) || (isZero(beacon_packet->left_times, 3) && isZero(beacon_packet->right_times, 3))) {
+      return false;
+    }
+  }
+
+  if (MLS_ACTION_STATE_BEACON == beacon_packet->action) {
+    memcpy(light_packet->left_color_raw, beacon_packet->left_color_raw, 3);
+    memcpy(light_packet->right_color_raw, beacon_packet->right_color_raw, 3);
+  } else {
+    light_packet->left_fadein_time = beacon_packet->left_times[0];
+    light_packet->left_on_time = beacon_packet->left_times[1];
+    light_packet->left_fadeout_time = beacon_packet->left_times[2];
+    light_packet->right_fadein_time = beacon_packet->right_times[0];
+    light_packet->right_on_time = beacon_packet->right_times[1];
+    light_packet->right_fadeout_time = beacon_packet->right_times[2];
+  }
+  *start_master_time = beacon_packet->start_master_time;
+  return true;
+}
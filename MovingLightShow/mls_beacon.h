@@ -0,0 +1,45 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_beacon.h
+ * @brief State beacon of the master, for the late joining devices
+ *
+ * When the master has nothing else to send, its keep alive is a snapshot
+ * of its last LIGHT DATA, with the absolute start time of the effect, so
+ * that a device which has rebooted (or has missed the LIGHT DATA) can
+ * restart the current effect with the right phase.
+ *
+ * A LIGHT_PACKET and a start time do not fit in the 20 bytes of an ACTION
+ * DATA. The beacons alternate: MLS_ACTION_STATE_BEACON carries the colors,
+ * MLS_ACTION_STATE_FADES the fade in, on and fade out times (the other
+ * fields are in both). A device restarts the effect with the first half
+ * it receives (the effects with default times are already right), and
+ * again with the other half when it fills the fields still at 0 (an
+ * effect whose times come from the packet, like EFFECT_FLASH, is dark
+ * with zero times). The start time is absolute, a restart keeps the phase.
+ *
+ **********************************************************************/
+#ifndef MLS_BEACON_H
+#define MLS_BEACON_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "mls_mesh.h"
+  #include <stdint.h>
+
+
+  class MlsStateBeacon {
+
+    private:
+      uint8_t next_action;                 // Half sent in the next beacon of the master
+      static boolean isZero(const uint8_t *data, uint8_t size);
+
+    public:
+      MlsStateBeacon();
+      void fill(struct STATE_BEACON_PACKET *beacon_packet, const struct LIGHT_PACKET *light_packet, uint32_t start_master_time);
+      static boolean merge(const struct STATE_BEACON_PACKET *beacon_packet, struct LIGHT_PACKET *light_packet, uint32_t *start_master_time, boolean valid);
+  };
+
+#endif
@@ -0,0 +1,175 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_beat_detector.cpp
+ * @brief Beat detector on hops of audio samples, and the audio sample sources
+ *
+ **********************************************************************/
+#include "mls_beat_detector.h"
+
+
+#if defined(I2S_WS_PIN) && defined(I2S_SCK_PIN) && defined(I2S_SD_PIN)
+
+  // MlsI2sSampleSource constructor (the I2S driver is installed by the setup)
+  MlsI2sSampleSource::MlsI2sSampleSource(i2s_port_t port) {
+    this->port = port;
+    this->hop_end_micros = 0;
+  }
+
+
+  // One hop per DMA buffer: the read waits for the end of the capture of the next buffer
+  uint16_t MlsI2sSampleSource::read(int32_t *samples, uint16_t max_samples, uint32_t *hop_end_micros) {
+    size_t bytes_read;
+    uint16_t samples_read;
+    uint32_t read_start_micros = micros();
+    uint32_t now_micros;
+
+    if ((ESP_OK != i2s_read(this->port, samples, max_samples * sizeof(int32_t), &bytes_read, portMAX_DELAY)) || (0 == bytes_read)) {
+      return 0;
+    }
+    now_micros = micros();
+    samples_read = bytes_read / sizeof(int32_t);
+    if ((now_micros - read_start_micros) > ((I2S_BLOCK_SIZE * 500000) / I2S_SAMPLE_RATE)) {
+      // The read has waited for this buffer, its last sample has just been captured
+      this->hop_end_micros = now_micros;
+    } else {
+      // The buffer was already waiting, it follows the previous one
+      this->hop_end_micros += (samples_read * 1000000) / I2S_SAMPLE_RATE;
+    }
+    *hop_end_micros = this->hop_end_micros;
+    return samples_read;
+  }
+
+#endif
+
+
+// MlsBeatDetector constructor
+MlsBeatDetector::MlsBeatDetector() {
+  this->min_edge_gap = I2S_MIN_EDGE_GAP_US;
+  this->max_edge_gap = I2S_MAX_EDGE_GAP_US;
+  this->clear();
+}
+
+
+void MlsBeatDetector::clear() {
+  this->onset.begin(I2S_KICK_FREQUENCY, I2S_KICK_Q, I2S_SAMPLE_RATE);
+  this->levels.clear();
+  this->biggest_input = 0;
+  this->max_input = 0;
+  this->max_input_time = 0;
+  this->second_max_input = 0;
+  this->last_edge_time = 0;
+  this->last_edge_level = 0;
+  this->over_last_edge_level = false;
+  this->hops = 0;
+  this->beats = 0;
+}
+
+
+void MlsBeatDetector::setEdgeGaps(uint32_t min_gap_micros, uint32_t max_gap_micros) {
+  this->min_edge_gap = min_gap_micros;
+  this->max_edge_gap = max_gap_micros;
+}
+
+
+// Beat detection on a hop of samples (filtered in place), hop_end_micros is the capture time of its last sample
+boolean MlsBeatDetector::process(int32_t *samples, uint16_t count, uint32_t hop_end_micros, struct I2S_BEAT *beat) {
+  uint32_t onset_micros;
+  boolean detected = false;
+
+  // Bass drum band level of the hop, and onset detection on its rise
+  boolean onset = this->onset.process(samples, count);
+  uint32_t mean = this->onset.getLevel();
+  // Ignore incorrect values
+  if (mean > 0x10000000) {
+    mean = 0x10000000;
+  }
+  if (mean < 1) {
+    mean = 1;
+  }
+
+  if (mean > this->biggest_input) {
+    this->biggest_input = mean;
+  }
+
+  this->levels.add(mean);
+
+  if (mean > this->max_input) {
+    this->max_input = mean;
+    this->max_input_time = hop_end_micros;
+    this->second_max_input = 0;
+  } else if (((hop_end_micros - this->max_input_time) > (I2S_MAX_INPUT_FLUSH_US / 2)) && (mean > this->second_max_input)) {
+    this->second_max_input = mean;
+  }
+  if ((hop_end_micros - this->max_input_time) > I2S_MAX_INPUT_FLUSH_US) {
+    if (this->second_max_input < (0.5 * this->max_input)) {
+      this->second_max_input = 0.5 * this->max_input;
+    } else {
+      this->max_input = this->second_max_input;
+    }
+    this->max_input_time = hop_end_micros;
+    this->second_max_input = 0;
+  } else if ((hop_end_micros - this->max_input_time) > I2S_INPUT_FLUSH_US) {
+    if (this->second_max_input > (0.5 * this->max_input)) {
+      this->max_input = this->second_max_input;
+      this->max_input_time = hop_end_micros;
+      this->second_max_input = 0;
+    }
+  }
+
+  if (this->max_input < (this->biggest_input / 4)) {
+    this->max_input = this->biggest_input / 4;
+  }
+
+  // Capture time of the onset sample, from the end of the hop
+  onset_micros = hop_end_micros - (((count - this->onset.getOnsetOffset()) * 1000000) / I2S_SAMPLE_RATE);
+
+  if (mean < this->last_edge_level) {
+    this->over_last_edge_level = false;
+  }
+
+  // if ((((!this->over_last_edge_level) && ((onset_micros - this->last_edge_time) > this->min_edge_gap)) || ((onset_micros - this->last_edge_time) > this->max_edge_gap)) && (((mean / this->levels.getMean()) > I2S_EDGE_RATIO_LONG_TERM) || (mean > (this->max_input / I2S_EDGE_RATIO_INSTANT)))) {
+  if ((((!this->over_last_edge_level) && ((onset_micros - this->last_edge_time) > this->min_edge_gap)) || ((onset_micros - this->last_edge_time) > this->max_edge_gap)) && onset && ((this->levels.getMax() / mean) < I2S_EDGE_ROLLING_MAX)) {
+    this->last_edge_level = mean;
+    this->over_last_edge_level = true;
+    this->last_edge_time = onset_micros;
+    DEBUG_PRINT("BOOM :-), time (ms): ");
+    DEBUG_PRINT(onset_micros/1000);
+    DEBUG_PRINT(", level: ");
+    DEBUG_PRINT(mean);
+    DEBUG_PRINT(", rise: ");
+    DEBUG_PRINT(this->onset.getFlux());
+    DEBUG_PRINT(", threshold: ");
+    DEBUG_PRINTLN(this->onset.getThreshold());
+    /*
+    DEBUG_PRINT(", biggest: ");
+    DEBUG_PRINT(this->biggest_input);
+    DEBUG_PRINT(", max: ");
+    DEBUG_PRINT(this->max_input);
+    DEBUG_PRINT(", 2max: ");
+    DEBUG_PRINT(this->second_max_input);
+    DEBUG_PRINT(", long term mean: ");
+    DEBUG_PRINT(this->levels.getMean());
+    DEBUG_PRINT(", ratio: ");
+    DEBUG_PRINTLN((mean / this->levels.getMean()));
+    */
+    beat->onset_micros = onset_micros;
+    beat->level = mean;
+    this->beats++;
+    detected = true;
+  }
+  this->hops++;
+  return detected;
+}
+
+
+uint32_t MlsBeatDetector::getHops() {
+  return this->hops;
+}
+
+
+uint32_t MlsBeatDetector::getBeats() {
+  return this->beats;
+}
@@ -0,0 +1,85 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_beat_detector.h
+ * @brief Beat detector on hops of audio samples, and the audio sample sources
+ *
+ * MlsBeatDetector keeps all the detection state (band level statistics,
+ * onset detector and hold-off between two beats). It only depends on the
+ * samples and on their capture time, never on the real time clock, so
+ * the same hops give the same beats on the device and in a replay of a
+ * recording, at any speed.
+ *
+ * The samples come from an MlsSampleSource: MlsI2sSampleSource reads the
+ * I2S MEMS microphone, one DMA buffer per hop. The end of the hop is the
+ * time of the read if the read has waited for the buffer, otherwise the
+ * end of the previous hop plus the duration of the hop.
+ *
+ **********************************************************************/
+#ifndef MLS_BEAT_DETECTOR_H
+#define MLS_BEAT_DETECTOR_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "DebugTools.h"
+  #include "mls_level_window.h"
+  #include "mls_onset.h"
+  #include <stdint.h>
+
+  #if defined(I2S_WS_PIN) && defined(I2S_SCK_PIN) && defined(I2S_SD_PIN)
+    #include "driver/i2s.h"
+  #endif
+
+
+  class MlsSampleSource {
+
+    public:
+      virtual ~MlsSampleSource() {}
+      // Next hop of samples (0 if none), and the capture time of its last sample
+      virtual uint16_t read(int32_t *samples, uint16_t max_samples, uint32_t *hop_end_micros) = 0;
+  };
+
+
+  #if defined(I2S_WS_PIN) && defined(I2S_SCK_PIN) && defined(I2S_SD_PIN)
+    class MlsI2sSampleSource : public MlsSampleSource {
+
+      private:
+        i2s_port_t port;
+        uint32_t hop_end_micros;
+
+      public:
+        MlsI2sSampleSource(i2s_port_t port);
+        uint16_t read(int32_t *samples, uint16_t max_samples, uint32_t *hop_end_micros);
+    };
+  #endif
+
+
+  class MlsBeatDetector {
+
+    private:
+      MlsOnsetDetector onset;
+      MlsLevelWindow<I2S_ROLLING_MEAN_SIZE> levels; // Mean and maximum of the last I2S_ROLLING_MEAN_SIZE hop levels
+      uint32_t biggest_input;
+      uint32_t max_input;
+      uint32_t max_input_time;
+      uint32_t second_max_input;
+      uint32_t last_edge_time;
+      uint32_t last_edge_level;
+      boolean over_last_edge_level;
+      uint32_t min_edge_gap;                        // Hold-off between two beats, in microseconds
+      uint32_t max_edge_gap;
+      uint32_t hops;
+      uint32_t beats;
+
+    public:
+      MlsBeatDetector();
+      void clear();
+      void setEdgeGaps(uint32_t min_gap_micros, uint32_t max_gap_micros);
+      boolean process(int32_t *samples, uint16_t count, uint32_t hop_end_micros, struct I2S_BEAT *beat);
+      uint32_t getHops();
+      uint32_t getBeats();
+  };
+
+#endif
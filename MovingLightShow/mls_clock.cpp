@@ -0,0 +1,152 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_clock.cpp
+ * @brief Master clock estimation (offset and drift of the local clock)
+ *
+ **********************************************************************/
+#include "mls_clock.h"
+
+
+// MlsClock constructor
+MlsClock::MlsClock() {
+  this->reset();
+  this->resyncs = 0;
+}
+
+
+// Forget the current estimation
+void MlsClock::reset() {
+  this->master = false;
+  this->synchronized = false;
+  this->offset_micros = 0;
+  this->reference_local_micros = 0;
+  this->drift_ppb = 0;
+  this->window_samples = 0;
+  this->jumps = 0;
+  this->drift_measured = false;
+  this->previous_window = false;
+}
+
+
+// The master clock is the local clock
+void MlsClock::setMaster() {
+  this->reset();
+  this->master = true;
+  this->synchronized = true;
+}
+
+
+// Add a master clock sample (master time when the packet was sent, local time when it was received)
+void MlsClock::addSample(uint32_t master_micros, uint32_t local_micros) {
+  int32_t sample_offset_micros;
+  int32_t predicted_offset_micros;
+
+  if (this->master) {
+    return;
+  }
+
+  sample_offset_micros = (int32_t) (master_micros - local_micros);
+  predicted_offset_micros = this->getOffsetMicros(local_micros);
+
+  // Master clock jump: a late packet, or the master has rebooted if the next samples confirm it
+  if (this->synchronized && (abs(sample_offset_micros - predicted_offset_micros) > MLSCLOCK_RESYNC_MICROS)) {
+    this->jumps++;
+    if (this->jumps < MLSCLOCK_RESYNC_SAMPLES) {
+      return;
+    }
+  } else {
+    this->jumps = 0;
+  }
+
+  // First sample, or the master has rebooted: restart the estimation
+  if ((!this->synchronized) || (this->jumps > 0)) {
+    if (this->synchronized) {
+      this->resyncs++;
+    }
+    this->reset();
+    this->synchronized = true;
+    this->offset_micros = sample_offset_micros;
+    this->reference_local_micros = local_micros;
+    DEBUG_PRINT("MLSclock: synchronized, offset: "); DEBUG_PRINTLN(this->offset_micros);
+    return;
+  }
+
+  // A packet faster than expected gives directly a better offset
+  if (sample_offset_micros > predicted_offset_micros) {
+    this->offset_micros = sample_offset_micros;
+    this->reference_local_micros = local_micros;
+  }
+
+  // Best sample of the window, for the drift estimation
+  if ((0 == this->window_samples) ||
+      ((sample_offset_micros - predicted_offset_micros) > (this->window_best_offset_micros - this->getOffsetMicros(this->window_best_local_micros)))) {
+    this->window_best_offset_micros = sample_offset_micros;
+    this->window_best_local_micros = local_micros;
+  }
+  this->window_samples++;
+
+  if (this->window_samples >= MLSCLOCK_WINDOW) {
+    int32_t delta_local_micros = (int32_t) (this->window_best_local_micros - this->previous_local_micros);
+    if ((!this->previous_window) || (delta_local_micros >= MLSCLOCK_DRIFT_BASELINE_US)) {
+      if (this->previous_window) {
+        int32_t measured_drift_ppb = (int32_t) ((1000000000LL * (int64_t) (this->window_best_offset_micros - this->previous_offset_micros)) / delta_local_micros);
+        // The first measurement is used directly, the next ones are smoothed
+        if (this->drift_measured) {
+          this->drift_ppb += (measured_drift_ppb - this->drift_ppb) / MLSCLOCK_DRIFT_SMOOTHING;
+        } else {
+          this->drift_ppb = measured_drift_ppb;
+          this->drift_measured = true;
+        }
+        if (this->drift_ppb > MLSCLOCK_MAX_DRIFT_PPB) {
+          this->drift_ppb = MLSCLOCK_MAX_DRIFT_PPB;
+        } else if (this->drift_ppb < -MLSCLOCK_MAX_DRIFT_PPB) {
+          this->drift_ppb = -MLSCLOCK_MAX_DRIFT_PPB;
+        }
+      }
+      this->previous_window = true;
+      this->previous_offset_micros = this->window_best_offset_micros;
+      this->previous_local_micros = this->window_best_local_micros;
+    }
+    this->offset_micros = this->window_best_offset_micros;
+    this->reference_local_micros = this->window_best_local_micros;
+    this->window_samples = 0;
+  }
+}
+
+
+boolean MlsClock::isSynchronized() {
+  return this->synchronized;
+}
+
+
+// Master clock - local clock, at a specific local time
+int32_t MlsClock::getOffsetMicros(uint32_t local_micros) {
+  int32_t elapsed_micros = (int32_t) (local_micros - this->reference_local_micros);
+  return this->offset_micros + (int32_t) (((int64_t) this->drift_ppb * elapsed_micros) / 1000000000LL);
+}
+
+
+int32_t MlsClock::getDriftPpb() {
+  return this->drift_ppb;
+}
+
+
+uint16_t MlsClock::getResyncs() {
+  return this->resyncs;
+}
+
+
+// Convert a local time to the master time
+uint32_t MlsClock::localToMaster(uint32_t local_micros) {
+  return local_micros + this->getOffsetMicros(local_micros);
+}
+
+
+// Convert a master time to the local time
+uint32_t MlsClock::masterToLocal(uint32_t master_micros) {
+  uint32_t local_micros = master_micros - this->offset_micros;
+  return master_micros - this->getOffsetMicros(local_micros);
+}
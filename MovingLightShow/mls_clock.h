@@ -0,0 +1,59 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_clock.h
+ * @brief Master clock estimation (offset and drift of the local clock)
+ *
+ * Every master packet carries the master clock (MASTER_TIME) when it was
+ * sent. The one-way delay can only make the measured offset (master - local)
+ * smaller, so the best sample of each window is the highest one, like the
+ * minimum delay filter of NTP. The drift is estimated between the best
+ * samples of two windows at least MLSCLOCK_DRIFT_BASELINE_US apart, so
+ * that the jitter left by the filter is small compared to the drift over
+ * the baseline. A jump of the master clock is only a master reboot when
+ * it is seen on MLSCLOCK_RESYNC_SAMPLES consecutive samples.
+ *
+ **********************************************************************/
+#ifndef MLS_CLOCK_H
+#define MLS_CLOCK_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "DebugTools.h"
+  #include <stdint.h>
+
+
+  class MlsClock {
+
+    private:
+      boolean master;
+      boolean synchronized;
+      int32_t offset_micros;               // Master clock - local clock at the reference time
+      uint32_t reference_local_micros;     // Local reference time of the offset
+      int32_t drift_ppb;                   // Drift of the master clock compared to the local clock (in parts per billion)
+      int32_t window_best_offset_micros;
+      uint32_t window_best_local_micros;
+      uint8_t window_samples;
+      uint8_t jumps;                       // Consecutive samples with a master clock jump
+      boolean drift_measured;
+      boolean previous_window;
+      int32_t previous_offset_micros;
+      uint32_t previous_local_micros;
+      uint16_t resyncs;
+
+    public:
+      MlsClock();
+      void reset();
+      void setMaster();
+      void addSample(uint32_t master_micros, uint32_t local_micros);
+      boolean isSynchronized();
+      int32_t getOffsetMicros(uint32_t local_micros);
+      int32_t getDriftPpb();
+      uint16_t getResyncs();
+      uint32_t localToMaster(uint32_t local_micros);
+      uint32_t masterToLocal(uint32_t master_micros);
+  };
+
+#endif
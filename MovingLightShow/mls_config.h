@@ -29,12 +29,15 @@
 
   #define LED_TYPE                  WS2812B
   #define LED_COLOR_ORDER           GRB
-  #define NUM_LEDS_PER_STRIP        18 // (18 LEDs, 30cm)
-  #define NUM_LEDS_PER_STRIP_MASTER 105 // (105 LEDs, 176 cm)
+  #define NUM_LEDS_PER_STRIP        18 // (18 LEDs, 30cm), default of the musicians, "leds" in the configuration
+  #define NUM_LEDS_PER_STRIP_MASTER 105 // (105 LEDs, 176 cm), default of the bass drum, "masterleds" in the configuration, and longest strip
   #define LED_TEST_BRIGHTNESS       63
   #define LED_CONFIG_BRIGHTNESS     128
   #define LED_MAX_BRIGHTNESS        255
   #define LED_MIN_BRIGHTNESS        15
+  #define LED_WS2812B_LED_MICROS    30    // WS2812B refresh time per LED (24 bits of 1.25us)
+  #define LED_WS2812B_RESET_MICROS  300   // WS2812B reset time (latch) after the last LED
+  #define LIGHT_MIN_FRAME_MICROS    10000 // Minimum frame period of TaskUpdateLight (100 fps max)
 
   #define MASTER_WITHOUT_EFFECT // The master must NOT play regular effect /(only special effects defined using modifier)
 
@@ -137,12 +140,31 @@
   #define ROTARY_ENCODER_VCC_PIN      -1 // We don't define a Vcc pin for the rotary encoder
 
   #define I2S_SAMPLE_RATE             16000 // 16000
-  #define I2S_BUFFERS                 8     // 8
-  #define I2S_BLOCK_SIZE              1024  // 1024
+  #define I2S_BUFFERS                 16    // 8 (16 buffers of 8 ms)
+  #define I2S_BLOCK_SIZE              128   // 1024 (samples per hop: one onset decision every 8 ms)
   #define I2S_EDGE_RATIO_LONG_TERM    1.2   // 5 (3 better)
   #define I2S_EDGE_RATIO_INSTANT      1.1   // 4 (2 better)
   #define I2S_EDGE_ROLLING_MAX        3     // 4 = first try (to sensitive)
-  #define I2S_ROLLING_MEAN_SIZE       100   // 200
+  #define I2S_ROLLING_MEAN_SIZE       200   // 100 with the 16 ms blocks (same 1.6 s window)
+  #define I2S_INPUT_FLUSH_US          1000000 // was 2 seconds, in microseconds
+  #define I2S_MAX_INPUT_FLUSH_US      2000000 // was 4 seconds, in microseconds
+  #define I2S_MIN_EDGE_GAP_US         300000  // was 100 milliseconds, in microseconds
+  #define I2S_MAX_EDGE_GAP_US         600000  // was 300 milliseconds, in microseconds
+  #define I2S_KICK_FREQUENCY          70    // Center of the bass drum band-pass filter (Hz)
+  #define I2S_KICK_Q                  0.8   // Quality factor of the band-pass filter
+  #define I2S_ONSET_WINDOW            64    // Hops of level rises for the onset threshold (0.5 s)
+  #define I2S_ONSET_FLUX_RATIO        4     // Onset: level rise over 4 times the mean rise
+  #define I2S_ONSET_MIN_FLUX          2000  // Noise floor of the level rise (24 bits samples)
+  #define I2S_BEAT_MAILBOX_SIZE       4     // Beats waiting for the loop (power of 2)
+  #define I2S_TEMPO_MIN_PERIOD_US     300000  // 200 BPM
+  #define I2S_TEMPO_MAX_PERIOD_US     1000000 // 60 BPM
+  #define I2S_TEMPO_TOLERANCE         8     // Onset on the beat: phase error below 1/8 of the period
+  #define I2S_TEMPO_PHASE_GAIN        4     // Phase correction: 1/4 of the error
+  #define I2S_TEMPO_PERIOD_GAIN       16    // Period correction: 1/16 of the error
+  #define I2S_TEMPO_HIT_CONFIDENCE    32    // Confidence (0-255) added by an onset on the beat
+  #define I2S_TEMPO_MISS_CONFIDENCE   64    // Confidence removed by an onset off the beat
+  #define I2S_TEMPO_LOCK_CONFIDENCE   128   // Beats sent in advance over this confidence
+  #define I2S_TEMPO_MAX_SILENT_BEATS  4     // Back to the reactive mode after 4 beats without onset
 
   #define JSON_SIZE                   1024
   #define UNIQUEID_CHAR_SIZE          10
@@ -157,8 +179,46 @@
   #define MAX_FORCE_FIRMWARE_WAIT_MS  30000
 
   #define MLSMESH_MAX_MS_FIRST_PACKET 60000 // How long to wait in ms before receiving the first ESPNOW packet (otherwise we will reboot)
+  #define MLSMESH_STATE_BEACON_MS     2000  // Period of the state beacons of the master, once the timeout is over
   #define MLSMESH_MASTER_TIMEOUT_MS   10000 // How long to wait in ms before a new ESPNOW packet is sent (otherwise we will send a keep alive packet)
 
+  #define MLSMESH_MAX_DEVICES         210   // Maximum number of devices in the registry of the master (master included, less than 255)
+  #define MLSMESH_MAX_REPEATERS       12    // Maximum number of repeaters (size of REPEATERS_ID)
+  #define MLSMESH_REPEATER_SLOT_US    3000  // Time slot of each repeater in microseconds
+  #define MLSMESH_REPEATER_MIN_RSSI   -80   // Minimum RSSI of a device to be elected as repeater (basic connectivity)
+  #define MLSMESH_REPEATER_GOOD_RSSI  -70   // Repeaters are only needed if some devices have a lower RSSI (reliable delivery)
+  #define MLSMESH_RSSI_MAX_AGE_MS     30000 // RSSI older than this is ignored for the repeaters election
+  #define MLSMESH_ELECTION_TIME_MS    5000  // Repeaters election period in ms (master only)
+  #define MLSMESH_RSSI_REPORT_MS      10000 // RSSI report period in ms (topology keep alive of each device)
+  #define MLSMESH_RX_RING_SIZE        8     // Received packets waiting for the protocol task
+  #define MLSMESH_TOPOLOGY_BATCH_MS   50    // Period of the topology batch replies of the master
+  #define MLSMESH_REGISTRY_FILE       "/registry.bin" // Devices registry of the master, to resume after an unexpected reset
+  #define MLSMESH_REGISTRY_SAVE_MS    2000  // Period of the registry file updates (only the new devices are appended)
+  #define MLSMESH_REPLAY_RESYNC_GAP   1024  // A packet older than this (in packet ids) means that its sender has been restarted
+  #define MLSMESH_STATS_REPORT_MS     10000 // Debug report period of the receive ring statistics
+  #define MLSMESH_REBOOT_FLUSH_MS     500   // Maximum wait for the transmit scheduler to send the relay of a reboot request
+  #define MLS_TX_QUEUE_SIZE           4     // Frames waiting in each priority class of the transmit scheduler
+  #define MLS_TX_DONE_TIMEOUT_US      10000 // Frame in flight considered as sent without its send callback
+  #define MLS_TX_PUMP_MS              5     // Period of the transmit scheduler in the protocol task (for the rate limited frames)
+  #define MLS_TX_COMMAND_RATE         20    // Commands per second (burst of MLS_TX_BURST)
+  #define MLS_TX_TOPOLOGY_RATE        25    // Topology frames per second (burst of MLS_TX_BURST)
+  #define MLS_TX_KEEP_ALIVE_RATE      2     // Keep alive frames per second (burst of 1)
+  #define MLS_TX_BURST                4
+  #define MLSMESH_WIRE_COMPACT              // Packets sent in the compact wire format (comment it while some devices have a firmware without its decoder)
+  #define MLSMESH_ARM_REPEATS         3     // Copies of an ARM DATA sent before the first FIRE DATA of the effect
+  #define MLSMESH_ARM_REPEAT_MS       20    // Gap between the copies of an ARM DATA
+  #define MLSMESH_ARM_REFRESH_MS      2000  // ARM DATA sent again during the effect, for the late joining devices
+
+  #define MLSCLOCK_WINDOW             16     // Number of master clock samples per estimation window
+  #define MLSCLOCK_RESYNC_MICROS      50000  // Master clock jump (in microseconds) considered as a master reboot
+  #define MLSCLOCK_RESYNC_SAMPLES     2      // Consecutive samples with a jump before a resync (a single late packet is ignored)
+  #define MLSCLOCK_DRIFT_BASELINE_US  10000000 // Minimum time between the two windows of a drift measurement
+  #define MLSCLOCK_DRIFT_SMOOTHING    8      // Smoothing factor of the drift estimation
+  #define MLSCLOCK_MAX_DRIFT_PPB      200000 // Maximum drift between two clocks (200 ppm)
+
+  #define MLS_LIGHT_MAILBOX_SIZE      4     // Light data waiting to be played (power of 2)
+  #define MLS_LIGHT_ARMED_SLOTS       4     // Armed effects compiled in advance, waiting for their fire
+
   #define BLE_NOTIF_HEARTBEAT_MS      1000 // BLE notification heartbeat in ms
 
   #define CHECK_RESEND_TIME_MS        500   // Check resend time in ms (to repeat the command during CHECk effect)
@@ -166,12 +226,25 @@
 
   #define OLED_INFO_REFRESH_TIME      1000
 
-  #define SUBSCRIBE_RETRY_TIME_MS     1000
+  #define SUBSCRIBE_RETRY_TIME_MS     1000  // First subscription retry period (doubled after each trial, with a random jitter)
+  #define SUBSCRIBE_MAX_BACKOFF_MS    16000 // Maximum subscription retry period
+  #define SUBSCRIBE_FIRST_WINDOW_MS   2000  // The first subscription request is sent at a random time in this window
 
   // FastLED global options
   // -----------------------
   // https://github.com/FastLED/FastLED
   #define FASTLED_ALLOW_INTERRUPTS 0
+  // #define LED_SHOW_CHANGED_STRIPS_ONLY // Show only the changed strips (not with the ESP32 RMT driver, which sends all the strips together)
+  // #define LED_DRIVER_RMT               // Asynchronous double-buffered RMT output instead of FastLED.show() (one RMT channel per strip)
+
+  // Static arena of the per-strip buffers, sized for the longest strips
+  #define MLS_ARENA_STRIPS_SIZE (4 * 3 * NUM_LEDS_PER_STRIP_MASTER)       // Left/right strips and shown strips (3 bytes per LED)
+  #ifdef LED_DRIVER_RMT
+    #define MLS_ARENA_RMT_SIZE  (4 * 24 * 4 * NUM_LEDS_PER_STRIP_MASTER)  // Two RMT buffers per strip (24 items of 4 bytes per LED)
+  #else
+    #define MLS_ARENA_RMT_SIZE  0
+  #endif
+  #define MLS_ARENA_SIZE        (MLS_ARENA_STRIPS_SIZE + MLS_ARENA_RMT_SIZE + 16) // Plus the alignment of the buffers
   
   // Bluetooth LE definition
   // -----------------------
@@ -0,0 +1,123 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_envelope.cpp
+ * @brief Brightness envelope of the effects (fade in, on, fade out, ...)
+ *
+ **********************************************************************/
+#include "mls_envelope.h"
+
+
+// MlsEnvelope constructor
+MlsEnvelope::MlsEnvelope() {
+  this->begin(MLS_ENVELOPE_NO_KEY, 0);
+}
+
+
+// Start the compilation of a new envelope, with the level before the start of the effect
+void MlsEnvelope::begin(uint32_t key, uint8_t level) {
+  this->key = key;
+  this->number_of_segments = 0;
+  this->current_segment = 0;
+  this->initial_level = level;
+  this->level = level;
+  this->duration_micros = 0;
+  this->overflow = false;
+  this->close();
+}
+
+
+// Keep the current level
+boolean MlsEnvelope::hold(uint32_t duration_micros) {
+  return this->ramp(duration_micros, this->level);
+}
+
+
+// Change immediately the current level
+void MlsEnvelope::jump(uint8_t level) {
+  this->level = level;
+  this->close();
+}
+
+
+// Linear change from the current level to a new level (false if there is no segment left, the envelope is incomplete)
+boolean MlsEnvelope::ramp(uint32_t duration_micros, uint8_t level) {
+  struct ENVELOPE_SEGMENT *segment;
+  int64_t slope;
+
+  if (0 == duration_micros) {
+    this->jump(level);
+    return true;
+  }
+  if (this->number_of_segments >= MLS_ENVELOPE_SEGMENTS) {
+    this->overflow = true;
+    return false;
+  }
+  slope = (((int64_t) level - (int64_t) this->level) << 32) / (int64_t) duration_micros;
+  segment = &this->segments[this->number_of_segments];
+  segment->start_micros = this->duration_micros;
+  segment->length_micros = duration_micros;
+  segment->slope = (uint64_t) slope;
+  segment->origin = (((uint64_t) this->level) << 32) + 0x80000000ULL - (((uint64_t) segment->start_micros) * segment->slope);
+  this->number_of_segments++;
+  this->duration_micros = segment->start_micros + duration_micros;
+  this->level = level;
+  this->close();
+  return true;
+}
+
+
+// Open segment of the last level, from the end of the segments up to the largest delta time
+void MlsEnvelope::close() {
+  struct ENVELOPE_SEGMENT *segment = &this->segments[this->number_of_segments];
+
+  segment->start_micros = this->duration_micros;
+  segment->length_micros = (this->duration_micros < 0x80000000UL) ? (0x80000000UL - this->duration_micros) : 0;
+  segment->slope = 0;
+  segment->origin = ((uint64_t) this->level) << 32;
+}
+
+
+// Regular envelope: delay, fade in, on and fade out
+boolean MlsEnvelope::compileFade(uint32_t key, uint32_t delay_micros, uint32_t fadein_time_micros, uint32_t on_time_micros, uint32_t fadeout_time_micros, uint8_t min_level, uint8_t max_level) {
+  this->begin(key, min_level);
+  this->hold(delay_micros);
+  this->ramp(fadein_time_micros, max_level);
+  this->hold(on_time_micros);
+  this->ramp(fadeout_time_micros, min_level);
+  return this->isComplete();
+}
+
+
+boolean MlsEnvelope::isCompiled(uint32_t key) {
+  return (this->key == key) && (MLS_ENVELOPE_NO_KEY != key);
+}
+
+
+// All the segments of the envelope have been compiled since begin()
+boolean MlsEnvelope::isComplete() {
+  return !this->overflow;
+}
+
+
+void MlsEnvelope::invalidate() {
+  this->key = MLS_ENVELOPE_NO_KEY;
+}
+
+
+// Level of the envelope out of the segment of the previous frame, which becomes the segment of this delta time
+uint8_t MlsEnvelope::seekLevel(int32_t delta_time_micros) {
+  uint8_t index = 0;
+
+  if (delta_time_micros < 0) {
+    return this->initial_level;
+  }
+  // The open segment of the last level ends the search
+  while ((index < this->number_of_segments) && ((((uint32_t) delta_time_micros) - this->segments[index].start_micros) >= this->segments[index].length_micros)) {
+    index++;
+  }
+  this->current_segment = index;
+  return (this->segments[index].origin + (((uint64_t) (uint32_t) delta_time_micros) * this->segments[index].slope)) >> 32;
+}
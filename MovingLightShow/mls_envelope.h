@@ -0,0 +1,79 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_envelope.h
+ * @brief Brightness envelope of the effects (fade in, on, fade out, ...)
+ *
+ * The envelope is compiled once when the light data is received: each
+ * segment has its boundaries, its slope (level change per microsecond,
+ * Q32) and its origin (level extrapolated at the start of the effect,
+ * rounding included), so the evaluation of a frame in the segment of the
+ * previous frame is one range test and one 64 bits multiply-add-shift.
+ * The level after the last segment is an open segment too.
+ *
+ * The Q32 slope keeps its error below 1/2^32 level per microsecond, so
+ * the level is rounded within 0.52 level of the exact fade, even for the
+ * longest fades (a Q16 slope stopped a 60 s fade at its start level).
+ *
+ * A ramp beyond MLS_ENVELOPE_SEGMENTS is refused: ramp() returns false
+ * and the envelope stays incomplete (isComplete() is false) until the
+ * next begin().
+ *
+ **********************************************************************/
+#ifndef MLS_ENVELOPE_H
+#define MLS_ENVELOPE_H
+
+  #include <Arduino.h>
+  #include <stdint.h>
+
+  #define MLS_ENVELOPE_SEGMENTS 6          // Maximum number of segments (HEARTBEAT has 5 segments)
+  #define MLS_ENVELOPE_NO_KEY   0xFFFFFFFF // The envelope must be compiled
+
+
+  struct ENVELOPE_SEGMENT {
+    uint32_t start_micros;             // Start of the segment, since the start of the effect
+    uint32_t length_micros;            // Length of the segment
+    uint64_t slope;                    // Level change per microsecond (Q32, two's complement)
+    uint64_t origin;                   // Level at the start of the effect on the slope of the segment (Q32, with the rounding)
+  };
+
+
+  class MlsEnvelope {
+
+    private:
+      struct ENVELOPE_SEGMENT segments[MLS_ENVELOPE_SEGMENTS + 1]; // The last level is an open segment after the segments
+      uint8_t number_of_segments;
+      uint8_t current_segment;         // Segment of the last evaluation
+      uint8_t initial_level;           // Level before the start of the effect
+      uint8_t level;                   // Level at the end of the last segment
+      boolean overflow;                // A ramp was refused, no segment left
+      uint32_t duration_micros;
+      uint32_t key;                    // Parameters used to compile the envelope
+      void close();
+      uint8_t seekLevel(int32_t delta_time_micros);
+
+    public:
+      MlsEnvelope();
+      void begin(uint32_t key, uint8_t level);
+      boolean hold(uint32_t duration_micros);
+      void jump(uint8_t level);
+      boolean ramp(uint32_t duration_micros, uint8_t level);
+      boolean compileFade(uint32_t key, uint32_t delay_micros, uint32_t fadein_time_micros, uint32_t on_time_micros, uint32_t fadeout_time_micros, uint8_t min_level, uint8_t max_level);
+      boolean isCompiled(uint32_t key);
+      boolean isComplete();
+      void invalidate();
+
+      // Level of the envelope (0..255) for a delta time since the start of the effect
+      inline uint8_t getLevel(int32_t delta_time_micros) {
+        const struct ENVELOPE_SEGMENT *segment = &this->segments[this->current_segment];
+        // Most of the frames are in the segment of the previous frame (a negative delta time is out of all segments)
+        if ((((uint32_t) delta_time_micros) - segment->start_micros) < segment->length_micros) {
+          return (segment->origin + (((uint64_t) (uint32_t) delta_time_micros) * segment->slope)) >> 32;
+        }
+        return this->seekLevel(delta_time_micros);
+      }
+  };
+
+#endif
@@ -0,0 +1,101 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_groups.cpp
+ * @brief MLSmesh group and unicast addressing
+ *
+ **********************************************************************/
+#include "mls_groups.h"
+#include "mls_light_effects.h"
+
+
+// MlsGroups constructor
+MlsGroups::MlsGroups() {
+  this->setMembership(0, 0, 0);
+  this->filtered = 0;
+}
+
+
+// Packet type without the addressing modifiers
+uint8_t MlsGroups::getType(uint8_t type) {
+  return type & ~MLS_TYPE_MODIFIERS;
+}
+
+
+// Light of a column: both strips in the palette color of the column (column 1: first color)
+void MlsGroups::getColumnLight(const struct LIGHT_PACKET *light, uint8_t column, const uint8_t palette[][3], uint8_t palette_size, struct LIGHT_PACKET *column_light) {
+  memcpy(column_light->raw, light->raw, LIGHT_PACKET_SIZE);
+  memcpy(column_light->left_color_raw, palette[(column - 1) % palette_size], 3);
+  memcpy(column_light->right_color_raw, palette[(column - 1) % palette_size], 3);
+}
+
+
+// One light packet per column group (columns 1 to columns), returns the number of packets sent
+uint8_t MlsGroups::sendColumnLights(mls_groups_send send, const struct LIGHT_PACKET *light, uint8_t columns, const uint8_t palette[][3], uint8_t palette_size) {
+  struct LIGHT_PACKET column_light;
+  uint8_t sent = 0;
+
+  if (columns > MLS_GROUP_MAX_COLUMN) {
+    columns = MLS_GROUP_MAX_COLUMN;
+  }
+  for (uint8_t column = 1; column <= columns; column++) {
+    getColumnLight(light, column, palette, palette_size, &column_light);
+    if (send(MLS_TYPE_LIGHT_DATA, MLS_GROUP_COLUMN(column), column_light.raw)) {
+      sent++;
+    }
+  }
+  return sent;
+}
+
+
+// Set the groups of the device (rank, column and sections), the group all is always set
+// The ranks and the columns above 63 have no group
+void MlsGroups::setMembership(uint8_t rank, uint8_t column, uint32_t sections) {
+  uint8_t group_id;
+
+  memset(this->membership, 0, sizeof(this->membership));
+  this->membership[MLS_GROUP_ALL >> 5] |= (1UL << (MLS_GROUP_ALL & 0x1F));
+  if ((column > 0) && (column <= MLS_GROUP_MAX_COLUMN)) {
+    group_id = MLS_GROUP_COLUMN(column);
+    this->membership[group_id >> 5] |= (1UL << (group_id & 0x1F));
+  }
+  if (rank <= MLS_GROUP_MAX_RANK) {
+    group_id = MLS_GROUP_RANK(rank);
+    this->membership[group_id >> 5] |= (1UL << (group_id & 0x1F));
+  }
+  for (uint8_t section = 0; section < MLS_GROUP_SECTIONS; section++) {
+    if (sections & (1UL << section)) {
+      group_id = MLS_GROUP_SECTION(section);
+      this->membership[group_id >> 5] |= (1UL << (group_id & 0x1F));
+    }
+  }
+}
+
+
+boolean MlsGroups::isMember(uint8_t group_id) {
+  return (0 != (this->membership[group_id >> 5] & (1UL << (group_id & 0x1F))));
+}
+
+
+// Is a packet for me (broadcast, unicast to my id, or group of which I am a member)
+boolean MlsGroups::accepts(uint8_t type, uint8_t destination_id, uint8_t my_id) {
+  if (type & MLS_TYPE_MODIFIER_UNICAST) {
+    return (destination_id == my_id);
+  }
+  if (type & MLS_TYPE_MODIFIER_GROUP) {
+    return this->isMember(destination_id);
+  }
+  return true;
+}
+
+
+void MlsGroups::countFiltered() {
+  this->filtered++;
+}
+
+
+uint16_t MlsGroups::getFiltered() {
+  return this->filtered;
+}
@@ -0,0 +1,70 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_groups.h
+ * @brief MLSmesh group and unicast addressing
+ *
+ * A packet with MLS_TYPE_MODIFIER_UNICAST in its TYPE is for the device
+ * DESTINATION_ID only. A packet with MLS_TYPE_MODIFIER_GROUP is for the
+ * members of the group DESTINATION_ID:
+ *   0x01-0x3F: column 1 to 63
+ *   0x40-0x7F: rank 0 to 63
+ *   0x80-0x9F: section 0 to 31 (configurable, "sections" bitmask)
+ *   0xFF:      all the devices
+ *
+ * The membership is a bitmap of the 256 group ids, so that the receive
+ * callback can drop the packets of the other groups in constant time.
+ *
+ * A sender sets the modifier in the type and the destination id with
+ * mlsmesh_send_group_packet() or mlsmesh_send_unicast_packet(). A per
+ * column choreography costs one packet per column: sendColumnLights()
+ * sends the light of each column to its column group only. The ranks
+ * and the columns above 63 have no group (they are not aliased to the
+ * group of another rank or column).
+ *
+ **********************************************************************/
+#ifndef MLS_GROUPS_H
+#define MLS_GROUPS_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "mls_mesh.h"
+  #include <stdint.h>
+
+  #define MLS_GROUP_ALL             0xFF
+  #define MLS_GROUP_COLUMN(c)       ((c) & 0x3F)
+  #define MLS_GROUP_RANK(r)         (0x40 | ((r) & 0x3F))
+  #define MLS_GROUP_SECTION(s)      (0x80 | ((s) & 0x1F))
+  #define MLS_GROUP_SECTIONS        32
+  #define MLS_GROUP_MAX_COLUMN      63
+  #define MLS_GROUP_MAX_RANK        63
+
+  #define MLS_TYPE_MODIFIERS        (MLS_TYPE_MODIFIER_UNICAST | MLS_TYPE_MODIFIER_GROUP)
+
+  struct LIGHT_PACKET;
+
+  // Sender of a group packet (packet type without modifier, group id, data)
+  typedef boolean (*mls_groups_send)(const uint8_t packetType, const uint8_t groupId, const uint8_t *data);
+
+
+  class MlsGroups {
+
+    private:
+      uint32_t membership[8];                     // Bit n: member of the group id n
+      uint16_t filtered;                          // Packets dropped because they are for other devices
+
+    public:
+      MlsGroups();
+      static uint8_t getType(uint8_t type);
+      static void getColumnLight(const struct LIGHT_PACKET *light, uint8_t column, const uint8_t palette[][3], uint8_t palette_size, struct LIGHT_PACKET *column_light);
+      static uint8_t sendColumnLights(mls_groups_send send, const struct LIGHT_PACKET *light, uint8_t columns, const uint8_t palette[][3], uint8_t palette_size);
+      void setMembership(uint8_t rank, uint8_t column, uint32_t sections);
+      boolean isMember(uint8_t group_id);
+      boolean accepts(uint8_t type, uint8_t destination_id, uint8_t my_id);
+      void countFiltered();
+      uint16_t getFiltered();
+  };
+
+#endif
@@ -0,0 +1,167 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_led_driver.cpp
+ * @brief LED strips output drivers (FastLED or asynchronous RMT)
+ *
+ **********************************************************************/
+#include "mls_led_driver.h"
+
+
+// FastLED driver: the strips are handled by FastLED, no output buffer
+void MlsFastLedDriver::begin(struct CRGB *left_strip, struct CRGB *right_strip, uint16_t leds_per_strip, MlsArena *arena) {
+  FastLED.addLeds<LED_TYPE, LEFT_LEDS_PIN, LED_COLOR_ORDER>(left_strip, leds_per_strip);
+  FastLED.addLeds<LED_TYPE, RIGHT_LEDS_PIN, LED_COLOR_ORDER>(right_strip, leds_per_strip);
+  FastLED.clear();
+}
+
+
+void MlsFastLedDriver::show(boolean left_changed, boolean right_changed) {
+  #ifdef LED_SHOW_CHANGED_STRIPS_ONLY
+    if (left_changed) {
+      FastLED[0].showLeds(FastLED.getBrightness());
+    }
+    if (right_changed) {
+      FastLED[1].showLeds(FastLED.getBrightness());
+    }
+  #else
+    if (left_changed || right_changed) {
+      FastLED.show();
+    }
+  #endif
+}
+
+
+// FastLED.show() returns when the strips are sent
+boolean MlsFastLedDriver::isBusy() {
+  return false;
+}
+
+
+#ifdef LED_DRIVER_RMT
+
+  // MlsRmtLedDriver constructor
+  MlsRmtLedDriver::MlsRmtLedDriver() {
+    for (uint8_t lr = 0; lr < 2; lr++) {
+      this->strips[lr] = NULL;
+      this->items[0][lr] = NULL;
+      this->items[1][lr] = NULL;
+      this->sending[lr] = false;
+    }
+    this->leds_per_strip = 0;
+    this->back_buffer = 0;
+    this->waits = 0;
+  }
+
+
+  // RMT driver: one RMT channel per strip (channel 0 on the left, channel 1 on the right)
+  void MlsRmtLedDriver::begin(struct CRGB *left_strip, struct CRGB *right_strip, uint16_t leds_per_strip, MlsArena *arena) {
+    rmt_config_t config;
+    const uint8_t pins[2] = {LEFT_LEDS_PIN, RIGHT_LEDS_PIN};
+
+    this->strips[0] = left_strip;
+    this->strips[1] = right_strip;
+    this->leds_per_strip = leds_per_strip;
+
+    for (uint8_t lr = 0; lr < 2; lr++) {
+      memset(&config, 0, sizeof(config));
+      config.rmt_mode = RMT_MODE_TX;
+      config.channel = (rmt_channel_t) lr;
+      config.clk_div = RMT_LED_CLK_DIV;
+      config.gpio_num = (gpio_num_t) pins[lr];
+      config.mem_block_num = 1;
+      config.tx_config.loop_en = false;
+      config.tx_config.carrier_en = false;
+      config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+      config.tx_config.idle_output_en = true;
+      rmt_config(&config);
+      rmt_driver_install((rmt_channel_t) lr, 0, 0);
+      for (uint8_t buffer = 0; buffer < 2; buffer++) {
+        this->items[buffer][lr] = (rmt_item32_t *) arena->allocate(RMT_LED_BITS * leds_per_strip * sizeof(rmt_item32_t));
+      }
+    }
+  }
+
+
+  // Encode a strip in RMT items (WS2812B: GRB order, MSB first)
+  void MlsRmtLedDriver::encode(struct CRGB *strip, rmt_item32_t *items, uint8_t brightness) {
+    uint8_t color[3];
+    uint8_t bit;
+    uint32_t item_0;
+    uint32_t item_1;
+    rmt_item32_t item;
+
+    item.duration0 = RMT_LED_T0H_TICKS; item.level0 = 1; item.duration1 = RMT_LED_T0L_TICKS; item.level1 = 0;
+    item_0 = item.val;
+    item.duration0 = RMT_LED_T1H_TICKS; item.level0 = 1; item.duration1 = RMT_LED_T1L_TICKS; item.level1 = 0;
+    item_1 = item.val;
+
+    for (uint16_t i = 0; i < this->leds_per_strip; i++) {
+      color[0] = scale8(strip[i].g, brightness);
+      color[1] = scale8(strip[i].r, brightness);
+      color[2] = scale8(strip[i].b, brightness);
+      for (uint8_t c = 0; c < 3; c++) {
+        for (bit = 0; bit < 8; bit++) {
+          items->val = (color[c] & (0x80 >> bit)) ? item_1 : item_0;
+          items++;
+        }
+      }
+    }
+  }
+
+
+  // Wait for the end of the previous frame of a strip
+  void MlsRmtLedDriver::waitDone(uint8_t lr) {
+    if (!this->sending[lr]) {
+      return;
+    }
+    if (ESP_OK != rmt_wait_tx_done((rmt_channel_t) lr, 0)) {
+      this->waits++;
+      rmt_wait_tx_done((rmt_channel_t) lr, portMAX_DELAY);
+    }
+    this->sending[lr] = false;
+  }
+
+
+  // Encode the changed strips in the back buffer, and start to send them
+  void MlsRmtLedDriver::show(boolean left_changed, boolean right_changed) {
+    boolean changed[2] = {left_changed, right_changed};
+    uint8_t brightness = FastLED.getBrightness();
+
+    if ((!left_changed) && (!right_changed)) {
+      return;
+    }
+    for (uint8_t lr = 0; lr < 2; lr++) {
+      if (changed[lr] && (NULL != this->items[this->back_buffer][lr])) {
+        // The front buffer can still be sending
+        this->encode(this->strips[lr], this->items[this->back_buffer][lr], brightness);
+      }
+    }
+    for (uint8_t lr = 0; lr < 2; lr++) {
+      if (changed[lr] && (NULL != this->items[this->back_buffer][lr])) {
+        this->waitDone(lr);
+        rmt_write_items((rmt_channel_t) lr, this->items[this->back_buffer][lr], RMT_LED_BITS * this->leds_per_strip, false);
+        this->sending[lr] = true;
+      }
+    }
+    this->back_buffer = 1 - this->back_buffer;
+  }
+
+
+  boolean MlsRmtLedDriver::isBusy() {
+    for (uint8_t lr = 0; lr < 2; lr++) {
+      if (this->sending[lr] && (ESP_OK != rmt_wait_tx_done((rmt_channel_t) lr, 0))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+  uint16_t MlsRmtLedDriver::getWaits() {
+    return this->waits;
+  }
+
+#endif
@@ -0,0 +1,81 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_led_driver.h
+ * @brief LED strips output drivers (FastLED or asynchronous RMT)
+ *
+ * MlsFastLedDriver is the regular FastLED output: FastLED.show() sends
+ * the strips and returns when they are sent.
+ *
+ * MlsRmtLedDriver encodes the frame in RMT items and returns immediately:
+ * the RMT peripheral sends the frame N from one buffer, while the frame
+ * N+1 is encoded in the other buffer. The encoding waits only if the
+ * frame N+1 is ready before the end of the frame N.
+ *
+ **********************************************************************/
+#ifndef MLS_LED_DRIVER_H
+#define MLS_LED_DRIVER_H
+
+  #include "mls_config.h"
+  #include "DebugTools.h"
+  #include "mls_arena.h"
+
+  #include "FastLED.h"
+  #include <stdint.h>
+
+  #ifdef LED_DRIVER_RMT
+    #include "driver/rmt.h"
+  #endif
+
+
+  class MlsLedDriver {
+
+    public:
+      virtual ~MlsLedDriver() {}
+      virtual void begin(struct CRGB *left_strip, struct CRGB *right_strip, uint16_t leds_per_strip, MlsArena *arena) = 0;
+      virtual void show(boolean left_changed, boolean right_changed) = 0;
+      virtual boolean isBusy() = 0;
+  };
+
+
+  class MlsFastLedDriver : public MlsLedDriver {
+
+    public:
+      void begin(struct CRGB *left_strip, struct CRGB *right_strip, uint16_t leds_per_strip, MlsArena *arena);
+      void show(boolean left_changed, boolean right_changed);
+      boolean isBusy();
+  };
+
+
+  #ifdef LED_DRIVER_RMT
+    #define RMT_LED_BITS         24 // RMT items per LED
+    #define RMT_LED_CLK_DIV      2  // 80MHz / 2: 25ns per RMT tick
+    #define RMT_LED_T0H_TICKS    16 // WS2812B 0 bit: 0.40us high
+    #define RMT_LED_T0L_TICKS    34 //                0.85us low
+    #define RMT_LED_T1H_TICKS    32 // WS2812B 1 bit: 0.80us high
+    #define RMT_LED_T1L_TICKS    18 //                0.45us low
+
+    class MlsRmtLedDriver : public MlsLedDriver {
+
+      private:
+        struct CRGB *strips[2];
+        uint16_t leds_per_strip;
+        rmt_item32_t *items[2][2];   // [buffer][strip]
+        uint8_t back_buffer;         // Buffer being encoded, the other one can be sending
+        boolean sending[2];          // Strip sending from the front buffer
+        uint16_t waits;              // Frames ready before the end of the previous frame
+        void encode(struct CRGB *strip, rmt_item32_t *items, uint8_t brightness);
+        void waitDone(uint8_t lr);
+
+      public:
+        MlsRmtLedDriver();
+        void begin(struct CRGB *left_strip, struct CRGB *right_strip, uint16_t leds_per_strip, MlsArena *arena);
+        void show(boolean left_changed, boolean right_changed);
+        boolean isBusy();
+        uint16_t getWaits();
+    };
+  #endif
+
+#endif
@@ -0,0 +1,94 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_level_window.h
+ * @brief Sliding window statistics of the audio levels (mean and maximum)
+ *
+ * Constant cost per level, whatever the size of the window:
+ * - the mean is a running sum of level / SIZE (the same integer divisions
+ *   as the sum of the whole window, so the result is identical),
+ * - the maximum uses a monotonic deque: the levels which can still become
+ *   the maximum, in decreasing order. Each level is pushed and popped once.
+ *
+ **********************************************************************/
+#ifndef MLS_LEVEL_WINDOW_H
+#define MLS_LEVEL_WINDOW_H
+
+  #include <Arduino.h>
+  #include <stdint.h>
+  #include <string.h>
+
+
+  template <uint16_t SIZE>
+  class MlsLevelWindow {
+
+    private:
+      uint32_t levels[SIZE];          // Last SIZE levels (0 before the window is full)
+      uint32_t sum;                   // Sum of level / SIZE of the window
+      uint32_t count;                 // Levels added since the last clear
+      uint32_t deque_index[SIZE];     // Monotonic deque (count of each level), ring of SIZE entries
+      uint32_t deque_level[SIZE];
+      uint16_t deque_head;
+      uint16_t deque_size;
+
+    public:
+      MlsLevelWindow() {
+        this->clear();
+      }
+
+      void clear() {
+        memset(this->levels, 0, sizeof(this->levels));
+        this->sum = 0;
+        this->count = 0;
+        this->deque_head = 0;
+        this->deque_size = 0;
+      }
+
+      void add(uint32_t level) {
+        uint16_t slot = this->count % SIZE;
+        uint16_t back;
+
+        // Running mean
+        this->sum = this->sum - (this->levels[slot] / SIZE) + (level / SIZE);
+        this->levels[slot] = level;
+
+        // Sliding maximum: the front level is out of the window, and the smaller levels before this one can no longer be the maximum
+        if ((this->deque_size > 0) && ((this->count - this->deque_index[this->deque_head]) >= SIZE)) {
+          this->deque_head = (this->deque_head + 1) % SIZE;
+          this->deque_size--;
+        }
+        while (this->deque_size > 0) {
+          back = (this->deque_head + this->deque_size - 1) % SIZE;
+          if (this->deque_level[back] > level) {
+            break;
+          }
+          this->deque_size--;
+        }
+        back = (this->deque_head + this->deque_size) % SIZE;
+        this->deque_index[back] = this->count;
+        this->deque_level[back] = level;
+        this->deque_size++;
+        this->count++;
+      }
+
+      // Mean of the window, as the sum of level / SIZE
+      uint32_t getMean() {
+        return this->sum;
+      }
+
+      // Maximum level of the window
+      uint32_t getMax() {
+        if (0 == this->deque_size) {
+          return 0;
+        }
+        return this->deque_level[this->deque_head];
+      }
+
+      uint32_t getCount() {
+        return this->count;
+      }
+  };
+
+#endif
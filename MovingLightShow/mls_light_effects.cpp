@@ -12,20 +12,78 @@
 
 // MlsLightEffects constructor
 MlsLightEffects::MlsLightEffects(uint16_t leds_per_strip, struct CRGB *left_strip, struct CRGB *right_strip) {
+  this->clock = NULL;
+  this->frame_time_micros = 0;
+  this->last_strip[0] = NULL;
+  this->last_strip[1] = NULL;
+  this->max_leds_per_strip = leds_per_strip;
+  this->notify_task = NULL;
+  this->led_driver = NULL;
   this->setLedsPerStrip(leds_per_strip);
   this->setStrips(left_strip, right_strip);
     for (uint8_t lr = 0; lr < 2; lr++) {
     this->data_actual[lr].packet = 0;
     this->data_actual[lr].effect = 0;
-    this->data_received[lr].packet = 0;
-    this->data_received[lr].effect = 0;
+    this->strip_envelope[lr] = &this->envelope[lr];
+  }
+  this->data_waiting = false;
+  this->render_compilations = 0;
+  for (uint8_t slot = 0; slot < MLS_LIGHT_ARMED_SLOTS; slot++) {
+    this->armed_valid[slot] = false;
   }
 }
 
 
+// Carve the shown strips from the arena, for the strips of the role of the device
+boolean MlsLightEffects::begin(MlsArena *arena, uint16_t leds_per_strip) {
+  for (uint8_t lr = 0; lr < 2; lr++) {
+    this->last_strip[lr] = (struct CRGB *) arena->allocate(leds_per_strip * sizeof(struct CRGB));
+    if (NULL == this->last_strip[lr]) {
+      return false;
+    }
+  }
+  this->max_leds_per_strip = leds_per_strip;
+  this->setLedsPerStrip(leds_per_strip);
+  return true;
+}
+
+
 // Set the LEDs per strip
 void MlsLightEffects::setLedsPerStrip(uint16_t leds_per_strip) {
+  if (leds_per_strip > this->max_leds_per_strip) {
+    leds_per_strip = this->max_leds_per_strip;
+  }
   this->leds_per_strip = leds_per_strip;
+  this->dirty[0] = true;
+  this->dirty[1] = true;
+}
+
+
+// Set the clock used to convert the master start time of the effects
+void MlsLightEffects::setClock(MlsClock *clock) {
+  this->clock = clock;
+}
+
+
+// Set the output driver of the strips
+void MlsLightEffects::setLedDriver(MlsLedDriver *led_driver) {
+  this->led_driver = led_driver;
+}
+
+
+// Set the task to wake up when a new light data is received (handle address, the task can be deleted)
+void MlsLightEffects::setNotifyTask(TaskHandle_t *task) {
+  this->notify_task = task;
+}
+
+
+// Start time of the light data waiting to be played (TaskUpdateLight only)
+boolean MlsLightEffects::getWaitingStartTime(uint32_t *start_time_micros) {
+  if (!this->data_waiting) {
+    return false;
+  }
+  *start_time_micros = this->data_received.strip[0].received ? this->data_received.strip[0].start_time_micros : this->data_received.strip[1].start_time_micros;
+  return true;
 }
 
 
@@ -83,72 +141,77 @@ void MlsLightEffects::setMyRank(uint8_t rank) {
 }
 
 
+// Maximum number of light data waiting in the mailbox
+uint8_t MlsLightEffects::getMailboxHighWater() {
+  return this->mailbox.getHighWater();
+}
+
+
+// Light data overwritten in the mailbox before being played
+uint16_t MlsLightEffects::getMailboxOverruns() {
+  return this->mailbox.getOverruns();
+}
+
+
+// Torn reads of the mailbox retried by TaskUpdateLight
+uint16_t MlsLightEffects::getMailboxRetries() {
+  return this->mailbox.getRetries();
+}
+
+
+// Envelopes compiled by TaskUpdateLight instead of the ingest (ranks changed after the reception)
+uint16_t MlsLightEffects::getRenderCompilations() {
+  return this->render_compilations;
+}
+
+
 // Calculate the effective brightness of the LEDs (gamma correction is done when writing in the strips memory addresses)
 struct CRGB MlsLightEffects::adjustBrightness(struct CRGB color, uint8_t brightness) {
-  return CRGB((brightness * color.r) / 255, (brightness * color.g) / 255, (brightness * color.b) / 255);
+  return CRGB(this->divide255(brightness * color.r), this->divide255(brightness * color.g), this->divide255(brightness * color.b));
+}
+
+
+// Exact division by 255 of a product of two 8 bits values, without division
+uint8_t MlsLightEffects::divide255(uint16_t value) {
+  return (value + 1 + (value >> 8)) >> 8;
+}
+
+
+// Parameters used to compile the envelope of an effect (the envelope is carried with its light data,
+// so an armed effect keeps the envelope compiled at arm time when it is fired with its packet id)
+uint32_t MlsLightEffects::getEnvelopeKey() {
+  return ((uint32_t) this->number_of_ranks << 8) | this->my_rank;
 }
 
 
 // Set the strip data for the HEARTBEAT effect
-void MlsLightEffects::effectHeartbeat(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectHeartbeat(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
   struct CRGB new_color;
-  struct CRGB diastole_color;
-  uint32_t systole_fadein_time_micros = 50 * actual_data->duration_ms;    // 5% of total duration
-  uint32_t systole_on_time_micros = 100 * actual_data->duration_ms;       // 10% of total duration
-  uint32_t systole_fadeout_time_micros = 300 * actual_data->duration_ms;  // 25% of total duration (but diastole is coming before the end)
-  uint32_t diastole_time_micros = 350 * actual_data->duration_ms;         // Diastole appears at 35% of whole signal
-  uint32_t diastole_fadein_time_micros = 0;
-  uint32_t diastole_on_time_micros = 100 * actual_data->duration_ms;      // 10% of total duration
-  uint32_t diastole_fadeout_time_micros = 450 * actual_data->duration_ms; // 45% of total duration
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
   memcpy(new_color.raw, actual_data->color_raw, 3);
-  diastole_color = this->adjustBrightness(new_color, actual_data->option);
-  if (((actual_data->delta_time_micros) >= diastole_time_micros) && (diastole_fadein_time_micros > 0) && ((actual_data->delta_time_micros - diastole_time_micros) <= (diastole_fadein_time_micros))) {
-    new_color = this->adjustBrightness(diastole_color, 255 * (actual_data->delta_time_micros - diastole_time_micros)  / diastole_fadein_time_micros);
-  } else if (((actual_data->delta_time_micros) >= diastole_time_micros) && ((actual_data->delta_time_micros - diastole_time_micros) < (diastole_fadein_time_micros + diastole_on_time_micros))) {
-    new_color = diastole_color;
-  } else if (((actual_data->delta_time_micros) >= diastole_time_micros) && (diastole_fadeout_time_micros > 0) && ((actual_data->delta_time_micros - diastole_time_micros) < (diastole_fadein_time_micros + diastole_on_time_micros + diastole_fadeout_time_micros))) {
-    new_color = this->adjustBrightness(diastole_color, 255 * (diastole_time_micros
-    + diastole_fadeout_time_micros - ((actual_data->delta_time_micros) - diastole_fadein_time_micros - diastole_on_time_micros)) / diastole_fadeout_time_micros);
-  } else if ((actual_data->delta_time_micros) >= (diastole_time_micros + diastole_time_micros + diastole_on_time_micros + diastole_fadeout_time_micros)) {
-    new_color = CRGB::Black;
-  } else if ((actual_data->delta_time_micros >= 0) && (systole_fadein_time_micros > 0) && (actual_data->delta_time_micros < systole_fadein_time_micros)) {
-    new_color = this->adjustBrightness(new_color, 255 * actual_data->delta_time_micros / systole_fadein_time_micros);
-  } else if ((actual_data->delta_time_micros >= 0) && (actual_data->delta_time_micros < (systole_fadein_time_micros + systole_on_time_micros))) {
-  } else if ((actual_data->delta_time_micros >= 0) && (systole_fadeout_time_micros > 0) && (actual_data->delta_time_micros < (systole_fadein_time_micros + systole_on_time_micros + systole_fadeout_time_micros))) {
-    new_color = this->adjustBrightness(new_color, 255 * (systole_fadeout_time_micros - (actual_data->delta_time_micros - systole_fadein_time_micros - systole_on_time_micros)) / systole_fadeout_time_micros);
-  } else {
-    new_color = CRGB::Black;
-  }
+  new_color = this->adjustBrightness(new_color, envelope->getLevel(actual_data->delta_time_micros));
   this->fill(new_color, actual_data->leds_per_strip, strip);
 }
 
 
 // Set the strip data for the FLASH effect
-void MlsLightEffects::effectBreath(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectBreath(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
   struct CRGB new_color;
-  uint32_t breath_fadein_time_micros = 350 * actual_data->duration_ms;
-  uint32_t breath_on_time_micros = 100 * actual_data->duration_ms;
-  uint32_t breath_fadeout_time_micros = 350 * actual_data->duration_ms;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
   memcpy(new_color.raw, actual_data->color_raw, 3);
-  if ((actual_data->delta_time_micros >= 0) && (breath_fadein_time_micros > 0) && (actual_data->delta_time_micros < breath_fadein_time_micros)) {
-    new_color = this->adjustBrightness(new_color, 63 + (192 * actual_data->delta_time_micros / breath_fadein_time_micros));
-  } else if ((actual_data->delta_time_micros >= 0) && (actual_data->delta_time_micros < (breath_fadein_time_micros + breath_on_time_micros))) {
-  } else if ((actual_data->delta_time_micros >= 0) && (breath_fadeout_time_micros > 0) && (actual_data->delta_time_micros < (breath_fadein_time_micros + breath_on_time_micros + breath_fadeout_time_micros))) {
-    new_color = this->adjustBrightness(new_color, 63 + (192 * (breath_fadeout_time_micros - (actual_data->delta_time_micros - breath_fadein_time_micros - breath_on_time_micros)) / breath_fadeout_time_micros));
-  } else {
-    new_color = this->adjustBrightness(new_color, 63);
-  }
+  new_color = this->adjustBrightness(new_color, envelope->getLevel(actual_data->delta_time_micros));
   this->fill(new_color, actual_data->leds_per_strip, strip);
 }
 
 
 // Set the strip data for the FIREFLY effect
-void MlsLightEffects::effectFirefly(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectFirefly(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
 
   FIREFLY_COLOR firefly_color;
   struct CRGB new_color;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
   // OK, let's try to create a new firefly
   if (actual_data->delta_time_micros > (1000 * actual_data->duration_ms)) {
@@ -158,6 +221,7 @@ void MlsLightEffects::effectFirefly(struct STRIP_DATA *actual_data, struct CRGB
       actual_data->fadein_time_micros = 1000 * random(FIREFLIES_FADEIN_MINIMUM, FIREFLIES_FADEIN_MAXIMUM);
       actual_data->fadeout_time_micros = 1000 * random(FIREFLIES_FADEOUT_MAXIMUM, FIREFLIES_FADEOUT_MAXIMUM);
       actual_data->on_time_micros = (1000 * actual_data->duration_ms) - actual_data->fadein_time_micros - actual_data->fadeout_time_micros;
+      envelope->compileFade(this->getEnvelopeKey(), 0, actual_data->fadein_time_micros, actual_data->on_time_micros, actual_data->fadeout_time_micros, 0, 255);
       firefly_color.raw = FirefliesColorPalette[random(0, FIREFLIES_COLORS)];
       actual_data->color_r = firefly_color.one[2]; actual_data->color_g = firefly_color.one[1]; actual_data->color_b = firefly_color.one[0];
       DEBUG_PRINT("A firefly is born for "); DEBUG_PRINT(actual_data->duration_ms); DEBUG_PRINTLN(" ms");
@@ -167,19 +231,12 @@ void MlsLightEffects::effectFirefly(struct STRIP_DATA *actual_data, struct CRGB
       actual_data->color_r = 0; actual_data->color_g = 0; actual_data->color_b = 0;
       DEBUG_PRINT("No firefly for "); DEBUG_PRINT(actual_data->duration_ms); DEBUG_PRINTLN(" ms");
     }
-    actual_data->start_time_micros = micros();
+    actual_data->start_time_micros = this->frame_time_micros;
     actual_data->delta_time_micros = 0;
   }
   if (actual_data->option > 0) {
     memcpy(new_color.raw, actual_data->color_raw, 3);
-    if ((actual_data->delta_time_micros >= 0) && (actual_data->fadein_time_micros > 0) && (actual_data->delta_time_micros < actual_data->fadein_time_micros)) {
-      new_color = this->adjustBrightness(new_color, 255 * actual_data->delta_time_micros / actual_data->fadein_time_micros);
-    } else if ((actual_data->delta_time_micros >= 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros))) {
-    } else if ((actual_data->delta_time_micros >= 0) && (actual_data->fadeout_time_micros > 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros + actual_data->fadeout_time_micros))) {
-      new_color = this->adjustBrightness(new_color, 255 * (actual_data->fadeout_time_micros - (actual_data->delta_time_micros - actual_data->fadein_time_micros - actual_data->on_time_micros)) / actual_data->fadeout_time_micros);
-    } else {
-      new_color = CRGB::Black;
-    }
+    new_color = this->adjustBrightness(new_color, envelope->getLevel(actual_data->delta_time_micros));
   } else {
     new_color = CRGB::Black;
   }
@@ -188,9 +245,10 @@ void MlsLightEffects::effectFirefly(struct STRIP_DATA *actual_data, struct CRGB
 
 
 // Set the strip data for the STARS effect
-void MlsLightEffects::effectStars(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectStars(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
 
   struct CRGB new_color;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
   // OK, let's try to create a new star
   if (actual_data->delta_time_micros > (1000 * actual_data->duration_ms)) {
@@ -200,25 +258,18 @@ void MlsLightEffects::effectStars(struct STRIP_DATA *actual_data, struct CRGB *s
       actual_data->fadeout_time_micros = 1000 * random(STARS_FADEOUT_MAXIMUM, STARS_FADEOUT_MAXIMUM);
       actual_data->on_time_micros = 0;
       actual_data->duration_ms = (actual_data->fadein_time_micros + actual_data->fadeout_time_micros) / 1000;
+      envelope->compileFade(this->getEnvelopeKey(), 0, actual_data->fadein_time_micros, actual_data->on_time_micros, actual_data->fadeout_time_micros, 0, 255);
       DEBUG_PRINT("A star is born for "); DEBUG_PRINT(actual_data->duration_ms); DEBUG_PRINTLN(" ms");
     } else {
       actual_data->duration_ms = random(STARS_GAP_MINIMUM, STARS_GAP_MAXIMUM);
       actual_data->option = 0;
       DEBUG_PRINT("No star for "); DEBUG_PRINT(actual_data->duration_ms); DEBUG_PRINTLN(" ms");
     }
-    actual_data->start_time_micros = micros();
+    actual_data->start_time_micros = this->frame_time_micros;
     actual_data->delta_time_micros = 0;
   }
   if (actual_data->option > 0) {
-    new_color = CRGB::White;
-    if ((actual_data->delta_time_micros >= 0) && (actual_data->fadein_time_micros > 0) && (actual_data->delta_time_micros < actual_data->fadein_time_micros)) {
-      new_color = this->adjustBrightness(new_color, 255 * actual_data->delta_time_micros / actual_data->fadein_time_micros);
-    } else if ((actual_data->delta_time_micros >= 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros))) {
-    } else if ((actual_data->delta_time_micros >= 0) && (actual_data->fadeout_time_micros > 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros + actual_data->fadeout_time_micros))) {
-      new_color = this->adjustBrightness(new_color, 255 * (actual_data->fadeout_time_micros - (actual_data->delta_time_micros - actual_data->fadein_time_micros - actual_data->on_time_micros)) / actual_data->fadeout_time_micros);
-    } else {
-      new_color = CRGB::Black;
-    }
+    new_color = this->adjustBrightness(CRGB::White, envelope->getLevel(actual_data->delta_time_micros));
   } else {
     new_color = CRGB::Black;
   }
@@ -302,6 +353,7 @@ void MlsLightEffects::effectCheck(struct STRIP_DATA *actual_data, struct CRGB *s
   if (actual_data->last_step != actual_data->step) {
     actual_data->last_step = actual_data->step;
   }
+  this->setDirty(strip);
 }
 
 
@@ -322,16 +374,13 @@ void MlsLightEffects::effectProgress(struct STRIP_DATA *actual_data, struct CRGB
   if (actual_data->last_step != actual_data->step) {
     actual_data->last_step = actual_data->step;
   }
+  this->setDirty(strip);
 }
 
 
-void MlsLightEffects::effectVueMeter(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectVueMeter(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
   struct CRGB new_color;
-  uint32_t shift_delay_micros;
-  uint32_t fadein_time_micros = 0;
-  uint32_t fadeout_time_micros;
-  uint32_t on_time_micros;
-  uint32_t rank_start_delay_micros;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
   uint8_t effective_ranks = this->number_of_ranks;
   uint8_t effective_rank = this->my_rank;
 
@@ -342,122 +391,43 @@ void MlsLightEffects::effectVueMeter(struct STRIP_DATA *actual_data, struct CRGB
     effective_rank = 1;
   }
 
-  shift_delay_micros = 1000 * (actual_data->duration_ms - actual_data->option) / (2 * (effective_ranks - 1));
-  rank_start_delay_micros = (effective_rank - 1) * shift_delay_micros;
-  fadeout_time_micros = shift_delay_micros;
-  on_time_micros = (1000 * actual_data->option) + (2 * (effective_ranks - effective_rank) * shift_delay_micros);
-
   new_color = CRGB::Green;
   if ((effective_ranks - effective_rank) <= 1) {
     new_color = CRGB::Red;
-   fadeout_time_micros = shift_delay_micros;
-  }
-
-  if (this->my_rank > 1) {
-    fadein_time_micros = shift_delay_micros;
-    rank_start_delay_micros = rank_start_delay_micros - fadein_time_micros;
-  }
-
-/*
-  DEBUG_PRINT("this->my_rank: "); DEBUG_PRINTLN(this->my_rank);
-  DEBUG_PRINT("effective_ranks: "); DEBUG_PRINTLN(effective_ranks);
-  DEBUG_PRINT("effective_rank: "); DEBUG_PRINTLN(effective_rank);
-  DEBUG_PRINT("rank_start_delay_micros: "); DEBUG_PRINTLN(rank_start_delay_micros);
-  DEBUG_PRINT("actual_data->leds_per_strip: "); DEBUG_PRINTLN(actual_data->leds_per_strip);
-  DEBUG_PRINT("fadein_time_micros: "); DEBUG_PRINTLN(fadein_time_micros);
-  DEBUG_PRINT("on_time_micros: "); DEBUG_PRINTLN(on_time_micros);
-  DEBUG_PRINT("fadeout_time_micros: "); DEBUG_PRINTLN(fadeout_time_micros);
-*/
-
-  if ((actual_data->delta_time_micros >= rank_start_delay_micros) && (fadein_time_micros > 0) && (actual_data->delta_time_micros < (rank_start_delay_micros + fadein_time_micros))) {
-    new_color = this->adjustBrightness(new_color, 255 * (actual_data->delta_time_micros - rank_start_delay_micros) / fadein_time_micros);
-  } else if ((actual_data->delta_time_micros >= rank_start_delay_micros) && (actual_data->delta_time_micros < (rank_start_delay_micros + fadein_time_micros + on_time_micros))) {
-  } else if ((actual_data->delta_time_micros >= rank_start_delay_micros) && (fadeout_time_micros > 0) && (actual_data->delta_time_micros < (rank_start_delay_micros + fadein_time_micros + on_time_micros + fadeout_time_micros))) {
-    new_color = this->adjustBrightness(new_color, 255 * (fadeout_time_micros - (actual_data->delta_time_micros - rank_start_delay_micros - fadein_time_micros - on_time_micros)) / fadeout_time_micros);
-  } else {
-    new_color = CRGB::Black;
   }
+  new_color = this->adjustBrightness(new_color, envelope->getLevel(actual_data->delta_time_micros));
   this->fill(new_color, actual_data->leds_per_strip, strip);
 }
 
 
-void MlsLightEffects::effectWaveBack(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectWaveBack(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
   struct CRGB new_color;
-  uint32_t shift_delay_micros;
-  uint32_t fadein_time_micros = 0;
-  uint32_t fadeout_time_micros;
-  uint32_t on_time_micros;
-  uint32_t rank_start_delay_micros;
-  uint8_t effective_ranks = this->number_of_ranks;
-  uint8_t effective_rank = this->my_rank;
-
-  if (effective_ranks < 2) {
-    effective_ranks = 2;
-  }
-  if (effective_rank < 1) {
-    effective_rank = 1;
-  }
-
-  shift_delay_micros = 1000 * (actual_data->duration_ms - actual_data->option) / (effective_ranks - 1);
-  rank_start_delay_micros = (effective_rank - 1) * shift_delay_micros;
-  fadeout_time_micros = shift_delay_micros;
-  on_time_micros = (1000 * actual_data->option) + ((effective_ranks - effective_rank) * shift_delay_micros);
-  new_color = CRGB::Blue;
-
-  if ((effective_ranks - effective_rank) <= 1) {
-   fadeout_time_micros = shift_delay_micros;
-  }
-
-  if (this->my_rank > 1) {
-    fadein_time_micros = shift_delay_micros;
-    rank_start_delay_micros = rank_start_delay_micros - fadein_time_micros;
-  }
-
-  on_time_micros = on_time_micros + rank_start_delay_micros;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
-  if ((actual_data->delta_time_micros >= rank_start_delay_micros) && (fadein_time_micros > 0) && (actual_data->delta_time_micros < (rank_start_delay_micros + fadein_time_micros))) {
-    new_color = this->adjustBrightness(new_color, 255 * (actual_data->delta_time_micros - rank_start_delay_micros) / fadein_time_micros);
-  } else if ((actual_data->delta_time_micros >= rank_start_delay_micros) && (actual_data->delta_time_micros < (rank_start_delay_micros + fadein_time_micros + on_time_micros))) {
-  } else if ((actual_data->delta_time_micros >= rank_start_delay_micros) && (fadeout_time_micros > 0) && (actual_data->delta_time_micros < (rank_start_delay_micros + fadein_time_micros + on_time_micros + fadeout_time_micros))) {
-    new_color = this->adjustBrightness(new_color, 255 * (fadeout_time_micros - (actual_data->delta_time_micros - rank_start_delay_micros - fadein_time_micros - on_time_micros)) / fadeout_time_micros);
-  } else {
-    new_color = CRGB::Black;
-  }
+  new_color = this->adjustBrightness(CRGB::Blue, envelope->getLevel(actual_data->delta_time_micros));
   this->fill(new_color, actual_data->leds_per_strip, strip);
 }
 
 
 // Set the strip data for the FLASH effect
-void MlsLightEffects::effectFlash(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectFlash(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
   struct CRGB new_color;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
   memcpy(new_color.raw, actual_data->color_raw, 3);
-  if ((actual_data->delta_time_micros >= 0) && (actual_data->fadein_time_micros > 0) && (actual_data->delta_time_micros < actual_data->fadein_time_micros)) {
-    new_color = this->adjustBrightness(new_color, 255 * actual_data->delta_time_micros / actual_data->fadein_time_micros);
-  } else if ((actual_data->delta_time_micros >= 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros))) {
-  } else if ((actual_data->delta_time_micros >= 0) && (actual_data->fadeout_time_micros > 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros + actual_data->fadeout_time_micros))) {
-    new_color = this->adjustBrightness(new_color, 255 * (actual_data->fadeout_time_micros - (actual_data->delta_time_micros - actual_data->fadein_time_micros - actual_data->on_time_micros)) / actual_data->fadeout_time_micros);
-  } else {
-    new_color = CRGB::Black;
-  }
+  new_color = this->adjustBrightness(new_color, envelope->getLevel(actual_data->delta_time_micros));
   this->fill(new_color, actual_data->leds_per_strip, strip);
 }
 
 
 // Set the strip data for the THREE STEPS effect
-void MlsLightEffects::effectThreeSteps(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectThreeSteps(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
   struct CRGB new_color;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
   if (0 == ((300 + actual_data->repeat_counter - this->my_rank) % 3)) {
     memcpy(new_color.raw, actual_data->color_raw, 3);
-    if ((actual_data->delta_time_micros >= 0) && (actual_data->fadein_time_micros > 0) && (actual_data->delta_time_micros < actual_data->fadein_time_micros)) {
-      new_color = this->adjustBrightness(new_color, 255 * actual_data->delta_time_micros / actual_data->fadein_time_micros);
-    } else if ((actual_data->delta_time_micros >= 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros))) {
-    } else if ((actual_data->delta_time_micros >= 0) && (actual_data->fadeout_time_micros > 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros + actual_data->fadeout_time_micros))) {
-      new_color = this->adjustBrightness(new_color, 255 * (actual_data->fadeout_time_micros - (actual_data->delta_time_micros - actual_data->fadein_time_micros - actual_data->on_time_micros)) / actual_data->fadeout_time_micros);
-    } else {
-      new_color = CRGB::Black;
-    }
+    new_color = this->adjustBrightness(new_color, envelope->getLevel(actual_data->delta_time_micros));
   } else {
     new_color = CRGB::Black;
   }
@@ -465,24 +435,19 @@ void MlsLightEffects::effectThreeSteps(struct STRIP_DATA *actual_data, struct CR
 }
 
 
-void MlsLightEffects::effectRainbowRankBeat(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectRainbowRankBeat(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
   struct CRGB new_color;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
   new_color = CHSV(((255 * ((this->my_rank + actual_data->repeat_counter) % (1 + number_of_ranks)) / number_of_ranks)) % 256, 255, 255);
-  if ((actual_data->delta_time_micros >= 0) && (actual_data->fadein_time_micros > 0) && (actual_data->delta_time_micros < actual_data->fadein_time_micros)) {
-    new_color = this->adjustBrightness(new_color, 255 * actual_data->delta_time_micros / actual_data->fadein_time_micros);
-  } else if ((actual_data->delta_time_micros >= 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros))) {
-  } else if ((actual_data->delta_time_micros >= 0) && (actual_data->fadeout_time_micros > 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros + actual_data->fadeout_time_micros))) {
-    new_color = this->adjustBrightness(new_color, 255 * (actual_data->fadeout_time_micros - (actual_data->delta_time_micros - actual_data->fadein_time_micros - actual_data->on_time_micros)) / actual_data->fadeout_time_micros);
-  } else {
-    new_color = CRGB::Black;
-  }
+  new_color = this->adjustBrightness(new_color, envelope->getLevel(actual_data->delta_time_micros));
   this->fill(new_color, actual_data->leds_per_strip, strip);
 }
 
 
-void MlsLightEffects::effectThreeStepsAlternate(struct STRIP_DATA *actual_data, struct CRGB *strip) {
+void MlsLightEffects::effectThreeStepsAlternate(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr) {
   struct CRGB new_color;
+  MlsEnvelope *envelope = this->strip_envelope[lr];
 
   if (0 == ((300 + actual_data->repeat_counter - this->my_rank) % 3)) {
     if (0 == (actual_data->repeat_counter % 2)) {
@@ -492,14 +457,7 @@ void MlsLightEffects::effectThreeStepsAlternate(struct STRIP_DATA *actual_data,
     }
 
     memcpy(new_color.raw, actual_data->color_raw, 3);
-    if ((actual_data->delta_time_micros >= 0) && (actual_data->fadein_time_micros > 0) && (actual_data->delta_time_micros < actual_data->fadein_time_micros)) {
-      new_color = this->adjustBrightness(new_color, 255 * actual_data->delta_time_micros / actual_data->fadein_time_micros);
-    } else if ((actual_data->delta_time_micros >= 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros))) {
-    } else if ((actual_data->delta_time_micros >= 0) && (actual_data->fadeout_time_micros > 0) && (actual_data->delta_time_micros < (actual_data->fadein_time_micros + actual_data->on_time_micros + actual_data->fadeout_time_micros))) {
-      new_color = this->adjustBrightness(new_color, 255 * (actual_data->fadeout_time_micros - (actual_data->delta_time_micros - actual_data->fadein_time_micros - actual_data->on_time_micros)) / actual_data->fadeout_time_micros);
-    } else {
-      new_color = CRGB::Black;
-    }
+    new_color = this->adjustBrightness(new_color, envelope->getLevel(actual_data->delta_time_micros));
   } else {
     new_color = CRGB::Black;
   }
@@ -527,6 +485,7 @@ void MlsLightEffects::effectProgressRainbow(struct STRIP_DATA *actual_data, stru
   for (uint16_t i = 0; i < actual_data->leds_per_strip; i++) {
     strip[i] = CHSV((light_wave + map(i % actual_data->leds_per_strip, 0, actual_data->leds_per_strip, 0, 255) % 256), 255, 255);
   }
+  this->setDirty(strip);
 }
 
 
@@ -536,96 +495,382 @@ void MlsLightEffects::setLightData(uint16_t packetId, struct LIGHT_PACKET *light
 }
 
 
-// setLightData with latency informations
+// setLightData with latency informations (latency is the age of the packet, the effect starts earlier)
 void MlsLightEffects::setLightData(uint16_t packetId, struct LIGHT_PACKET *lightPacket, uint32_t latency_micros) {
+  this->setLightDataAt(packetId, lightPacket, micros() - latency_micros);
+}
+
+
+// setLightData with an absolute start time in the master clock (same instant on all devices)
+void MlsLightEffects::setLightDataMasterTime(uint16_t packetId, struct LIGHT_PACKET *lightPacket, uint32_t master_start_time_micros) {
+  if ((NULL == this->clock) || (!this->clock->isSynchronized())) {
+    this->setLightDataAt(packetId, lightPacket, micros());
+  } else {
+    this->setLightDataAt(packetId, lightPacket, this->clock->masterToLocal(master_start_time_micros));
+  }
+}
+
+
+// setLightData with an absolute start time in the local clock
+void MlsLightEffects::setLightDataAt(uint16_t packetId, struct LIGHT_PACKET *lightPacket, uint32_t start_time_micros) {
+  struct RECEIVED_DATA received_data;
   if (this->received_packet != packetId) {
     this->received_packet = packetId;
-    if (EFFECT_KEEP_ALIVE != lightPacket->effect) {
-      // Overwrite some values for some effects
-      if (EFFECT_FLASH_ALTERNATE == lightPacket->effect) {
-        lightPacket->effect_modifier = MODIFIER_FLIP_FLOP;
-        if (0 == (lightPacket->left_color_r + lightPacket->left_color_g +  lightPacket->left_color_b + lightPacket->right_color_r + lightPacket->right_color_g +  lightPacket->right_color_b)) {
-          lightPacket->left_color_r = 255; lightPacket->left_color_g = 0; lightPacket->left_color_b = 0;
-          lightPacket->right_color_r = 0; lightPacket->right_color_g = 255; lightPacket->right_color_b = 0;
+    if (this->compileLightData(packetId, lightPacket, &received_data)) {
+      this->postLightData(&received_data, start_time_micros);
+    }
+  }
+}
+
+
+// Fill and compile the strips data of a light packet, without the start time (false if no strip is concerned)
+boolean MlsLightEffects::compileLightData(uint16_t packetId, struct LIGHT_PACKET *lightPacket, struct RECEIVED_DATA *received_data) {
+  memset(received_data->strip, 0, sizeof(received_data->strip));
+  if (EFFECT_KEEP_ALIVE != lightPacket->effect) {
+    // Overwrite some values for some effects
+    if (EFFECT_FLASH_ALTERNATE == lightPacket->effect) {
+      lightPacket->effect_modifier = MODIFIER_FLIP_FLOP;
+      if (0 == (lightPacket->left_color_r + lightPacket->left_color_g +  lightPacket->left_color_b + lightPacket->right_color_r + lightPacket->right_color_g +  lightPacket->right_color_b)) {
+        lightPacket->left_color_r = 255; lightPacket->left_color_g = 0; lightPacket->left_color_b = 0;
+        lightPacket->right_color_r = 0; lightPacket->right_color_g = 255; lightPacket->right_color_b = 0;
+      }
+    }
+    
+    if (MODIFIER_IGNORE_LEFT != (lightPacket->effect_modifier & MODIFIER_IGNORE_LEFT)) {
+      // DEBUG_PRINT("Packet color RGB left: ");
+      // DEBUG_PRINT(lightPacket->left_color_r); DEBUG_PRINT("/"); DEBUG_PRINT(lightPacket->left_color_g); DEBUG_PRINT("/"); DEBUG_PRINTLN(lightPacket->left_color_b);
+      received_data->strip[0].packet               = packetId;
+      received_data->strip[0].step                 = 0;
+      received_data->strip[0].last_step            = 0;
+      received_data->strip[0].leds_per_strip       = this->leds_per_strip;
+      received_data->strip[0].delta_time_micros    = 0;
+      received_data->strip[0].effect               = lightPacket->effect;
+      received_data->strip[0].effect_modifier      = lightPacket->effect_modifier;
+      received_data->strip[0].repeat_counter       = lightPacket->repeat_counter;
+      received_data->strip[0].duration_ms          = lightPacket->duration_ms;
+      received_data->strip[0].option               = lightPacket->option;
+      received_data->strip[0].color_r              = lightPacket->left_color_r;
+      received_data->strip[0].color_g              = lightPacket->left_color_g;
+      received_data->strip[0].color_b              = lightPacket->left_color_b;
+      received_data->strip[0].fadein_time_micros   = lightPacket->left_fadein_time * 10000;
+      received_data->strip[0].on_time_micros       = lightPacket->left_on_time * 10000;
+      received_data->strip[0].fadeout_time_micros  = lightPacket->left_fadeout_time * 10000;
+      received_data->strip[0].repeat               = (MODIFIER_REPEAT == (lightPacket->effect_modifier  & MODIFIER_REPEAT));
+    }
+    if (MODIFIER_IGNORE_RIGHT != (lightPacket->effect_modifier & MODIFIER_IGNORE_RIGHT)) {
+      // DEBUG_PRINT("Packet color RGB right: ");
+      // DEBUG_PRINT(lightPacket->right_color_r); DEBUG_PRINT("/"); DEBUG_PRINT(lightPacket->right_color_g); DEBUG_PRINT("/"); DEBUG_PRINTLN(lightPacket->right_color_b);
+      received_data->strip[1].packet               = packetId;
+      received_data->strip[1].step                 = 0;
+      received_data->strip[1].last_step            = 0;
+      received_data->strip[1].leds_per_strip       = this->leds_per_strip;
+      received_data->strip[1].delta_time_micros    = 0;
+      received_data->strip[1].effect               = lightPacket->effect;
+      received_data->strip[1].effect_modifier      = lightPacket->effect_modifier;
+      received_data->strip[1].repeat_counter       = lightPacket->repeat_counter;
+      received_data->strip[1].duration_ms          = lightPacket->duration_ms;
+      received_data->strip[1].option               = lightPacket->option;
+      received_data->strip[1].color_r              = lightPacket->right_color_r;
+      received_data->strip[1].color_g              = lightPacket->right_color_g;
+      received_data->strip[1].color_b              = lightPacket->right_color_b;
+      received_data->strip[1].fadein_time_micros   = lightPacket->right_fadein_time * 10000;
+      received_data->strip[1].on_time_micros       = lightPacket->right_on_time * 10000;
+      received_data->strip[1].fadeout_time_micros  = lightPacket->right_fadeout_time * 10000;
+      received_data->strip[1].repeat               = (MODIFIER_REPEAT == (lightPacket->effect_modifier  & MODIFIER_REPEAT));
+      received_data->strip[1].received             = true;
+    }
+    if (MODIFIER_IGNORE_LEFT != (lightPacket->effect_modifier & MODIFIER_IGNORE_LEFT)) {
+      received_data->strip[0].received             = true;
+    }
+    for (uint8_t lr = 0; lr < 2; lr++) {
+      if (received_data->strip[lr].received) {
+        this->compileStripData(&received_data->strip[lr], lr);
+        // An incomplete envelope would play a truncated effect, the strip is refused
+        if (!this->compileEnvelope(&received_data->strip[lr], &received_data->envelope[lr])) {
+          received_data->strip[lr].received = false;
+        }
+      }
+    }
+  }
+  return (received_data->strip[0].received || received_data->strip[1].received);
+}
+
+
+// Set the start time of compiled strips data, and post them to the light task
+void MlsLightEffects::postLightData(struct RECEIVED_DATA *received_data, uint32_t start_time_micros) {
+  uint32_t received_time_micros = micros();
+  for (uint8_t lr = 0; lr < 2; lr++) {
+    if (received_data->strip[lr].received) {
+      received_data->strip[lr].received_time_micros = received_time_micros;
+      received_data->strip[lr].latency_micros       = received_time_micros - start_time_micros;
+      received_data->strip[lr].start_time_micros    = start_time_micros;
+    }
+  }
+  portENTER_CRITICAL(&this->mailbox_mux);
+  this->mailbox.push(received_data);
+  portEXIT_CRITICAL(&this->mailbox_mux);
+  if ((NULL != this->notify_task) && (NULL != *this->notify_task)) {
+    xTaskNotifyGive(*this->notify_task);
+  }
+}
+
+
+// Compile in advance the light data of an armed effect, played later by fireLightData
+void MlsLightEffects::armLightData(uint8_t armId, struct LIGHT_PACKET *lightPacket) {
+  uint8_t slot = armId % MLS_LIGHT_ARMED_SLOTS;
+  this->armed_valid[slot] = false;
+  if (this->compileLightData(0, lightPacket, &this->armed_data[slot])) {
+    this->armed_id[slot] = armId;
+    this->armed_valid[slot] = true;
+  }
+}
+
+
+// Play an armed effect, with an absolute start time in the master clock (false if the effect is not armed)
+boolean MlsLightEffects::fireLightData(uint8_t armId, uint16_t repeatCounter, uint16_t packetId, uint32_t master_start_time_micros) {
+  uint8_t slot = armId % MLS_LIGHT_ARMED_SLOTS;
+  struct RECEIVED_DATA received_data;
+
+  if ((!this->armed_valid[slot]) || (armId != this->armed_id[slot])) {
+    return false;
+  }
+  if (this->received_packet == packetId) {
+    return true;
+  }
+  this->received_packet = packetId;
+  memcpy(&received_data, &this->armed_data[slot], sizeof(struct RECEIVED_DATA));
+  for (uint8_t lr = 0; lr < 2; lr++) {
+    received_data.strip[lr].packet         = packetId;
+    received_data.strip[lr].repeat_counter = repeatCounter;
+  }
+  if ((NULL == this->clock) || (!this->clock->isSynchronized())) {
+    this->postLightData(&received_data, micros());
+  } else {
+    this->postLightData(&received_data, this->clock->masterToLocal(master_start_time_micros));
+  }
+  return true;
+}
+
+
+// Resolve once the default values of an effect, when the light data is received
+void MlsLightEffects::compileStripData(struct STRIP_DATA *strip_data, uint8_t lr) {
+  switch (strip_data->effect) {
+    case EFFECT_FLASH_YELLOW:
+      strip_data->fadein_time_micros = 0;
+      strip_data->on_time_micros = 30000;
+      strip_data->fadeout_time_micros = 350000;
+      strip_data->color_r = 255; strip_data->color_g = 165; strip_data->color_b = 0;
+      break;
+    case EFFECT_FLASH_ALTERNATE:
+    case EFFECT_3_STEPS_ALTERNATE:
+    case EFFECT_RAINBOW_RANK_BEAT:
+      strip_data->fadein_time_micros = 0;
+      strip_data->on_time_micros = 30000;
+      strip_data->fadeout_time_micros = 350000;
+      break;
+    case EFFECT_STROBE:
+      strip_data->repeat = true;
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = 120;
+      }
+      strip_data->fadein_time_micros = 0;
+      strip_data->on_time_micros = 30000;
+      strip_data->fadeout_time_micros = 0;
+      strip_data->color_r = 255; strip_data->color_g = 255; strip_data->color_b = 255;
+      break;
+    case EFFECT_VUE_METER:
+      if (strip_data->option == 0) {
+        strip_data->option = 50; // Default minimum on time of the max level in ms 
+      }
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = 300; // Default effect duration
+      }
+      break;
+    case EFFECT_WAVE_BACK:
+      if (strip_data->option == 0) {
+        strip_data->option = 50; // Default minimum on time for all in ms
+      }
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = 300; // Default effect duration
+      }
+      break;
+    case EFFECT_3_STEPS:
+      strip_data->fadein_time_micros = 0;
+      strip_data->on_time_micros = 30000;
+      strip_data->fadeout_time_micros = 350000;
+      if (0 == (strip_data->color_r + strip_data->color_g +  strip_data->color_b)) {
+        if (0 == lr) {
+          strip_data->color_r = 0; strip_data->color_g = 255; strip_data->color_b = 0;
+        } else {
+          strip_data->color_r = 255; strip_data->color_g = 0; strip_data->color_b = 0;
         }
       }
-      
-      if (MODIFIER_IGNORE_LEFT != (lightPacket->effect_modifier & MODIFIER_IGNORE_LEFT)) {
-        // DEBUG_PRINT("Packet color RGB left: ");
-        // DEBUG_PRINT(lightPacket->left_color_r); DEBUG_PRINT("/"); DEBUG_PRINT(lightPacket->left_color_g); DEBUG_PRINT("/"); DEBUG_PRINTLN(lightPacket->left_color_b);
-        this->data_received[0].received             = false;
-        this->data_received[0].received_time_micros = micros();
-        this->data_received[0].packet               = packetId;
-        this->data_received[0].step                 = 0;
-        this->data_received[0].last_step            = 0;
-        this->data_received[0].leds_per_strip       = this->leds_per_strip;
-        this->data_received[0].latency_micros       = latency_micros;
-        this->data_received[0].start_time_micros    = this->data_received[0].received_time_micros + latency_micros;
-        this->data_received[0].delta_time_micros    = 0;
-        this->data_received[0].effect               = lightPacket->effect;
-        this->data_received[0].effect_modifier      = lightPacket->effect_modifier;
-        this->data_received[0].repeat_counter       = lightPacket->repeat_counter;
-        this->data_received[0].duration_ms          = lightPacket->duration_ms;
-        this->data_received[0].option               = lightPacket->option;
-        this->data_received[0].color_r              = lightPacket->left_color_r;
-        this->data_received[0].color_g              = lightPacket->left_color_g;
-        this->data_received[0].color_b              = lightPacket->left_color_b;
-        this->data_received[0].fadein_time_micros   = lightPacket->left_fadein_time * 10000;
-        this->data_received[0].on_time_micros       = lightPacket->left_on_time * 10000;
-        this->data_received[0].fadeout_time_micros  = lightPacket->left_fadeout_time * 10000;
-        this->data_received[0].repeat               = (MODIFIER_REPEAT == (lightPacket->effect_modifier  & MODIFIER_REPEAT));
+      break;
+    case EFFECT_HEARTBEAT:
+      strip_data->repeat = true;
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = 1000; // Default effect duration
+      }
+      if (strip_data->option == 0) {
+        strip_data->option = 224; // Default diastole brigthtness
+      }
+      if ((0 == strip_data->color_r) && (0 == strip_data->color_g) && (0 == strip_data->color_b)) {
+        strip_data->color_r = 255; strip_data->color_g = 0; strip_data->color_b = 0;
       }
-      if (MODIFIER_IGNORE_RIGHT != (lightPacket->effect_modifier & MODIFIER_IGNORE_RIGHT)) {
-        // DEBUG_PRINT("Packet color RGB right: ");
-        // DEBUG_PRINT(lightPacket->right_color_r); DEBUG_PRINT("/"); DEBUG_PRINT(lightPacket->right_color_g); DEBUG_PRINT("/"); DEBUG_PRINTLN(lightPacket->right_color_b);
-        this->data_received[1].received             = false;
-        this->data_received[1].received_time_micros = micros();
-        this->data_received[1].packet               = packetId;
-        this->data_received[1].step                 = 0;
-        this->data_received[1].last_step            = 0;
-        this->data_received[1].leds_per_strip       = this->leds_per_strip;
-        this->data_received[1].latency_micros       = latency_micros;
-        this->data_received[1].start_time_micros    = this->data_received[1].received_time_micros + latency_micros;
-        this->data_received[1].delta_time_micros    = 0;
-        this->data_received[1].effect               = lightPacket->effect;
-        this->data_received[1].effect_modifier      = lightPacket->effect_modifier;
-        this->data_received[1].repeat_counter       = lightPacket->repeat_counter;
-        this->data_received[1].duration_ms          = lightPacket->duration_ms;
-        this->data_received[1].option               = lightPacket->option;
-        this->data_received[1].color_r              = lightPacket->right_color_r;
-        this->data_received[1].color_g              = lightPacket->right_color_g;
-        this->data_received[1].color_b              = lightPacket->right_color_b;
-        this->data_received[1].fadein_time_micros   = lightPacket->right_fadein_time * 10000;
-        this->data_received[1].on_time_micros       = lightPacket->right_on_time * 10000;
-        this->data_received[1].fadeout_time_micros  = lightPacket->right_fadeout_time * 10000;
-        this->data_received[1].repeat               = (MODIFIER_REPEAT == (lightPacket->effect_modifier  & MODIFIER_REPEAT));
-        this->data_received[1].received             = true;
+      break;
+    case EFFECT_PROGRESS4:
+      strip_data->option = 4;
+    case EFFECT_PROGRESS:
+      strip_data->repeat = true;
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = 300;
       }
-      if (MODIFIER_IGNORE_LEFT != (lightPacket->effect_modifier & MODIFIER_IGNORE_LEFT)) {
-        this->data_received[0].received             = true;
+      if (strip_data->option == 0) {
+        strip_data->option = 3;
       }
+      break;
+    case EFFECT_PROGRESS_RAINBOW:
+      strip_data->repeat = true;
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = 300;
+      }
+      break;
+    case EFFECT_BREATH:
+      strip_data->repeat = true;
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = 5000; // Default effect duration
+      }
+      if ((0 == strip_data->color_r) && (0 == strip_data->color_g) && (0 == strip_data->color_b)) {
+        strip_data->color_r = 0; strip_data->color_g = 255; strip_data->color_b = 0;
+      }
+      break;
+    case EFFECT_FIREFLY:
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = random(1, FIREFLIES_GAP_MAXIMUM); // Default effect duration
+      }
+      break;
+    case EFFECT_STARS:
+      if (strip_data->duration_ms == 0) {
+        strip_data->duration_ms = random(1, STARS_GAP_MAXIMUM); // Default effect duration
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+
+// Compile once the brightness envelope of an effect, when the light data is received (false if the envelope is incomplete)
+boolean MlsLightEffects::compileEnvelope(struct STRIP_DATA *strip_data, MlsEnvelope *envelope) {
+  uint8_t effective_ranks = this->number_of_ranks;
+  uint8_t effective_rank = this->my_rank;
+  uint32_t shift_delay_micros;
+  uint32_t fadein_time_micros = 0;
+  uint32_t rank_start_delay_micros;
+
+  if (effective_ranks < 2) {
+    effective_ranks = 2;
+  }
+  if (effective_rank < 1) {
+    effective_rank = 1;
+  }
+
+  switch (strip_data->effect) {
+    case EFFECT_HEARTBEAT: {
+      uint32_t systole_fadein_time_micros = 50 * strip_data->duration_ms;    // 5% of total duration
+      uint32_t systole_on_time_micros = 100 * strip_data->duration_ms;       // 10% of total duration
+      uint32_t systole_fadeout_time_micros = 300 * strip_data->duration_ms;  // 25% of total duration (but diastole is coming before the end)
+      uint32_t diastole_time_micros = 350 * strip_data->duration_ms;         // Diastole appears at 35% of whole signal
+      uint32_t diastole_on_time_micros = 100 * strip_data->duration_ms;      // 10% of total duration
+      uint32_t diastole_fadeout_time_micros = 450 * strip_data->duration_ms; // 45% of total duration
+      uint32_t systole_cut_time_micros = diastole_time_micros - systole_fadein_time_micros - systole_on_time_micros;
+
+      envelope->begin(this->getEnvelopeKey(), 0);
+      envelope->ramp(systole_fadein_time_micros, 255);
+      envelope->hold(systole_on_time_micros);
+      if (systole_fadeout_time_micros > 0) {
+        envelope->ramp(systole_cut_time_micros, 255 * (systole_fadeout_time_micros - systole_cut_time_micros) / systole_fadeout_time_micros);
+      }
+      envelope->jump(strip_data->option);
+      envelope->hold(diastole_on_time_micros);
+      envelope->ramp(diastole_fadeout_time_micros, 0);
+      break;
     }
+    case EFFECT_BREATH:
+      envelope->compileFade(this->getEnvelopeKey(), 0, 350 * strip_data->duration_ms, 100 * strip_data->duration_ms, 350 * strip_data->duration_ms, 63, 255);
+      break;
+    case EFFECT_VUE_METER:
+      // The ranks are lit one after the other up to the last one, and switched off in the reverse order
+      shift_delay_micros = 1000 * (strip_data->duration_ms - strip_data->option) / (2 * (effective_ranks - 1));
+      rank_start_delay_micros = (effective_rank - 1) * shift_delay_micros;
+      if (this->my_rank > 1) {
+        fadein_time_micros = shift_delay_micros;
+        rank_start_delay_micros = rank_start_delay_micros - fadein_time_micros;
+      }
+      envelope->compileFade(this->getEnvelopeKey(), rank_start_delay_micros, fadein_time_micros,
+                            (1000 * strip_data->option) + (2 * (effective_ranks - effective_rank) * shift_delay_micros), shift_delay_micros, 0, 255);
+      break;
+    case EFFECT_WAVE_BACK:
+      // The ranks are lit one after the other, and all switched off together
+      shift_delay_micros = 1000 * (strip_data->duration_ms - strip_data->option) / (effective_ranks - 1);
+      rank_start_delay_micros = (effective_rank - 1) * shift_delay_micros;
+      if (this->my_rank > 1) {
+        fadein_time_micros = shift_delay_micros;
+        rank_start_delay_micros = rank_start_delay_micros - fadein_time_micros;
+      }
+      envelope->compileFade(this->getEnvelopeKey(), rank_start_delay_micros, fadein_time_micros,
+                            (1000 * strip_data->option) + ((effective_ranks - effective_rank) * shift_delay_micros) + rank_start_delay_micros, shift_delay_micros, 0, 255);
+      break;
+    default:
+      // Fade in, on and fade out of the flip data (the firefly and the stars compile their own envelope at each birth)
+      envelope->compileFade(this->getEnvelopeKey(), 0, strip_data->fadein_time_micros, strip_data->on_time_micros, strip_data->fadeout_time_micros, 0, 255);
+      break;
   }
+  if (!envelope->isComplete()) {
+    DEBUG_PRINT("Envelope of effect "); DEBUG_PRINT(strip_data->effect); DEBUG_PRINTLN(" has too many segments");
+    return false;
+  }
+  return true;
 }
 
 
 void MlsLightEffects::updateLight() {
+  this->updateLight(micros());
+}
+
+
+// Render one frame at a given time (the clock is read only once per frame)
+void MlsLightEffects::updateLight(uint32_t now_micros) {
   struct CRGB *current_strip;
   struct STRIP_DATA *actual_data;
+  struct STRIP_DATA *start_data;
   uint8_t effect_changed[2];
 
-  uint16_t option = 0;
+  this->frame_time_micros = now_micros;
 
-  // Loop for both strips (left and right) - prepare flip data
   for (uint8_t lr = 0; lr < 2; lr++) {
     this->data_actual[lr].applied = false;
-    if ((this->data_received[lr].received) && ((micros() - this->data_received[lr].start_time_micros) >= 0)) {
-      this->data_received[lr].received = false;
-      effect_changed[lr] = (this->data_actual[lr].effect != this->data_received[lr].effect);
-      memcpy(this->data_actual[lr].raw, this->data_received[lr].raw, STRIP_DATA_SIZE);
-      memcpy(this->data_flip[lr].raw, this->data_actual[lr].flip_data, FLIP_DATA_SIZE);
-      this->data_actual[lr].applied = true;
-      // DEBUG_PRINT("*** updateLight *** "); DEBUG_PRINTLN(lr);
+    effect_changed[lr] = false;
+  }
+
+  // Apply in order all the received data which have reached their start time - prepare flip data
+  // (a packet with a start time in the future is waiting, the current effect is still running)
+  while (this->data_waiting || this->mailbox.pop(&this->data_received)) {
+    this->data_waiting = true;
+    // Both strips have the same start time
+    start_data = this->data_received.strip[0].received ? &this->data_received.strip[0] : &this->data_received.strip[1];
+    if (((int32_t) (this->frame_time_micros - start_data->start_time_micros)) < 0) {
+      break;
+    }
+    this->data_waiting = false;
+    for (uint8_t lr = 0; lr < 2; lr++) {
+      if (this->data_received.strip[lr].received) {
+        effect_changed[lr] = effect_changed[lr] || (this->data_actual[lr].effect != this->data_received.strip[lr].effect);
+        memcpy(this->data_actual[lr].raw, this->data_received.strip[lr].raw, STRIP_DATA_SIZE);
+        memcpy(this->data_flip[lr].raw, this->data_actual[lr].flip_data, FLIP_DATA_SIZE);
+        this->envelope[lr] = this->data_received.envelope[lr];
+        this->data_actual[lr].applied = true;
+      }
     }
   }
 
@@ -651,30 +896,38 @@ void MlsLightEffects::updateLight() {
 
     if (effect_changed[lr]) {
       actual_data->last_step = 65535;
-      actual_data->start_time_micros = micros() - actual_data->latency_micros;
       this->play_counter[lr] = actual_data->repeat_counter;
       this->current_play_counter[lr] = actual_data->repeat_counter;
     } else if (actual_data->repeat) {
-      this->play_counter[lr] = actual_data->repeat_counter + ((micros() - actual_data->start_time_micros) / (1000 * actual_data->duration_ms));
+      this->play_counter[lr] = actual_data->repeat_counter + ((this->frame_time_micros - actual_data->start_time_micros) / (1000 * actual_data->duration_ms));
     } else {
       this->play_counter[lr] = actual_data->repeat_counter; // To be sure that the flip is syncrhonized between all musicians
     }
 
     if (actual_data->repeat) {
-      actual_data->delta_time_micros  = (micros() - actual_data->start_time_micros) % (1000 * actual_data->duration_ms);
+      actual_data->delta_time_micros  = (this->frame_time_micros - actual_data->start_time_micros) % (1000 * actual_data->duration_ms);
     } else {
-      actual_data->delta_time_micros  = micros() - actual_data->start_time_micros;
+      actual_data->delta_time_micros  = this->frame_time_micros - actual_data->start_time_micros;
     }
 
     if (effect_changed[lr] || actual_data->applied || (this->play_counter[lr] != this->current_play_counter[lr])) {
 
+      // The envelope follows the fade times of the flip data
       if ((MODIFIER_FLIP_FLOP == (actual_data->effect_modifier & MODIFIER_FLIP_FLOP)) && (0 != (this->play_counter[lr] % 2))) {
         memcpy(actual_data->flip_data, this->data_flip[(lr + 1) % 2].raw, FLIP_DATA_SIZE);
+        this->strip_envelope[lr] = &this->envelope[(lr + 1) % 2];
       } else {
         memcpy(actual_data->flip_data, this->data_flip[lr].raw, FLIP_DATA_SIZE);
+        this->strip_envelope[lr] = &this->envelope[lr];
       }
     }
 
+    // Compiled when the light data was received (or armed), unless the ranks have changed since
+    if (!this->strip_envelope[lr]->isCompiled(this->getEnvelopeKey())) {
+      this->compileEnvelope(actual_data, this->strip_envelope[lr]);
+      this->render_compilations++;
+    }
+
     this->current_play_counter[lr] = this->play_counter[lr];
     if ((!effect_changed[lr]) && actual_data->applied) {
       this->play_counter[lr]++;
@@ -688,103 +941,34 @@ void MlsLightEffects::updateLight() {
           this->fill(CRGB::Black, actual_data->leds_per_strip, current_strip);
           break;
         case EFFECT_FLASH_YELLOW:
-          actual_data->fadein_time_micros = 0;
-          actual_data->on_time_micros = 30000;
-          actual_data->fadeout_time_micros = 350000;
-          actual_data->color_r = 255; actual_data->color_g = 165; actual_data->color_b = 0;
-          this->effectFlash(actual_data, current_strip);
-          break;
         case EFFECT_FLASH_ALTERNATE:
-          actual_data->fadein_time_micros = 0;
-          actual_data->on_time_micros = 30000;
-          actual_data->fadeout_time_micros = 350000;
-          this->effectFlash(actual_data, current_strip);
-          break;
         case EFFECT_STROBE:
-          actual_data->repeat = true;
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = 120;
-          }
-          actual_data->fadein_time_micros = 0;
-          actual_data->on_time_micros = 30000;
-          actual_data->fadeout_time_micros = 0;
-          actual_data->color_r = 255; actual_data->color_g = 255; actual_data->color_b = 255;
         case EFFECT_FLASH:
-          this->effectFlash(actual_data, current_strip);
+          this->effectFlash(actual_data, current_strip, lr);
           break;
         case EFFECT_VUE_METER:
-          if (actual_data->option == 0) {
-            actual_data->option = 50; // Default minimum on time of the max level in ms 
-          }
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = 300; // Default effect duration
-          }
-          this->effectVueMeter(actual_data, current_strip);
+          this->effectVueMeter(actual_data, current_strip, lr);
           break;
         case EFFECT_WAVE_BACK:
-          if (actual_data->option == 0) {
-            actual_data->option = 50; // Default minimum on time for all in ms
-          }
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = 300; // Default effect duration
-          }
-          this->effectWaveBack(actual_data, current_strip);
+          this->effectWaveBack(actual_data, current_strip, lr);
           break;
         case EFFECT_3_STEPS_ALTERNATE:
-          actual_data->fadein_time_micros = 0;
-          actual_data->on_time_micros = 30000;
-          actual_data->fadeout_time_micros = 350000;
-          this->effectThreeStepsAlternate(actual_data, current_strip);
+          this->effectThreeStepsAlternate(actual_data, current_strip, lr);
           break;
         case EFFECT_3_STEPS:
-          actual_data->fadein_time_micros = 0;
-          actual_data->on_time_micros = 30000;
-          actual_data->fadeout_time_micros = 350000;
-          if (0 == (actual_data->color_r + actual_data->color_g +  actual_data->color_b)) {
-            if (0 == lr) {
-              actual_data->color_r = 0; actual_data->color_g = 255; actual_data->color_b = 0;
-            } else {
-              actual_data->color_r = 255; actual_data->color_g = 0; actual_data->color_b = 0;
-            }
-          }
-          this->effectThreeSteps(actual_data, current_strip);
+          this->effectThreeSteps(actual_data, current_strip, lr);
           break;
         case EFFECT_RAINBOW_RANK_BEAT:
-          actual_data->fadein_time_micros = 0;
-          actual_data->on_time_micros = 30000;
-          actual_data->fadeout_time_micros = 350000;
-          this->effectRainbowRankBeat(actual_data, current_strip);
+          this->effectRainbowRankBeat(actual_data, current_strip, lr);
           break;
         case EFFECT_HEARTBEAT:
-          actual_data->repeat = true;
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = 1000; // Default effect duration
-          }
-          if (actual_data->option == 0) {
-            actual_data->option = 224; // Default diastole brigthtness
-          }
-          if ((0 == actual_data->color_r) && (0 == actual_data->color_g) && (0 == actual_data->color_b)) {
-            actual_data->color_r = 255; actual_data->color_g = 0; actual_data->color_b = 0;
-          }
-          this->effectHeartbeat(actual_data, current_strip);
+          this->effectHeartbeat(actual_data, current_strip, lr);
           break;
         case EFFECT_PROGRESS4:
-          actual_data->option = 4;
         case EFFECT_PROGRESS:
-          actual_data->repeat = true;
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = 300;
-          }
-          if (actual_data->option == 0) {
-            actual_data->option = 3;
-          }
           this->effectProgress(actual_data, current_strip);
           break;
         case EFFECT_PROGRESS_RAINBOW:
-          actual_data->repeat = true;
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = 300;
-          }
           this->effectProgressRainbow(actual_data, current_strip);
           break;
         case EFFECT_FIXED:
@@ -797,26 +981,13 @@ void MlsLightEffects::updateLight() {
           // this->effectPolice(actual_data, current_strip);
           break;
         case EFFECT_BREATH:
-          actual_data->repeat = true;
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = 5000; // Default effect duration
-          }
-          if ((0 == actual_data->color_r) && (0 == actual_data->color_g) && (0 == actual_data->color_b)) {
-            actual_data->color_r = 0; actual_data->color_g = 255; actual_data->color_b = 0;
-          }
-          this->effectBreath(actual_data, current_strip);
+          this->effectBreath(actual_data, current_strip, lr);
           break;
         case EFFECT_FIREFLY:
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = random(1, FIREFLIES_GAP_MAXIMUM); // Default effect duration
-          }
-          this->effectFirefly(actual_data, current_strip);
+          this->effectFirefly(actual_data, current_strip, lr);
           break;
         case EFFECT_STARS:
-          if (actual_data->duration_ms == 0) {
-            actual_data->duration_ms = random(1, STARS_GAP_MAXIMUM); // Default effect duration
-          }
-          this->effectStars(actual_data, current_strip);
+          this->effectStars(actual_data, current_strip, lr);
           break;
         default:
           break;
@@ -829,8 +1000,17 @@ void MlsLightEffects::updateLight() {
 
 // Fill with a specific color the number of LEDs of a strip
 void MlsLightEffects::fill(struct CRGB color, uint16_t number_of_leds, struct CRGB *strip) {
+  struct CRGB gamma_color = CRGB(pgm_read_byte(&gamma8[color.r]),  pgm_read_byte(&gamma8[color.g]),  pgm_read_byte(&gamma8[color.b]));
+  boolean changed = false;
   for (uint16_t i = 0; i < number_of_leds; i++) {
-    strip[i] = CRGB(pgm_read_byte(&gamma8[color.r]),  pgm_read_byte(&gamma8[color.g]),  pgm_read_byte(&gamma8[color.b]));
+    if ((strip[i].r != gamma_color.r) || (strip[i].g != gamma_color.g) || (strip[i].b != gamma_color.b)) {
+      strip[i] = gamma_color;
+      changed = true;
+    }
+  }
+  // Most of the frames of an effect are not changing the strip
+  if (changed) {
+    this->setDirty(strip);
   }
 }
 
@@ -854,6 +1034,7 @@ void MlsLightEffects::setValue(uint16_t value, uint16_t maxValue, struct CRGB co
   for (uint16_t i = maxValue; i < this->leds_per_strip; i++) {
     strip[i] = CRGB::Black;
   }
+  this->setDirty(strip);
 }
 
 
@@ -878,15 +1059,41 @@ void MlsLightEffects::setValueThree(uint16_t value, uint16_t maxValue, struct CR
   for (uint16_t i = maxValue; i < this->leds_per_strip; i++) {
     strip[i] = CRGB::Black;
   }
+  this->setDirty(strip);
+}
+
+
+// The strip has been written, showLeds must check it
+void MlsLightEffects::setDirty(struct CRGB *strip) {
+  if (strip == this->left_strip) {
+    this->dirty[0] = true;
+  } else if (strip == this->right_strip) {
+    this->dirty[1] = true;
+  }
 }
 
 
+// Show the strips, only if they have changed since the last show
 void MlsLightEffects::showLeds() {
-  // Warning! The ledp strip structure is on 3 bytes !!!
-  if ((memcmp(this->left_strip, this->last_left_strip, 3 * this->leds_per_strip) != 0) || (memcmp(this->right_strip, this->last_right_strip, 3 * this->leds_per_strip) != 0)) {
-    memcpy(last_left_strip,  left_strip,  3 * this->leds_per_strip);
-    memcpy(last_right_strip, right_strip, 3 * this->leds_per_strip);
-    FastLED.show();
+  struct CRGB *strips[2] = {this->left_strip, this->right_strip};
+  boolean changed[2] = {false, false};
+
+  for (uint8_t lr = 0; lr < 2; lr++) {
+    if (NULL == this->last_strip[lr]) {
+      // No shown strip before begin()
+      changed[lr] = this->dirty[lr];
+      this->dirty[lr] = false;
+    } else if (this->dirty[lr]) {
+      this->dirty[lr] = false;
+      // Warning! The ledp strip structure is on 3 bytes !!!
+      if (memcmp(strips[lr], this->last_strip[lr], 3 * this->leds_per_strip) != 0) {
+        memcpy(this->last_strip[lr], strips[lr], 3 * this->leds_per_strip);
+        changed[lr] = true;
+      }
+    }
+  }
+  if (NULL != this->led_driver) {
+    this->led_driver->show(changed[0], changed[1]);
   }
 }
 
@@ -896,6 +1103,8 @@ void MlsLightEffects::clearLeds() {
     this->left_strip[i]  = CRGB::Black;
     this->right_strip[i] = CRGB::Black;
   }
+  this->setDirty(this->left_strip);
+  this->setDirty(this->right_strip);
 }
 
 
@@ -12,6 +12,11 @@
 
   #include "mls_config.h"
   #include "DebugTools.h"
+  #include "mls_clock.h"
+  #include "mls_mailbox.h"
+  #include "mls_envelope.h"
+  #include "mls_led_driver.h"
+  #include "mls_arena.h"
 
   #include "FastLED.h"
   #include <stdint.h>
@@ -193,6 +198,12 @@
   const uint8_t STRIP_DATA_SIZE = sizeof(STRIP_DATA);
 
 
+  struct RECEIVED_DATA {              // Light data received for both strips (received flag set if the strip is concerned)
+    struct STRIP_DATA strip[2];
+    MlsEnvelope envelope[2];          // Brightness envelopes compiled from the flip data of each strip
+  };
+
+
   struct LIGHT_PACKET {               // Light packet (LIGHT DATA payload)
     union {
       struct {
@@ -233,41 +244,71 @@
   class MlsLightEffects {
     
     private:
-      struct STRIP_DATA data_received[2];
+      MlsMailbox<struct RECEIVED_DATA, MLS_LIGHT_MAILBOX_SIZE> mailbox; // Written by the protocol task and the loop, read by TaskUpdateLight
+      portMUX_TYPE mailbox_mux = portMUX_INITIALIZER_UNLOCKED;           // The master has two producers (loop and protocol task)
+      struct RECEIVED_DATA data_received;                                // Next light data, waiting for its start time
+      boolean data_waiting;
+      TaskHandle_t *notify_task;                                         // Task to wake up when a new light data is received
       struct STRIP_DATA data_actual[2];
       struct FLIP_DATA data_flip[2];
+      MlsEnvelope envelope[2];                                           // Brightness envelopes of the flip data of each strip
+      MlsEnvelope *strip_envelope[2];                                    // Envelope of the flip data currently drawn by each strip
+      uint16_t render_compilations;                                      // Envelopes compiled by the render path
       uint16_t play_counter[2];
       uint16_t current_play_counter[2];
       struct CRGB *left_strip;
       struct CRGB *right_strip;
-      struct CRGB last_left_strip[NUM_LEDS_PER_STRIP];
-      struct CRGB last_right_strip[NUM_LEDS_PER_STRIP];
+      struct CRGB *last_strip[2];                                        // Last shown strips (carved from the arena)
+      volatile boolean dirty[2];                                         // Strip written since the last show
+      MlsLedDriver *led_driver;                                          // Output of the changed strips
       uint16_t received_packet;
       uint16_t leds_per_strip;
+      uint16_t max_leds_per_strip;                                       // Size of the strip buffers
   	  uint8_t number_of_columns = 4;
 	    uint8_t number_of_ranks = 8;
       uint8_t my_column;
       uint8_t my_rank;
+      MlsClock *clock;
+      uint32_t frame_time_micros;                                        // Time of the frame being rendered
+      struct RECEIVED_DATA armed_data[MLS_LIGHT_ARMED_SLOTS];            // Compiled light data of the armed effects, waiting for their fire
+      uint8_t armed_id[MLS_LIGHT_ARMED_SLOTS];
+      boolean armed_valid[MLS_LIGHT_ARMED_SLOTS];
+      boolean compileLightData(uint16_t packetId, struct LIGHT_PACKET *lightData, struct RECEIVED_DATA *received_data);
+      void postLightData(struct RECEIVED_DATA *received_data, uint32_t start_time_micros);
+      void setLightDataAt(uint16_t packetId, struct LIGHT_PACKET *lightData, uint32_t start_time_micros);
+      uint8_t divide255(uint16_t value);
+      uint32_t getEnvelopeKey();
+      void setDirty(struct CRGB *strip);
+      void compileStripData(struct STRIP_DATA *strip_data, uint8_t lr);
+      boolean compileEnvelope(struct STRIP_DATA *strip_data, MlsEnvelope *envelope);
 
     public:
       MlsLightEffects(uint16_t leds_per_strip, struct CRGB *left_strip, struct CRGB *right_strip);
+      boolean begin(MlsArena *arena, uint16_t leds_per_strip);
+      void armLightData(uint8_t armId, struct LIGHT_PACKET *lightData);
       void clearLeds();
-      void effectBreath(struct STRIP_DATA *actual_data, struct CRGB *strip);
+      void effectBreath(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
       void effectCheck(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
-      void effectFirefly(struct STRIP_DATA *actual_data, struct CRGB *strip);
+      void effectFirefly(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
       void effectFixed(struct STRIP_DATA *actual_data, struct CRGB *strip);
-      void effectFlash(struct STRIP_DATA *actual_data, struct CRGB *strip);
-      void effectHeartbeat(struct STRIP_DATA *actual_data, struct CRGB *strip);
+      void effectFlash(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
+      void effectHeartbeat(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
       void effectProgress(struct STRIP_DATA *actual_data, struct CRGB *strip);
       void effectProgressRainbow(struct STRIP_DATA *actual_data, struct CRGB *strip);
-      void effectRainbowRankBeat(struct STRIP_DATA *actual_data, struct CRGB *strip);
-      void effectStars(struct STRIP_DATA *actual_data, struct CRGB *strip);
-      void effectThreeSteps(struct STRIP_DATA *actual_data, struct CRGB *strip);
-      void effectThreeStepsAlternate(struct STRIP_DATA *actual_data, struct CRGB *strip);
-      void effectVueMeter(struct STRIP_DATA *actual_data, struct CRGB *strip);
-      void effectWaveBack(struct STRIP_DATA *actual_data, struct CRGB *strip);
+      void effectRainbowRankBeat(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
+      void effectStars(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
+      void effectThreeSteps(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
+      void effectThreeStepsAlternate(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
+      void effectVueMeter(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
+      void effectWaveBack(struct STRIP_DATA *actual_data, struct CRGB *strip, uint8_t lr);
       void fill(struct CRGB color, uint16_t number_of_leds, struct CRGB *strip);
+      boolean fireLightData(uint8_t armId, uint16_t repeatCounter, uint16_t packetId, uint32_t master_start_time_micros);
       uint8_t getColumns();
+      boolean getWaitingStartTime(uint32_t *start_time_micros);
+      uint8_t getMailboxHighWater();
+      uint16_t getMailboxOverruns();
+      uint16_t getMailboxRetries();
+      uint16_t getRenderCompilations();
       uint8_t getMyColumn();
       uint8_t getMyRank();
       uint8_t getRanks();
@@ -275,7 +316,11 @@
       void setLedsPerStrip(uint16_t leds_per_strip);
       void setLightData(uint16_t packetId, struct LIGHT_PACKET *lightData);
       void setLightData(uint16_t packetId, struct LIGHT_PACKET *lightData, uint32_t latency_micros);
+      void setLightDataMasterTime(uint16_t packetId, struct LIGHT_PACKET *lightData, uint32_t master_start_time_micros);
+      void setClock(MlsClock *clock);
+      void setLedDriver(MlsLedDriver *led_driver);
       void setMyColumn(uint8_t column);
+      void setNotifyTask(TaskHandle_t *task);
       void setMyRank(uint8_t rank);
       void setRanks(uint8_t number_of_ranks);
       void setStrips(struct CRGB *left_strip, struct CRGB *right_strip);
@@ -284,6 +329,7 @@
       void showLeds();
       void stopUpdate();
       void updateLight();
+      void updateLight(uint32_t now_micros);
       struct CRGB adjustBrightness(struct CRGB color, uint8_t brightness);
   };
 
@@ -0,0 +1,129 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_mailbox.h
+ * @brief Lock-free single producer / single consumer mailbox
+ *
+ * Bounded queue of SIZE slots (power of 2) between two tasks, which can
+ * run on different cores. When the queue is full, the producer never
+ * waits: it overwrites the oldest slot. Each slot is protected by a
+ * sequence number (seqlock), which is odd during the write. The consumer
+ * checks the sequence number before and after the copy, and retries with
+ * the next slot if the copy was overwritten in the meantime.
+ *
+ **********************************************************************/
+#ifndef MLS_MAILBOX_H
+#define MLS_MAILBOX_H
+
+  #include <Arduino.h>
+  #include <stdint.h>
+  #include <string.h>
+
+
+  template <typename T, uint8_t SIZE>
+  class MlsMailbox {
+
+    protected:
+      struct MAILBOX_SLOT {
+        volatile uint32_t sequence;   // 2 * (index + 1) when the slot contains the item index, odd during the write
+        T data;
+      };
+      struct MAILBOX_SLOT slots[SIZE];
+      volatile uint32_t write_index;  // Only written by the producer
+      volatile uint32_t read_index;   // Only written by the consumer
+      volatile uint16_t overruns;     // Items overwritten before being read
+      volatile uint16_t retries;      // Torn reads detected (and retried) by the consumer
+      volatile uint8_t high_water;    // Maximum number of items waiting in the mailbox
+
+    public:
+      MlsMailbox() {
+        this->clear();
+      }
+
+      void clear() {
+        // The sequence numbers are enough, the data of a slot is only read after its write
+        for (uint8_t i = 0; i < SIZE; i++) {
+          this->slots[i].sequence = 0;
+        }
+        this->write_index = 0;
+        this->read_index = 0;
+        this->overruns = 0;
+        this->retries = 0;
+        this->high_water = 0;
+      }
+
+      // Producer side, never blocks
+      void push(const T *item) {
+        uint32_t index = this->write_index;
+        struct MAILBOX_SLOT *slot = &this->slots[index % SIZE];
+        uint32_t waiting = index - this->read_index;
+
+        if (waiting >= SIZE) {
+          this->overruns++;
+          waiting = SIZE - 1;
+        }
+        slot->sequence = (2 * index) + 1;
+        __sync_synchronize();
+        memcpy(&slot->data, item, sizeof(T));
+        __sync_synchronize();
+        slot->sequence = 2 * (index + 1);
+        __sync_synchronize();
+        this->write_index = index + 1;
+        if ((waiting + 1) > this->high_water) {
+          this->high_water = waiting + 1;
+        }
+      }
+
+      // Consumer side, false if the mailbox is empty
+      boolean pop(T *item) {
+        uint32_t index;
+        uint32_t sequence;
+        struct MAILBOX_SLOT *slot;
+
+        while (true) {
+          uint32_t written = this->write_index;
+          __sync_synchronize();
+          index = this->read_index;
+          if (index == written) {
+            return false;
+          }
+          // The oldest items have already been overwritten by the producer
+          if ((written - index) > SIZE) {
+            index = written - SIZE;
+          }
+          slot = &this->slots[index % SIZE];
+          sequence = slot->sequence;
+          __sync_synchronize();
+          memcpy(item, &slot->data, sizeof(T));
+          __sync_synchronize();
+          if ((sequence == (2 * (index + 1))) && (sequence == slot->sequence)) {
+            this->read_index = index + 1;
+            return true;
+          }
+          // Torn read, this item is lost, try the next one
+          this->retries++;
+          this->read_index = index + 1;
+        }
+      }
+
+      uint8_t available() {
+        uint32_t waiting = this->write_index - this->read_index;
+        return (waiting > SIZE) ? SIZE : waiting;
+      }
+
+      uint16_t getOverruns() {
+        return this->overruns;
+      }
+
+      uint16_t getRetries() {
+        return this->retries;
+      }
+
+      uint8_t getHighWater() {
+        return this->high_water;
+      }
+  };
+
+#endif
@@ -20,17 +20,22 @@
   #include "esp_wifi.h"
 
   #define MLS_ACTION_KEEP_ALIVE     0   // Packet is ignored, keep alive only
+  #define MLS_ACTION_STATE_BEACON   1   // Keep alive with the state of the current effect, and its colors (see STATE_BEACON_PACKET)
+  #define MLS_ACTION_STATE_FADES    2   // Keep alive with the state of the current effect, and its fade times (see STATE_BEACON_PACKET)
   #define MLS_ACTION_REBOOT         99  // Reset the device
   #define MLS_ACTION_FORCE_UPDATE   199 // Force the firmware update
 
   #define MLS_TOPOLOGY_KEEP_ALIVE   0
   #define MLS_TOPOLOGY_REQUEST      1
   #define MLS_TOPOLOGY_REPLY        2
+  #define MLS_TOPOLOGY_BATCH_REPLY  3   // Several replies in one packet (see TOPOLOGY_BATCH_PACKET)
 
   #define MLS_TYPE_TOPOLOGY_DATA    1
   #define MLS_TYPE_ACTION_DATA      2
   #define MLS_TYPE_LIGHT_DATA       3
   #define MLS_TYPE_ACK_LIGHT_DATA   4
+  #define MLS_TYPE_ARM_DATA         5   // Payload is LIGHT_PACKET, repeat_counter is the arm id
+  #define MLS_TYPE_FIRE_DATA        6   // Short packet (MLS_FIRE_PACKET), expanded in a MLS_PACKET with FIRE_PACKET payload
   #define MLS_TYPE_MODIFIER_UNICAST 0x20
   #define MLS_TYPE_MODIFIER_GROUP   0x40
 
@@ -57,6 +62,8 @@
                                          //              0x02: ACTION DATA (payload is ACTION_PACKET)
                                          //              0x03: LIGHT DATA  (payload is LIGHT_PACKET)
                                          //              0x04: ACK LIGHT DATA (like LIGHT DATA, but sent back from all devices)
+                                         //              0x05: ARM DATA (payload is LIGHT_PACKET, effect played later by a FIRE DATA)
+                                         //              0x06: FIRE DATA (payload is FIRE_PACKET, sent as a short MLS_FIRE_PACKET)
                                          //             +0x20: UNICAST destination packet (Device ID is in DESTINATION_ID)
                                          //             +0x40: GROUP destination packet (Group ID is in DESTINATION_ID)
             uint8_t RESERVED;            // Reserved for future use
@@ -76,7 +83,8 @@
                                          //     0: 0 to -40 dBm , and -3dBm per step (1: down to -34dBm, 2: down to -38dBm, ... 14: down to -82dBm, 15 : -83dBm and lower
                                          //  4: Rescaled RSSI in 4 x 2 bits
                                          //     0: 0 to -40 dBm, 1: -41 to -70dBm, 2: -71 TO -80dBm, 3: -81dBm and lower
-            int8_t RSSI[24];             // 0 to -120 dBm (-70dBm Minimum signal strength for reliable packet delivery,
+            uint32_t MASTER_TIME;        // Master clock (in microseconds) when the original packet was sent
+            int8_t RSSI[20];             // 0 to -120 dBm (-70dBm Minimum signal strength for reliable packet delivery,
                                          //   -80dBm Minimum signal strength for basic connectivity. Packet delivery may be unreliable.)
             uint8_t FIRST_SENDER_ID;     // First sender ID which have sent the last packet
             uint8_t FIRST_REPEATER_SLOT; // First repeater slot which have sent the last packet
@@ -97,6 +105,32 @@
   const uint8_t MLS_PACKET_SIZE = sizeof(MLS_PACKET);
 
 
+  struct MLS_FIRE_PACKET {             // Short packet of the master, sent on the beat to play an armed effect
+    union {
+      struct {
+        char IID[3];                   // Installation ID
+        uint8_t TYPE;                  // MLS_TYPE_FIRE_DATA
+        uint8_t SENDER_ID;             // Same as MLS_PACKET
+        uint16_t PACKET_ID;            // Same as MLS_PACKET
+        uint8_t REPEATER_POSITION;     // Same as MLS_PACKET (the repeaters are the ones of the last MLS_PACKET)
+        uint32_t MASTER_TIME;          // Same as MLS_PACKET
+        uint8_t ARM_ID;                // Armed effect to play
+        uint16_t REPEAT_COUNTER;       // Beat counter
+      } __attribute__((__packed__));
+      uint8_t raw[15];                 // Full raw data of the packet
+    };
+  } __attribute__((__packed__));
+  const uint8_t MLS_FIRE_PACKET_SIZE = sizeof(MLS_FIRE_PACKET);
+
+
+  struct RECEIVED_PACKET {             // Packet enqueued by the ESP-NOW callback for the protocol task
+    uint32_t received_micros;          // Local reception time (in the callback)
+    uint8_t mac[6];                    // MAC address of the sender
+    int8_t rssi;                       // RSSI of the frame (-127 if unknown)
+    struct MLS_PACKET packet;
+  };
+
+
   struct TOPOLOGY_PACKET {
     union {
       struct {
@@ -113,6 +147,30 @@
   const uint8_t TOPOLOGY_PACKET_SIZE = sizeof(TOPOLOGY_PACKET);
 
 
+  #define MLS_TOPOLOGY_BATCH_SIZE   3   // Replies in a TOPOLOGY_BATCH_PACKET
+
+
+  struct TOPOLOGY_BATCH_REPLY {        // Reply of the master to a subscription
+    uint8_t mac_suffix[3];             // Last 3 bytes of the MAC address of the device (the first 3 bytes are the Espressif OUI)
+    uint8_t device_id;                 // 0xFF: empty reply
+    uint8_t rank;
+    uint8_t column;
+  } __attribute__((__packed__));
+
+
+  struct TOPOLOGY_BATCH_PACKET {       // Topology batch packet (TOPOLOGY DATA payload, type MLS_TOPOLOGY_BATCH_REPLY)
+    union {
+      struct {
+        uint8_t type;
+        struct TOPOLOGY_BATCH_REPLY replies[MLS_TOPOLOGY_BATCH_SIZE];
+        uint8_t reserved;
+      } __attribute__((__packed__));
+      uint8_t raw[MLS_DATA_SIZE];     // Full raw data of the packet
+    };
+  } __attribute__((__packed__));
+  const uint8_t TOPOLOGY_BATCH_PACKET_SIZE = sizeof(TOPOLOGY_BATCH_PACKET);
+
+
   struct ACTION_PACKET {               // Action packet (ACTION DATA payload)
     union {
       struct {
@@ -124,8 +182,47 @@
   } __attribute__((__packed__));
   const uint8_t ACTION_PACKET_SIZE = sizeof(ACTION_PACKET);
 
-  const uint8_t espnowBroadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
-  uint8_t searchDevice(struct DEVICE_INFO *all_devices, uint8_t number_of_devices, uint8_t *mac);
+  struct FIRE_PACKET {                 // Fire packet (FIRE DATA payload, once expanded)
+    union {
+      struct {
+        uint8_t arm_id;               // Armed effect to play
+        uint16_t repeat_counter;      // Beat counter
+        uint8_t reserved[17];
+      } __attribute__((__packed__));
+      uint8_t raw[MLS_DATA_SIZE];     // Full raw data of the packet
+    };
+  } __attribute__((__packed__));
+  const uint8_t FIRE_PACKET_SIZE = sizeof(FIRE_PACKET);
+
+
+  struct STATE_BEACON_PACKET {         // State beacon (ACTION DATA payload, action MLS_ACTION_STATE_BEACON or MLS_ACTION_STATE_FADES)
+    union {                            // Snapshot of the last LIGHT DATA of the master, for the late joining devices: the colors and
+      struct {                         // the fade times do not fit together, they are sent in alternate beacons (see MlsStateBeacon)
+        uint8_t action;
+        uint8_t effect;
+        uint8_t effect_modifier;
+        uint16_t repeat_counter;
+        uint16_t duration_ms;
+        uint16_t option;
+        union {
+          struct {                     // MLS_ACTION_STATE_BEACON
+            uint8_t left_color_raw[3];
+            uint8_t right_color_raw[3];
+          } __attribute__((__packed__));
+          struct {                     // MLS_ACTION_STATE_FADES (fade in, on and fade out times, in step of 10ms)
+            uint8_t left_times[3];
+            uint8_t right_times[3];
+          } __attribute__((__packed__));
+        };
+        uint32_t start_master_time;    // MASTER_TIME of the LIGHT DATA (the age of the effect is MASTER_TIME of the beacon - start_master_time)
+        uint8_t reserved;
+      } __attribute__((__packed__));
+      uint8_t raw[MLS_DATA_SIZE];     // Full raw data of the packet
+    };
+  } __attribute__((__packed__));
+  const uint8_t STATE_BEACON_PACKET_SIZE = sizeof(STATE_BEACON_PACKET);
+
+  const uint8_t espnowBroadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
 #endif
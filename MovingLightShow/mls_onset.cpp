@@ -0,0 +1,109 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_onset.cpp
+ * @brief Kick drum onset detector (bass band filter and energy derivative)
+ *
+ **********************************************************************/
+#include "mls_onset.h"
+
+
+// MlsOnsetDetector constructor
+MlsOnsetDetector::MlsOnsetDetector() {
+  this->begin(I2S_KICK_FREQUENCY, I2S_KICK_Q, I2S_SAMPLE_RATE);
+}
+
+
+// Band-pass biquad, constant 0 dB peak gain (RBJ audio EQ cookbook)
+void MlsOnsetDetector::begin(float frequency, float q, uint32_t sample_rate) {
+  float w0 = 2.0 * PI * frequency / sample_rate;
+  float alpha = sin(w0) / (2.0 * q);
+  float a0 = 1.0 + alpha;
+  float one = (float) (1L << MLS_ONSET_COEF_SHIFT);
+
+  this->b0 = (int32_t) ((alpha / a0) * one);
+  this->b2 = -this->b0;
+  this->a1 = (int32_t) ((-2.0 * cos(w0) / a0) * one);
+  this->a2 = (int32_t) (((1.0 - alpha) / a0) * one);
+  this->x1 = 0;
+  this->x2 = 0;
+  this->y1 = 0;
+  this->y2 = 0;
+  this->level = 0;
+  this->previous_level = 0;
+  this->flux = 0;
+  this->threshold = 0;
+  this->onsets = 0;
+  this->onset_offset = 0;
+  this->flux_window.clear();
+}
+
+
+// Filter a hop of samples in place, and check if its level rise is an onset
+boolean MlsOnsetDetector::process(int32_t *samples, uint16_t count) {
+  int64_t accumulator;
+  int32_t x;
+  uint32_t sum = 0;
+  boolean onset;
+
+  if (0 == count) {
+    return false;
+  }
+  for (uint16_t i = 0; i < count; i++) {
+    x = samples[i] >> MLS_ONSET_INPUT_SHIFT;
+    accumulator = ((int64_t) this->b0 * (x - this->x2)) - ((int64_t) this->a1 * this->y1) - ((int64_t) this->a2 * this->y2);
+    this->x2 = this->x1;
+    this->x1 = x;
+    this->y2 = this->y1;
+    this->y1 = (int32_t) (accumulator >> MLS_ONSET_COEF_SHIFT);
+    samples[i] = abs(this->y1);
+    sum += (samples[i] / count);
+  }
+
+  this->level = sum;
+  this->flux = (this->level > this->previous_level) ? (this->level - this->previous_level) : 0;
+  this->previous_level = this->level;
+
+  // The threshold is based on the previous hops only
+  this->threshold = this->flux_window.getMean() * I2S_ONSET_FLUX_RATIO;
+  onset = (this->flux > I2S_ONSET_MIN_FLUX) && (this->flux > this->threshold);
+  this->flux_window.add(this->flux);
+  if (onset) {
+    this->onsets++;
+    this->onset_offset = 0;
+    while ((this->onset_offset < (count - 1)) && (((uint32_t) samples[this->onset_offset]) < this->level)) {
+      this->onset_offset++;
+    }
+  }
+  return onset;
+}
+
+
+// Mean absolute level of the filtered hop
+uint32_t MlsOnsetDetector::getLevel() {
+  return this->level;
+}
+
+
+// Level rise since the previous hop
+uint32_t MlsOnsetDetector::getFlux() {
+  return this->flux;
+}
+
+
+uint32_t MlsOnsetDetector::getThreshold() {
+  return this->threshold;
+}
+
+
+uint32_t MlsOnsetDetector::getOnsets() {
+  return this->onsets;
+}
+
+
+// Onset sample in the last hop with an onset
+uint16_t MlsOnsetDetector::getOnsetOffset() {
+  return this->onset_offset;
+}
@@ -0,0 +1,72 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_onset.h
+ * @brief Kick drum onset detector (bass band filter and energy derivative)
+ *
+ * The I2S samples go through a fixed-point biquad band-pass, centered on
+ * the bass drum fundamental (I2S_KICK_FREQUENCY), so that the brass and
+ * the snare are mostly removed. The level of each hop of I2S_BLOCK_SIZE
+ * samples is the mean of the absolute filtered values.
+ *
+ * The onset function is the positive derivative of the level (the level
+ * rise since the previous hop). An onset is detected when this rise is
+ * over I2S_ONSET_FLUX_RATIO times the mean rise of the last
+ * I2S_ONSET_WINDOW hops, and over the I2S_ONSET_MIN_FLUX noise floor.
+ * The hold-off between two beats is still done by the caller.
+ *
+ * The hop is filtered in place. The onset sample is the first sample of
+ * the hop whose filtered value reaches the level of the hop.
+ *
+ **********************************************************************/
+#ifndef MLS_ONSET_H
+#define MLS_ONSET_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "mls_level_window.h"
+  #include <stdint.h>
+
+  #define MLS_ONSET_COEF_SHIFT  28 // Q28 biquad coefficients (|a1| < 2)
+  #define MLS_ONSET_INPUT_SHIFT 8  // 24 bits samples, left aligned in 32 bits
+
+
+  struct I2S_BEAT {                   // Beat detected by the audio task, for the loop
+    uint32_t onset_micros;            // Local time of the onset sample
+    uint32_t level;                   // Bass band level of the hop
+  };
+
+
+  class MlsOnsetDetector {
+
+    private:
+      int32_t b0;                           // Q28 coefficients (a0 normalized to 1, b1 is 0 for a band-pass)
+      int32_t b2;
+      int32_t a1;
+      int32_t a2;
+      int32_t x1;                           // Filter state (direct form I)
+      int32_t x2;
+      int32_t y1;
+      int32_t y2;
+      uint32_t level;
+      uint32_t previous_level;
+      uint32_t flux;
+      uint32_t threshold;
+      uint32_t onsets;
+      uint16_t onset_offset;
+      MlsLevelWindow<I2S_ONSET_WINDOW> flux_window;
+
+    public:
+      MlsOnsetDetector();
+      void begin(float frequency, float q, uint32_t sample_rate);
+      boolean process(int32_t *samples, uint16_t count);
+      uint32_t getLevel();
+      uint32_t getFlux();
+      uint32_t getThreshold();
+      uint32_t getOnsets();
+      uint16_t getOnsetOffset();
+  };
+
+#endif
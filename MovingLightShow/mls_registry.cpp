@@ -0,0 +1,399 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_registry.cpp
+ * @brief MLSmesh devices registry of the master
+ *
+ **********************************************************************/
+#include "mls_registry.h"
+#include "SPIFFS.h"
+
+
+// MlsRegistry constructor
+MlsRegistry::MlsRegistry() {
+  this->clear();
+}
+
+
+void MlsRegistry::clear() {
+  this->number_of_devices = 0;
+  this->saved_devices = 0;
+  memset(this->rssi, -127, sizeof(this->rssi));
+  memset(this->rssi_time, 0, sizeof(this->rssi_time));
+  memset(this->rank_head, MLSMESH_UNKNOWN_DEVICE, sizeof(this->rank_head));
+  memset(this->column_head, MLSMESH_UNKNOWN_DEVICE, sizeof(this->column_head));
+  memset(this->hash_table, MLSMESH_UNKNOWN_DEVICE, sizeof(this->hash_table));
+  memset(this->suffix_shared, 0, sizeof(this->suffix_shared));
+  memset(this->suffix_table, MLSMESH_UNKNOWN_DEVICE, sizeof(this->suffix_table));
+  this->suffix_collisions = 0;
+  memset((void *) this->reply_pending, 0, sizeof(this->reply_pending));
+  this->reply_head = 0;
+  this->reply_tail = 0;
+  this->probes = 0;
+  this->searches = 0;
+}
+
+
+// FNV-1a hash of the MAC address
+uint16_t MlsRegistry::getHash(const uint8_t *mac) {
+  uint32_t hash = 2166136261UL;
+
+  for (uint8_t i = 0; i < 6; i++) {
+    hash = (hash ^ mac[i]) * 16777619UL;
+  }
+  return (hash ^ (hash >> 16)) & (MLSMESH_REGISTRY_HASH_SIZE - 1);
+}
+
+
+// Slot of the MAC address in the hash table, or the empty slot where it can be added
+uint16_t MlsRegistry::findSlot(const uint8_t *mac) {
+  uint16_t slot = this->getHash(mac);
+  uint8_t id;
+
+  this->searches++;
+  while (true) {
+    this->probes++;
+    id = this->hash_table[slot];
+    if ((MLSMESH_UNKNOWN_DEVICE == id) || (memcmp(this->mac[id], mac, 6) == 0)) {
+      return slot;
+    }
+    slot = (slot + 1) & (MLSMESH_REGISTRY_HASH_SIZE - 1);
+  }
+}
+
+
+// Slot of the MAC suffix (last 3 bytes) in the suffix table, or the empty slot where it can be added
+uint16_t MlsRegistry::findSuffixSlot(const uint8_t *mac) {
+  uint32_t hash = 2166136261UL;
+  uint16_t slot;
+  uint8_t id;
+
+  for (uint8_t i = 3; i < 6; i++) {
+    hash = (hash ^ mac[i]) * 16777619UL;
+  }
+  slot = (hash ^ (hash >> 16)) & (MLSMESH_REGISTRY_HASH_SIZE - 1);
+  while (true) {
+    id = this->suffix_table[slot];
+    if ((MLSMESH_UNKNOWN_DEVICE == id) || (memcmp(&this->mac[id][3], &mac[3], 3) == 0)) {
+      return slot;
+    }
+    slot = (slot + 1) & (MLSMESH_REGISTRY_HASH_SIZE - 1);
+  }
+}
+
+
+// Register a device (the id of an already registered device is kept), MLSMESH_UNKNOWN_DEVICE if the registry is full
+uint8_t MlsRegistry::add(const uint8_t *mac, uint8_t rank, uint8_t column) {
+  uint16_t slot = this->findSlot(mac);
+  uint8_t id = this->hash_table[slot];
+
+  if (MLSMESH_UNKNOWN_DEVICE != id) {
+    return id;
+  }
+  if (this->number_of_devices >= MLSMESH_MAX_DEVICES) {
+    DEBUG_PRINTLN("MLSmesh: registry full");
+    this->checkSuffix(mac, MLSMESH_UNKNOWN_DEVICE);
+    return MLSMESH_UNKNOWN_DEVICE;
+  }
+  id = this->number_of_devices;
+  memcpy(this->mac[id], mac, 6);
+  this->checkSuffix(mac, id);
+  this->rank[id] = rank;
+  this->column[id] = column;
+  this->rssi[id] = -127;
+  this->rssi_time[id] = 0;
+  this->next_in_rank[id] = this->rank_head[rank];
+  this->rank_head[rank] = id;
+  this->next_in_column[id] = this->column_head[column];
+  this->column_head[column] = id;
+  this->hash_table[slot] = id;
+  __sync_synchronize();
+  this->number_of_devices++;
+  return id;
+}
+
+
+// Mark the devices with the same MAC suffix as a new device (id is MLSMESH_UNKNOWN_DEVICE if the
+// registry is full): they get a full reply again, in case their batch reply was taken by the new device
+void MlsRegistry::checkSuffix(const uint8_t *mac, uint8_t id) {
+  uint16_t slot = this->findSuffixSlot(mac);
+  uint8_t first = this->suffix_table[slot];
+
+  for (uint8_t other = first; MLSMESH_UNKNOWN_DEVICE != other; other = this->next_same_suffix[other]) {
+    // The master never waits for a topology reply
+    if (0 == other) {
+      continue;
+    }
+    this->suffix_shared[other] = true;
+    if (MLSMESH_UNKNOWN_DEVICE != id) {
+      this->suffix_shared[id] = true;
+      this->suffix_collisions++;
+    }
+    this->queueReply(other);
+  }
+  if (MLSMESH_UNKNOWN_DEVICE != id) {
+    this->next_same_suffix[id] = first;
+    this->suffix_table[slot] = id;
+  }
+}
+
+
+// Id of a registered device, MLSMESH_UNKNOWN_DEVICE if unknown
+uint8_t MlsRegistry::search(const uint8_t *mac) {
+  return this->hash_table[this->findSlot(mac)];
+}
+
+
+uint8_t MlsRegistry::getNumberOfDevices() {
+  return this->number_of_devices;
+}
+
+
+const uint8_t *MlsRegistry::getMac(uint8_t id) {
+  return this->mac[id];
+}
+
+
+uint8_t MlsRegistry::getRank(uint8_t id) {
+  return this->rank[id];
+}
+
+
+uint8_t MlsRegistry::getColumn(uint8_t id) {
+  return this->column[id];
+}
+
+
+int8_t MlsRegistry::getRssi(uint8_t id) {
+  return this->rssi[id];
+}
+
+
+uint32_t MlsRegistry::getRssiTime(uint8_t id) {
+  return this->rssi_time[id];
+}
+
+
+// RSSI of the last packet received from a device (ignored for an unregistered id)
+void MlsRegistry::setRssi(uint8_t id, int8_t rssi, uint32_t now_ms) {
+  if (id >= this->number_of_devices) {
+    return;
+  }
+  this->rssi[id] = rssi;
+  this->rssi_time[id] = (0 == now_ms) ? 1 : now_ms;
+}
+
+
+// Device never heard, or not heard since max_age_ms
+boolean MlsRegistry::isStale(uint8_t id, uint32_t now_ms, uint32_t max_age_ms) {
+  return (0 == this->rssi_time[id]) || ((now_ms - this->rssi_time[id]) > max_age_ms);
+}
+
+
+// Devices of a rank (the last registered first), MLSMESH_UNKNOWN_DEVICE at the end of the list
+uint8_t MlsRegistry::firstInRank(uint8_t rank) {
+  return this->rank_head[rank];
+}
+
+
+uint8_t MlsRegistry::nextInRank(uint8_t id) {
+  return this->next_in_rank[id];
+}
+
+
+// Devices of a column (the last registered first), MLSMESH_UNKNOWN_DEVICE at the end of the list
+uint8_t MlsRegistry::firstInColumn(uint8_t column) {
+  return this->column_head[column];
+}
+
+
+uint8_t MlsRegistry::nextInColumn(uint8_t id) {
+  return this->next_in_column[id];
+}
+
+
+// Next stale device after id (the master has the id 0, start with 0), MLSMESH_UNKNOWN_DEVICE at the end
+uint8_t MlsRegistry::nextStale(uint8_t id, uint32_t now_ms, uint32_t max_age_ms) {
+  for (id++; id < this->number_of_devices; id++) {
+    if (this->isStale(id, now_ms, max_age_ms)) {
+      return id;
+    }
+  }
+  return MLSMESH_UNKNOWN_DEVICE;
+}
+
+
+// Queue a topology reply for a device (only once if it is already waiting)
+void MlsRegistry::queueReply(uint8_t id) {
+  if ((id >= this->number_of_devices) || this->reply_pending[id]) {
+    return;
+  }
+  this->reply_pending[id] = true;
+  this->reply_queue[this->reply_tail] = id;
+  __sync_synchronize();
+  this->reply_tail = this->reply_tail + 1;
+}
+
+
+// Next device waiting for a topology reply, MLSMESH_UNKNOWN_DEVICE if none
+uint8_t MlsRegistry::nextReply() {
+  uint8_t id;
+
+  if (this->reply_head == this->reply_tail) {
+    return MLSMESH_UNKNOWN_DEVICE;
+  }
+  __sync_synchronize();
+  id = this->reply_queue[this->reply_head];
+  this->reply_pending[id] = false;
+  this->reply_head = this->reply_head + 1;
+  return id;
+}
+
+
+// Next topology batch reply (return the number of replies), up to a device with a shared MAC suffix,
+// whose id is returned in full_reply_id (MLSMESH_UNKNOWN_DEVICE if none) for a full reply
+uint8_t MlsRegistry::fillBatch(struct TOPOLOGY_BATCH_PACKET *batch_packet, uint8_t *full_reply_id) {
+  uint8_t replies = 0;
+  uint8_t id;
+
+  memset(batch_packet->raw, 0xFF, MLS_DATA_SIZE);
+  batch_packet->type = MLS_TOPOLOGY_BATCH_REPLY;
+  *full_reply_id = MLSMESH_UNKNOWN_DEVICE;
+  while (replies < MLS_TOPOLOGY_BATCH_SIZE) {
+    id = this->nextReply();
+    if (MLSMESH_UNKNOWN_DEVICE == id) {
+      break;
+    }
+    if (this->suffix_shared[id]) {
+      *full_reply_id = id;
+      break;
+    }
+    memcpy(batch_packet->replies[replies].mac_suffix, &this->mac[id][3], 3);
+    batch_packet->replies[replies].device_id = id;
+    batch_packet->replies[replies].rank = this->rank[id];
+    batch_packet->replies[replies].column = this->column[id];
+    replies++;
+  }
+  return replies;
+}
+
+
+// Topology reply with the full MAC address of a device
+void MlsRegistry::fillReply(uint8_t id, struct TOPOLOGY_PACKET *reply_packet) {
+  memset(reply_packet->raw, 0, TOPOLOGY_PACKET_SIZE);
+  reply_packet->type = MLS_TOPOLOGY_REPLY;
+  reply_packet->device_id = id;
+  memcpy(reply_packet->mac, this->mac[id], 6);
+  reply_packet->rank = this->rank[id];
+  reply_packet->column = this->column[id];
+}
+
+
+// Full reply without id (0xFF) for a refused device (registry full)
+void MlsRegistry::fillRefusal(const uint8_t *mac, struct TOPOLOGY_PACKET *reply_packet) {
+  memset(reply_packet->raw, 0, TOPOLOGY_PACKET_SIZE);
+  reply_packet->type = MLS_TOPOLOGY_REPLY;
+  reply_packet->device_id = 0xFF;
+  memcpy(reply_packet->mac, mac, 6);
+}
+
+
+boolean MlsRegistry::isSuffixShared(uint8_t id) {
+  return (id < this->number_of_devices) && this->suffix_shared[id];
+}
+
+
+uint16_t MlsRegistry::getSuffixCollisions() {
+  return this->suffix_collisions;
+}
+
+
+// Load the registry file, only if the master is the same (id 0)
+boolean MlsRegistry::load(const char *filename, const uint8_t *master_mac) {
+  struct REGISTRY_FILE_HEADER header;
+  struct REGISTRY_RECORD record;
+  File file = SPIFFS.open(filename, "r");
+
+  this->clear();
+  if (!file) {
+    return false;
+  }
+  if ((file.read((uint8_t *) &header, sizeof(header)) != sizeof(header)) || (MLSMESH_REGISTRY_MAGIC != header.magic) || (MLSMESH_REGISTRY_VERSION != header.version)) {
+    DEBUG_PRINTLN("MLSmesh: invalid registry file");
+    file.close();
+    return false;
+  }
+  while (file.read((uint8_t *) &record, sizeof(record)) == sizeof(record)) {
+    if ((record.id != this->number_of_devices) || (record.id >= MLSMESH_MAX_DEVICES)) {
+      break;
+    }
+    if ((0 == record.id) && (memcmp(record.mac, master_mac, 6) != 0)) {
+      DEBUG_PRINTLN("MLSmesh: registry file of another master");
+      break;
+    }
+    this->add(record.mac, record.rank, record.column);
+  }
+  file.close();
+  if (0 == this->number_of_devices) {
+    return false;
+  }
+  this->saved_devices = this->number_of_devices;
+  DEBUG_PRINTLN("MLSmesh: " + String(this->number_of_devices) + " devices loaded from the registry file");
+  return true;
+}
+
+
+// Append the devices registered since the last save (the file is rewritten for a new registry)
+boolean MlsRegistry::save(const char *filename) {
+  struct REGISTRY_FILE_HEADER header;
+  struct REGISTRY_RECORD records[MLSMESH_REGISTRY_SAVE_BATCH];
+  uint8_t number_of_devices = this->number_of_devices;
+  uint8_t count;
+  File file;
+
+  if (this->saved_devices == number_of_devices) {
+    return false;
+  }
+  if (0 == this->saved_devices) {
+    file = SPIFFS.open(filename, "w");
+    header.magic = MLSMESH_REGISTRY_MAGIC;
+    header.version = MLSMESH_REGISTRY_VERSION;
+    memset(header.reserved, 0, sizeof(header.reserved));
+    if (file) {
+      file.write((uint8_t *) &header, sizeof(header));
+    }
+  } else {
+    file = SPIFFS.open(filename, "a");
+  }
+  if (!file) {
+    DEBUG_PRINTLN("MLSmesh: failed to open the registry file");
+    return false;
+  }
+  while (this->saved_devices < number_of_devices) {
+    for (count = 0; (count < MLSMESH_REGISTRY_SAVE_BATCH) && ((this->saved_devices + count) < number_of_devices); count++) {
+      memcpy(records[count].mac, this->mac[this->saved_devices + count], 6);
+      records[count].id = this->saved_devices + count;
+      records[count].rank = this->rank[this->saved_devices + count];
+      records[count].column = this->column[this->saved_devices + count];
+    }
+    if (file.write((uint8_t *) records, count * sizeof(struct REGISTRY_RECORD)) != (count * sizeof(struct REGISTRY_RECORD))) {
+      DEBUG_PRINTLN("MLSmesh: failed to write the registry file");
+      break;
+    }
+    this->saved_devices += count;
+  }
+  file.close();
+  return true;
+}
+
+
+uint32_t MlsRegistry::getProbes() {
+  return this->probes;
+}
+
+
+uint32_t MlsRegistry::getSearches() {
+  return this->searches;
+}
@@ -0,0 +1,132 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_registry.h
+ * @brief MLSmesh devices registry of the master
+ *
+ * The id of a device is its position in the registry (the master has the
+ * id 0). The fields are stored in separate arrays (structure of arrays):
+ * the RSSI updates of each packet and the scans by RSSI age, rank or
+ * column only touch small contiguous arrays, the MAC addresses are only
+ * read at registration time.
+ *
+ * The MAC addresses are indexed by an open addressing hash table (linear
+ * probing, never more than half full), so the search of a device during a
+ * subscription storm is O(1) instead of a scan of all the devices. The
+ * devices of a rank or of a column are chained in lists. A second table
+ * indexes the MAC suffixes (see below), so that a registration stays O(1).
+ *
+ * The topology replies are queued, and sent in batches by the master.
+ * A batch reply only carries the last 3 bytes of the MAC address: when a
+ * new device has the same MAC suffix as another registered device, both
+ * are marked, and their replies are sent with the full MAC address. The
+ * older device gets a full reply again: a full reply also corrects an id
+ * taken from the batch reply of the other device. The older device is
+ * also marked when the new device is refused (registry full). The
+ * refused device may already have taken its id from a batch reply: the
+ * master answers each refused request with a full reply carrying the id
+ * 0xFF (fillRefusal), which takes the id back.
+ *
+ * The registry is saved in flash (SPIFFS), so that the master can resume
+ * the show with the same ids after an unexpected reset. The file is a
+ * header followed by one record per device, in id order: the new devices
+ * are only appended (one write for all the devices registered since the
+ * last save), the file is rewritten only for a new registry. A record
+ * partially written during a reset is ignored.
+ *
+ **********************************************************************/
+#ifndef MLS_REGISTRY_H
+#define MLS_REGISTRY_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "DebugTools.h"
+  #include "mls_mesh.h"
+  #include <stdint.h>
+
+  #define MLSMESH_UNKNOWN_DEVICE       0xFF // No device (search failed, end of a list)
+  #define MLSMESH_REGISTRY_HASH_SIZE   512  // Hash table entries (power of 2, at least twice MLSMESH_MAX_DEVICES)
+  #define MLSMESH_REGISTRY_MAGIC       0x52534C4D // "MLSR" header of the registry file
+  #define MLSMESH_REGISTRY_VERSION     1
+  #define MLSMESH_REGISTRY_SAVE_BATCH  16   // Records written per file write
+
+
+  struct REGISTRY_FILE_HEADER {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved[3];
+  } __attribute__((__packed__));
+
+
+  struct REGISTRY_RECORD {
+    uint8_t mac[6];
+    uint8_t id;                        // Position of the record, checked at load time
+    uint8_t rank;
+    uint8_t column;
+  } __attribute__((__packed__));
+
+
+  class MlsRegistry {
+
+    private:
+      volatile uint8_t number_of_devices;
+      uint8_t saved_devices;                               // Devices already in the registry file
+      int8_t rssi[MLSMESH_MAX_DEVICES];                    // Hot: updated on each packet
+      uint32_t rssi_time[MLSMESH_MAX_DEVICES];             // Last time rssi was measured (in ms, 0: never)
+      uint8_t rank[MLSMESH_MAX_DEVICES];
+      uint8_t column[MLSMESH_MAX_DEVICES];
+      uint8_t next_in_rank[MLSMESH_MAX_DEVICES];
+      uint8_t next_in_column[MLSMESH_MAX_DEVICES];
+      uint8_t rank_head[256];
+      uint8_t column_head[256];
+      uint8_t mac[MLSMESH_MAX_DEVICES][6];                 // Cold: only read at registration time
+      boolean suffix_shared[MLSMESH_MAX_DEVICES];          // Another device has the same last 3 bytes of MAC address
+      uint8_t next_same_suffix[MLSMESH_MAX_DEVICES];
+      uint16_t suffix_collisions;
+      uint8_t hash_table[MLSMESH_REGISTRY_HASH_SIZE];      // Device id of each MAC address
+      uint8_t suffix_table[MLSMESH_REGISTRY_HASH_SIZE];    // Last registered device of each MAC suffix (chained by next_same_suffix)
+      uint8_t reply_queue[256];                            // Devices waiting for a topology reply (each device once)
+      volatile uint8_t reply_head;                         // Only written by the consumer (loop)
+      volatile uint8_t reply_tail;                         // Only written by the producer (protocol task)
+      volatile boolean reply_pending[MLSMESH_MAX_DEVICES];
+      uint32_t probes;                                     // Hash table slots read by the searches (statistics)
+      uint32_t searches;
+      uint16_t getHash(const uint8_t *mac);
+      uint16_t findSlot(const uint8_t *mac);
+      uint16_t findSuffixSlot(const uint8_t *mac);
+      void checkSuffix(const uint8_t *mac, uint8_t id);
+
+    public:
+      MlsRegistry();
+      void clear();
+      uint8_t add(const uint8_t *mac, uint8_t rank, uint8_t column);
+      uint8_t search(const uint8_t *mac);
+      uint8_t getNumberOfDevices();
+      const uint8_t *getMac(uint8_t id);
+      uint8_t getRank(uint8_t id);
+      uint8_t getColumn(uint8_t id);
+      int8_t getRssi(uint8_t id);
+      uint32_t getRssiTime(uint8_t id);
+      void setRssi(uint8_t id, int8_t rssi, uint32_t now_ms);
+      boolean isStale(uint8_t id, uint32_t now_ms, uint32_t max_age_ms);
+      uint8_t firstInRank(uint8_t rank);
+      uint8_t nextInRank(uint8_t id);
+      uint8_t firstInColumn(uint8_t column);
+      uint8_t nextInColumn(uint8_t id);
+      uint8_t nextStale(uint8_t id, uint32_t now_ms, uint32_t max_age_ms);
+      void queueReply(uint8_t id);
+      uint8_t nextReply();
+      uint8_t fillBatch(struct TOPOLOGY_BATCH_PACKET *batch_packet, uint8_t *full_reply_id);
+      void fillReply(uint8_t id, struct TOPOLOGY_PACKET *reply_packet);
+      static void fillRefusal(const uint8_t *mac, struct TOPOLOGY_PACKET *reply_packet);
+      boolean isSuffixShared(uint8_t id);
+      uint16_t getSuffixCollisions();
+      boolean load(const char *filename, const uint8_t *master_mac);
+      boolean save(const char *filename);
+      uint32_t getProbes();
+      uint32_t getSearches();
+  };
+
+#endif
@@ -0,0 +1,141 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_render.cpp
+ * @brief Render clock of TaskUpdateLight (frame deadlines and statistics)
+ *
+ **********************************************************************/
+#include "mls_render.h"
+
+
+// MlsRender constructor
+MlsRender::MlsRender(uint16_t leds_per_strip) {
+  this->setLedsPerStrip(leds_per_strip);
+  this->next_frame_micros = 0;
+  this->frame_start_micros = 0;
+  this->resetStatistics();
+}
+
+
+// Frame period aligned on the WS2812B refresh time of the strip
+void MlsRender::setLedsPerStrip(uint16_t leds_per_strip) {
+  uint32_t refresh_micros = (leds_per_strip * LED_WS2812B_LED_MICROS) + LED_WS2812B_RESET_MICROS;
+  this->frame_period_micros = refresh_micros * ((LIGHT_MIN_FRAME_MICROS + refresh_micros - 1) / refresh_micros);
+}
+
+
+void MlsRender::startFrame(uint32_t now_micros) {
+  this->frame_start_micros = now_micros;
+
+  if (0 == this->fps_frames) {
+    this->fps_start_micros = now_micros;
+  }
+  this->fps_frames++;
+  if ((now_micros - this->fps_start_micros) >= 1000000) {
+    this->fps = ((uint32_t) (this->fps_frames - 1) * 1000000) / (now_micros - this->fps_start_micros);
+    this->fps_frames = 1;
+    this->fps_start_micros = now_micros;
+  }
+}
+
+
+void MlsRender::endFrame(uint32_t now_micros) {
+  uint32_t frame_micros = now_micros - this->frame_start_micros;
+
+  this->frames++;
+  if (frame_micros < this->frame_min_micros) {
+    this->frame_min_micros = frame_micros;
+  }
+  if (frame_micros > this->frame_max_micros) {
+    this->frame_max_micros = frame_micros;
+  }
+  this->frame_sum_micros += frame_micros;
+  this->frame_count++;
+  // Average on the last 1024 frames
+  if (this->frame_count >= 1024) {
+    this->frame_sum_micros /= 2;
+    this->frame_count /= 2;
+  }
+
+  // Frame woken up earlier by a new packet or a waiting effect: the deadline is still the same
+  // (the wait is rounded up to the tick, the regular frame starts after the deadline, or up to
+  // one tick before it with the tick phase of the wait)
+  if (((int32_t) (this->next_frame_micros - this->frame_start_micros)) >= (int32_t) (portTICK_PERIOD_MS * 1000)) {
+    return;
+  }
+
+  // Next deadline, the missed frames are skipped
+  this->next_frame_micros += this->frame_period_micros;
+  if (((int32_t) (now_micros - this->next_frame_micros)) > 0) {
+    if (this->frames > 1) {
+      this->missed_deadlines++;
+    }
+    this->next_frame_micros = now_micros + this->frame_period_micros;
+  }
+}
+
+
+// Number of ticks to wait until the next frame (the start time of a waiting effect can be earlier),
+// rounded up: a wait shorter than a tick is one tick instead of a busy loop
+TickType_t MlsRender::getWaitTicks(uint32_t now_micros, boolean waiting, uint32_t waiting_start_micros) {
+  uint32_t wake_up_micros = this->next_frame_micros;
+  int32_t wait_micros;
+
+  if (waiting && (((int32_t) (waiting_start_micros - wake_up_micros)) < 0)) {
+    wake_up_micros = waiting_start_micros;
+  }
+  wait_micros = (int32_t) (wake_up_micros - now_micros);
+  if (wait_micros <= 0) {
+    return 0;
+  }
+  return (wait_micros + (portTICK_PERIOD_MS * 1000) - 1) / (portTICK_PERIOD_MS * 1000);
+}
+
+
+void MlsRender::resetStatistics() {
+  this->frames = 0;
+  this->missed_deadlines = 0;
+  this->frame_min_micros = 0xFFFFFFFF;
+  this->frame_max_micros = 0;
+  this->frame_sum_micros = 0;
+  this->frame_count = 0;
+  this->fps_frames = 0;
+  this->fps = 0;
+}
+
+
+uint32_t MlsRender::getFramePeriodMicros() {
+  return this->frame_period_micros;
+}
+
+
+uint32_t MlsRender::getFrames() {
+  return this->frames;
+}
+
+
+uint32_t MlsRender::getMissedDeadlines() {
+  return this->missed_deadlines;
+}
+
+
+uint16_t MlsRender::getFps() {
+  return this->fps;
+}
+
+
+uint32_t MlsRender::getFrameMinMicros() {
+  return (0 == this->frame_count) ? 0 : this->frame_min_micros;
+}
+
+
+uint32_t MlsRender::getFrameAvgMicros() {
+  return (0 == this->frame_count) ? 0 : (this->frame_sum_micros / this->frame_count);
+}
+
+
+uint32_t MlsRender::getFrameMaxMicros() {
+  return this->frame_max_micros;
+}
@@ -0,0 +1,56 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_render.h
+ * @brief Render clock of TaskUpdateLight (frame deadlines and statistics)
+ *
+ * The frame period is a multiple of the WS2812B refresh time of the strip
+ * (24 bits of 1.25us per LED, plus the reset time), and at least
+ * LIGHT_MIN_FRAME_MICROS. Between two frames, TaskUpdateLight gives the
+ * idle time back to the scheduler, until the next deadline, the start
+ * time of a waiting effect, or a new packet notification.
+ *
+ **********************************************************************/
+#ifndef MLS_RENDER_H
+#define MLS_RENDER_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include <stdint.h>
+
+
+  class MlsRender {
+
+    private:
+      uint32_t frame_period_micros;
+      uint32_t next_frame_micros;       // Deadline of the next frame
+      uint32_t frame_start_micros;
+      uint32_t frames;
+      uint32_t missed_deadlines;
+      uint32_t frame_min_micros;
+      uint32_t frame_max_micros;
+      uint32_t frame_sum_micros;
+      uint32_t frame_count;
+      uint32_t fps_start_micros;
+      uint16_t fps_frames;
+      uint16_t fps;
+
+    public:
+      MlsRender(uint16_t leds_per_strip);
+      void setLedsPerStrip(uint16_t leds_per_strip);
+      void startFrame(uint32_t now_micros);
+      void endFrame(uint32_t now_micros);
+      TickType_t getWaitTicks(uint32_t now_micros, boolean waiting, uint32_t waiting_start_micros);
+      void resetStatistics();
+      uint32_t getFramePeriodMicros();
+      uint32_t getFrames();
+      uint32_t getMissedDeadlines();
+      uint16_t getFps();
+      uint32_t getFrameMinMicros();
+      uint32_t getFrameAvgMicros();
+      uint32_t getFrameMaxMicros();
+  };
+
+#endif
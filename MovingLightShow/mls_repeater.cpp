@@ -0,0 +1,218 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_repeater.cpp
+ * @brief MLSmesh repeaters (RSSI based election and time slotted retransmission)
+ *
+ **********************************************************************/
+#include "mls_repeater.h"
+
+
+// MlsRepeater constructor
+MlsRepeater::MlsRepeater() {
+  this->clearRepeaters();
+  this->pending = false;
+  this->forwarded_packets = 0;
+  this->overwritten_packets = 0;
+}
+
+
+// Forget all the repeaters
+void MlsRepeater::clear() {
+  portENTER_CRITICAL(&this->mux);
+  this->clearRepeaters();
+  portEXIT_CRITICAL(&this->mux);
+}
+
+
+// Forget all the repeaters (lock already taken)
+void MlsRepeater::clearRepeaters() {
+  memset(this->repeaters_id, MLSMESH_NO_REPEATER, MLSMESH_MAX_REPEATERS);
+  this->number_of_repeaters = 0;
+  this->my_position = 0;
+}
+
+
+// Elect the repeaters (master only)
+// The candidates are the devices with the weakest RSSI which are still hearing the master
+// reliably, because they are at the edge of the master coverage. They are sorted by rank
+// for the airtime order, in order to have a wave from the first rank to the last rank.
+void MlsRepeater::elect(MlsRegistry *registry, uint32_t now_ms) {
+  uint8_t candidates[MLSMESH_MAX_REPEATERS];
+  uint8_t number_of_candidates = 0;
+  uint8_t heard_devices = 0;
+  boolean repeaters_needed = false;
+  uint8_t number_of_devices = registry->getNumberOfDevices();
+  uint8_t i;
+
+  for (uint8_t id = 1; id < number_of_devices; id++) {
+    if (registry->isStale(id, now_ms, MLSMESH_RSSI_MAX_AGE_MS)) {
+      continue;
+    }
+    heard_devices++;
+    if (registry->getRssi(id) < MLSMESH_REPEATER_MIN_RSSI) {
+      repeaters_needed = true;
+      continue;
+    }
+    if (registry->getRssi(id) < MLSMESH_REPEATER_GOOD_RSSI) {
+      repeaters_needed = true;
+    }
+    // Insertion in the candidates list, weakest RSSI first
+    i = number_of_candidates;
+    if (i == MLSMESH_MAX_REPEATERS) {
+      if (registry->getRssi(id) >= registry->getRssi(candidates[i - 1])) {
+        continue;
+      }
+      i--;
+    } else {
+      number_of_candidates++;
+    }
+    while ((i > 0) && (registry->getRssi(id) < registry->getRssi(candidates[i - 1]))) {
+      candidates[i] = candidates[i - 1];
+      i--;
+    }
+    candidates[i] = id;
+  }
+
+  // Some registered devices are not heard anymore by the master
+  if ((heard_devices + 1) < number_of_devices) {
+    repeaters_needed = true;
+  }
+  if (!repeaters_needed) {
+    number_of_candidates = 0;
+  }
+
+  // Airtime order: from the first rank to the last rank
+  for (uint8_t j = 1; j < number_of_candidates; j++) {
+    uint8_t id = candidates[j];
+    i = j;
+    while ((i > 0) && (registry->getRank(id) < registry->getRank(candidates[i - 1]))) {
+      candidates[i] = candidates[i - 1];
+      i--;
+    }
+    candidates[i] = id;
+  }
+
+  portENTER_CRITICAL(&this->mux);
+  this->clearRepeaters();
+  memcpy(this->repeaters_id, candidates, number_of_candidates);
+  this->number_of_repeaters = number_of_candidates;
+  portEXIT_CRITICAL(&this->mux);
+  DEBUG_PRINT("MLSmesh: repeaters elected: "); DEBUG_PRINTLN(this->number_of_repeaters);
+}
+
+
+// Add the repeaters information in an original packet (master only)
+void MlsRepeater::fillPacket(struct MLS_PACKET *packet) {
+  portENTER_CRITICAL(&this->mux);
+  memcpy(packet->REPEATERS_ID, this->repeaters_id, MLSMESH_MAX_REPEATERS);
+  portEXIT_CRITICAL(&this->mux);
+  packet->REPEATER_POSITION = 0;
+}
+
+
+// Learn the current repeaters list from a master packet, and my own position in the list
+void MlsRepeater::learnRepeaters(struct MLS_PACKET *packet, uint8_t my_id) {
+  portENTER_CRITICAL(&this->mux);
+  this->clearRepeaters();
+  memcpy(this->repeaters_id, packet->REPEATERS_ID, MLSMESH_MAX_REPEATERS);
+  for (uint8_t i = 0; i < MLSMESH_MAX_REPEATERS; i++) {
+    if (MLSMESH_NO_REPEATER == this->repeaters_id[i]) {
+      break;
+    }
+    this->number_of_repeaters++;
+    if ((MLSMESH_NO_REPEATER != my_id) && (my_id == this->repeaters_id[i])) {
+      this->my_position = i + 1;
+    }
+  }
+  portEXIT_CRITICAL(&this->mux);
+}
+
+
+// Schedule the forward of a master packet in my time slot (if I'm a repeater)
+void MlsRepeater::schedule(struct MLS_PACKET *packet, uint32_t received_micros) {
+  uint8_t received_position = packet->REPEATER_POSITION & MLSMESH_REPEATER_POSITION_MASK;
+
+  portENTER_CRITICAL(&this->mux);
+  // The wave is already behind me
+  if ((0 == this->my_position) || (received_position >= this->my_position)) {
+    portEXIT_CRITICAL(&this->mux);
+    return;
+  }
+  if (this->pending) {
+    this->overwritten_packets++;
+  }
+  memcpy(this->pending_packet.raw, packet->raw, MLS_PACKET_SIZE);
+  this->pending_packet.REPEATER_POSITION = (packet->REPEATER_POSITION & ~MLSMESH_REPEATER_POSITION_MASK) | this->my_position;
+  this->pending_time_micros = received_micros + ((this->my_position - received_position) * MLSMESH_REPEATER_SLOT_US);
+  this->pending = true;
+  portEXIT_CRITICAL(&this->mux);
+}
+
+
+// Get the packet to forward, if its time slot is reached
+boolean MlsRepeater::nextPacket(struct MLS_PACKET *packet, uint32_t now_micros) {
+  portENTER_CRITICAL(&this->mux);
+  if ((!this->pending) || (((int32_t) (now_micros - this->pending_time_micros)) < 0)) {
+    portEXIT_CRITICAL(&this->mux);
+    return false;
+  }
+  memcpy(packet->raw, this->pending_packet.raw, MLS_PACKET_SIZE);
+  this->pending = false;
+  this->forwarded_packets++;
+  portEXIT_CRITICAL(&this->mux);
+  return true;
+}
+
+
+// Time left before the slot of the pending packet (0: already reached)
+uint32_t MlsRepeater::getWaitMicros(uint32_t now_micros) {
+  int32_t wait_micros;
+
+  portENTER_CRITICAL(&this->mux);
+  if (!this->pending) {
+    portEXIT_CRITICAL(&this->mux);
+    return MLSMESH_REPEATER_NO_SLOT;
+  }
+  wait_micros = (int32_t) (this->pending_time_micros - now_micros);
+  portEXIT_CRITICAL(&this->mux);
+  return (wait_micros > 0) ? wait_micros : 0;
+}
+
+
+// Age of a received copy, based on the repeater position which has sent it
+uint32_t MlsRepeater::getHopLatencyMicros(struct MLS_PACKET *packet) {
+  return (packet->REPEATER_POSITION & MLSMESH_REPEATER_POSITION_MASK) * MLSMESH_REPEATER_SLOT_US;
+}
+
+
+uint8_t MlsRepeater::getMyPosition() {
+  uint8_t my_position;
+
+  portENTER_CRITICAL(&this->mux);
+  my_position = this->my_position;
+  portEXIT_CRITICAL(&this->mux);
+  return my_position;
+}
+
+
+uint8_t MlsRepeater::getNumberOfRepeaters() {
+  uint8_t number_of_repeaters;
+
+  portENTER_CRITICAL(&this->mux);
+  number_of_repeaters = this->number_of_repeaters;
+  portEXIT_CRITICAL(&this->mux);
+  return number_of_repeaters;
+}
+
+
+uint16_t MlsRepeater::getForwardedPackets() {
+  return this->forwarded_packets;
+}
+
+
+uint16_t MlsRepeater::getOverwrittenPackets() {
+  return this->overwritten_packets;
+}
@@ -0,0 +1,69 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_repeater.h
+ * @brief MLSmesh repeaters (RSSI based election and time slotted retransmission)
+ *
+ * The master elects up to MLSMESH_MAX_REPEATERS repeaters, based on the RSSI
+ * of the devices, and announces them in REPEATERS_ID of every packet, in
+ * airtime order (from the first rank to the last rank).
+ *
+ * A repeater at position q (1..12) forwards each original master packet once,
+ * (q - p) time slots after having received it from the position p (0 is the
+ * master). REPEATER_POSITION of the forwarded packet is set to q, so that
+ * every receiver knows how old its copy is (about q time slots).
+ *
+ * The packets are scheduled and forwarded by the protocol task, which
+ * sleeps until the slot deadline given by getWaitMicros(). The list of
+ * repeaters is also read by the receive callback (core 0) and written by
+ * the election of the loop (core 1): the state is guarded by a spinlock.
+ *
+ **********************************************************************/
+#ifndef MLS_REPEATER_H
+#define MLS_REPEATER_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "DebugTools.h"
+  #include "mls_mesh.h"
+  #include "mls_registry.h"
+  #include <stdint.h>
+
+  #define MLSMESH_NO_REPEATER            0xFF // Empty entry in REPEATERS_ID
+  #define MLSMESH_REPEATER_POSITION_MASK 0x0F // LSB of REPEATER_POSITION: repeater position (0: master)
+  #define MLSMESH_REPEATER_NO_SLOT       0xFFFFFFFF // getWaitMicros(): no packet to forward
+
+
+  class MlsRepeater {
+
+    private:
+      uint8_t repeaters_id[MLSMESH_MAX_REPEATERS];
+      uint8_t number_of_repeaters;
+      uint8_t my_position;                        // 0: not a repeater
+      struct MLS_PACKET pending_packet;
+      uint32_t pending_time_micros;
+      volatile boolean pending;
+      uint16_t forwarded_packets;
+      uint16_t overwritten_packets;
+      portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+      void clearRepeaters();
+
+    public:
+      MlsRepeater();
+      void clear();
+      void elect(MlsRegistry *registry, uint32_t now_ms);
+      void fillPacket(struct MLS_PACKET *packet);
+      void learnRepeaters(struct MLS_PACKET *packet, uint8_t my_id);
+      void schedule(struct MLS_PACKET *packet, uint32_t received_micros);
+      boolean nextPacket(struct MLS_PACKET *packet, uint32_t now_micros);
+      uint32_t getWaitMicros(uint32_t now_micros);
+      uint32_t getHopLatencyMicros(struct MLS_PACKET *packet);
+      uint8_t getMyPosition();
+      uint8_t getNumberOfRepeaters();
+      uint16_t getForwardedPackets();
+      uint16_t getOverwrittenPackets();
+  };
+
+#endif
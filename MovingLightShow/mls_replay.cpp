@@ -0,0 +1,112 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_replay.cpp
+ * @brief MLSmesh duplicate and ordering filter (replay window per sender)
+ *
+ **********************************************************************/
+#include "mls_replay.h"
+
+
+// MlsReplayWindow constructor
+MlsReplayWindow::MlsReplayWindow() {
+  this->clear();
+  this->duplicates = 0;
+  this->too_old = 0;
+  this->reordered = 0;
+  this->resyncs = 0;
+}
+
+
+// Serial number comparison (RFC 1982), wrap-safe
+boolean MlsReplayWindow::isNewer(uint16_t a, uint16_t b) {
+  return ((int16_t) (a - b)) > 0;
+}
+
+
+void MlsReplayWindow::clear() {
+  memset(this->newest_id, 0, sizeof(this->newest_id));
+  memset(this->bitmap, 0, sizeof(this->bitmap));
+}
+
+
+// Forget a sender (new device with this id)
+void MlsReplayWindow::clear(uint8_t sender_id) {
+  if (sender_id < MLSMESH_REPLAY_SENDERS) {
+    this->bitmap[sender_id] = 0;
+  }
+}
+
+
+// Check a packet of a sender, and remember it if it is new
+boolean MlsReplayWindow::isNew(uint8_t sender_id, uint16_t packet_id) {
+  int16_t delta;
+  uint32_t bit;
+
+  if (sender_id >= MLSMESH_REPLAY_SENDERS) {
+    return true;
+  }
+  delta = (int16_t) (packet_id - this->newest_id[sender_id]);
+
+  // First packet of this sender, or sender restarted
+  if ((0 == this->bitmap[sender_id]) || (delta <= -MLSMESH_REPLAY_RESYNC_GAP)) {
+    if (0 != this->bitmap[sender_id]) {
+      this->resyncs++;
+    }
+    this->newest_id[sender_id] = packet_id;
+    this->bitmap[sender_id] = 1;
+    return true;
+  }
+
+  // Newer packet, the window slides
+  if (delta > 0) {
+    this->bitmap[sender_id] = (delta >= MLSMESH_REPLAY_WINDOW) ? 1 : ((this->bitmap[sender_id] << delta) | 1);
+    this->newest_id[sender_id] = packet_id;
+    return true;
+  }
+
+  // Older packet
+  if (-delta >= MLSMESH_REPLAY_WINDOW) {
+    this->too_old++;
+    return false;
+  }
+  bit = ((uint32_t) 1) << (-delta);
+  if (this->bitmap[sender_id] & bit) {
+    this->duplicates++;
+    return false;
+  }
+  this->bitmap[sender_id] |= bit;
+  this->reordered++;
+  return true;
+}
+
+
+// Newest packet id received from a sender
+uint16_t MlsReplayWindow::getNewestId(uint8_t sender_id) {
+  if (sender_id >= MLSMESH_REPLAY_SENDERS) {
+    return 0;
+  }
+  return this->newest_id[sender_id];
+}
+
+
+uint16_t MlsReplayWindow::getDuplicates() {
+  return this->duplicates;
+}
+
+
+uint16_t MlsReplayWindow::getTooOld() {
+  return this->too_old;
+}
+
+
+uint16_t MlsReplayWindow::getReordered() {
+  return this->reordered;
+}
+
+
+uint16_t MlsReplayWindow::getResyncs() {
+  return this->resyncs;
+}
@@ -0,0 +1,57 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_replay.h
+ * @brief MLSmesh duplicate and ordering filter (replay window per sender)
+ *
+ * Each sender (SENDER_ID 0..254) numbers its own packets (PACKET_ID).
+ * The packet ids are compared as serial numbers (RFC 1982): a is newer
+ * than b if (int16_t) (a - b) > 0, which is right across the wraparound.
+ *
+ * For each sender, the window keeps the newest packet id, and a bitmap of
+ * the MLSMESH_REPLAY_WINDOW last packet ids (bit n: newest - n received).
+ * A packet is new if it is newer than the newest one, or if it is in the
+ * window and not yet received (reordered). A packet older than the window
+ * is dropped, except if it is so old that the sender has been restarted
+ * (the first packet id of each device is random, to make it likely).
+ *
+ * Fixed footprint: 6 bytes per sender, 1530 bytes for 255 senders.
+ *
+ **********************************************************************/
+#ifndef MLS_REPLAY_H
+#define MLS_REPLAY_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include <stdint.h>
+
+  #define MLSMESH_REPLAY_SENDERS    255  // SENDER_ID 0..254 (0xFF is an unregistered device)
+  #define MLSMESH_REPLAY_WINDOW     32   // Packet ids remembered per sender (bits of the bitmap)
+
+
+  class MlsReplayWindow {
+
+    private:
+      uint16_t newest_id[MLSMESH_REPLAY_SENDERS];
+      uint32_t bitmap[MLSMESH_REPLAY_SENDERS];    // 0: nothing received from this sender
+      uint16_t duplicates;
+      uint16_t too_old;
+      uint16_t reordered;
+      uint16_t resyncs;
+
+    public:
+      MlsReplayWindow();
+      static boolean isNewer(uint16_t a, uint16_t b);
+      void clear();
+      void clear(uint8_t sender_id);
+      boolean isNew(uint8_t sender_id, uint16_t packet_id);
+      uint16_t getNewestId(uint8_t sender_id);
+      uint16_t getDuplicates();
+      uint16_t getTooOld();
+      uint16_t getReordered();
+      uint16_t getResyncs();
+  };
+
+#endif
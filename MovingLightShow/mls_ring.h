@@ -0,0 +1,99 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_ring.h
+ * @brief Lock-free single producer / single consumer ring of preallocated slots
+ *
+ * Unlike MlsMailbox, the items are never overwritten: the producer
+ * reserves a free slot, writes it in place and commits it, or drops the
+ * item if the ring is full. The consumer reads the oldest committed slot
+ * in place and releases it when done, so each item is copied only once.
+ *
+ **********************************************************************/
+#ifndef MLS_RING_H
+#define MLS_RING_H
+
+  #include <Arduino.h>
+  #include <stdint.h>
+  #include <string.h>
+
+
+  template <typename T, uint8_t SIZE>
+  class MlsRing {
+
+    private:
+      T slots[SIZE];
+      volatile uint32_t write_index;  // Only written by the producer
+      volatile uint32_t read_index;   // Only written by the consumer
+      volatile uint16_t drops;        // Items dropped because the ring was full
+      volatile uint8_t high_water;    // Maximum number of items waiting in the ring
+
+    public:
+      MlsRing() {
+        this->clear();
+      }
+
+      void clear() {
+        memset(this->slots, 0, sizeof(this->slots));
+        this->write_index = 0;
+        this->read_index = 0;
+        this->drops = 0;
+        this->high_water = 0;
+      }
+
+      // Producer side, never blocks: free slot to fill, NULL if the ring is full
+      T *reserve() {
+        uint32_t index = this->write_index;
+
+        if ((index - this->read_index) >= SIZE) {
+          this->drops++;
+          return NULL;
+        }
+        return &this->slots[index % SIZE];
+      }
+
+      // Producer side, the reserved slot is ready for the consumer
+      void commit() {
+        uint32_t waiting;
+
+        __sync_synchronize();
+        this->write_index = this->write_index + 1;
+        waiting = this->write_index - this->read_index;
+        if (waiting > this->high_water) {
+          this->high_water = waiting;
+        }
+      }
+
+      // Consumer side, oldest item (read in place), NULL if the ring is empty
+      T *peek() {
+        uint32_t index = this->read_index;
+
+        if (index == this->write_index) {
+          return NULL;
+        }
+        __sync_synchronize();
+        return &this->slots[index % SIZE];
+      }
+
+      // Consumer side, the slot of the oldest item can be reused by the producer
+      void release() {
+        __sync_synchronize();
+        this->read_index = this->read_index + 1;
+      }
+
+      uint8_t available() {
+        return this->write_index - this->read_index;
+      }
+
+      uint16_t getDrops() {
+        return this->drops;
+      }
+
+      uint8_t getHighWater() {
+        return this->high_water;
+      }
+  };
+
+#endif
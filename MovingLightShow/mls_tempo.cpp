@@ -0,0 +1,168 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_tempo.cpp
+ * @brief Tempo tracker and beat predictor (phase-locked on the onsets)
+ *
+ **********************************************************************/
+#include "mls_tempo.h"
+
+
+// MlsTempo constructor
+MlsTempo::MlsTempo() {
+  this->clear();
+}
+
+
+void MlsTempo::clear() {
+  this->period_micros = 0;
+  this->beat_micros = 0;
+  this->last_onset_micros = 0;
+  this->announced_micros = 0;
+  this->has_onset = false;
+  this->has_announced = false;
+  this->confidence = 0;
+  this->hits = 0;
+  this->misses = 0;
+}
+
+
+// Start the tracking again, with the interval between the last two onsets as period
+void MlsTempo::acquire(uint32_t onset_micros, uint32_t interval_micros) {
+  if ((interval_micros < I2S_TEMPO_MIN_PERIOD_US) || (interval_micros > I2S_TEMPO_MAX_PERIOD_US)) {
+    this->period_micros = 0;
+    this->confidence = 0;
+    return;
+  }
+  this->period_micros = interval_micros;
+  this->beat_micros = onset_micros;
+  this->confidence = I2S_TEMPO_HIT_CONFIDENCE;
+}
+
+
+// Phase and period correction with a detected onset
+void MlsTempo::addOnset(uint32_t onset_micros) {
+  uint32_t interval_micros = onset_micros - this->last_onset_micros;
+  uint32_t elapsed_micros;
+  uint32_t beats;
+  int32_t error_micros;
+  boolean first = !this->has_onset;
+
+  this->last_onset_micros = onset_micros;
+  this->has_onset = true;
+  if (first) {
+    return;
+  }
+  if ((0 == this->period_micros) || (0 == this->confidence)) {
+    this->acquire(onset_micros, interval_micros);
+    return;
+  }
+
+  // Phase error against the nearest predicted beat
+  elapsed_micros = onset_micros - this->beat_micros;
+  beats = (elapsed_micros + (this->period_micros / 2)) / this->period_micros;
+  if (0 == beats) {
+    beats = 1;
+  }
+  error_micros = (int32_t) (elapsed_micros - (beats * this->period_micros));
+
+  if (abs(error_micros) <= (int32_t) (this->period_micros / I2S_TEMPO_TOLERANCE)) {
+    // On the beat
+    this->beat_micros += (beats * this->period_micros) + (error_micros / I2S_TEMPO_PHASE_GAIN);
+    this->period_micros += error_micros / (int32_t) (I2S_TEMPO_PERIOD_GAIN * beats);
+    this->period_micros = constrain(this->period_micros, I2S_TEMPO_MIN_PERIOD_US, I2S_TEMPO_MAX_PERIOD_US);
+    this->confidence = min(255, this->confidence + I2S_TEMPO_HIT_CONFIDENCE);
+    this->hits++;
+  } else {
+    // Off the beat (or tempo change)
+    this->confidence = (this->confidence > I2S_TEMPO_MISS_CONFIDENCE) ? (this->confidence - I2S_TEMPO_MISS_CONFIDENCE) : 0;
+    this->misses++;
+    if (0 == this->confidence) {
+      this->acquire(onset_micros, interval_micros);
+    }
+  }
+}
+
+
+// Predictive mode: confident tempo, and a recent onset
+boolean MlsTempo::isLocked(uint32_t now_micros) {
+  if ((0 == this->period_micros) || (this->confidence < I2S_TEMPO_LOCK_CONFIDENCE)) {
+    return false;
+  }
+  return ((now_micros - this->last_onset_micros) < (I2S_TEMPO_MAX_SILENT_BEATS * this->period_micros));
+}
+
+
+// Local time of the next predicted beat
+uint32_t MlsTempo::getNextBeat(uint32_t now_micros) {
+  uint32_t elapsed_micros = now_micros - this->beat_micros;
+
+  if ((0 == this->period_micros) || (((int32_t) elapsed_micros) < 0)) {
+    return this->beat_micros;
+  }
+  return this->beat_micros + (((elapsed_micros / this->period_micros) + 1) * this->period_micros);
+}
+
+
+// True once per predicted beat, lead_micros before it (locked tempo only), beat_micros is its local time
+boolean MlsTempo::isBeatDue(uint32_t now_micros, uint32_t lead_micros, uint32_t *beat_micros) {
+  uint32_t next_micros;
+
+  if (!this->isLocked(now_micros)) {
+    return false;
+  }
+  next_micros = this->getNextBeat(now_micros);
+  if (((int32_t) (next_micros - now_micros)) > ((int32_t) lead_micros)) {
+    return false;
+  }
+  // This beat was already announced (the phase can move a little bit between two calls)
+  if (this->has_announced && (((int32_t) (next_micros - this->announced_micros)) < ((int32_t) (this->period_micros / 2)))) {
+    return false;
+  }
+  this->announced_micros = next_micros;
+  this->has_announced = true;
+  *beat_micros = next_micros;
+  return true;
+}
+
+
+uint32_t MlsTempo::getPeriodMicros() {
+  return this->period_micros;
+}
+
+
+// Tempo in beats per minute (0 if unknown)
+uint16_t MlsTempo::getBpm() {
+  if (0 == this->period_micros) {
+    return 0;
+  }
+  return (60000000 + (this->period_micros / 2)) / this->period_micros;
+}
+
+
+uint8_t MlsTempo::getConfidence() {
+  return this->confidence;
+}
+
+
+// Phase of the beat (0: on the beat, 128: half way to the next one)
+uint8_t MlsTempo::getPhase(uint32_t now_micros) {
+  uint32_t elapsed_micros = now_micros - this->beat_micros;
+
+  if ((0 == this->period_micros) || (((int32_t) elapsed_micros) < 0)) {
+    return 0;
+  }
+  return ((uint64_t) (elapsed_micros % this->period_micros) * 256) / this->period_micros;
+}
+
+
+uint16_t MlsTempo::getHits() {
+  return this->hits;
+}
+
+
+uint16_t MlsTempo::getMisses() {
+  return this->misses;
+}
@@ -0,0 +1,59 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_tempo.h
+ * @brief Tempo tracker and beat predictor (phase-locked on the onsets)
+ *
+ * The first period is the interval between two onsets. Then each onset
+ * is compared with the nearest predicted beat: if the phase error is
+ * below 1/I2S_TEMPO_TOLERANCE of the period, the onset is on the beat,
+ * the phase and the period are corrected by a fraction of the error
+ * (second order PLL), and the confidence rises. An onset off the beat
+ * lowers the confidence, and the tracking starts again from the last
+ * interval when the confidence is 0.
+ *
+ * The tempo is locked when the confidence is high enough and the last
+ * onset is recent. The master can then send the beats in advance, so
+ * that they are played on the predicted beat.
+ *
+ **********************************************************************/
+#ifndef MLS_TEMPO_H
+#define MLS_TEMPO_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include <stdint.h>
+
+
+  class MlsTempo {
+
+    private:
+      uint32_t period_micros;       // 0: no tempo
+      uint32_t beat_micros;         // Local time of the last beat on which the phase is locked
+      uint32_t last_onset_micros;
+      uint32_t announced_micros;    // Last predicted beat already announced
+      boolean has_onset;
+      boolean has_announced;
+      uint8_t confidence;
+      uint16_t hits;
+      uint16_t misses;
+      void acquire(uint32_t onset_micros, uint32_t interval_micros);
+
+    public:
+      MlsTempo();
+      void clear();
+      void addOnset(uint32_t onset_micros);
+      boolean isLocked(uint32_t now_micros);
+      uint32_t getNextBeat(uint32_t now_micros);
+      boolean isBeatDue(uint32_t now_micros, uint32_t lead_micros, uint32_t *beat_micros);
+      uint32_t getPeriodMicros();
+      uint16_t getBpm();
+      uint8_t getConfidence();
+      uint8_t getPhase(uint32_t now_micros);
+      uint16_t getHits();
+      uint16_t getMisses();
+  };
+
+#endif
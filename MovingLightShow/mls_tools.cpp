@@ -56,6 +56,9 @@ void MlsTools::loadConfiguration(String default_iid) {
   this->config.rank   = doc["rank"]   | 0;
   this->config.column = doc["column"] | 0;
   this->config.remote = doc["remote"] | 0;
+  this->config.leds       = doc["leds"]       | NUM_LEDS_PER_STRIP;
+  this->config.masterleds = doc["masterleds"] | NUM_LEDS_PER_STRIP_MASTER;
+  this->config.sections   = doc["sections"]   | 0;
 
   this->disableDefauldSsid = ((this->config.ssid1validated != 0) || (this->config.ssid2validated != 0));
 
@@ -84,6 +87,9 @@ void MlsTools::loadConfiguration(String default_iid) {
   this->configRead.rank   = this->config.rank;
   this->configRead.column = this->config.column;
   this->configRead.remote = this->config.remote;
+  this->configRead.leds       = this->config.leds;
+  this->configRead.masterleds = this->config.masterleds;
+  this->configRead.sections   = this->config.sections;
 
   serializeJson(doc, this->jsonActual);
   DEBUG_PRINTLN("Json content: " + String(this->jsonActual));
@@ -124,6 +130,9 @@ void MlsTools::importConfiguration(String jsonImport) {
   this->config.rank   = doc["rank"]   | this->config.rank,
   this->config.column = doc["column"] | this->config.column,
   this->config.remote = doc["remote"] | this->config.remote,
+  this->config.leds       = doc["leds"]       | this->config.leds,
+  this->config.masterleds = doc["masterleds"] | this->config.masterleds,
+  this->config.sections   = doc["sections"]   | this->config.sections,
 
   serializeJson(doc, this->jsonActual);
   DEBUG_PRINTLN("Json content: " + String(this->jsonActual));
@@ -155,6 +164,9 @@ boolean MlsTools::saveConfiguration() {
   doc["rank"]           = this->config.rank;
   doc["column"]         = this->config.column;
   doc["remote"]         = this->config.remote;
+  doc["leds"]           = this->config.leds;
+  doc["masterleds"]     = this->config.masterleds;
+  doc["sections"]       = this->config.sections;
 
   // Serialize JSON to file only if changed
   serializeJson(doc, this->jsonActual);
@@ -40,6 +40,9 @@
         int rank;
         int column;
         int remote;
+        int leds;
+        int masterleds;
+        int sections; // Bit n: member of the section n (see mls_groups.h)
       } __attribute__((__packed__));
       Config config;
       Config configRead;
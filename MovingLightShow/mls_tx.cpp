@@ -0,0 +1,245 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_tx.cpp
+ * @brief MLSmesh transmit scheduler (priority classes, rate limits, airtime)
+ *
+ **********************************************************************/
+#include "mls_tx.h"
+
+
+// MlsTxScheduler constructor
+MlsTxScheduler::MlsTxScheduler() {
+  for (uint8_t tx_class = 0; tx_class < MLS_TX_CLASSES; tx_class++) {
+    this->head[tx_class] = 0;
+    this->waiting[tx_class] = 0;
+    this->setRate(tx_class, 0, 1);
+  }
+  memset(this->current, 0, sizeof(this->current));
+  memset(this->last_second, 0, sizeof(this->last_second));
+  this->last_refill_ms = 0;
+  this->second_start_ms = 0;
+  this->busy = false;
+  this->busy_class = 0;
+  this->busy_since_micros = 0;
+  this->sequence = 0;
+  this->expired = false;
+  this->expired_class = 0;
+  this->ignored_sequence = 0;
+  this->timeouts = 0;
+  this->late_completions = 0;
+}
+
+
+// Estimated airtime of a frame at 1 Mbps
+uint32_t MlsTxScheduler::getAirtimeMicros(uint8_t length) {
+  return MLS_TX_FRAME_OVERHEAD_US + (length * 8);
+}
+
+
+// Rate limit of a class (0 frames per second: no limit)
+void MlsTxScheduler::setRate(uint8_t tx_class, uint16_t frames_per_second, uint16_t burst) {
+  this->rate[tx_class] = frames_per_second;
+  this->burst[tx_class] = burst;
+  this->tokens[tx_class] = burst * 1000;
+}
+
+
+// Add the tokens of the elapsed time (in the critical section)
+void MlsTxScheduler::refill(uint32_t now_ms) {
+  uint32_t elapsed_ms = now_ms - this->last_refill_ms;
+
+  if (0 == elapsed_ms) {
+    return;
+  }
+  this->last_refill_ms = now_ms;
+  for (uint8_t tx_class = 0; tx_class < MLS_TX_CLASSES; tx_class++) {
+    this->tokens[tx_class] += elapsed_ms * this->rate[tx_class];
+    if (this->tokens[tx_class] > (this->burst[tx_class] * 1000UL)) {
+      this->tokens[tx_class] = this->burst[tx_class] * 1000UL;
+    }
+  }
+}
+
+
+// Keep the statistics of the last full second (in the critical section)
+void MlsTxScheduler::rollStats(uint32_t now_ms) {
+  if ((now_ms - this->second_start_ms) >= 1000) {
+    memcpy(this->last_second, this->current, sizeof(this->current));
+    memset(this->current, 0, sizeof(this->current));
+    this->second_start_ms = now_ms;
+  }
+}
+
+
+// Queue a frame without MASTER_TIME to stamp (forwarded frames, frames of the remote control)
+boolean MlsTxScheduler::enqueue(uint8_t tx_class, const uint8_t *data, uint8_t length) {
+  return this->enqueue(tx_class, data, length, MLS_TX_NO_TIME);
+}
+
+
+// Queue a frame in its class (the oldest frame of the class is dropped if the queue is full), and send it if the radio is free
+// The MASTER_TIME at time_offset is the master time of the enqueue, the time spent in the queue is added when it is sent
+// Also called from the LoRa interrupt (lora_receive_cb)
+boolean MlsTxScheduler::enqueue(uint8_t tx_class, const uint8_t *data, uint8_t length, uint8_t time_offset) {
+  uint8_t index;
+  boolean in_isr = xPortInIsrContext();
+
+  if ((tx_class >= MLS_TX_CLASSES) || (length > MLSMESH_WIRE_MAX_SIZE)) {
+    return false;
+  }
+  if ((MLS_TX_NO_TIME != time_offset) && ((time_offset + sizeof(uint32_t)) > length)) {
+    return false;
+  }
+  if (in_isr) {
+    portENTER_CRITICAL_ISR(&this->mux);
+  } else {
+    portENTER_CRITICAL(&this->mux);
+  }
+  if (MLS_TX_QUEUE_SIZE == this->waiting[tx_class]) {
+    this->head[tx_class] = (this->head[tx_class] + 1) % MLS_TX_QUEUE_SIZE;
+    this->waiting[tx_class]--;
+    this->current[tx_class].drops++;
+  }
+  index = (this->head[tx_class] + this->waiting[tx_class]) % MLS_TX_QUEUE_SIZE;
+  this->queue[tx_class][index].length = length;
+  this->queue[tx_class][index].time_offset = time_offset;
+  this->queue[tx_class][index].enqueued_micros = micros();
+  memcpy(this->queue[tx_class][index].data, data, length);
+  this->waiting[tx_class]++;
+  if (in_isr) {
+    portEXIT_CRITICAL_ISR(&this->mux);
+  } else {
+    portEXIT_CRITICAL(&this->mux);
+  }
+
+  // esp_now_send must not be called in an interrupt (LoRa callback), the next pump will send it
+  if (!in_isr) {
+    this->pump();
+  }
+  return true;
+}
+
+
+// Send the next frame, if the radio is free
+void MlsTxScheduler::pump() {
+  struct MLS_TX_FRAME frame;
+  uint8_t tx_class;
+  boolean found = false;
+  uint32_t now_ms = millis();
+  uint32_t delay_micros;
+  uint32_t master_time;
+
+  portENTER_CRITICAL(&this->mux);
+  this->rollStats(now_ms);
+  if (this->busy && ((micros() - this->busy_since_micros) > MLS_TX_DONE_TIMEOUT_US)) {
+    this->busy = false;
+    this->timeouts++;
+    // Its completion may still come, unless a completion was already ignored during its flight (the lost one)
+    this->expired = (this->ignored_sequence != this->sequence);
+    this->expired_class = this->busy_class;
+  }
+  if (!this->busy) {
+    this->refill(now_ms);
+    for (tx_class = 0; tx_class < MLS_TX_CLASSES; tx_class++) {
+      if ((this->waiting[tx_class] > 0) && ((0 == this->rate[tx_class]) || (this->tokens[tx_class] >= 1000))) {
+        memcpy(&frame, &this->queue[tx_class][this->head[tx_class]], sizeof(struct MLS_TX_FRAME));
+        this->head[tx_class] = (this->head[tx_class] + 1) % MLS_TX_QUEUE_SIZE;
+        this->waiting[tx_class]--;
+        if (0 != this->rate[tx_class]) {
+          this->tokens[tx_class] -= 1000;
+        }
+        this->busy = true;
+        this->busy_class = tx_class;
+        this->busy_since_micros = micros();
+        this->sequence++;
+        this->current[tx_class].sent++;
+        this->current[tx_class].airtime_micros += getAirtimeMicros(frame.length);
+        delay_micros = this->busy_since_micros - frame.enqueued_micros;
+        if (delay_micros > this->current[tx_class].max_delay_micros) {
+          this->current[tx_class].max_delay_micros = delay_micros;
+        }
+        found = true;
+        break;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&this->mux);
+
+  // Stamp the MASTER_TIME with the time of the send
+  if (found && (MLS_TX_NO_TIME != frame.time_offset)) {
+    memcpy(&master_time, &frame.data[frame.time_offset], sizeof(master_time));
+    master_time += micros() - frame.enqueued_micros;
+    memcpy(&frame.data[frame.time_offset], &master_time, sizeof(master_time));
+  }
+  if (found && (ESP_OK != esp_now_send(espnowBroadcastAddress, frame.data, frame.length))) {
+    portENTER_CRITICAL(&this->mux);
+    this->busy = false;
+    this->current[tx_class].failures++;
+    portEXIT_CRITICAL(&this->mux);
+  }
+}
+
+
+// End of the frame in flight (OnEspNowDataSent, Wi-Fi task)
+// The late completion of a timed out frame is charged to its class, and does not end the frame in flight
+void MlsTxScheduler::onSent(boolean success) {
+  portENTER_CRITICAL(&this->mux);
+  if (this->expired) {
+    this->expired = false;
+    this->ignored_sequence = this->sequence;
+    this->late_completions++;
+    if (!success) {
+      this->current[this->expired_class].failures++;
+    }
+  } else if (this->busy) {
+    if (!success) {
+      this->current[this->busy_class].failures++;
+    }
+    this->busy = false;
+  }
+  portEXIT_CRITICAL(&this->mux);
+}
+
+
+boolean MlsTxScheduler::isBusy() {
+  return this->busy;
+}
+
+
+// No frame waiting and no frame in flight
+boolean MlsTxScheduler::isIdle() {
+  boolean idle;
+
+  portENTER_CRITICAL(&this->mux);
+  idle = !this->busy;
+  for (uint8_t tx_class = 0; tx_class < MLS_TX_CLASSES; tx_class++) {
+    idle = idle && (0 == this->waiting[tx_class]);
+  }
+  portEXIT_CRITICAL(&this->mux);
+  return idle;
+}
+
+
+uint8_t MlsTxScheduler::getWaiting(uint8_t tx_class) {
+  return this->waiting[tx_class];
+}
+
+
+uint16_t MlsTxScheduler::getTimeouts() {
+  return this->timeouts;
+}
+
+
+uint16_t MlsTxScheduler::getLateCompletions() {
+  return this->late_completions;
+}
+
+
+void MlsTxScheduler::getLastSecond(uint8_t tx_class, struct MLS_TX_STATS *stats) {
+  portENTER_CRITICAL(&this->mux);
+  memcpy(stats, &this->last_second[tx_class], sizeof(struct MLS_TX_STATS));
+  portEXIT_CRITICAL(&this->mux);
+}
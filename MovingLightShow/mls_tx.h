@@ -0,0 +1,115 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_tx.h
+ * @brief MLSmesh transmit scheduler (priority classes, rate limits, airtime)
+ *
+ * All the MLSmesh frames are sent through one scheduler. Each priority
+ * class has its own small queue (the oldest frame is dropped if it is
+ * full) and an optional token bucket rate limit. One frame is in flight
+ * at a time: the next one is sent when OnEspNowDataSent reports the end
+ * of the previous one (or after MLS_TX_DONE_TIMEOUT_US), always from the
+ * highest priority class which has a frame and a token.
+ *
+ * Each frame handed to esp_now_send gets a sequence number. The send
+ * callbacks come in the order of the sends, so when a frame times out,
+ * the next completion is its late completion: it is ignored (a failure
+ * is charged to the class of the timed out frame), and does not end the
+ * next frame in flight. If that completion never comes, the completion
+ * of the next frame is ignored instead, and the expected late completion
+ * is dropped when that frame times out in turn.
+ *
+ * The MASTER_TIME of an original frame is stamped just before
+ * esp_now_send: the frame is queued with the master time of its enqueue
+ * and the position of its MASTER_TIME, and the scheduler adds the time
+ * spent in the queue. The playout budget of the receivers and their
+ * MlsClock samples start when the frame is really sent. The forwarded
+ * frames keep the MASTER_TIME of the original frame.
+ *
+ * The airtime is estimated at the 1 Mbps ESP-NOW rate, with the fixed
+ * overhead of the vendor action frame (preamble, MAC header and FCS).
+ * The statistics are kept per class for the last full second.
+ *
+ **********************************************************************/
+#ifndef MLS_TX_H
+#define MLS_TX_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "mls_mesh.h"
+  #include "mls_wire.h"
+  #include <stdint.h>
+  #include <esp_now.h>
+
+  #define MLS_TX_BEAT               0    // Light, arm and fire data
+  #define MLS_TX_COMMAND            1    // Commands, actions and CHECK resends
+  #define MLS_TX_TOPOLOGY           2    // Subscriptions, topology replies and RSSI reports
+  #define MLS_TX_KEEP_ALIVE         3    // Keep alive and state beacons
+  #define MLS_TX_CLASSES            4
+
+  #define MLS_TX_FRAME_OVERHEAD_US  (192 + (43 * 8)) // Long preamble, and 43 bytes of vendor action frame at 1 Mbps
+  #define MLS_TX_NO_TIME            0xFF // The frame has no MASTER_TIME to stamp
+
+
+  struct MLS_TX_FRAME {
+    uint8_t length;
+    uint8_t time_offset;            // Position of the MASTER_TIME in data (MLS_TX_NO_TIME: not stamped)
+    uint32_t enqueued_micros;
+    uint8_t data[MLSMESH_WIRE_MAX_SIZE];
+  };
+
+
+  struct MLS_TX_STATS {
+    uint16_t sent;
+    uint16_t drops;                 // Dropped because the queue of the class was full
+    uint16_t failures;              // Refused by esp_now_send or reported as failed
+    uint32_t airtime_micros;
+    uint32_t max_delay_micros;      // Longest time spent in the queue
+  };
+
+
+  class MlsTxScheduler {
+
+    private:
+      struct MLS_TX_FRAME queue[MLS_TX_CLASSES][MLS_TX_QUEUE_SIZE];
+      uint8_t head[MLS_TX_CLASSES];
+      uint8_t waiting[MLS_TX_CLASSES];
+      uint16_t rate[MLS_TX_CLASSES];            // Frames per second (0: no limit)
+      uint16_t burst[MLS_TX_CLASSES];
+      uint32_t tokens[MLS_TX_CLASSES];          // In thousandths of frame
+      uint32_t last_refill_ms;
+      boolean busy;
+      uint8_t busy_class;
+      uint32_t busy_since_micros;
+      uint32_t sequence;                        // Sequence number of the last frame handed to esp_now_send
+      boolean expired;                          // A frame timed out, and its completion is still expected
+      uint8_t expired_class;
+      uint32_t ignored_sequence;                // Frame in flight when the last late completion was ignored
+      uint16_t timeouts;
+      uint16_t late_completions;
+      struct MLS_TX_STATS current[MLS_TX_CLASSES];
+      struct MLS_TX_STATS last_second[MLS_TX_CLASSES];
+      uint32_t second_start_ms;
+      portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+      void refill(uint32_t now_ms);
+      void rollStats(uint32_t now_ms);
+
+    public:
+      MlsTxScheduler();
+      static uint32_t getAirtimeMicros(uint8_t length);
+      void setRate(uint8_t tx_class, uint16_t frames_per_second, uint16_t burst);
+      boolean enqueue(uint8_t tx_class, const uint8_t *data, uint8_t length);
+      boolean enqueue(uint8_t tx_class, const uint8_t *data, uint8_t length, uint8_t time_offset);
+      void pump();
+      void onSent(boolean success);
+      boolean isBusy();
+      boolean isIdle();
+      uint8_t getWaiting(uint8_t tx_class);
+      uint16_t getTimeouts();
+      uint16_t getLateCompletions();
+      void getLastSecond(uint8_t tx_class, struct MLS_TX_STATS *stats);
+  };
+
+#endif
@@ -0,0 +1,249 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_wire.cpp
+ * @brief MLSmesh compact wire format (versioned, optional sections)
+ *
+ **********************************************************************/
+#include "mls_wire.h"
+
+
+// MlsWire constructor
+MlsWire::MlsWire() {
+  memset(this->encoded_bytes, 0, sizeof(this->encoded_bytes));
+  memset(this->encoded_packets, 0, sizeof(this->encoded_packets));
+  this->decode_errors = 0;
+}
+
+
+// Length of data without its trailing default values
+uint8_t MlsWire::trimmedLength(const uint8_t *data, uint8_t size, uint8_t default_value) {
+  while ((size > 0) && (default_value == data[size - 1])) {
+    size--;
+  }
+  return size;
+}
+
+
+// Is the buffer a compact packet (otherwise a fixed MLS_PACKET, or a short fire packet)
+boolean MlsWire::isCompact(const uint8_t *buffer, int len) {
+  return ((len >= MLSMESH_WIRE_HEADER_SIZE) && (MLSMESH_WIRE_VERSION_FLAG == (buffer[3] & MLSMESH_WIRE_VERSION_FLAG)));
+}
+
+
+// Type and destination of a received packet, in any format, without decoding it
+void MlsWire::peekAddress(const uint8_t *buffer, int len, uint8_t *type, uint8_t *destination_id) {
+  *type = 0;
+  *destination_id = 0;
+  if (isCompact(buffer, len)) {
+    *type = buffer[4];
+    // DESTINATION_ID is the first optional section
+    if ((buffer[5] & MLSMESH_WIRE_DESTINATION) && (len > MLSMESH_WIRE_HEADER_SIZE)) {
+      *destination_id = buffer[MLSMESH_WIRE_HEADER_SIZE];
+    }
+  } else if (MLS_PACKET_SIZE == len) {
+    *type = buffer[3];
+    *destination_id = buffer[6];
+  }
+}
+
+
+// Encode a packet in the compact format, the buffer must have MLSMESH_WIRE_MAX_SIZE bytes (return the encoded length)
+uint8_t MlsWire::encode(struct MLS_PACKET *packet, uint8_t *buffer) {
+  uint8_t flags = 0;
+  uint8_t length;
+  uint8_t count;
+  uint8_t *header_flags;
+
+  memcpy(buffer, packet->IID, 3);
+  buffer[3] = MLSMESH_WIRE_VERSION_FLAG | MLSMESH_WIRE_VERSION;
+  buffer[4] = packet->TYPE;
+  header_flags = &buffer[5];
+  buffer[6] = packet->SENDER_ID;
+  memcpy(&buffer[7], &packet->PACKET_ID, 2);
+  buffer[9] = packet->REPEATER_POSITION;
+  memcpy(&buffer[MLSMESH_WIRE_MASTER_TIME], &packet->MASTER_TIME, 4);
+  length = MLSMESH_WIRE_HEADER_SIZE;
+
+  if (0 != packet->DESTINATION_ID) {
+    flags |= MLSMESH_WIRE_DESTINATION;
+    buffer[length++] = packet->DESTINATION_ID;
+  }
+  count = trimmedLength(packet->REPEATERS_ID, MLSMESH_MAX_REPEATERS, 0xFF);
+  if (count > 0) {
+    flags |= MLSMESH_WIRE_REPEATERS;
+    buffer[length++] = count;
+    memcpy(&buffer[length], packet->REPEATERS_ID, count);
+    length += count;
+  }
+  if ((0 != packet->ANNOUNCED_DEVICES) || (0 != packet->NUMBER_OF_COLUMNS) || (0 != packet->NUMBER_OF_RANKS)) {
+    flags |= MLSMESH_WIRE_TOPOLOGY;
+    buffer[length++] = packet->ANNOUNCED_DEVICES;
+    buffer[length++] = packet->NUMBER_OF_COLUMNS;
+    buffer[length++] = packet->NUMBER_OF_RANKS;
+  }
+  count = trimmedLength((uint8_t *) packet->RSSI, sizeof(packet->RSSI), 0);
+  if ((count > 0) || (0 != packet->RSSI0) || (0 != packet->RSSI_SHIFTER)) {
+    flags |= MLSMESH_WIRE_RSSI;
+    buffer[length++] = packet->RSSI0;
+    buffer[length++] = packet->RSSI_SHIFTER;
+    buffer[length++] = count;
+    memcpy(&buffer[length], packet->RSSI, count);
+    length += count;
+  }
+  if ((0 != packet->FIRST_SENDER_ID) || (0 != packet->FIRST_REPEATER_SLOT) || (0 != packet->BETTER_SENDER_ID) || (0 != packet->BETTER_REPEATER_ID)) {
+    flags |= MLSMESH_WIRE_SENDERS;
+    buffer[length++] = packet->FIRST_SENDER_ID;
+    buffer[length++] = packet->FIRST_REPEATER_SLOT;
+    buffer[length++] = packet->BETTER_SENDER_ID;
+    buffer[length++] = packet->BETTER_REPEATER_ID;
+  }
+  if ((0 != packet->COMMAND) || (0 != packet->COMMAND_SENDER_ID) || (0 != packet->COMMAND_PACKET_ID)) {
+    flags |= MLSMESH_WIRE_COMMAND;
+    buffer[length++] = packet->COMMAND;
+    buffer[length++] = packet->COMMAND_SENDER_ID;
+    memcpy(&buffer[length], &packet->COMMAND_PACKET_ID, 2);
+    length += 2;
+  }
+  count = trimmedLength(packet->DATA, MLS_DATA_SIZE, 0);
+  if (count > 0) {
+    flags |= MLSMESH_WIRE_DATA;
+    buffer[length++] = count;
+    memcpy(&buffer[length], packet->DATA, count);
+    length += count;
+  }
+  if (0 != packet->RESERVED) {
+    flags |= MLSMESH_WIRE_RESERVED;
+    buffer[length++] = packet->RESERVED;
+  }
+  *header_flags = flags;
+
+  this->encoded_bytes[packet->TYPE % MLSMESH_WIRE_TYPES] += length;
+  this->encoded_packets[packet->TYPE % MLSMESH_WIRE_TYPES]++;
+  return length;
+}
+
+
+// Decode a compact packet in a full MLS_PACKET (false if the packet is truncated, too long or of an unknown version)
+boolean MlsWire::decode(const uint8_t *buffer, int len, struct MLS_PACKET *packet) {
+  if ((!isCompact(buffer, len)) || (MLSMESH_WIRE_VERSION != (buffer[3] & ~MLSMESH_WIRE_VERSION_FLAG)) || (len > MLSMESH_WIRE_MAX_SIZE)) {
+    this->decode_errors++;
+    return false;
+  }
+  memset(packet->raw, 0, MLS_PACKET_SIZE);
+  memset(packet->REPEATERS_ID, 0xFF, MLSMESH_MAX_REPEATERS);
+  memcpy(packet->IID, buffer, 3);
+  packet->TYPE = buffer[4];
+  packet->SENDER_ID = buffer[6];
+  memcpy(&packet->PACKET_ID, &buffer[7], 2);
+  packet->REPEATER_POSITION = buffer[9];
+  memcpy(&packet->MASTER_TIME, &buffer[MLSMESH_WIRE_MASTER_TIME], 4);
+  if (!decodeSections(buffer[5], buffer, len, packet)) {
+    this->decode_errors++;
+    return false;
+  }
+  return true;
+}
+
+
+// Decode the optional sections, each section is checked against the received length before being read
+boolean MlsWire::decodeSections(uint8_t flags, const uint8_t *buffer, int len, struct MLS_PACKET *packet) {
+  uint8_t count;
+  int position = MLSMESH_WIRE_HEADER_SIZE;
+
+  if (flags & MLSMESH_WIRE_DESTINATION) {
+    if ((position + 1) > len) {
+      return false;
+    }
+    packet->DESTINATION_ID = buffer[position++];
+  }
+  if (flags & MLSMESH_WIRE_REPEATERS) {
+    if ((position + 1) > len) {
+      return false;
+    }
+    count = buffer[position++];
+    if ((count > MLSMESH_MAX_REPEATERS) || ((position + count) > len)) {
+      return false;
+    }
+    memcpy(packet->REPEATERS_ID, &buffer[position], count);
+    position += count;
+  }
+  if (flags & MLSMESH_WIRE_TOPOLOGY) {
+    if ((position + 3) > len) {
+      return false;
+    }
+    packet->ANNOUNCED_DEVICES = buffer[position++];
+    packet->NUMBER_OF_COLUMNS = buffer[position++];
+    packet->NUMBER_OF_RANKS = buffer[position++];
+  }
+  if (flags & MLSMESH_WIRE_RSSI) {
+    if ((position + 3) > len) {
+      return false;
+    }
+    packet->RSSI0 = buffer[position++];
+    packet->RSSI_SHIFTER = buffer[position++];
+    count = buffer[position++];
+    if ((count > sizeof(packet->RSSI)) || ((position + count) > len)) {
+      return false;
+    }
+    memcpy(packet->RSSI, &buffer[position], count);
+    position += count;
+  }
+  if (flags & MLSMESH_WIRE_SENDERS) {
+    if ((position + 4) > len) {
+      return false;
+    }
+    packet->FIRST_SENDER_ID = buffer[position++];
+    packet->FIRST_REPEATER_SLOT = buffer[position++];
+    packet->BETTER_SENDER_ID = buffer[position++];
+    packet->BETTER_REPEATER_ID = buffer[position++];
+  }
+  if (flags & MLSMESH_WIRE_COMMAND) {
+    if ((position + 4) > len) {
+      return false;
+    }
+    packet->COMMAND = buffer[position++];
+    packet->COMMAND_SENDER_ID = buffer[position++];
+    memcpy(&packet->COMMAND_PACKET_ID, &buffer[position], 2);
+    position += 2;
+  }
+  if (flags & MLSMESH_WIRE_DATA) {
+    if ((position + 1) > len) {
+      return false;
+    }
+    count = buffer[position++];
+    if ((count > MLS_DATA_SIZE) || ((position + count) > len)) {
+      return false;
+    }
+    memcpy(packet->DATA, &buffer[position], count);
+    position += count;
+  }
+  if (flags & MLSMESH_WIRE_RESERVED) {
+    if ((position + 1) > len) {
+      return false;
+    }
+    packet->RESERVED = buffer[position++];
+  }
+  return (position == len);
+}
+
+
+uint16_t MlsWire::getDecodeErrors() {
+  return this->decode_errors;
+}
+
+
+uint16_t MlsWire::getEncodedPackets(uint8_t type) {
+  return this->encoded_packets[type % MLSMESH_WIRE_TYPES];
+}
+
+
+// Average encoded size of a packet type (MLS_PACKET_SIZE bytes in the fixed format)
+uint8_t MlsWire::getAverageSize(uint8_t type) {
+  if (0 == this->encoded_packets[type % MLSMESH_WIRE_TYPES]) {
+    return 0;
+  }
+  return this->encoded_bytes[type % MLSMESH_WIRE_TYPES] / this->encoded_packets[type % MLSMESH_WIRE_TYPES];
+}
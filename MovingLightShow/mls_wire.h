@@ -0,0 +1,74 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_wire.h
+ * @brief MLSmesh compact wire format (versioned, optional sections)
+ *
+ * Inside the firmware, a packet is always a full MLS_PACKET. On the air,
+ * it is encoded with a fixed header and only the sections in use:
+ *
+ *   IID[3] VERSION TYPE FLAGS SENDER_ID PACKET_ID[2] REPEATER_POSITION MASTER_TIME[4]
+ *   then, in this order, the sections of FLAGS:
+ *     0x01 DESTINATION_ID
+ *     0x02 count + REPEATERS_ID[count]          (trailing 0xFF removed)
+ *     0x04 ANNOUNCED_DEVICES NUMBER_OF_COLUMNS NUMBER_OF_RANKS
+ *     0x08 RSSI0 RSSI_SHIFTER count + RSSI[count] (trailing 0 removed)
+ *     0x10 FIRST_SENDER_ID FIRST_REPEATER_SLOT BETTER_SENDER_ID BETTER_REPEATER_ID
+ *     0x20 COMMAND COMMAND_SENDER_ID COMMAND_PACKET_ID[2]
+ *     0x40 count + DATA[count]                   (trailing 0 removed)
+ *     0x80 RESERVED
+ *
+ * A section is omitted only if all its fields have their default value,
+ * so that the decoded packet is the original one (the CRC is not carried,
+ * it is not computed by MLSmesh). The MSB of VERSION is set, while it is
+ * never set in the TYPE of a fixed MLS_PACKET: both formats are decoded.
+ *
+ **********************************************************************/
+#ifndef MLS_WIRE_H
+#define MLS_WIRE_H
+
+  #include <Arduino.h>
+  #include "mls_config.h"
+  #include "mls_mesh.h"
+  #include <stdint.h>
+
+  #define MLSMESH_WIRE_VERSION_FLAG      0x80 // Set in the 4th byte of a compact packet
+  #define MLSMESH_WIRE_VERSION           1
+  #define MLSMESH_WIRE_HEADER_SIZE       14
+  #define MLSMESH_WIRE_MASTER_TIME       10   // Position of MASTER_TIME in the header
+  #define MLSMESH_WIRE_MAX_SIZE          (MLSMESH_WIRE_HEADER_SIZE + 1 + (1 + MLSMESH_MAX_REPEATERS) + 3 + (3 + 20) + 4 + 4 + (1 + MLS_DATA_SIZE) + 1)
+  #define MLSMESH_WIRE_TYPES             16   // Statistics per packet type (TYPE & 0x0F)
+
+  #define MLSMESH_WIRE_DESTINATION       0x01
+  #define MLSMESH_WIRE_REPEATERS         0x02
+  #define MLSMESH_WIRE_TOPOLOGY          0x04
+  #define MLSMESH_WIRE_RSSI              0x08
+  #define MLSMESH_WIRE_SENDERS           0x10
+  #define MLSMESH_WIRE_COMMAND           0x20
+  #define MLSMESH_WIRE_DATA              0x40
+  #define MLSMESH_WIRE_RESERVED          0x80
+
+
+  class MlsWire {
+
+    private:
+      uint32_t encoded_bytes[MLSMESH_WIRE_TYPES];
+      uint16_t encoded_packets[MLSMESH_WIRE_TYPES];
+      uint16_t decode_errors;
+      static uint8_t trimmedLength(const uint8_t *data, uint8_t size, uint8_t default_value);
+      boolean decodeSections(uint8_t flags, const uint8_t *buffer, int len, struct MLS_PACKET *packet);
+
+    public:
+      MlsWire();
+      static boolean isCompact(const uint8_t *buffer, int len);
+      static void peekAddress(const uint8_t *buffer, int len, uint8_t *type, uint8_t *destination_id);
+      uint8_t encode(struct MLS_PACKET *packet, uint8_t *buffer);
+      boolean decode(const uint8_t *buffer, int len, struct MLS_PACKET *packet);
+      uint16_t getDecodeErrors();
+      uint16_t getEncodedPackets(uint8_t type);
+      uint8_t getAverageSize(uint8_t type);
+  };
+
+#endif
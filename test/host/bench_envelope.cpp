@@ -0,0 +1,270 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  bench_envelope.cpp
+ * @brief Cost and accuracy of the envelope evaluation
+ *
+ * The BREATH and HEARTBEAT colors of a frame are computed by the fade
+ * ladders of the first effects (a chain of time tests, divisions for
+ * the level, and three divisions by 255 in adjustBrightness, copied
+ * here), and by MlsEnvelope with the multiply-shift division by 255 of
+ * the current adjustBrightness (copied here too, the LED fill is left
+ * out). The Q16 slope of the first MlsEnvelope (32 bits multiply-shift,
+ * copied here) is compared with the Q32 slope (64 bits multiply and
+ * rounding). The envelopes are compiled before the frames, as they are
+ * compiled when the light data is received. The durations and the
+ * diastole level are read at run time, as they are read from the strip
+ * data by the effects (constant values would turn the divisions of the
+ * ladders into multiplications). A frame evaluates both strips. The
+ * cycles are read with the TSC on x86 (the ratio between both is the
+ * useful figure, the ESP32 cost is not the host one).
+ *
+ **********************************************************************/
+#include "mls_host.h"
+#include "mls_envelope.h"
+#include <FastLED.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+#define BENCH_FRAMES       2000000
+#define BENCH_RUNS         5       // The best run is kept, the others are disturbed by the host
+#define BENCH_FRAME_MICROS 10000
+
+static volatile uint32_t sink = 0;
+
+// Default BREATH and HEARTBEAT parameters, read at run time
+static volatile uint16_t breath_duration_ms = 5000;
+static volatile uint16_t heartbeat_duration_ms = 1000;
+static volatile uint8_t heartbeat_option = 224;
+
+
+// Previous fade in evaluation, with the Q16 slope
+class EnvelopeQ16 {
+
+  private:
+    uint32_t duration_micros;
+    int32_t slope;
+    uint8_t start_level;
+    uint8_t end_level;
+
+  public:
+    void ramp(uint32_t duration_micros, uint8_t start_level, uint8_t end_level) {
+      this->duration_micros = duration_micros;
+      this->start_level = start_level;
+      this->end_level = end_level;
+      this->slope = (((int32_t) end_level - (int32_t) start_level) * 65536) / (int32_t) duration_micros;
+    }
+
+    uint8_t getLevel(int32_t delta_time_micros) {
+      if (((uint32_t) delta_time_micros) >= this->duration_micros) {
+        return this->end_level;
+      }
+      return this->start_level + ((delta_time_micros * this->slope) >> 16);
+    }
+};
+
+
+// Brightness of the first effects, with three divisions
+static struct CRGB adjustBrightnessDivide(struct CRGB color, uint8_t brightness) {
+  return CRGB((brightness * color.r) / 255, (brightness * color.g) / 255, (brightness * color.b) / 255);
+}
+
+
+// Brightness of MlsLightEffects, exact division by 255 without division
+static uint8_t divide255(uint16_t value) {
+  return (value + 1 + (value >> 8)) >> 8;
+}
+
+
+static struct CRGB adjustBrightness(struct CRGB color, uint8_t brightness) {
+  return CRGB(divide255(brightness * color.r), divide255(brightness * color.g), divide255(brightness * color.b));
+}
+
+
+// Fade ladder of the first BREATH effect
+static struct CRGB ladderBreath(struct CRGB color, uint16_t duration_ms, int32_t delta_time_micros) {
+  struct CRGB new_color = color;
+  uint32_t breath_fadein_time_micros = 350 * duration_ms;
+  uint32_t breath_on_time_micros = 100 * duration_ms;
+  uint32_t breath_fadeout_time_micros = 350 * duration_ms;
+
+  if ((delta_time_micros >= 0) && (breath_fadein_time_micros > 0) && (delta_time_micros < breath_fadein_time_micros)) {
+    new_color = adjustBrightnessDivide(new_color, 63 + (192 * delta_time_micros / breath_fadein_time_micros));
+  } else if ((delta_time_micros >= 0) && (delta_time_micros < (breath_fadein_time_micros + breath_on_time_micros))) {
+  } else if ((delta_time_micros >= 0) && (breath_fadeout_time_micros > 0) && (delta_time_micros < (breath_fadein_time_micros + breath_on_time_micros + breath_fadeout_time_micros))) {
+    new_color = adjustBrightnessDivide(new_color, 63 + (192 * (breath_fadeout_time_micros - (delta_time_micros - breath_fadein_time_micros - breath_on_time_micros)) / breath_fadeout_time_micros));
+  } else {
+    new_color = adjustBrightnessDivide(new_color, 63);
+  }
+  return new_color;
+}
+
+
+// Fade ladder of the first HEARTBEAT effect
+static struct CRGB ladderHeartbeat(struct CRGB color, uint16_t duration_ms, uint8_t option, int32_t delta_time_micros) {
+  struct CRGB new_color = color;
+  struct CRGB diastole_color;
+  uint32_t systole_fadein_time_micros = 50 * duration_ms;
+  uint32_t systole_on_time_micros = 100 * duration_ms;
+  uint32_t systole_fadeout_time_micros = 300 * duration_ms;
+  uint32_t diastole_time_micros = 350 * duration_ms;
+  uint32_t diastole_fadein_time_micros = 0;
+  uint32_t diastole_on_time_micros = 100 * duration_ms;
+  uint32_t diastole_fadeout_time_micros = 450 * duration_ms;
+
+  diastole_color = adjustBrightnessDivide(new_color, option);
+  if (((delta_time_micros) >= diastole_time_micros) && (diastole_fadein_time_micros > 0) && ((delta_time_micros - diastole_time_micros) <= (diastole_fadein_time_micros))) {
+    new_color = adjustBrightnessDivide(diastole_color, 255 * (delta_time_micros - diastole_time_micros)  / diastole_fadein_time_micros);
+  } else if (((delta_time_micros) >= diastole_time_micros) && ((delta_time_micros - diastole_time_micros) < (diastole_fadein_time_micros + diastole_on_time_micros))) {
+    new_color = diastole_color;
+  } else if (((delta_time_micros) >= diastole_time_micros) && (diastole_fadeout_time_micros > 0) && ((delta_time_micros - diastole_time_micros) < (diastole_fadein_time_micros + diastole_on_time_micros + diastole_fadeout_time_micros))) {
+    new_color = adjustBrightnessDivide(diastole_color, 255 * (diastole_time_micros
+    + diastole_fadeout_time_micros - ((delta_time_micros) - diastole_fadein_time_micros - diastole_on_time_micros)) / diastole_fadeout_time_micros);
+  } else if ((delta_time_micros) >= (diastole_time_micros + diastole_time_micros + diastole_on_time_micros + diastole_fadeout_time_micros)) {
+    new_color = CRGB::Black;
+  } else if ((delta_time_micros >= 0) && (systole_fadein_time_micros > 0) && (delta_time_micros < systole_fadein_time_micros)) {
+    new_color = adjustBrightnessDivide(new_color, 255 * delta_time_micros / systole_fadein_time_micros);
+  } else if ((delta_time_micros >= 0) && (delta_time_micros < (systole_fadein_time_micros + systole_on_time_micros))) {
+  } else if ((delta_time_micros >= 0) && (systole_fadeout_time_micros > 0) && (delta_time_micros < (systole_fadein_time_micros + systole_on_time_micros + systole_fadeout_time_micros))) {
+    new_color = adjustBrightnessDivide(new_color, 255 * (systole_fadeout_time_micros - (delta_time_micros - systole_fadein_time_micros - systole_on_time_micros)) / systole_fadeout_time_micros);
+  } else {
+    new_color = CRGB::Black;
+  }
+  return new_color;
+}
+
+
+// Envelope of the HEARTBEAT effect, as compiled by MlsLightEffects
+static void compileHeartbeat(MlsEnvelope *envelope, uint16_t duration_ms, uint8_t option) {
+  uint32_t systole_fadein_time_micros = 50 * duration_ms;
+  uint32_t systole_on_time_micros = 100 * duration_ms;
+  uint32_t systole_fadeout_time_micros = 300 * duration_ms;
+  uint32_t diastole_time_micros = 350 * duration_ms;
+  uint32_t diastole_on_time_micros = 100 * duration_ms;
+  uint32_t diastole_fadeout_time_micros = 450 * duration_ms;
+  uint32_t systole_cut_time_micros = diastole_time_micros - systole_fadein_time_micros - systole_on_time_micros;
+
+  envelope->begin(1, 0);
+  envelope->ramp(systole_fadein_time_micros, 255);
+  envelope->hold(systole_on_time_micros);
+  envelope->ramp(systole_cut_time_micros, 255 * (systole_fadeout_time_micros - systole_cut_time_micros) / systole_fadeout_time_micros);
+  envelope->jump(option);
+  envelope->hold(diastole_on_time_micros);
+  envelope->ramp(diastole_fadeout_time_micros, 0);
+}
+
+
+static uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+// Cycles per frame of a repeated effect, one frame every BENCH_FRAME_MICROS (the delta time
+// is stepped without a division, which would cost more than the envelope)
+template <typename FRAME>
+static double cyclesPerFrame(uint32_t period_micros, FRAME frame) {
+  uint64_t best_cycles = UINT64_MAX;
+  uint64_t start;
+  uint64_t cycles;
+  int32_t delta_micros;
+
+  for (uint8_t run = 0; run < BENCH_RUNS; run++) {
+    delta_micros = 0;
+    start = readCycles();
+    for (uint32_t i = 0; i < BENCH_FRAMES; i++) {
+      frame(delta_micros);
+      delta_micros += BENCH_FRAME_MICROS;
+      if (((uint32_t) delta_micros) >= period_micros) {
+        delta_micros -= period_micros;
+      }
+    }
+    cycles = readCycles() - start;
+    if (cycles < best_cycles) {
+      best_cycles = cycles;
+    }
+  }
+  return (double) best_cycles / BENCH_FRAMES;
+}
+
+
+int main(int argc, char **argv) {
+  const uint32_t durations_ms[] = {1000, 20000, 60000};
+  uint32_t fade_micros;
+
+  printf("Breath fade in (63 to 255)   Q16 midpoint/last   Q32 midpoint/last   exact midpoint\n");
+  for (uint8_t i = 0; i < 3; i++) {
+    EnvelopeQ16 before;
+    MlsEnvelope after;
+    fade_micros = 350 * durations_ms[i];
+    before.ramp(fade_micros, 63, 255);
+    after.compileFade(1, 0, fade_micros, 0, 0, 63, 255);
+    printf("  %5u ms                     %3u / %3u           %3u / %3u           %.1f\n", durations_ms[i],
+           before.getLevel(fade_micros / 2), before.getLevel(fade_micros - 1),
+           after.getLevel(fade_micros / 2), after.getLevel(fade_micros - 1), 63.0 + 96.0);
+  }
+
+  // One frame every 10 ms of a 5 s breath (the default duration), both strips
+  EnvelopeQ16 before[2];
+  MlsEnvelope after[2];
+  fade_micros = 350 * 5000;
+  for (uint8_t lr = 0; lr < 2; lr++) {
+    before[lr].ramp(fade_micros, 63, 255);
+    after[lr].compileFade(1, 0, fade_micros, 0, 0, 63, 255);
+  }
+  printf("Cycles per frame (2 strips): before (Q16) %.1f, after (Q32) %.1f\n",
+         cyclesPerFrame(fade_micros, [&](int32_t delta_micros) {
+           sink += before[0].getLevel(delta_micros) + before[1].getLevel(delta_micros);
+         }),
+         cyclesPerFrame(fade_micros, [&](int32_t delta_micros) {
+           sink += after[0].getLevel(delta_micros) + after[1].getLevel(delta_micros);
+         }));
+
+  // Colors of a 5 s BREATH and of a 1 s HEARTBEAT (default durations), one frame every 10 ms, both strips
+  const struct CRGB colors[2] = {CRGB(0, 255, 0), CRGB(255, 0, 0)};
+  uint16_t breath_ms = breath_duration_ms;
+  uint16_t heartbeat_ms = heartbeat_duration_ms;
+  uint8_t option = heartbeat_option;
+  MlsEnvelope breath[2];
+  MlsEnvelope heartbeat[2];
+  for (uint8_t lr = 0; lr < 2; lr++) {
+    breath[lr].compileFade(1, 0, 350 * breath_ms, 100 * breath_ms, 350 * breath_ms, 63, 255);
+    compileHeartbeat(&heartbeat[lr], heartbeat_ms, option);
+  }
+
+  printf("Breath cycles per frame (2 strips): fade ladder %.1f, envelope %.1f\n",
+         cyclesPerFrame(1000 * breath_ms, [&](int32_t delta_micros) {
+           for (uint8_t lr = 0; lr < 2; lr++) {
+             struct CRGB color = ladderBreath(colors[lr], breath_ms, delta_micros);
+             sink += color.r + color.g + color.b;
+           }
+         }),
+         cyclesPerFrame(1000 * breath_ms, [&](int32_t delta_micros) {
+           for (uint8_t lr = 0; lr < 2; lr++) {
+             struct CRGB color = adjustBrightness(colors[lr], breath[lr].getLevel(delta_micros));
+             sink += color.r + color.g + color.b;
+           }
+         }));
+
+  printf("Heartbeat cycles per frame (2 strips): fade ladder %.1f, envelope %.1f\n",
+         cyclesPerFrame(1000 * heartbeat_ms, [&](int32_t delta_micros) {
+           for (uint8_t lr = 0; lr < 2; lr++) {
+             struct CRGB color = ladderHeartbeat(colors[lr], heartbeat_ms, option, delta_micros);
+             sink += color.r + color.g + color.b;
+           }
+         }),
+         cyclesPerFrame(1000 * heartbeat_ms, [&](int32_t delta_micros) {
+           for (uint8_t lr = 0; lr < 2; lr++) {
+             struct CRGB color = adjustBrightness(colors[lr], heartbeat[lr].getLevel(delta_micros));
+             sink += color.r + color.g + color.b;
+           }
+         }));
+  return 0;
+}
@@ -0,0 +1,267 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  bench_light_effects.cpp
+ * @brief Cost of updateLight() per frame, defaults per frame or at ingest
+ *
+ * "Before" runs the default-rewriting switch of the previous
+ * updateLight() and the rank timings of the previous VUE_METER and
+ * WAVE_BACK effects (copied here) on the data of both strips before each
+ * frame, as they were computed at every frame. "After" is updateLight()
+ * alone, with the defaults and the rank timings compiled once by
+ * setLightData. The device is in the third of four ranks, so that the
+ * ranks are delayed and faded in. A frame renders both strips of
+ * NUM_LEDS_PER_STRIP LEDs, every 10 ms, without LED driver.
+ * The cycles are read with the TSC on x86 (the ratio between both is
+ * the useful figure, the ESP32 cost is not the host one).
+ *
+ **********************************************************************/
+#include "mls_host.h"
+#include "mls_light_effects.h"
+#include <chrono>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+#define BENCH_FRAMES        20000
+#define BENCH_FRAME_MICROS  10000
+#define BENCH_START_MICROS  1000000
+
+static MlsArena arena;
+static struct CRGB left_leds[NUM_LEDS_PER_STRIP];
+static struct CRGB right_leds[NUM_LEDS_PER_STRIP];
+static MlsLightEffects effects(NUM_LEDS_PER_STRIP, left_leds, right_leds);
+
+// Not static, so that the rewriting of the previous updateLight() is not optimized out
+struct STRIP_DATA bench_strip_data[2];
+uint32_t bench_rank_start_delay_micros[2];
+
+
+// Default values rewritten at every frame by the previous updateLight() switch
+static void rewriteDefaults(struct STRIP_DATA *actual_data, uint8_t lr) {
+  switch (actual_data->effect) {
+    case EFFECT_FLASH_YELLOW:
+      actual_data->fadein_time_micros = 0;
+      actual_data->on_time_micros = 30000;
+      actual_data->fadeout_time_micros = 350000;
+      actual_data->color_r = 255; actual_data->color_g = 165; actual_data->color_b = 0;
+      break;
+    case EFFECT_FLASH_ALTERNATE:
+      actual_data->fadein_time_micros = 0;
+      actual_data->on_time_micros = 30000;
+      actual_data->fadeout_time_micros = 350000;
+      break;
+    case EFFECT_STROBE:
+      actual_data->repeat = true;
+      if (actual_data->duration_ms == 0) {
+        actual_data->duration_ms = 120;
+      }
+      actual_data->fadein_time_micros = 0;
+      actual_data->on_time_micros = 30000;
+      actual_data->fadeout_time_micros = 0;
+      actual_data->color_r = 255; actual_data->color_g = 255; actual_data->color_b = 255;
+      break;
+    case EFFECT_VUE_METER:
+      if (actual_data->option == 0) {
+        actual_data->option = 50; // Default minimum on time of the max level in ms
+      }
+      if (actual_data->duration_ms == 0) {
+        actual_data->duration_ms = 300; // Default effect duration
+      }
+      break;
+    case EFFECT_WAVE_BACK:
+      if (actual_data->option == 0) {
+        actual_data->option = 50; // Default minimum on time for all in ms
+      }
+      if (actual_data->duration_ms == 0) {
+        actual_data->duration_ms = 300; // Default effect duration
+      }
+      break;
+    case EFFECT_3_STEPS_ALTERNATE:
+    case EFFECT_RAINBOW_RANK_BEAT:
+      actual_data->fadein_time_micros = 0;
+      actual_data->on_time_micros = 30000;
+      actual_data->fadeout_time_micros = 350000;
+      break;
+    case EFFECT_3_STEPS:
+      actual_data->fadein_time_micros = 0;
+      actual_data->on_time_micros = 30000;
+      actual_data->fadeout_time_micros = 350000;
+      if (0 == (actual_data->color_r + actual_data->color_g +  actual_data->color_b)) {
+        if (0 == lr) {
+          actual_data->color_r = 0; actual_data->color_g = 255; actual_data->color_b = 0;
+        } else {
+          actual_data->color_r = 255; actual_data->color_g = 0; actual_data->color_b = 0;
+        }
+      }
+      break;
+    case EFFECT_HEARTBEAT:
+      actual_data->repeat = true;
+      if (actual_data->duration_ms == 0) {
+        actual_data->duration_ms = 1000; // Default effect duration
+      }
+      if (actual_data->option == 0) {
+        actual_data->option = 224; // Default diastole brigthtness
+      }
+      if ((0 == actual_data->color_r) && (0 == actual_data->color_g) && (0 == actual_data->color_b)) {
+        actual_data->color_r = 255; actual_data->color_g = 0; actual_data->color_b = 0;
+      }
+      break;
+    case EFFECT_PROGRESS4:
+      actual_data->option = 4;
+    case EFFECT_PROGRESS:
+      actual_data->repeat = true;
+      if (actual_data->duration_ms == 0) {
+        actual_data->duration_ms = 300;
+      }
+      if (actual_data->option == 0) {
+        actual_data->option = 3;
+      }
+      break;
+    case EFFECT_PROGRESS_RAINBOW:
+      actual_data->repeat = true;
+      if (actual_data->duration_ms == 0) {
+        actual_data->duration_ms = 300;
+      }
+      break;
+    case EFFECT_BREATH:
+      actual_data->repeat = true;
+      if (actual_data->duration_ms == 0) {
+        actual_data->duration_ms = 5000; // Default effect duration
+      }
+      if ((0 == actual_data->color_r) && (0 == actual_data->color_g) && (0 == actual_data->color_b)) {
+        actual_data->color_r = 0; actual_data->color_g = 255; actual_data->color_b = 0;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+
+// Rank timings computed at every frame by the previous VUE_METER and WAVE_BACK effects
+static void rewriteRankTimings(struct STRIP_DATA *actual_data, uint8_t lr, uint8_t number_of_ranks, uint8_t my_rank) {
+  uint32_t shift_delay_micros;
+  uint32_t rank_start_delay_micros;
+  uint8_t effective_ranks = number_of_ranks;
+  uint8_t effective_rank = my_rank;
+
+  if (effective_ranks < 2) {
+    effective_ranks = 2;
+  }
+  if (effective_rank < 1) {
+    effective_rank = 1;
+  }
+  switch (actual_data->effect) {
+    case EFFECT_VUE_METER:
+      shift_delay_micros = 1000 * (actual_data->duration_ms - actual_data->option) / (2 * (effective_ranks - 1));
+      rank_start_delay_micros = (effective_rank - 1) * shift_delay_micros;
+      actual_data->fadeout_time_micros = shift_delay_micros;
+      actual_data->on_time_micros = (1000 * actual_data->option) + (2 * (effective_ranks - effective_rank) * shift_delay_micros);
+      break;
+    case EFFECT_WAVE_BACK:
+      shift_delay_micros = 1000 * (actual_data->duration_ms - actual_data->option) / (effective_ranks - 1);
+      rank_start_delay_micros = (effective_rank - 1) * shift_delay_micros;
+      actual_data->fadeout_time_micros = shift_delay_micros;
+      actual_data->on_time_micros = (1000 * actual_data->option) + ((effective_ranks - effective_rank) * shift_delay_micros);
+      break;
+    default:
+      return;
+  }
+  if (my_rank > 1) {
+    actual_data->fadein_time_micros = shift_delay_micros;
+    rank_start_delay_micros = rank_start_delay_micros - shift_delay_micros;
+  }
+  bench_rank_start_delay_micros[lr] = rank_start_delay_micros;
+}
+
+
+static uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+// Cycles per frame of an effect started now, with or without the default rewriting before each frame
+static double benchEffect(uint16_t packet_id, uint8_t effect, boolean rewrite) {
+  struct LIGHT_PACKET packet;
+  struct STRIP_DATA *strip_data = bench_strip_data;
+  uint64_t start;
+  uint64_t cycles = 0;
+
+  memset(&packet, 0, sizeof(packet));
+  packet.effect = effect;
+  packet.left_fadein_time = 2; packet.left_on_time = 3; packet.left_fadeout_time = 5;
+  packet.right_fadein_time = 2; packet.right_on_time = 3; packet.right_fadeout_time = 5;
+  memset(strip_data, 0, sizeof(bench_strip_data));
+  for (uint8_t lr = 0; lr < 2; lr++) {
+    strip_data[lr].effect = effect;
+    strip_data[lr].leds_per_strip = NUM_LEDS_PER_STRIP;
+    strip_data[lr].fadein_time_micros = 20000;
+    strip_data[lr].on_time_micros = 30000;
+    strip_data[lr].fadeout_time_micros = 50000;
+  }
+
+  effects.setLightData(packet_id, &packet);
+  for (uint32_t frame = 0; frame < BENCH_FRAMES; frame++) {
+    start = readCycles();
+    if (rewrite) {
+      for (uint8_t lr = 0; lr < 2; lr++) {
+        rewriteDefaults(&strip_data[lr], lr);
+        rewriteRankTimings(&strip_data[lr], lr, effects.getRanks(), effects.getMyRank());
+      }
+    }
+    effects.updateLight(micros());
+    cycles += readCycles() - start;
+    mls_host_advance_micros(BENCH_FRAME_MICROS);
+  }
+  return (double) cycles / BENCH_FRAMES;
+}
+
+
+int main(int argc, char **argv) {
+  const struct {
+    const char *name;
+    uint8_t effect;
+  } bench_effects[] = {
+    {"Flash yellow", EFFECT_FLASH_YELLOW},
+    {"Strobe",       EFFECT_STROBE},
+    {"Vue meter",    EFFECT_VUE_METER},
+    {"Wave back",    EFFECT_WAVE_BACK},
+    {"3 steps",      EFFECT_3_STEPS},
+    {"Heartbeat",    EFFECT_HEARTBEAT},
+    {"Progress",     EFFECT_PROGRESS},
+    {"Breath",       EFFECT_BREATH},
+  };
+  uint16_t packet_id = 1;
+  double before_cycles;
+  double after_cycles;
+  double before_total = 0;
+  double after_total = 0;
+
+  mls_host_set_micros(BENCH_START_MICROS);
+  randomSeed(1);
+  effects.begin(&arena, NUM_LEDS_PER_STRIP);
+  effects.setRanks(4);
+  effects.setColumns(2);
+  effects.setMyRank(3);
+  effects.setMyColumn(0);
+
+  printf("Cycles per frame (2 strips of %u LEDs)   before (per frame)   after (at ingest)\n", NUM_LEDS_PER_STRIP);
+  for (uint8_t i = 0; i < (sizeof(bench_effects) / sizeof(bench_effects[0])); i++) {
+    before_cycles = benchEffect(packet_id++, bench_effects[i].effect, true);
+    after_cycles = benchEffect(packet_id++, bench_effects[i].effect, false);
+    before_total += before_cycles;
+    after_total += after_cycles;
+    printf("  %-12s                           %8.1f             %8.1f\n", bench_effects[i].name, before_cycles, after_cycles);
+  }
+  printf("  Mean                                   %8.1f             %8.1f\n",
+         before_total / (sizeof(bench_effects) / sizeof(bench_effects[0])), after_total / (sizeof(bench_effects) / sizeof(bench_effects[0])));
+  return 0;
+}
@@ -0,0 +1,200 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  bench_registry.cpp
+ * @brief Cost of the registry operations during a subscription storm
+ *
+ * The registry is filled like a storm (MLSMESH_MAX_DEVICES devices), then
+ * every request is searched again (hits), the devices over the limit keep
+ * asking (misses and refused add, the full registry path), a storm of
+ * BENCH_REQUESTS devices asks again and again, and the repeater election
+ * scans the stale devices. The registry can not hold BENCH_REQUESTS
+ * devices: the device ids are uint8_t (0xFF is MLSMESH_UNKNOWN_DEVICE),
+ * and the hash table is sized for MLSMESH_MAX_DEVICES. "Before" is the
+ * linear scan of the MAC addresses (copied here), "after" is the hash
+ * table of MlsRegistry. The cycles are read with the TSC on x86 (the
+ * ratio between both is the useful figure, the ESP32 cost is not the
+ * host one).
+ *
+ **********************************************************************/
+#include "mls_host.h"
+#include "mls_registry.h"
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+#define BENCH_ROUNDS        2000
+#define BENCH_STORM_ROUNDS  200
+#define BENCH_REQUESTS      1000 // Devices asking for a subscription (registered or refused)
+
+
+// Previous search, a scan of all the MAC addresses
+class LinearRegistry {
+
+  private:
+    uint8_t mac[MLSMESH_MAX_DEVICES][6];
+    uint8_t number_of_devices;
+
+  public:
+    LinearRegistry() : number_of_devices(0) {}
+
+    uint8_t search(const uint8_t *mac) {
+      for (uint8_t id = 0; id < this->number_of_devices; id++) {
+        if (memcmp(this->mac[id], mac, 6) == 0) {
+          return id;
+        }
+      }
+      return MLSMESH_UNKNOWN_DEVICE;
+    }
+
+    uint8_t add(const uint8_t *mac) {
+      uint8_t id = this->search(mac);
+      if ((MLSMESH_UNKNOWN_DEVICE != id) || (this->number_of_devices >= MLSMESH_MAX_DEVICES)) {
+        return id;
+      }
+      memcpy(this->mac[this->number_of_devices], mac, 6);
+      return this->number_of_devices++;
+    }
+};
+
+
+static uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+static void makeMac(uint16_t n, uint8_t *mac) {
+  mac[0] = 0x24;
+  mac[1] = 0x0A;
+  mac[2] = 0xC4;
+  mac[3] = 0x5F;
+  mac[4] = (uint8_t) (n >> 8);
+  mac[5] = (uint8_t) n;
+}
+
+
+int main(int argc, char **argv) {
+  static uint8_t macs[BENCH_REQUESTS][6];
+  MlsRegistry *after = new MlsRegistry();
+  LinearRegistry *before = new LinearRegistry();
+  uint64_t start;
+  uint64_t before_cycles;
+  uint64_t after_cycles;
+  volatile uint32_t sink = 0;
+
+  for (uint16_t n = 0; n < BENCH_REQUESTS; n++) {
+    makeMac(n, macs[n]);
+  }
+
+  // Registration of all the devices
+  start = readCycles();
+  for (uint16_t n = 0; n < MLSMESH_MAX_DEVICES; n++) {
+    sink += before->add(macs[n]);
+  }
+  before_cycles = readCycles() - start;
+  start = readCycles();
+  for (uint16_t n = 0; n < MLSMESH_MAX_DEVICES; n++) {
+    sink += after->add(macs[n], n / 10, n % 10);
+  }
+  after_cycles = readCycles() - start;
+  printf("Registration of %u devices, cycles per add:            before (scan) %7.1f, after (hash) %6.1f\n",
+         MLSMESH_MAX_DEVICES, (double) before_cycles / MLSMESH_MAX_DEVICES, (double) after_cycles / MLSMESH_MAX_DEVICES);
+
+  // Requests of registered devices (retries, keep alive): search hits
+  start = readCycles();
+  for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+    for (uint16_t n = 0; n < MLSMESH_MAX_DEVICES; n++) {
+      sink += before->search(macs[n]);
+    }
+  }
+  before_cycles = readCycles() - start;
+  start = readCycles();
+  for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+    for (uint16_t n = 0; n < MLSMESH_MAX_DEVICES; n++) {
+      sink += after->search(macs[n]);
+    }
+  }
+  after_cycles = readCycles() - start;
+  printf("Search of a registered device, cycles:                before (scan) %7.1f, after (hash) %6.1f\n",
+         (double) before_cycles / (BENCH_ROUNDS * MLSMESH_MAX_DEVICES), (double) after_cycles / (BENCH_ROUNDS * MLSMESH_MAX_DEVICES));
+
+  // Requests of the devices over the limit: search miss and refused add
+  start = readCycles();
+  for (uint32_t round = 0; round < BENCH_STORM_ROUNDS; round++) {
+    for (uint16_t n = MLSMESH_MAX_DEVICES; n < BENCH_REQUESTS; n++) {
+      if (MLSMESH_UNKNOWN_DEVICE == before->search(macs[n])) {
+        sink += before->add(macs[n]);
+      }
+    }
+  }
+  before_cycles = readCycles() - start;
+  start = readCycles();
+  for (uint32_t round = 0; round < BENCH_STORM_ROUNDS; round++) {
+    for (uint16_t n = MLSMESH_MAX_DEVICES; n < BENCH_REQUESTS; n++) {
+      if (MLSMESH_UNKNOWN_DEVICE == after->search(macs[n])) {
+        sink += after->add(macs[n], 1, 1);
+      }
+    }
+  }
+  after_cycles = readCycles() - start;
+  printf("Request refused by the full registry, cycles:         before (scan) %7.1f, after (hash) %6.1f\n",
+         (double) before_cycles / (BENCH_STORM_ROUNDS * (BENCH_REQUESTS - MLSMESH_MAX_DEVICES)), (double) after_cycles / (BENCH_STORM_ROUNDS * (BENCH_REQUESTS - MLSMESH_MAX_DEVICES)));
+
+  // Storm of all the requests, registered and refused devices mixed
+  start = readCycles();
+  for (uint32_t round = 0; round < BENCH_STORM_ROUNDS; round++) {
+    for (uint16_t n = 0; n < BENCH_REQUESTS; n++) {
+      if (MLSMESH_UNKNOWN_DEVICE == before->search(macs[n])) {
+        sink += before->add(macs[n]);
+      }
+    }
+  }
+  before_cycles = readCycles() - start;
+  start = readCycles();
+  for (uint32_t round = 0; round < BENCH_STORM_ROUNDS; round++) {
+    for (uint16_t n = 0; n < BENCH_REQUESTS; n++) {
+      if (MLSMESH_UNKNOWN_DEVICE == after->search(macs[n])) {
+        sink += after->add(macs[n], 1, 1);
+      }
+    }
+  }
+  after_cycles = readCycles() - start;
+  printf("Storm of %u requests, cycles per request:           before (scan) %7.1f, after (hash) %6.1f\n",
+         BENCH_REQUESTS, (double) before_cycles / (BENCH_STORM_ROUNDS * BENCH_REQUESTS), (double) after_cycles / (BENCH_STORM_ROUNDS * BENCH_REQUESTS));
+  printf("Hash table: %.2f probes per search\n", (double) after->getProbes() / after->getSearches());
+
+  // Stale scan of the repeater election: all fresh, then one stale device in 8
+  for (uint16_t n = 1; n < MLSMESH_MAX_DEVICES; n++) {
+    after->setRssi(n, -70, 100000);
+  }
+  start = readCycles();
+  for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+    for (uint8_t id = after->nextStale(0, 110000, 30000); MLSMESH_UNKNOWN_DEVICE != id; id = after->nextStale(id, 110000, 30000)) {
+      sink += id;
+    }
+  }
+  before_cycles = readCycles() - start;
+  for (uint16_t n = 1; n < MLSMESH_MAX_DEVICES; n += 8) {
+    after->setRssi(n, -70, 1000);
+  }
+  start = readCycles();
+  for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+    for (uint8_t id = after->nextStale(0, 110000, 30000); MLSMESH_UNKNOWN_DEVICE != id; id = after->nextStale(id, 110000, 30000)) {
+      sink += id;
+    }
+  }
+  after_cycles = readCycles() - start;
+  printf("Stale scan of %u devices, cycles per scan:            no stale device %7.1f, 1 in 8 stale %7.1f\n",
+         MLSMESH_MAX_DEVICES, (double) before_cycles / BENCH_ROUNDS, (double) after_cycles / BENCH_ROUNDS);
+
+  delete after;
+  delete before;
+  return 0;
+}
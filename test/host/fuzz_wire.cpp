@@ -0,0 +1,105 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  fuzz_wire.cpp
+ * @brief Fuzz target of the MlsWire decoder
+ *
+ * Any received buffer is given to MlsWire::decode(). A decoded packet
+ * must be encoded in a valid compact packet, which is decoded in the same
+ * packet again (the encoding of a decoded packet is canonical).
+ *
+ * With MLS_FUZZ=ON (clang), the target is built with libFuzzer and the
+ * address sanitizer. Otherwise, the main below is a short deterministic
+ * run on mutated copies of valid packets, registered as a test.
+ *
+ *   cmake -S . -B fuzz -DCMAKE_CXX_COMPILER=clang++ -DMLS_FUZZ=ON
+ *   cmake --build fuzz --target fuzz_wire && fuzz/test/host/fuzz_wire
+ *
+ **********************************************************************/
+#include "mls_host.h"
+#include "mls_wire.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static MlsWire wire;
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  struct MLS_PACKET packet;
+  struct MLS_PACKET decoded;
+  uint8_t buffer[MLSMESH_WIRE_MAX_SIZE];
+  uint8_t length;
+
+  if ((size > 255) || (!wire.decode(data, size, &packet))) {
+    return 0;
+  }
+  length = wire.encode(&packet, buffer);
+  if ((length > MLSMESH_WIRE_MAX_SIZE) || (length > size)) {
+    abort();
+  }
+  if ((!wire.decode(buffer, length, &decoded)) || (0 != memcmp(packet.raw, decoded.raw, MLS_PACKET_SIZE))) {
+    abort();
+  }
+  return 0;
+}
+
+
+#ifndef MLS_LIBFUZZER
+
+// Bytes changed, inserted or removed in a valid packet
+static uint8_t mutate(uint8_t *buffer, uint8_t length) {
+  uint8_t mutations = 1 + random(4);
+
+  for (uint8_t i = 0; i < mutations; i++) {
+    long position = random(length + 1);
+    switch (random(4)) {
+      case 0:
+        if (length < MLSMESH_WIRE_MAX_SIZE) {
+          memmove(&buffer[position + 1], &buffer[position], length - position);
+          buffer[position] = random(256);
+          length++;
+        }
+        break;
+      case 1:
+        if (position < length) {
+          memmove(&buffer[position], &buffer[position + 1], length - position - 1);
+          length--;
+        }
+        break;
+      default:
+        if (position < length) {
+          buffer[position] ^= 1 << random(8);
+        }
+        break;
+    }
+  }
+  return length;
+}
+
+
+int main(int argc, char **argv) {
+  struct MLS_PACKET packet;
+  uint8_t buffer[MLSMESH_WIRE_MAX_SIZE + 4];
+  uint8_t length;
+  uint32_t inputs = 0;
+
+  randomSeed(1806);
+  for (uint32_t i = 0; i < 200000; i++) {
+    memset(packet.raw, 0, MLS_PACKET_SIZE);
+    memset(packet.REPEATERS_ID, 0xFF, MLSMESH_MAX_REPEATERS);
+    for (uint8_t j = 0; j < (MLS_PACKET_SIZE - 1); j++) {
+      if (random(3) == 0) {
+        packet.raw[j] = random(256);
+      }
+    }
+    length = mutate(buffer, wire.encode(&packet, buffer));
+    LLVMFuzzerTestOneInput(buffer, length);
+    inputs++;
+  }
+  printf("%u inputs, %u decode errors\n", inputs, wire.getDecodeErrors());
+  return 0;
+}
+
+#endif
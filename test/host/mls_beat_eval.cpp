@@ -0,0 +1,192 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_beat_eval.cpp
+ * @brief Beat labels and evaluation of the detected beats (host build)
+ *
+ **********************************************************************/
+#include "mls_beat_eval.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string>
+
+
+boolean MlsBeatLabels::open(const char *filename) {
+  std::string text;
+  char buffer[4096];
+  size_t bytes_read;
+  FILE *file = fopen(filename, "r");
+
+  if (NULL == file) {
+    return false;
+  }
+  while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    text.append(buffer, bytes_read);
+  }
+  fclose(file);
+  return this->parse(text.c_str());
+}
+
+
+// One beat per line (first number in seconds), false if a line is not a time
+boolean MlsBeatLabels::parse(const char *text) {
+  const char *line = text;
+  char *end;
+  double seconds;
+
+  this->beats_micros.clear();
+  while ('\0' != *line) {
+    while ((' ' == *line) || ('\t' == *line)) {
+      line++;
+    }
+    if (('#' != *line) && ('\r' != *line) && ('\n' != *line) && ('\0' != *line)) {
+      seconds = strtod(line, &end);
+      if ((end == line) || (seconds < 0)) {
+        return false;
+      }
+      this->add((uint32_t) ((seconds * 1000000) + 0.5));
+    }
+    while (('\n' != *line) && ('\0' != *line)) {
+      line++;
+    }
+    if ('\n' == *line) {
+      line++;
+    }
+  }
+  std::sort(this->beats_micros.begin(), this->beats_micros.end());
+  return true;
+}
+
+
+void MlsBeatLabels::add(uint32_t beat_micros) {
+  this->beats_micros.push_back(beat_micros);
+}
+
+
+size_t MlsBeatLabels::getBeats() {
+  return this->beats_micros.size();
+}
+
+
+const std::vector<uint32_t> &MlsBeatLabels::getBeatsMicros() {
+  return this->beats_micros;
+}
+
+
+// MlsBeatEvaluator constructor
+MlsBeatEvaluator::MlsBeatEvaluator(uint32_t tolerance_micros, uint32_t bin_micros) {
+  this->tolerance_micros = tolerance_micros;
+  this->bin_micros = bin_micros;
+  this->clear();
+}
+
+
+void MlsBeatEvaluator::clear() {
+  this->matched = 0;
+  this->false_positives = 0;
+  this->missed = 0;
+  this->latency_sum = 0;
+  this->histogram.assign(((2 * this->tolerance_micros) / this->bin_micros) + 1, 0);
+}
+
+
+// Match the detections with the labels (both in time order, same time base)
+void MlsBeatEvaluator::add(const std::vector<uint32_t> &detections_micros, const std::vector<uint32_t> &labels_micros) {
+  size_t i = 0;
+  size_t j = 0;
+
+  while ((i < detections_micros.size()) && (j < labels_micros.size())) {
+    int64_t latency = (int64_t) detections_micros[i] - (int64_t) labels_micros[j];
+    if (llabs(latency) <= this->tolerance_micros) {
+      this->matched++;
+      this->latency_sum += latency;
+      this->histogram[(latency + this->tolerance_micros) / this->bin_micros]++;
+      i++;
+      j++;
+    } else if (latency < 0) {
+      this->false_positives++;
+      i++;
+    } else {
+      this->missed++;
+      j++;
+    }
+  }
+  this->false_positives += detections_micros.size() - i;
+  this->missed += labels_micros.size() - j;
+}
+
+
+// Sum of the results of several files (same tolerance and bins)
+void MlsBeatEvaluator::add(MlsBeatEvaluator *evaluator) {
+  this->matched += evaluator->matched;
+  this->false_positives += evaluator->false_positives;
+  this->missed += evaluator->missed;
+  this->latency_sum += evaluator->latency_sum;
+  for (size_t i = 0; (i < this->histogram.size()) && (i < evaluator->histogram.size()); i++) {
+    this->histogram[i] += evaluator->histogram[i];
+  }
+}
+
+
+uint32_t MlsBeatEvaluator::getMatched() {
+  return this->matched;
+}
+
+
+uint32_t MlsBeatEvaluator::getFalsePositives() {
+  return this->false_positives;
+}
+
+
+uint32_t MlsBeatEvaluator::getMissed() {
+  return this->missed;
+}
+
+
+double MlsBeatEvaluator::getPrecision() {
+  uint32_t detections = this->matched + this->false_positives;
+  return (0 == detections) ? 0 : ((double) this->matched / detections);
+}
+
+
+double MlsBeatEvaluator::getRecall() {
+  uint32_t labels = this->matched + this->missed;
+  return (0 == labels) ? 0 : ((double) this->matched / labels);
+}
+
+
+double MlsBeatEvaluator::getFScore() {
+  double precision = this->getPrecision();
+  double recall = this->getRecall();
+  return ((precision + recall) <= 0) ? 0 : ((2 * precision * recall) / (precision + recall));
+}
+
+
+double MlsBeatEvaluator::getMeanLatencyMicros() {
+  return (0 == this->matched) ? 0 : ((double) this->latency_sum / this->matched);
+}
+
+
+const std::vector<uint32_t> &MlsBeatEvaluator::getHistogram() {
+  return this->histogram;
+}
+
+
+// One line per bin: lower bound of the bin in ms, count, and a bar
+void MlsBeatEvaluator::printHistogram(FILE *output) {
+  uint32_t biggest = 1;
+
+  for (size_t i = 0; i < this->histogram.size(); i++) {
+    biggest = std::max(biggest, this->histogram[i]);
+  }
+  for (size_t i = 0; i < this->histogram.size(); i++) {
+    int32_t bin_start = (int32_t) (i * this->bin_micros) - (int32_t) this->tolerance_micros;
+    fprintf(output, "%+7.1f ms %6u ", bin_start / 1000.0, this->histogram[i]);
+    for (uint32_t j = 0; j < ((this->histogram[i] * 50) + biggest - 1) / biggest; j++) {
+      fputc('#', output);
+    }
+    fputc('\n', output);
+  }
+}
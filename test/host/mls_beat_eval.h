@@ -0,0 +1,75 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_beat_eval.h
+ * @brief Beat labels and evaluation of the detected beats (host build)
+ *
+ * A label file has one beat per line: the first number of the line is
+ * the time of the beat in seconds, the rest of the line is ignored (so
+ * that the Audacity label tracks "start end label" are read as is). The
+ * empty lines and the lines starting with # are skipped.
+ *
+ * The detected beats are matched one to one with the labels, in time
+ * order, within +/- the tolerance (70 ms by default, like the MIREX beat
+ * tracking evaluation). A matched beat is a true positive, an unmatched
+ * beat is a false positive, an unmatched label is a missed beat. The
+ * latency (detection - label) of the matched beats is kept in a
+ * histogram.
+ *
+ **********************************************************************/
+#ifndef MLS_BEAT_EVAL_H
+#define MLS_BEAT_EVAL_H
+
+  #include <Arduino.h>
+  #include <stdint.h>
+  #include <stdio.h>
+  #include <vector>
+
+  #define MLS_BEAT_EVAL_TOLERANCE_US  70000 // Maximum distance between a beat and its label
+  #define MLS_BEAT_EVAL_BIN_US        5000  // Width of the latency histogram bins
+
+
+  class MlsBeatLabels {
+
+    private:
+      std::vector<uint32_t> beats_micros;
+
+    public:
+      boolean open(const char *filename);
+      boolean parse(const char *text);
+      void add(uint32_t beat_micros);
+      size_t getBeats();
+      const std::vector<uint32_t> &getBeatsMicros();
+  };
+
+
+  class MlsBeatEvaluator {
+
+    private:
+      uint32_t tolerance_micros;
+      uint32_t bin_micros;
+      uint32_t matched;
+      uint32_t false_positives;
+      uint32_t missed;
+      int64_t latency_sum;
+      std::vector<uint32_t> histogram;       // From -tolerance to +tolerance
+
+    public:
+      MlsBeatEvaluator(uint32_t tolerance_micros = MLS_BEAT_EVAL_TOLERANCE_US, uint32_t bin_micros = MLS_BEAT_EVAL_BIN_US);
+      void clear();
+      void add(const std::vector<uint32_t> &detections_micros, const std::vector<uint32_t> &labels_micros);
+      void add(MlsBeatEvaluator *evaluator);
+      uint32_t getMatched();
+      uint32_t getFalsePositives();
+      uint32_t getMissed();
+      double getPrecision();
+      double getRecall();
+      double getFScore();
+      double getMeanLatencyMicros();
+      const std::vector<uint32_t> &getHistogram();
+      void printHistogram(FILE *output);
+  };
+
+#endif
@@ -0,0 +1,137 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_beat_replay.cpp
+ * @brief Replay of WAV recordings through MlsBeatDetector (Linux CLI)
+ *
+ * Each WAV file goes through the beat detector of the firmware, as fast
+ * as possible. If a label file with the same name and the .txt extension
+ * exists (see mls_beat_eval.h), the beats are compared with the labels:
+ * precision, recall, F-score and latency histogram per file, and for all
+ * the files.
+ *
+ *   mls_beat_replay [-t tolerance_ms] [-g min_gap_ms max_gap_ms] [-b] file.wav...
+ *
+ *   -t  tolerance of the matching (default 70 ms)
+ *   -g  hold-off between two beats (default I2S_MIN/MAX_EDGE_GAP_US)
+ *   -b  print the detected beats (Audacity label track format)
+ *
+ **********************************************************************/
+#include "mls_host.h"
+#include "mls_beat_detector.h"
+#include "mls_wav_sample_source.h"
+#include "mls_beat_eval.h"
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+
+
+static void usage() {
+  fprintf(stderr, "usage: mls_beat_replay [-t tolerance_ms] [-g min_gap_ms max_gap_ms] [-b] file.wav...\n");
+  exit(2);
+}
+
+
+// Label file of a recording: same name, .txt extension
+static std::string labelsFilename(const char *wav_filename) {
+  std::string filename(wav_filename);
+  size_t dot = filename.rfind('.');
+
+  if ((std::string::npos != dot) && (std::string::npos == filename.find('/', dot))) {
+    filename.erase(dot);
+  }
+  return filename + ".txt";
+}
+
+
+int main(int argc, char **argv) {
+  uint32_t tolerance_micros = MLS_BEAT_EVAL_TOLERANCE_US;
+  uint32_t min_gap_micros = I2S_MIN_EDGE_GAP_US;
+  uint32_t max_gap_micros = I2S_MAX_EDGE_GAP_US;
+  boolean print_beats = false;
+  uint64_t total_audio_micros = 0;
+  double total_cpu_seconds = 0;
+  uint16_t labelled_files = 0;
+  int files = 0;
+  int arg = 1;
+
+  while ((arg < argc) && ('-' == argv[arg][0])) {
+    if ((0 == strcmp(argv[arg], "-t")) && ((arg + 1) < argc)) {
+      tolerance_micros = atoi(argv[++arg]) * 1000;
+    } else if ((0 == strcmp(argv[arg], "-g")) && ((arg + 2) < argc)) {
+      min_gap_micros = atoi(argv[++arg]) * 1000;
+      max_gap_micros = atoi(argv[++arg]) * 1000;
+    } else if (0 == strcmp(argv[arg], "-b")) {
+      print_beats = true;
+    } else {
+      usage();
+    }
+    arg++;
+  }
+  if (arg >= argc) {
+    usage();
+  }
+
+  MlsBeatEvaluator total(tolerance_micros);
+  for (; arg < argc; arg++) {
+    MlsWavSampleSource source;
+    MlsBeatDetector detector;
+    MlsBeatLabels labels;
+    MlsBeatEvaluator evaluator(tolerance_micros);
+    struct I2S_BEAT beat;
+    std::vector<uint32_t> beats_micros;
+    int32_t samples[I2S_BLOCK_SIZE];
+    uint32_t hop_end_micros;
+    uint16_t count;
+
+    if (!source.open(argv[arg])) {
+      fprintf(stderr, "%s: not a PCM WAV file\n", argv[arg]);
+      continue;
+    }
+    files++;
+    detector.setEdgeGaps(min_gap_micros, max_gap_micros);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (0 != (count = source.read(samples, I2S_BLOCK_SIZE, &hop_end_micros))) {
+      if (detector.process(samples, count, hop_end_micros, &beat)) {
+        beats_micros.push_back(beat.onset_micros - source.getStartMicros());
+      }
+    }
+    double cpu_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    total_cpu_seconds += cpu_seconds;
+    total_audio_micros += source.getDurationMicros();
+
+    printf("%s: %u Hz, %u bits, %u channel(s), %.1f s, %u beats, %.0fx real time\n", argv[arg],
+           source.getFileSampleRate(), source.getFileBits(), source.getFileChannels(), source.getDurationMicros() / 1e6,
+           (unsigned) beats_micros.size(), (cpu_seconds > 0) ? (source.getDurationMicros() / 1e6 / cpu_seconds) : 0);
+    if (print_beats) {
+      for (size_t i = 0; i < beats_micros.size(); i++) {
+        printf("%.6f\t%.6f\tbeat\n", beats_micros[i] / 1e6, beats_micros[i] / 1e6);
+      }
+    }
+    if (!labels.open(labelsFilename(argv[arg]).c_str())) {
+      continue;
+    }
+    labelled_files++;
+    evaluator.add(beats_micros, labels.getBeatsMicros());
+    total.add(&evaluator);
+    printf("  %u labels, %u matched, %u false, %u missed, precision %.3f, recall %.3f, F %.3f, mean latency %+.1f ms\n",
+           (unsigned) labels.getBeats(), evaluator.getMatched(), evaluator.getFalsePositives(), evaluator.getMissed(),
+           evaluator.getPrecision(), evaluator.getRecall(), evaluator.getFScore(), evaluator.getMeanLatencyMicros() / 1000);
+    evaluator.printHistogram(stdout);
+  }
+
+  if (files > 1) {
+    printf("Total: %d files, %.1f s, %.0fx real time\n", files, total_audio_micros / 1e6,
+           (total_cpu_seconds > 0) ? (total_audio_micros / 1e6 / total_cpu_seconds) : 0);
+    if (labelled_files > 1) {
+      printf("  %u matched, %u false, %u missed, precision %.3f, recall %.3f, F %.3f, mean latency %+.1f ms\n",
+             total.getMatched(), total.getFalsePositives(), total.getMissed(),
+             total.getPrecision(), total.getRecall(), total.getFScore(), total.getMeanLatencyMicros() / 1000);
+      total.printHistogram(stdout);
+    }
+  }
+  return (0 == files) ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_recording_led_driver.cpp
+ * @brief LED strips output driver of the host build (recorded frames)
+ *
+ **********************************************************************/
+#include "mls_recording_led_driver.h"
+
+
+// MlsRecordingLedDriver constructor
+MlsRecordingLedDriver::MlsRecordingLedDriver() {
+  this->strips[0] = NULL;
+  this->strips[1] = NULL;
+  this->leds_per_strip = 0;
+  this->shows = 0;
+}
+
+
+// The strips are read at each show, no output buffer
+void MlsRecordingLedDriver::begin(struct CRGB *left_strip, struct CRGB *right_strip, uint16_t leds_per_strip, MlsArena *arena) {
+  this->strips[0] = left_strip;
+  this->strips[1] = right_strip;
+  this->leds_per_strip = leds_per_strip;
+  this->clear();
+}
+
+
+// Record both strips, only if one of them has changed (like the FastLED driver)
+void MlsRecordingLedDriver::show(boolean left_changed, boolean right_changed) {
+  struct MLS_RECORDED_FRAME frame;
+
+  this->shows++;
+  if ((!left_changed) && (!right_changed)) {
+    return;
+  }
+  frame.time_micros = micros();
+  frame.changed[0] = left_changed;
+  frame.changed[1] = right_changed;
+  for (uint8_t lr = 0; lr < 2; lr++) {
+    frame.strip[lr].assign(this->strips[lr], this->strips[lr] + this->leds_per_strip);
+  }
+  this->frames.push_back(frame);
+}
+
+
+boolean MlsRecordingLedDriver::isBusy() {
+  return false;
+}
+
+
+void MlsRecordingLedDriver::clear() {
+  this->frames.clear();
+  this->shows = 0;
+}
+
+
+// Calls of show(), with or without a changed strip
+uint32_t MlsRecordingLedDriver::getShows() {
+  return this->shows;
+}
+
+
+// Recorded frames (shows with a changed strip)
+size_t MlsRecordingLedDriver::getFrames() {
+  return this->frames.size();
+}
+
+
+const struct MLS_RECORDED_FRAME &MlsRecordingLedDriver::getFrame(size_t index) {
+  return this->frames[index];
+}
+
+
+const struct MLS_RECORDED_FRAME &MlsRecordingLedDriver::getLastFrame() {
+  return this->frames.back();
+}
@@ -0,0 +1,49 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_recording_led_driver.h
+ * @brief LED strips output driver of the host build (recorded frames)
+ *
+ * Each show() with a changed strip records a copy of both strips, with
+ * the virtual clock time and the changed flags, so that the tests check
+ * the frames really sent to the strips (and the frames not sent).
+ *
+ **********************************************************************/
+#ifndef MLS_RECORDING_LED_DRIVER_H
+#define MLS_RECORDING_LED_DRIVER_H
+
+  #include "mls_led_driver.h"
+  #include <stdint.h>
+  #include <vector>
+
+
+  struct MLS_RECORDED_FRAME {
+    uint32_t time_micros;
+    boolean changed[2];
+    std::vector<struct CRGB> strip[2];
+  };
+
+
+  class MlsRecordingLedDriver : public MlsLedDriver {
+
+    private:
+      struct CRGB *strips[2];
+      uint16_t leds_per_strip;
+      uint32_t shows;
+      std::vector<struct MLS_RECORDED_FRAME> frames;
+
+    public:
+      MlsRecordingLedDriver();
+      void begin(struct CRGB *left_strip, struct CRGB *right_strip, uint16_t leds_per_strip, MlsArena *arena);
+      void show(boolean left_changed, boolean right_changed);
+      boolean isBusy();
+      void clear();
+      uint32_t getShows();
+      size_t getFrames();
+      const struct MLS_RECORDED_FRAME &getFrame(size_t index);
+      const struct MLS_RECORDED_FRAME &getLastFrame();
+  };
+
+#endif
@@ -0,0 +1,46 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_test.h
+ * @brief Minimal checks of the host tests
+ *
+ * A failed check prints its location and the test goes on, the exit
+ * code of MLS_TEST_END is the number of failed checks (0: success).
+ *
+ **********************************************************************/
+#ifndef MLS_TEST_H
+#define MLS_TEST_H
+
+  #include <stdio.h>
+  #include <stdint.h>
+
+  static uint32_t mls_test_checks = 0;
+  static uint32_t mls_test_failures = 0;
+
+  #define CHECK(condition) do {                                                           \
+      mls_test_checks++;                                                                  \
+      if (!(condition)) {                                                                 \
+        mls_test_failures++;                                                              \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);    \
+      }                                                                                   \
+    } while (0)
+
+  #define CHECK_EQUAL(expected, actual) do {                                              \
+      long long mls_expected = (long long) (expected);                                    \
+      long long mls_actual = (long long) (actual);                                        \
+      mls_test_checks++;                                                                  \
+      if (mls_expected != mls_actual) {                                                   \
+        mls_test_failures++;                                                              \
+        fprintf(stderr, "%s:%d: CHECK_EQUAL(%s, %s) failed: %lld != %lld\n",              \
+                __FILE__, __LINE__, #expected, #actual, mls_expected, mls_actual);        \
+      }                                                                                   \
+    } while (0)
+
+  #define MLS_TEST_END() do {                                                             \
+      printf("%u checks, %u failures\n", mls_test_checks, mls_test_failures);             \
+      return (mls_test_failures > 255) ? 255 : (int) mls_test_failures;                   \
+    } while (0)
+
+#endif
@@ -0,0 +1,177 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_wav_sample_source.cpp
+ * @brief Audio sample source of the host build (WAV file)
+ *
+ **********************************************************************/
+#include "mls_wav_sample_source.h"
+#include <stdio.h>
+
+
+// Little endian fields of the WAV chunks
+static uint32_t wavUint32(const uint8_t *data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+
+static uint16_t wavUint16(const uint8_t *data) {
+  return data[0] | (data[1] << 8);
+}
+
+
+// MlsWavSampleSource constructor
+MlsWavSampleSource::MlsWavSampleSource() {
+  this->position = 0;
+  this->start_micros = MLS_WAV_START_MICROS;
+  this->file_sample_rate = 0;
+  this->file_bits = 0;
+  this->file_channels = 0;
+}
+
+
+boolean MlsWavSampleSource::open(const char *filename) {
+  std::vector<uint8_t> data;
+  uint8_t buffer[65536];
+  size_t bytes_read;
+  FILE *file = fopen(filename, "rb");
+
+  if (NULL == file) {
+    return false;
+  }
+  while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + bytes_read);
+  }
+  fclose(file);
+  return this->load(data.data(), data.size());
+}
+
+
+// Parse the RIFF chunks of a PCM WAV file (false if the format is not supported)
+boolean MlsWavSampleSource::load(const uint8_t *data, size_t size) {
+  const uint8_t *pcm = NULL;
+  size_t pcm_size = 0;
+  uint16_t format = 0;
+  uint16_t bytes_per_sample;
+  size_t frames;
+  size_t offset = 12;
+  std::vector<int32_t> first_channel;
+
+  this->samples.clear();
+  this->position = 0;
+  if ((size < 12) || (0 != memcmp(data, "RIFF", 4)) || (0 != memcmp(&data[8], "WAVE", 4))) {
+    return false;
+  }
+  while ((offset + 8) <= size) {
+    uint32_t chunk_size = wavUint32(&data[offset + 4]);
+    const uint8_t *chunk = &data[offset + 8];
+    if (chunk_size > (size - offset - 8)) {
+      chunk_size = size - offset - 8;
+    }
+    if ((0 == memcmp(&data[offset], "fmt ", 4)) && (chunk_size >= 16)) {
+      format = wavUint16(&chunk[0]);
+      this->file_channels = wavUint16(&chunk[2]);
+      this->file_sample_rate = wavUint32(&chunk[4]);
+      this->file_bits = wavUint16(&chunk[14]);
+      // WAVE_FORMAT_EXTENSIBLE: the format is the first 2 bytes of the sub format GUID
+      if ((0xFFFE == format) && (chunk_size >= 26)) {
+        format = wavUint16(&chunk[24]);
+      }
+    } else if (0 == memcmp(&data[offset], "data", 4)) {
+      pcm = chunk;
+      pcm_size = chunk_size;
+    }
+    offset += 8 + chunk_size + (chunk_size & 1);
+  }
+  if ((1 != format) || (NULL == pcm) || (0 == this->file_channels) || (0 == this->file_sample_rate) ||
+      ((8 != this->file_bits) && (16 != this->file_bits) && (24 != this->file_bits) && (32 != this->file_bits))) {
+    return false;
+  }
+
+  // First channel, left aligned in 32 bits (8 bits samples are unsigned)
+  bytes_per_sample = this->file_bits / 8;
+  frames = pcm_size / (bytes_per_sample * this->file_channels);
+  first_channel.resize(frames);
+  for (size_t i = 0; i < frames; i++) {
+    const uint8_t *sample = &pcm[i * bytes_per_sample * this->file_channels];
+    uint32_t value = 0;
+    for (uint16_t j = 0; j < bytes_per_sample; j++) {
+      value |= ((uint32_t) sample[j]) << (32 - this->file_bits + (8 * j));
+    }
+    if (8 == this->file_bits) {
+      value ^= 0x80000000;
+    }
+    first_channel[i] = (int32_t) value;
+  }
+
+  // Resampling at I2S_SAMPLE_RATE
+  if (I2S_SAMPLE_RATE == this->file_sample_rate) {
+    this->samples.swap(first_channel);
+  } else if (frames > 0) {
+    size_t count = ((uint64_t) frames * I2S_SAMPLE_RATE) / this->file_sample_rate;
+    this->samples.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      double source = ((double) i * this->file_sample_rate) / I2S_SAMPLE_RATE;
+      size_t index = (size_t) source;
+      double fraction = source - index;
+      double next = ((index + 1) < frames) ? first_channel[index + 1] : first_channel[index];
+      this->samples[i] = (int32_t) (first_channel[index] + ((next - first_channel[index]) * fraction));
+    }
+  }
+  return true;
+}
+
+
+void MlsWavSampleSource::rewind() {
+  this->position = 0;
+}
+
+
+// Next hop of the file, the capture time of a sample is its position in the file
+uint16_t MlsWavSampleSource::read(int32_t *samples, uint16_t max_samples, uint32_t *hop_end_micros) {
+  size_t count = this->samples.size() - this->position;
+
+  if (count > max_samples) {
+    count = max_samples;
+  }
+  if (0 == count) {
+    return 0;
+  }
+  memcpy(samples, &this->samples[this->position], count * sizeof(int32_t));
+  this->position += count;
+  *hop_end_micros = this->start_micros + (uint32_t) (((uint64_t) this->position * 1000000) / I2S_SAMPLE_RATE);
+  return count;
+}
+
+
+uint32_t MlsWavSampleSource::getStartMicros() {
+  return this->start_micros;
+}
+
+
+uint32_t MlsWavSampleSource::getDurationMicros() {
+  return ((uint64_t) this->samples.size() * 1000000) / I2S_SAMPLE_RATE;
+}
+
+
+// Samples at I2S_SAMPLE_RATE
+size_t MlsWavSampleSource::getSamples() {
+  return this->samples.size();
+}
+
+
+uint32_t MlsWavSampleSource::getFileSampleRate() {
+  return this->file_sample_rate;
+}
+
+
+uint16_t MlsWavSampleSource::getFileBits() {
+  return this->file_bits;
+}
+
+
+uint16_t MlsWavSampleSource::getFileChannels() {
+  return this->file_channels;
+}
@@ -0,0 +1,53 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_wav_sample_source.h
+ * @brief Audio sample source of the host build (WAV file)
+ *
+ * The PCM WAV file (8, 16, 24 or 32 bits, any number of channels) is
+ * loaded in memory: the first channel is resampled at I2S_SAMPLE_RATE
+ * (linear interpolation) and left aligned in 32 bits, like the samples
+ * of the I2S microphone.
+ *
+ * The hops are read as fast as the detector takes them. The capture time
+ * of a sample is start_micros plus its position in the file, so that the
+ * onsets are compared with the labels of the file.
+ *
+ **********************************************************************/
+#ifndef MLS_WAV_SAMPLE_SOURCE_H
+#define MLS_WAV_SAMPLE_SOURCE_H
+
+  #include "mls_beat_detector.h"
+  #include <stdint.h>
+  #include <vector>
+
+  #define MLS_WAV_START_MICROS  1000000 // Capture time of the first sample (after the hold-off of the first beat)
+
+
+  class MlsWavSampleSource : public MlsSampleSource {
+
+    private:
+      std::vector<int32_t> samples;
+      size_t position;
+      uint32_t start_micros;
+      uint32_t file_sample_rate;
+      uint16_t file_bits;
+      uint16_t file_channels;
+
+    public:
+      MlsWavSampleSource();
+      boolean open(const char *filename);
+      boolean load(const uint8_t *data, size_t size);
+      void rewind();
+      uint16_t read(int32_t *samples, uint16_t max_samples, uint32_t *hop_end_micros);
+      uint32_t getStartMicros();
+      uint32_t getDurationMicros();
+      size_t getSamples();
+      uint32_t getFileSampleRate();
+      uint16_t getFileBits();
+      uint16_t getFileChannels();
+  };
+
+#endif
@@ -0,0 +1,109 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  Arduino.h
+ * @brief Arduino core shim of the host build
+ *
+ * Only what the portable sketch files use. micros() and millis() read
+ * the virtual clock of mls_host.h, random() is a deterministic generator
+ * (same sequence after the same randomSeed()), delay() advances the
+ * virtual clock.
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_ARDUINO_H
+#define MLS_HOST_ARDUINO_H
+
+  #include <stdint.h>
+  #include <stddef.h>
+  #include <string.h>
+  #include <stdlib.h>
+  #include <stdio.h>
+  #include <math.h>
+  #include <algorithm>
+  #include "WString.h"
+  #include "esp_system.h"
+  #include "freertos/FreeRTOS.h"
+
+  typedef bool boolean;
+  typedef uint8_t byte;
+
+  #define PROGMEM
+  #define IRAM_ATTR
+  #define HIGH          1
+  #define LOW           0
+  #define INPUT         0
+  #define OUTPUT        1
+  #define INPUT_PULLUP  2
+  #define DEC           10
+  #define HEX           16
+  #define LED_BUILTIN   2
+
+  #ifndef PI
+    #define PI 3.1415926535897932384626433832795
+  #endif
+
+  #define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+  using std::min;
+  using std::max;
+
+  inline uint8_t pgm_read_byte(const uint8_t *p) { return *p; }
+  inline uint32_t pgm_read_dword(const uint32_t *p) { return *p; }
+
+  unsigned long micros();
+  unsigned long millis();
+  void delay(uint32_t ms);
+  void delayMicroseconds(uint32_t us);
+  void yield();
+  long random(long max);
+  long random(long min, long max);
+  void randomSeed(unsigned long seed);
+  long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+
+  // Serial output, written on stderr only if enabled (mls_host_set_serial)
+  class HardwareSerial {
+
+    private:
+      boolean enabled;
+      void write(const char *text);
+
+    public:
+      HardwareSerial();
+      void setEnabled(boolean enabled);
+      void begin(unsigned long baud) {}
+      void print(const char *text) { this->write(text); }
+      void print(const String &text) { this->write(text.c_str()); }
+      void print(char c) { char text[2] = {c, 0}; this->write(text); }
+      void print(double value, int digits = 2) { this->print(String(value, digits)); }
+      void print(long long value, int base = DEC) { this->print(String(value, base)); }
+      void print(unsigned long long value, int base = DEC) { this->print(String(value, base)); }
+      void print(int value, int base = DEC) { this->print((long long) value, base); }
+      void print(unsigned int value, int base = DEC) { this->print((unsigned long long) value, base); }
+      void print(long value, int base = DEC) { this->print((long long) value, base); }
+      void print(unsigned long value, int base = DEC) { this->print((unsigned long long) value, base); }
+      void print(unsigned char value, int base = DEC) { this->print((unsigned long long) value, base); }
+      void print(short value, int base = DEC) { this->print((long long) value, base); }
+      void print(unsigned short value, int base = DEC) { this->print((unsigned long long) value, base); }
+      void print(signed char value, int base = DEC) { this->print((long long) value, base); }
+      void println() { this->write("\n"); }
+      template<class T> void println(T value) { this->print(value); this->println(); }
+      template<class T> void println(T value, int base) { this->print(value, base); this->println(); }
+      void printf(const char *format, ...);
+  };
+
+  extern HardwareSerial Serial;
+
+
+  class EspClass {
+
+    public:
+      void restart();
+      uint32_t getFreeHeap();
+  };
+
+  extern EspClass ESP;
+
+#endif
@@ -0,0 +1,98 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  FastLED.h
+ * @brief FastLED shim of the host build
+ *
+ * CRGB has the same 3 bytes layout as FastLED. CHSV is converted with a
+ * plain 6 sectors hue mapping, not the FastLED rainbow mapping (the
+ * golden frames of the host tests only depend on this shim).
+ * FastLED.show() only counts the calls.
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_FASTLED_H
+#define MLS_HOST_FASTLED_H
+
+  #include "Arduino.h"
+
+  #define WS2812B 0
+  #define GRB     0
+
+
+  struct CHSV {
+    uint8_t h;
+    uint8_t s;
+    uint8_t v;
+    CHSV() : h(0), s(0), v(0) {}
+    CHSV(uint8_t hue, uint8_t saturation, uint8_t value) : h(hue), s(saturation), v(value) {}
+  };
+
+
+  struct CRGB {
+    union {
+      struct {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+      };
+      uint8_t raw[3];
+    };
+
+    enum HTMLColorCode : uint32_t {
+      Black  = 0x000000,
+      Blue   = 0x0000FF,
+      Green  = 0x008000,
+      Orange = 0xFFA500,
+      Red    = 0xFF0000,
+      White  = 0xFFFFFF,
+      Yellow = 0xFFFF00
+    };
+
+    CRGB() : r(0), g(0), b(0) {}
+    CRGB(uint8_t red, uint8_t green, uint8_t blue) : r(red), g(green), b(blue) {}
+    CRGB(uint32_t color) : r((color >> 16) & 0xFF), g((color >> 8) & 0xFF), b(color & 0xFF) {}
+    CRGB(HTMLColorCode color) : r((color >> 16) & 0xFF), g((color >> 8) & 0xFF), b(color & 0xFF) {}
+    CRGB(const CHSV &hsv);
+    bool operator==(const CRGB &other) const { return (r == other.r) && (g == other.g) && (b == other.b); }
+    bool operator!=(const CRGB &other) const { return !(*this == other); }
+  };
+
+
+  inline uint8_t scale8(uint8_t i, uint8_t scale) {
+    return (((uint16_t) i) * (1 + (uint16_t) scale)) >> 8;
+  }
+
+
+  class CLEDController {
+
+    public:
+      void showLeds(uint8_t brightness);
+  };
+
+
+  class CFastLED {
+
+    private:
+      uint8_t brightness;
+      uint32_t shows;
+      CLEDController controllers[2];
+      uint8_t controllers_count;
+
+    public:
+      CFastLED();
+      template<int TYPE, int PIN, int ORDER> CLEDController &addLeds(struct CRGB *leds, int count) {
+        return this->controllers[(this->controllers_count++) % 2];
+      }
+      void show();
+      void clear() {}
+      void setBrightness(uint8_t brightness) { this->brightness = brightness; }
+      uint8_t getBrightness() { return this->brightness; }
+      uint32_t getShows() { return this->shows; }
+      CLEDController &operator[](int index) { return this->controllers[index % 2]; }
+  };
+
+  extern CFastLED FastLED;
+
+#endif
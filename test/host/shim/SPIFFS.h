@@ -0,0 +1,57 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  SPIFFS.h
+ * @brief SPIFFS shim of the host build (files kept in memory)
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_SPIFFS_H
+#define MLS_HOST_SPIFFS_H
+
+  #include <Arduino.h>
+  #include <map>
+  #include <string>
+  #include <vector>
+
+  namespace fs {
+
+    class File {
+
+      private:
+        std::vector<uint8_t> *data;
+        size_t position;
+
+      public:
+        File() : data(NULL), position(0) {}
+        File(std::vector<uint8_t> *data, size_t position) : data(data), position(position) {}
+        size_t write(const uint8_t *buffer, size_t size);
+        size_t read(uint8_t *buffer, size_t size);
+        size_t size() const { return (NULL == this->data) ? 0 : this->data->size(); }
+        int available() { return (NULL == this->data) ? 0 : (int) (this->data->size() - this->position); }
+        void close() { this->data = NULL; }
+        operator bool() const { return NULL != this->data; }
+    };
+
+
+    class FS {
+
+      private:
+        std::map<std::string, std::vector<uint8_t> > files;
+
+      public:
+        bool begin(bool format_on_fail = false) { return true; }
+        bool format() { this->files.clear(); return true; }
+        File open(const char *path, const char *mode = "r");
+        bool exists(const char *path) { return this->files.count(path) > 0; }
+        bool remove(const char *path) { return this->files.erase(path) > 0; }
+        std::vector<uint8_t> *getData(const char *path);
+    };
+
+  }
+
+  using fs::File;
+  extern fs::FS SPIFFS;
+
+#endif
@@ -0,0 +1,56 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  WString.h
+ * @brief Arduino String shim of the host build
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_WSTRING_H
+#define MLS_HOST_WSTRING_H
+
+  #include <stdio.h>
+  #include <stdlib.h>
+  #include <string>
+
+
+  class String : public std::string {
+
+    public:
+      String() {}
+      String(const char *text) : std::string(text) {}
+      String(const std::string &text) : std::string(text) {}
+      String(char c) : std::string(1, c) {}
+      String(long long value, int base = 10) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), (16 == base) ? "%llX" : "%lld", value);
+        this->assign(buffer);
+      }
+      String(unsigned long long value, int base = 10) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), (16 == base) ? "%llX" : "%llu", value);
+        this->assign(buffer);
+      }
+      String(int value, int base = 10) : String((long long) value, base) {}
+      String(unsigned int value, int base = 10) : String((unsigned long long) value, base) {}
+      String(long value, int base = 10) : String((long long) value, base) {}
+      String(unsigned long value, int base = 10) : String((unsigned long long) value, base) {}
+      String(unsigned char value, int base = 10) : String((unsigned long long) value, base) {}
+      String(short value, int base = 10) : String((long long) value, base) {}
+      String(unsigned short value, int base = 10) : String((unsigned long long) value, base) {}
+      String(double value, int digits = 2) {
+        char buffer[48];
+        snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+        this->assign(buffer);
+      }
+      long toInt() const { return atol(this->c_str()); }
+      bool equals(const String &other) const { return *this == other; }
+      void concat(const String &other) { this->append(other); }
+  };
+
+  inline String operator+(const String &a, const String &b) { return String(std::string(a) + std::string(b)); }
+  inline String operator+(const String &a, const char *b) { return String(std::string(a) + b); }
+  inline String operator+(const char *a, const String &b) { return String(a + std::string(b)); }
+
+#endif
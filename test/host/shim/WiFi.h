@@ -0,0 +1,13 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  WiFi.h
+ * @brief Empty shim of the host build (only included, not used by the portable files)
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_WIFI_H
+#define MLS_HOST_WIFI_H
+
+#endif
@@ -0,0 +1,27 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  esp_now.h
+ * @brief ESP-NOW shim of the host build
+ *
+ * esp_now_send() hands the frame to the hook of the test (see
+ * mls_host.h), or drops it if there is no hook.
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_ESP_NOW_H
+#define MLS_HOST_ESP_NOW_H
+
+  #include <stddef.h>
+  #include <stdint.h>
+  #include "esp_system.h"
+
+  typedef enum {
+    ESP_NOW_SEND_SUCCESS = 0,
+    ESP_NOW_SEND_FAIL
+  } esp_now_send_status_t;
+
+  esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,22 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  esp_system.h
+ * @brief ESP-IDF system shim of the host build
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_ESP_SYSTEM_H
+#define MLS_HOST_ESP_SYSTEM_H
+
+  #include <stdint.h>
+
+  typedef int esp_err_t;
+
+  #define ESP_OK    0
+  #define ESP_FAIL  -1
+
+  uint32_t esp_random(void);
+
+#endif
@@ -0,0 +1,50 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  FreeRTOS.h
+ * @brief FreeRTOS shim of the host build
+ *
+ * The critical sections are real spinlocks, so that the host tests can
+ * run a producer and a consumer in two threads. The task notifications
+ * and the critical sections taken from an interrupt are only counted, and
+ * the interrupt context is set by the test (see mls_host.h).
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_FREERTOS_H
+#define MLS_HOST_FREERTOS_H
+
+  #include <stdint.h>
+
+  typedef void *TaskHandle_t;
+  typedef uint32_t TickType_t;
+  typedef int BaseType_t;
+  typedef unsigned int UBaseType_t;
+
+  #define pdTRUE              1
+  #define pdFALSE             0
+  #define pdPASS              1
+  #define portMAX_DELAY       0xFFFFFFFF
+  #define portTICK_PERIOD_MS  1
+  #define pdMS_TO_TICKS(ms)   ((TickType_t) (ms))
+
+  typedef struct {
+    volatile int owner;
+  } portMUX_TYPE;
+
+  #define portMUX_INITIALIZER_UNLOCKED {0}
+
+  void portENTER_CRITICAL(portMUX_TYPE *mux);
+  void portEXIT_CRITICAL(portMUX_TYPE *mux);
+  void portENTER_CRITICAL_ISR(portMUX_TYPE *mux);
+  void portEXIT_CRITICAL_ISR(portMUX_TYPE *mux);
+
+  BaseType_t xPortInIsrContext();
+  BaseType_t xTaskNotifyGive(TaskHandle_t task);
+  void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken);
+  uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+  TickType_t xTaskGetTickCount();
+  void vTaskDelay(TickType_t ticks);
+
+#endif
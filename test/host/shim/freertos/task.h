@@ -0,0 +1,15 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  task.h
+ * @brief FreeRTOS task shim of the host build (see FreeRTOS.h)
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_TASK_H
+#define MLS_HOST_TASK_H
+
+  #include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,309 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_host.cpp
+ * @brief Definitions of the host build shims
+ *
+ **********************************************************************/
+#include "mls_host.h"
+#include "FastLED.h"
+#include "SPIFFS.h"
+#include <atomic>
+#include <stdarg.h>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+CFastLED FastLED;
+fs::FS SPIFFS;
+
+static std::atomic<uint32_t> host_micros(0);
+static std::atomic<uint32_t> host_notifications(0);
+static std::atomic<uint32_t> host_restarts(0);
+static std::atomic<uint32_t> host_isr_critical_sections(0);
+static std::atomic<bool> host_isr_context(false);
+static uint32_t host_random_state = 1;
+static mls_host_send_hook host_send_hook = NULL;
+
+
+void mls_host_set_micros(uint32_t now_micros) {
+  host_micros = now_micros;
+}
+
+
+void mls_host_advance_micros(uint32_t delta_micros) {
+  host_micros += delta_micros;
+}
+
+
+void mls_host_set_serial(boolean enabled) {
+  Serial.setEnabled(enabled);
+}
+
+
+void mls_host_set_send_hook(mls_host_send_hook hook) {
+  host_send_hook = hook;
+}
+
+
+uint32_t mls_host_get_notifications() {
+  return host_notifications;
+}
+
+
+uint32_t mls_host_get_restarts() {
+  return host_restarts;
+}
+
+
+void mls_host_set_isr_context(boolean in_isr) {
+  host_isr_context = in_isr;
+}
+
+
+uint32_t mls_host_get_isr_critical_sections() {
+  return host_isr_critical_sections;
+}
+
+
+unsigned long micros() {
+  return host_micros;
+}
+
+
+unsigned long millis() {
+  return host_micros / 1000;
+}
+
+
+void delay(uint32_t ms) {
+  host_micros += 1000 * ms;
+}
+
+
+void delayMicroseconds(uint32_t us) {
+  host_micros += us;
+}
+
+
+void yield() {
+}
+
+
+// Park-Miller generator: same sequence after the same seed on all hosts
+void randomSeed(unsigned long seed) {
+  host_random_state = (0 == (seed % 2147483647UL)) ? 1 : (seed % 2147483647UL);
+}
+
+
+long random(long max) {
+  if (max <= 0) {
+    return 0;
+  }
+  host_random_state = (uint32_t) (((uint64_t) host_random_state * 48271) % 2147483647UL);
+  return host_random_state % max;
+}
+
+
+long random(long min, long max) {
+  if (min >= max) {
+    return min;
+  }
+  return min + random(max - min);
+}
+
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+
+uint32_t esp_random(void) {
+  return (uint32_t) random(0x7FFFFFFF);
+}
+
+
+HardwareSerial::HardwareSerial() {
+  this->enabled = false;
+}
+
+
+void HardwareSerial::setEnabled(boolean enabled) {
+  this->enabled = enabled;
+}
+
+
+void HardwareSerial::write(const char *text) {
+  if (this->enabled) {
+    fputs(text, stderr);
+  }
+}
+
+
+void HardwareSerial::printf(const char *format, ...) {
+  va_list args;
+
+  if (!this->enabled) {
+    return;
+  }
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+}
+
+
+void EspClass::restart() {
+  host_restarts++;
+}
+
+
+uint32_t EspClass::getFreeHeap() {
+  return 320 * 1024;
+}
+
+
+void portENTER_CRITICAL(portMUX_TYPE *mux) {
+  while (__atomic_exchange_n(&mux->owner, 1, __ATOMIC_ACQUIRE)) {
+    std::this_thread::yield();
+  }
+}
+
+
+void portEXIT_CRITICAL(portMUX_TYPE *mux) {
+  __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+}
+
+
+void portENTER_CRITICAL_ISR(portMUX_TYPE *mux) {
+  host_isr_critical_sections++;
+  portENTER_CRITICAL(mux);
+}
+
+
+void portEXIT_CRITICAL_ISR(portMUX_TYPE *mux) {
+  portEXIT_CRITICAL(mux);
+}
+
+
+BaseType_t xPortInIsrContext() {
+  return host_isr_context ? pdTRUE : pdFALSE;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  host_notifications++;
+  return pdPASS;
+}
+
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken) {
+  host_notifications++;
+}
+
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+  return 0;
+}
+
+
+TickType_t xTaskGetTickCount() {
+  return millis() / portTICK_PERIOD_MS;
+}
+
+
+void vTaskDelay(TickType_t ticks) {
+  host_micros += 1000 * ticks * portTICK_PERIOD_MS;
+}
+
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+  if (NULL == host_send_hook) {
+    return ESP_OK;
+  }
+  return host_send_hook(peer_addr, data, len);
+}
+
+
+// Plain 6 sectors hue mapping
+CRGB::CRGB(const CHSV &hsv) {
+  uint8_t sector = hsv.h / 43;
+  uint8_t remainder = (hsv.h - (sector * 43)) * 6;
+  uint8_t p = (hsv.v * (255 - hsv.s)) >> 8;
+  uint8_t q = (hsv.v * (255 - ((hsv.s * remainder) >> 8))) >> 8;
+  uint8_t t = (hsv.v * (255 - ((hsv.s * (255 - remainder)) >> 8))) >> 8;
+
+  switch (sector) {
+    case 0:  this->r = hsv.v; this->g = t;     this->b = p;     break;
+    case 1:  this->r = q;     this->g = hsv.v; this->b = p;     break;
+    case 2:  this->r = p;     this->g = hsv.v; this->b = t;     break;
+    case 3:  this->r = p;     this->g = q;     this->b = hsv.v; break;
+    case 4:  this->r = t;     this->g = p;     this->b = hsv.v; break;
+    default: this->r = hsv.v; this->g = p;     this->b = q;     break;
+  }
+}
+
+
+void CLEDController::showLeds(uint8_t brightness) {
+  FastLED.show();
+}
+
+
+CFastLED::CFastLED() {
+  this->brightness = 255;
+  this->shows = 0;
+  this->controllers_count = 0;
+}
+
+
+void CFastLED::show() {
+  this->shows++;
+}
+
+
+size_t fs::File::write(const uint8_t *buffer, size_t size) {
+  if (NULL == this->data) {
+    return 0;
+  }
+  if (this->position + size > this->data->size()) {
+    this->data->resize(this->position + size);
+  }
+  memcpy(this->data->data() + this->position, buffer, size);
+  this->position += size;
+  return size;
+}
+
+
+size_t fs::File::read(uint8_t *buffer, size_t size) {
+  if (NULL == this->data) {
+    return 0;
+  }
+  size = std::min(size, this->data->size() - this->position);
+  memcpy(buffer, this->data->data() + this->position, size);
+  this->position += size;
+  return size;
+}
+
+
+// "r": existing file from the start, "w": new empty file, "a": file created if needed, at the end
+fs::File fs::FS::open(const char *path, const char *mode) {
+  std::vector<uint8_t> *data;
+
+  if ('r' == mode[0]) {
+    data = this->getData(path);
+    return (NULL == data) ? File() : File(data, 0);
+  }
+  data = &this->files[path];
+  if ('w' == mode[0]) {
+    data->clear();
+  }
+  return File(data, data->size());
+}
+
+
+std::vector<uint8_t> *fs::FS::getData(const char *path) {
+  std::map<std::string, std::vector<uint8_t> >::iterator file = this->files.find(path);
+
+  return (this->files.end() == file) ? NULL : &file->second;
+}
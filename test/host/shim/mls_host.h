@@ -0,0 +1,32 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  mls_host.h
+ * @brief Controls of the host build shims (virtual clock, hooks)
+ *
+ * The virtual clock only moves when the test moves it (or by delay()),
+ * so that a test steps the effects and the protocol frame by frame, and
+ * always gets the same result.
+ *
+ **********************************************************************/
+#ifndef MLS_HOST_H
+#define MLS_HOST_H
+
+  #include <Arduino.h>
+  #include <esp_now.h>
+  #include <stdint.h>
+
+  typedef esp_err_t (*mls_host_send_hook)(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+  void mls_host_set_micros(uint32_t now_micros);
+  void mls_host_advance_micros(uint32_t delta_micros);
+  void mls_host_set_serial(boolean enabled);
+  void mls_host_set_send_hook(mls_host_send_hook hook);
+  uint32_t mls_host_get_notifications();
+  uint32_t mls_host_get_restarts();
+  void mls_host_set_isr_context(boolean in_isr);
+  uint32_t mls_host_get_isr_critical_sections();
+
+#endif
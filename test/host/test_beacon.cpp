@@ -0,0 +1,160 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_beacon.cpp
+ * @brief MlsStateBeacon: merge of the two halves, and rejoin time of a device
+ *
+ * The master plays a long effect and has nothing else to send: a state
+ * beacon is sent every MLSMESH_STATE_BEACON_MS. A device reboots at a
+ * random time, and each beacon is lost with a given probability. The
+ * rejoin time is the time until the device plays the effect (first
+ * half), and until it plays it exactly like the master (both halves,
+ * same start time). The mean, 95th percentile and maximum over
+ * TEST_REJOINS reboots are printed for each loss rate.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_beacon.h"
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+#define TEST_REJOINS     2000
+#define TEST_MAX_WAIT_MS 120000
+
+struct REJOIN_CASE {
+  uint8_t loss_percent;
+  uint32_t max_complete_ms;            // Expected maximum time until the effect is complete
+};
+
+static const struct REJOIN_CASE cases[] = {
+  {0, 2 * MLSMESH_STATE_BEACON_MS},
+  {10, 8 * MLSMESH_STATE_BEACON_MS},
+  {30, 16 * MLSMESH_STATE_BEACON_MS},
+  {50, 30 * MLSMESH_STATE_BEACON_MS},
+};
+
+
+// GREEN/GREEN FLASH (wave) 300 of the master: its times come from the packet
+static void masterEffect(struct LIGHT_PACKET *light_packet) {
+  *light_packet = (LIGHT_PACKET){EFFECT_FLASH, MODIFIER_REPEAT, 4321, 300, 0, 0, 255, 0, 12, 5, 12, 0, 255, 0, 12, 5, 12};
+}
+
+
+static void testMerge() {
+  MlsStateBeacon beacon;
+  struct STATE_BEACON_PACKET colors_packet;
+  struct STATE_BEACON_PACKET fades_packet;
+  struct LIGHT_PACKET master_packet;
+  struct LIGHT_PACKET device_packet;
+  uint32_t start_master_time = 0;
+
+  masterEffect(&master_packet);
+  beacon.fill(&colors_packet, &master_packet, 1000000);
+  beacon.fill(&fades_packet, &master_packet, 1000000);
+  CHECK_EQUAL(MLS_ACTION_STATE_BEACON, colors_packet.action);
+  CHECK_EQUAL(MLS_ACTION_STATE_FADES, fades_packet.action);
+  CHECK_EQUAL(255, colors_packet.left_color_raw[1]);
+  CHECK_EQUAL(12, fades_packet.left_times[0]);
+  CHECK_EQUAL(5, fades_packet.right_times[1]);
+  CHECK_EQUAL(1000000, fades_packet.start_master_time);
+
+  // Fade times first, then the colors, then nothing new
+  CHECK(MlsStateBeacon::merge(&fades_packet, &device_packet, &start_master_time, false));
+  CHECK_EQUAL(1000000, start_master_time);
+  CHECK_EQUAL(12, device_packet.right_fadeout_time);
+  CHECK_EQUAL(0, device_packet.left_color_g);
+  CHECK(MlsStateBeacon::merge(&colors_packet, &device_packet, &start_master_time, true));
+  CHECK(memcmp(device_packet.raw, master_packet.raw, LIGHT_PACKET_SIZE) == 0);
+  CHECK(!MlsStateBeacon::merge(&colors_packet, &device_packet, &start_master_time, true));
+  CHECK(!MlsStateBeacon::merge(&fades_packet, &device_packet, &start_master_time, true));
+
+  // The LIGHT DATA was received: the beacons change nothing
+  memcpy(device_packet.raw, master_packet.raw, LIGHT_PACKET_SIZE);
+  CHECK(!MlsStateBeacon::merge(&colors_packet, &device_packet, &start_master_time, true));
+  CHECK(!MlsStateBeacon::merge(&fades_packet, &device_packet, &start_master_time, true));
+
+  // Effect with default times: the fade beacon changes nothing
+  master_packet = (LIGHT_PACKET){EFFECT_HEARTBEAT, 0, 77, 1000, 0, 255, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  beacon.fill(&colors_packet, &master_packet, 2000000);
+  beacon.fill(&fades_packet, &master_packet, 2000000);
+  CHECK(MlsStateBeacon::merge(&colors_packet, &device_packet, &start_master_time, true));
+  CHECK_EQUAL(2000000, start_master_time);
+  CHECK(!MlsStateBeacon::merge(&fades_packet, &device_packet, &start_master_time, true));
+  CHECK(memcmp(device_packet.raw, master_packet.raw, LIGHT_PACKET_SIZE) == 0);
+}
+
+
+static uint32_t percentile(std::vector<uint32_t> *values, uint8_t percent) {
+  std::sort(values->begin(), values->end());
+  return (*values)[(values->size() * percent) / 100];
+}
+
+
+static void simulate(const struct REJOIN_CASE *test_case) {
+  MlsStateBeacon beacon;
+  struct STATE_BEACON_PACKET beacon_packet;
+  struct LIGHT_PACKET master_packet;
+  struct LIGHT_PACKET device_packet;
+  std::vector<uint32_t> playing;
+  std::vector<uint32_t> complete;
+  uint32_t start_master_time;
+  uint32_t join_ms;
+  uint32_t beacon_ms;
+  uint32_t playing_ms;
+  uint32_t complete_ms;
+  uint8_t restarts;
+  boolean valid;
+  double sum_playing = 0;
+  double sum_complete = 0;
+
+  randomSeed(1 + test_case->loss_percent);
+  masterEffect(&master_packet);
+  for (uint16_t rejoin = 0; rejoin < TEST_REJOINS; rejoin++) {
+    // The device reboots between two beacons, the beacons of the master alternate
+    join_ms = random(0, 2 * MLSMESH_STATE_BEACON_MS);
+    beacon_ms = 0;
+    valid = false;
+    restarts = 0;
+    playing_ms = 0;
+    complete_ms = 0;
+    while ((0 == complete_ms) && (beacon_ms < (join_ms + TEST_MAX_WAIT_MS))) {
+      beacon.fill(&beacon_packet, &master_packet, 1000000);
+      if ((beacon_ms >= join_ms) && (random(0, 100) >= test_case->loss_percent)) {
+        if (MlsStateBeacon::merge(&beacon_packet, &device_packet, &start_master_time, valid)) {
+          valid = true;
+          restarts++;
+          if (0 == playing_ms) {
+            playing_ms = beacon_ms - join_ms;
+          }
+          if ((1000000 == start_master_time) && (memcmp(device_packet.raw, master_packet.raw, LIGHT_PACKET_SIZE) == 0)) {
+            complete_ms = beacon_ms - join_ms;
+          }
+        }
+      }
+      beacon_ms += MLSMESH_STATE_BEACON_MS;
+    }
+    CHECK(complete_ms > 0);
+    CHECK(restarts <= 2);
+    playing.push_back(playing_ms);
+    complete.push_back(complete_ms);
+    sum_playing += playing_ms;
+    sum_complete += complete_ms;
+  }
+  printf("%2u%% beacons lost: playing after %5.0f ms (p95 %5u, max %5u), complete after %5.0f ms (p95 %5u, max %5u)\n",
+         test_case->loss_percent, sum_playing / TEST_REJOINS, percentile(&playing, 95), *std::max_element(playing.begin(), playing.end()),
+         sum_complete / TEST_REJOINS, percentile(&complete, 95), *std::max_element(complete.begin(), complete.end()));
+  CHECK(*std::max_element(complete.begin(), complete.end()) <= test_case->max_complete_ms);
+}
+
+
+int main(int argc, char **argv) {
+  testMerge();
+  for (uint8_t i = 0; i < (sizeof(cases) / sizeof(cases[0])); i++) {
+    simulate(&cases[i]);
+  }
+  MLS_TEST_END();
+}
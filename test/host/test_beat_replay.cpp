@@ -0,0 +1,235 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_beat_replay.cpp
+ * @brief WAV sample source, beat labels and evaluation of mls_beat_replay
+ *
+ * The WAV files are built in memory (16 bits stereo at 44.1 kHz, 24 bits
+ * mono at 16 kHz, 8 bits): the samples must be the first channel, left
+ * aligned and resampled at I2S_SAMPLE_RATE. The matching of the
+ * evaluation is checked on hand made beats, then a synthetic kick track
+ * goes through MlsBeatDetector like in mls_beat_replay.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_wav_sample_source.h"
+#include "mls_beat_eval.h"
+#include <math.h>
+#include <vector>
+
+
+static void putUint32(std::vector<uint8_t> *data, uint32_t value) {
+  for (uint8_t i = 0; i < 4; i++) {
+    data->push_back((value >> (8 * i)) & 0xFF);
+  }
+}
+
+
+static void putUint16(std::vector<uint8_t> *data, uint16_t value) {
+  data->push_back(value & 0xFF);
+  data->push_back(value >> 8);
+}
+
+
+// PCM WAV file, the signal (-1.0 to 1.0) in the first channel, its opposite in the others
+static std::vector<uint8_t> wavFile(uint32_t sample_rate, uint16_t bits, uint16_t channels, const std::vector<double> &signal) {
+  std::vector<uint8_t> data;
+  uint16_t bytes_per_sample = bits / 8;
+  uint32_t pcm_size = signal.size() * channels * bytes_per_sample;
+
+  data.insert(data.end(), (const uint8_t *) "RIFF", (const uint8_t *) "RIFF" + 4);
+  putUint32(&data, 4 + (8 + 16) + (8 + 4) + (8 + pcm_size));
+  data.insert(data.end(), (const uint8_t *) "WAVEfmt ", (const uint8_t *) "WAVEfmt " + 8);
+  putUint32(&data, 16);
+  putUint16(&data, 1);
+  putUint16(&data, channels);
+  putUint32(&data, sample_rate);
+  putUint32(&data, sample_rate * channels * bytes_per_sample);
+  putUint16(&data, channels * bytes_per_sample);
+  putUint16(&data, bits);
+  // Unknown chunk, skipped
+  data.insert(data.end(), (const uint8_t *) "LIST", (const uint8_t *) "LIST" + 4);
+  putUint32(&data, 4);
+  putUint32(&data, 0);
+  data.insert(data.end(), (const uint8_t *) "data", (const uint8_t *) "data" + 4);
+  putUint32(&data, pcm_size);
+  for (size_t i = 0; i < signal.size(); i++) {
+    for (uint16_t channel = 0; channel < channels; channel++) {
+      double value = (0 == channel) ? signal[i] : -signal[i];
+      int32_t sample = (int32_t) lrint(value * ((1L << (bits - 1)) - 1));
+      if (8 == bits) {
+        sample += 128;
+      }
+      for (uint16_t j = 0; j < bytes_per_sample; j++) {
+        data.push_back((sample >> (8 * j)) & 0xFF);
+      }
+    }
+  }
+  return data;
+}
+
+
+// Kicks: 60 Hz bursts with an exponential decay, on the beats (and noise between them)
+static std::vector<double> kickTrack(uint32_t sample_rate, double seconds, double period, std::vector<uint32_t> *beats_micros) {
+  std::vector<double> signal((size_t) (seconds * sample_rate), 0.0);
+
+  randomSeed(25);
+  for (size_t i = 0; i < signal.size(); i++) {
+    signal[i] = 0.01 * ((random(2001) - 1000) / 1000.0);
+  }
+  for (double beat = 0.25; beat < (seconds - 0.5); beat += period) {
+    size_t start = (size_t) (beat * sample_rate);
+    beats_micros->push_back((uint32_t) lrint(beat * 1000000));
+    for (size_t i = 0; ((start + i) < signal.size()) && (i < (0.3 * sample_rate)); i++) {
+      double t = (double) i / sample_rate;
+      signal[start + i] += 0.6 * exp(-t / 0.08) * sin(2 * PI * 60 * t);
+    }
+  }
+  return signal;
+}
+
+
+static void testWavFormats() {
+  std::vector<double> ramp;
+  MlsWavSampleSource source;
+  int32_t samples[I2S_BLOCK_SIZE];
+  uint32_t hop_end_micros;
+  std::vector<uint8_t> data;
+
+  for (uint16_t i = 0; i < 1600; i++) {
+    ramp.push_back((i % 200) / 200.0);
+  }
+
+  // 24 bits mono at I2S_SAMPLE_RATE: the samples as is, 24 bits left aligned
+  data = wavFile(I2S_SAMPLE_RATE, 24, 1, ramp);
+  CHECK(source.load(data.data(), data.size()));
+  CHECK_EQUAL(24, source.getFileBits());
+  CHECK_EQUAL(1, source.getFileChannels());
+  CHECK_EQUAL(1600, source.getSamples());
+  CHECK_EQUAL(100000, source.getDurationMicros());
+  CHECK_EQUAL(I2S_BLOCK_SIZE, source.read(samples, I2S_BLOCK_SIZE, &hop_end_micros));
+  CHECK_EQUAL(MLS_WAV_START_MICROS + ((I2S_BLOCK_SIZE * 1000000) / I2S_SAMPLE_RATE), hop_end_micros);
+  CHECK_EQUAL(0, samples[0]);
+  CHECK_EQUAL(lrint(0.5 * 8388607) << 8, samples[100]);
+  for (uint8_t i = 1; i < (1600 / I2S_BLOCK_SIZE); i++) {
+    CHECK_EQUAL(I2S_BLOCK_SIZE, source.read(samples, I2S_BLOCK_SIZE, &hop_end_micros));
+  }
+  CHECK_EQUAL(1600 % I2S_BLOCK_SIZE, source.read(samples, I2S_BLOCK_SIZE, &hop_end_micros));
+  CHECK_EQUAL(MLS_WAV_START_MICROS + 100000, hop_end_micros);
+  CHECK_EQUAL(0, source.read(samples, I2S_BLOCK_SIZE, &hop_end_micros));
+
+  // 16 bits stereo at 44.1 kHz: first channel, resampled
+  data = wavFile(44100, 16, 2, ramp);
+  CHECK(source.load(data.data(), data.size()));
+  CHECK_EQUAL(44100, source.getFileSampleRate());
+  CHECK_EQUAL(2, source.getFileChannels());
+  CHECK_EQUAL((1600 * I2S_SAMPLE_RATE) / 44100, source.getSamples());
+  CHECK_EQUAL(I2S_BLOCK_SIZE, source.read(samples, I2S_BLOCK_SIZE, &hop_end_micros));
+  // Sample 20 at 16 kHz is sample 55.125 of the ramp at 44.1 kHz
+  CHECK(fabs((samples[20] / 2147483648.0) - (55.125 / 200)) < 0.001);
+
+  // 8 bits (unsigned)
+  data = wavFile(I2S_SAMPLE_RATE, 8, 1, ramp);
+  CHECK(source.load(data.data(), data.size()));
+  CHECK_EQUAL(I2S_BLOCK_SIZE, source.read(samples, I2S_BLOCK_SIZE, &hop_end_micros));
+  CHECK_EQUAL(0, samples[0]);
+  CHECK_EQUAL(64 << 24, samples[100]);
+
+  // Not a WAV file, or not a PCM one
+  CHECK(!source.load((const uint8_t *) "RIFF----WAVX", 12));
+  data[20] = 3;
+  CHECK(!source.load(data.data(), data.size()));
+  CHECK(!source.open("/nonexistent.wav"));
+}
+
+
+static void testLabels() {
+  MlsBeatLabels labels;
+
+  CHECK(labels.parse("# Audacity label track\n1.5\t1.5\tkick\n0.500000\t0.500000\n\n  2.25 snare?\r\n"));
+  CHECK_EQUAL(3, labels.getBeats());
+  CHECK_EQUAL(500000, labels.getBeatsMicros()[0]);
+  CHECK_EQUAL(1500000, labels.getBeatsMicros()[1]);
+  CHECK_EQUAL(2250000, labels.getBeatsMicros()[2]);
+  CHECK(labels.parse("3"));
+  CHECK_EQUAL(1, labels.getBeats());
+  CHECK(!labels.parse("1.0\nkick\n"));
+  CHECK(!labels.parse("-1.0\n"));
+}
+
+
+static void testEvaluator() {
+  MlsBeatEvaluator evaluator(70000, 10000);
+  MlsBeatEvaluator total(70000, 10000);
+  std::vector<uint32_t> labels;
+  std::vector<uint32_t> detections;
+
+  // 5 labels: 3 beats in time (-20, +10, +70 ms), 1 beat too late, 1 false beat, 1 label missed
+  labels.push_back(1000000);
+  labels.push_back(1500000);
+  labels.push_back(2000000);
+  labels.push_back(2500000);
+  labels.push_back(3000000);
+  detections.push_back(980000);
+  detections.push_back(1510000);
+  detections.push_back(1800000);
+  detections.push_back(2070000);
+  detections.push_back(2571000);
+  evaluator.add(detections, labels);
+  CHECK_EQUAL(3, evaluator.getMatched());
+  CHECK_EQUAL(2, evaluator.getFalsePositives());
+  CHECK_EQUAL(2, evaluator.getMissed());
+  CHECK(fabs(evaluator.getPrecision() - 0.6) < 1e-9);
+  CHECK(fabs(evaluator.getRecall() - 0.6) < 1e-9);
+  CHECK(fabs(evaluator.getFScore() - 0.6) < 1e-9);
+  CHECK(fabs(evaluator.getMeanLatencyMicros() - 20000) < 1e-9);
+  CHECK_EQUAL(15, evaluator.getHistogram().size());
+  CHECK_EQUAL(1, evaluator.getHistogram()[5]);
+  CHECK_EQUAL(1, evaluator.getHistogram()[8]);
+  CHECK_EQUAL(1, evaluator.getHistogram()[14]);
+
+  total.add(&evaluator);
+  total.add(&evaluator);
+  CHECK_EQUAL(6, total.getMatched());
+  CHECK_EQUAL(2, total.getHistogram()[14]);
+  CHECK(fabs(total.getFScore() - 0.6) < 1e-9);
+}
+
+
+// Synthetic kicks at 120 BPM through the beat detector, like mls_beat_replay
+static void testKickTrack() {
+  std::vector<uint32_t> labels;
+  std::vector<uint32_t> beats_micros;
+  std::vector<uint8_t> data = wavFile(44100, 16, 2, kickTrack(44100, 30.0, 0.5, &labels));
+  MlsWavSampleSource source;
+  MlsBeatDetector detector;
+  MlsBeatEvaluator evaluator;
+  struct I2S_BEAT beat;
+  int32_t samples[I2S_BLOCK_SIZE];
+  uint32_t hop_end_micros;
+  uint16_t count;
+
+  CHECK(source.load(data.data(), data.size()));
+  while (0 != (count = source.read(samples, I2S_BLOCK_SIZE, &hop_end_micros))) {
+    if (detector.process(samples, count, hop_end_micros, &beat)) {
+      beats_micros.push_back(beat.onset_micros - source.getStartMicros());
+    }
+  }
+  evaluator.add(beats_micros, labels);
+  printf("Kick track: %u labels, %u beats, F %.3f, mean latency %+.1f ms\n", (unsigned) labels.size(),
+         (unsigned) beats_micros.size(), evaluator.getFScore(), evaluator.getMeanLatencyMicros() / 1000);
+  CHECK(evaluator.getFScore() >= 0.95);
+  CHECK(fabs(evaluator.getMeanLatencyMicros()) < 20000);
+}
+
+
+int main(int argc, char **argv) {
+  testWavFormats();
+  testLabels();
+  testEvaluator();
+  testKickTrack();
+  MLS_TEST_END();
+}
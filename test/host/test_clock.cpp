@@ -0,0 +1,186 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_clock.cpp
+ * @brief MlsClock: minimum delay filter and drift estimate, with jitter and drift
+ *
+ * A master packet is received every TEST_PERIOD_US. The master clock
+ * drifts by a constant number of ppm compared to the local clock, and the
+ * one-way delay of each packet (after the hop latency compensation of the
+ * sketch) is a random jitter, with some long delays (retries, queued
+ * frames). After TEST_SETTLE_US, the master time estimated by the device
+ * is compared with the real master time, and the drift estimate with the
+ * real drift. A master reboot (clock jump) must restart the estimation,
+ * but not a single late packet.
+ *
+ * A band of TEST_DEVICES devices, each with its own local clock drift and
+ * its own delays, then receives the same master packets. The residual
+ * inter-device skew is the spread of the master times estimated by the
+ * devices at the same real instant.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_clock.h"
+#include <stdio.h>
+
+#define TEST_PERIOD_US   50000          // One master packet every 50 ms
+#define TEST_DURATION_US 300000000      // 5 minutes
+#define TEST_SETTLE_US   60000000       // Errors measured after 1 minute
+#define TEST_DEVICES     4
+#define TEST_MAX_SKEW_US 1000           // Expected maximum inter-device skew (2 ms jitter, 5% of packets delayed up to 20 ms)
+
+struct CLOCK_CASE {
+  int32_t drift_ppm;                   // Master clock drift compared to the local clock
+  uint32_t jitter_us;                  // Random one-way delay, between 0 and jitter_us
+  uint8_t spike_percent;               // Packets delayed by up to spike_us more
+  uint32_t spike_us;
+  uint32_t max_error_us;               // Expected maximum error of the master time
+  uint32_t max_drift_error_ppb;        // Expected maximum error of the drift estimate
+};
+
+static const struct CLOCK_CASE cases[] = {
+  {0, 0, 0, 0, 20, 1000},
+  {0, 2000, 0, 0, 700, 5000},
+  {40, 500, 0, 0, 250, 5000},
+  {-40, 2000, 5, 20000, 700, 5000},
+  {100, 1000, 10, 20000, 450, 5000},
+  {-150, 3000, 10, 50000, 1600, 5000},  // Some packets are late by more than MLSCLOCK_RESYNC_MICROS
+};
+
+
+static void simulate(const struct CLOCK_CASE *test_case) {
+  MlsClock clock;
+  uint32_t master_start_micros = 123456789;
+  uint32_t local_micros;
+  uint32_t master_micros;
+  uint32_t delay_micros;
+  int64_t error_micros;
+  int64_t sum_error_micros = 0;
+  uint32_t max_error_micros = 0;
+  uint32_t measures = 0;
+  int32_t drift_error_ppb;
+
+  randomSeed(1 + test_case->jitter_us + test_case->drift_ppm);
+  for (uint64_t t = 0; t < TEST_DURATION_US; t += TEST_PERIOD_US) {
+    // Local time of the master send, and master time at this local time
+    local_micros = (uint32_t) (1000 + t);
+    master_micros = master_start_micros + (uint32_t) (t + ((int64_t) t * test_case->drift_ppm) / 1000000);
+    delay_micros = (test_case->jitter_us > 0) ? random(0, test_case->jitter_us) : 0;
+    if ((test_case->spike_percent > 0) && (random(0, 100) < test_case->spike_percent)) {
+      delay_micros += random(0, test_case->spike_us);
+    }
+    clock.addSample(master_micros, local_micros + delay_micros);
+
+    if (t >= TEST_SETTLE_US) {
+      error_micros = (int64_t) (int32_t) (clock.localToMaster(local_micros) - master_micros);
+      sum_error_micros += error_micros;
+      max_error_micros = max(max_error_micros, (uint32_t) llabs(error_micros));
+      measures++;
+    }
+  }
+  drift_error_ppb = abs(clock.getDriftPpb() - (test_case->drift_ppm * 1000));
+  printf("drift %4d ppm, jitter %4u us, %2u%% delayed up to %5u us: error mean %6.1f us, max %4u us, drift estimate %7d ppb (error %5d ppb)\n",
+         test_case->drift_ppm, test_case->jitter_us, test_case->spike_percent, test_case->spike_us,
+         (double) sum_error_micros / measures, max_error_micros, clock.getDriftPpb(), drift_error_ppb);
+  CHECK(clock.isSynchronized());
+  CHECK_EQUAL(0, clock.getResyncs());
+  CHECK(max_error_micros <= test_case->max_error_us);
+  CHECK((uint32_t) drift_error_ppb <= test_case->max_drift_error_ppb);
+}
+
+
+// A master reboot restarts the estimation, the delayed packets do not
+static void testResync() {
+  MlsClock clock;
+  uint32_t local_micros = 5000000;
+
+  clock.addSample(1000000, local_micros);
+  CHECK(clock.isSynchronized());
+  CHECK_EQUAL(-4000000, clock.getOffsetMicros(local_micros));
+
+  // Delayed packet: the offset is not changed
+  local_micros += TEST_PERIOD_US;
+  clock.addSample(1000000 + TEST_PERIOD_US - 30000, local_micros);
+  CHECK_EQUAL(-4000000, clock.getOffsetMicros(local_micros));
+  // Faster packet: better offset
+  local_micros += TEST_PERIOD_US;
+  clock.addSample(1000000 + (2 * TEST_PERIOD_US) + 200, local_micros);
+  CHECK_EQUAL(-3999800, clock.getOffsetMicros(local_micros));
+  // Single packet late by more than MLSCLOCK_RESYNC_MICROS: ignored
+  local_micros += TEST_PERIOD_US;
+  clock.addSample(1000000 + (3 * TEST_PERIOD_US) - 80000, local_micros);
+  CHECK_EQUAL(-3999800, clock.getOffsetMicros(local_micros));
+  local_micros += TEST_PERIOD_US;
+  clock.addSample(1000000 + (4 * TEST_PERIOD_US) + 200, local_micros);
+  CHECK_EQUAL(0, clock.getResyncs());
+
+  // The master has rebooted, confirmed by the next sample
+  local_micros += TEST_PERIOD_US;
+  clock.addSample(1000, local_micros);
+  CHECK_EQUAL(0, clock.getResyncs());
+  local_micros += TEST_PERIOD_US;
+  clock.addSample(1000 + TEST_PERIOD_US, local_micros);
+  CHECK_EQUAL(1, clock.getResyncs());
+  CHECK_EQUAL(1000 + TEST_PERIOD_US - (int32_t) local_micros, clock.getOffsetMicros(local_micros));
+  CHECK_EQUAL(local_micros + 100, clock.masterToLocal(1000 + TEST_PERIOD_US + 100));
+
+  // The master clock is never changed
+  clock.setMaster();
+  clock.addSample(99999999, local_micros);
+  CHECK_EQUAL(local_micros, clock.localToMaster(local_micros));
+}
+
+
+// Spread of the master time estimated at the same real instant by devices with different drifts and delays
+static void testSkew() {
+  static const int32_t drifts_ppm[TEST_DEVICES] = {-100, -20, 60, 150};
+  MlsClock clocks[TEST_DEVICES];
+  uint32_t master_start_micros = 987654321;
+  uint32_t local_micros;
+  uint32_t delay_micros;
+  int32_t error_micros;
+  int32_t min_error_micros;
+  int32_t max_error_micros;
+  uint64_t sum_skew_micros = 0;
+  uint32_t max_skew_micros = 0;
+  uint32_t measures = 0;
+
+  randomSeed(7);
+  for (uint64_t t = 0; t < TEST_DURATION_US; t += TEST_PERIOD_US) {
+    min_error_micros = INT32_MAX;
+    max_error_micros = INT32_MIN;
+    for (uint8_t device = 0; device < TEST_DEVICES; device++) {
+      // Local clock of the device at the real time t (master time: master_start_micros + t)
+      local_micros = (uint32_t) ((device * 1000000) + t + ((int64_t) t * drifts_ppm[device]) / 1000000);
+      delay_micros = random(0, 2000);
+      if (random(0, 100) < 5) {
+        delay_micros += random(0, 20000);
+      }
+      clocks[device].addSample(master_start_micros + (uint32_t) t, local_micros + delay_micros);
+      error_micros = (int32_t) (clocks[device].localToMaster(local_micros) - (master_start_micros + (uint32_t) t));
+      min_error_micros = min(min_error_micros, error_micros);
+      max_error_micros = max(max_error_micros, error_micros);
+    }
+    if (t >= TEST_SETTLE_US) {
+      sum_skew_micros += max_error_micros - min_error_micros;
+      max_skew_micros = max(max_skew_micros, (uint32_t) (max_error_micros - min_error_micros));
+      measures++;
+    }
+  }
+  printf("%u devices, drift %d to %d ppm, jitter 2000 us, 5%% delayed up to 20000 us: inter-device skew mean %6.1f us, max %4u us\n",
+         TEST_DEVICES, drifts_ppm[0], drifts_ppm[TEST_DEVICES - 1], (double) sum_skew_micros / measures, max_skew_micros);
+  CHECK(max_skew_micros <= TEST_MAX_SKEW_US);
+}
+
+
+int main(int argc, char **argv) {
+  testResync();
+  for (uint8_t i = 0; i < (sizeof(cases) / sizeof(cases[0])); i++) {
+    simulate(&cases[i]);
+  }
+  testSkew();
+  MLS_TEST_END();
+}
@@ -0,0 +1,132 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_envelope.cpp
+ * @brief Accuracy of MlsEnvelope against the exact linear fades
+ *
+ * The breath envelopes (35% fade in, 10% on, 35% fade out) of 1 s to
+ * 65.5 s are compared with the exact fade at each millisecond: the
+ * rounded level must stay within 0.52 level, and the end of each fade
+ * must reach its level without a jump. A ramp beyond the segments is
+ * refused and leaves the envelope incomplete.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_envelope.h"
+#include <math.h>
+
+
+// Exact level of the breath envelope of effectBreath
+static double exactBreath(uint32_t duration_ms, uint32_t delta_micros) {
+  double fade_micros = 350.0 * duration_ms;
+  double on_micros = 100.0 * duration_ms;
+
+  if (delta_micros < fade_micros) {
+    return 63.0 + (192.0 * delta_micros / fade_micros);
+  }
+  if (delta_micros < (fade_micros + on_micros)) {
+    return 255.0;
+  }
+  if (delta_micros < ((2 * fade_micros) + on_micros)) {
+    return 255.0 - (192.0 * (delta_micros - fade_micros - on_micros) / fade_micros);
+  }
+  return 63.0;
+}
+
+
+static void testBreath(uint32_t duration_ms) {
+  MlsEnvelope envelope;
+  uint32_t fade_micros = 350 * duration_ms;
+  double max_error = 0;
+  double error;
+
+  envelope.compileFade(duration_ms, 0, fade_micros, 100 * duration_ms, fade_micros, 63, 255);
+  for (uint32_t delta_micros = 0; delta_micros < (1000 * duration_ms); delta_micros += 1000) {
+    error = fabs(envelope.getLevel(delta_micros) - exactBreath(duration_ms, delta_micros));
+    if (error > max_error) {
+      max_error = error;
+    }
+  }
+  printf("Breath of %5u ms: max error %.3f level\n", duration_ms, max_error);
+  CHECK(max_error <= 0.52);
+
+  // No jump at the end of the fade in, and the midpoint of the fade in
+  CHECK_EQUAL(159, envelope.getLevel(fade_micros / 2));
+  CHECK_EQUAL(255, envelope.getLevel(fade_micros - 1));
+  CHECK_EQUAL(255, envelope.getLevel(fade_micros));
+  // Fade out, and back to the start for a repeated effect
+  CHECK_EQUAL(159, envelope.getLevel((fade_micros / 2) + fade_micros + (100 * duration_ms)));
+  CHECK_EQUAL(63, envelope.getLevel((2 * fade_micros) + (100 * duration_ms) - 1));
+  CHECK_EQUAL(63, envelope.getLevel(1000 * duration_ms));
+  CHECK_EQUAL(63, envelope.getLevel(0));
+}
+
+
+// Several segments, as in the heartbeat effect
+static void testSegments() {
+  MlsEnvelope envelope;
+
+  envelope.begin(1, 0);
+  envelope.ramp(50000, 255);
+  envelope.hold(100000);
+  envelope.ramp(200000, 128);
+  envelope.jump(0);
+  envelope.ramp(100000, 224);
+  envelope.ramp(450000, 0);
+  CHECK_EQUAL(0, envelope.getLevel(-1));
+  CHECK_EQUAL(102, envelope.getLevel(20000));
+  CHECK_EQUAL(255, envelope.getLevel(100000));
+  CHECK_EQUAL(160, envelope.getLevel(300000));
+  CHECK_EQUAL(0, envelope.getLevel(350000));
+  CHECK_EQUAL(112, envelope.getLevel(400000));
+  CHECK_EQUAL(112, envelope.getLevel(675000));
+  CHECK_EQUAL(0, envelope.getLevel(900000));
+  // Time going backward
+  CHECK_EQUAL(102, envelope.getLevel(20000));
+  CHECK(envelope.isCompiled(1));
+  envelope.invalidate();
+  CHECK(!envelope.isCompiled(1));
+}
+
+
+// A ramp beyond MLS_ENVELOPE_SEGMENTS is refused, the envelope is incomplete up to the next begin
+static void testOverflow() {
+  MlsEnvelope envelope;
+
+  envelope.begin(2, 0);
+  for (uint8_t i = 0; i < MLS_ENVELOPE_SEGMENTS; i++) {
+    CHECK(envelope.ramp(10000, (0 == (i % 2)) ? 255 : 0));
+  }
+  CHECK(envelope.isComplete());
+  envelope.jump(128);
+  CHECK(envelope.isComplete());
+  CHECK(!envelope.ramp(10000, 0));
+  CHECK(!envelope.hold(10000));
+  CHECK(!envelope.isComplete());
+  // The refused ramp is not played, the level after the segments is the last jump
+  CHECK_EQUAL(128, envelope.getLevel(10000 * MLS_ENVELOPE_SEGMENTS));
+  CHECK_EQUAL(128, envelope.getLevel(10000 * (MLS_ENVELOPE_SEGMENTS + 1)));
+  // A jump or a zero length ramp needs no segment
+  envelope.begin(3, 0);
+  for (uint8_t i = 0; i < MLS_ENVELOPE_SEGMENTS; i++) {
+    envelope.hold(10000);
+  }
+  CHECK(envelope.ramp(0, 255));
+  CHECK(envelope.isComplete());
+  CHECK(envelope.compileFade(4, 10000, 10000, 10000, 10000, 0, 255));
+}
+
+
+int main(int argc, char **argv) {
+  testBreath(1000);
+  testBreath(5000);
+  testBreath(20000);
+  testBreath(60000);
+  testBreath(65535);
+  testSegments();
+  testOverflow();
+  MLS_TEST_END();
+}
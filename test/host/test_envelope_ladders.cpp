@@ -0,0 +1,321 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_envelope_ladders.cpp
+ * @brief Frames of the envelope effects against the fade ladders they replaced
+ *
+ * The fade ladders of HEARTBEAT, BREATH, VUE_METER, WAVE_BACK and of the
+ * fades of FLASH and FLASH_YELLOW (a chain of time tests, a division for
+ * the level and adjustBrightness with its divisions by 255) are copied
+ * here from the effects before MlsEnvelope. Each effect is rendered by
+ * MlsLightEffects every millisecond, for several durations, options and
+ * ranks, and each channel of the first LED of both strips is compared
+ * with the gamma correction of the ladder color.
+ *
+ * The ladders round the level down, the envelope rounds it to the
+ * nearest level (within 0.52 level of the exact fade): a channel must be
+ * within TEST_TOLERANCE level of the ladder before the gamma correction.
+ * The diastole ladder of HEARTBEAT rounds down twice (the diastole color,
+ * then its fade out), up to 1.9 level below the exact fade, its channels
+ * must be within TEST_DIASTOLE_TOLERANCE levels. The frames rendered
+ * away from the ladder are counted and printed.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_light_effects.h"
+#include <string.h>
+
+#define TEST_LEDS         8
+#define TEST_FRAME_MICROS 1000
+#define TEST_TOLERANCE    1  // Levels before the gamma correction
+#define TEST_DIASTOLE_TOLERANCE 2
+
+static MlsArena arena;
+static struct CRGB left_leds[TEST_LEDS];
+static struct CRGB right_leds[TEST_LEDS];
+static MlsLightEffects effects(TEST_LEDS, left_leds, right_leds);
+static uint16_t packet_id = 1;
+
+// Parameters of the ladder of the current run
+static struct LIGHT_PACKET ladder_packet;
+static uint8_t ladder_ranks;
+static uint8_t ladder_rank;
+
+typedef struct CRGB (*ladder_color)(uint8_t lr, int32_t delta_time_micros);
+
+
+static struct CRGB adjustBrightness(struct CRGB color, uint8_t brightness) {
+  return CRGB((brightness * color.r) / 255, (brightness * color.g) / 255, (brightness * color.b) / 255);
+}
+
+
+static struct CRGB packetColor(uint8_t lr) {
+  if (0 == lr) {
+    return CRGB(ladder_packet.left_color_r, ladder_packet.left_color_g, ladder_packet.left_color_b);
+  }
+  return CRGB(ladder_packet.right_color_r, ladder_packet.right_color_g, ladder_packet.right_color_b);
+}
+
+
+// Fade in, on and fade out ladder of effectFlash
+static struct CRGB fadeLadder(struct CRGB new_color, int32_t delta_time_micros, uint32_t fadein_time_micros, uint32_t on_time_micros, uint32_t fadeout_time_micros) {
+  if ((delta_time_micros >= 0) && (fadein_time_micros > 0) && (delta_time_micros < fadein_time_micros)) {
+    new_color = adjustBrightness(new_color, 255 * delta_time_micros / fadein_time_micros);
+  } else if ((delta_time_micros >= 0) && (delta_time_micros < (fadein_time_micros + on_time_micros))) {
+  } else if ((delta_time_micros >= 0) && (fadeout_time_micros > 0) && (delta_time_micros < (fadein_time_micros + on_time_micros + fadeout_time_micros))) {
+    new_color = adjustBrightness(new_color, 255 * (fadeout_time_micros - (delta_time_micros - fadein_time_micros - on_time_micros)) / fadeout_time_micros);
+  } else {
+    new_color = CRGB::Black;
+  }
+  return new_color;
+}
+
+
+static struct CRGB flashLadder(uint8_t lr, int32_t delta_time_micros) {
+  if (0 == lr) {
+    return fadeLadder(packetColor(lr), delta_time_micros, ladder_packet.left_fadein_time * 10000, ladder_packet.left_on_time * 10000, ladder_packet.left_fadeout_time * 10000);
+  }
+  return fadeLadder(packetColor(lr), delta_time_micros, ladder_packet.right_fadein_time * 10000, ladder_packet.right_on_time * 10000, ladder_packet.right_fadeout_time * 10000);
+}
+
+
+static struct CRGB flashYellowLadder(uint8_t lr, int32_t delta_time_micros) {
+  return fadeLadder(CRGB(255, 165, 0), delta_time_micros, 0, 30000, 350000);
+}
+
+
+// Ladder of effectHeartbeat
+static struct CRGB heartbeatLadder(uint8_t lr, int32_t delta_time_micros) {
+  struct CRGB new_color = packetColor(lr);
+  struct CRGB diastole_color;
+  uint32_t systole_fadein_time_micros = 50 * ladder_packet.duration_ms;
+  uint32_t systole_on_time_micros = 100 * ladder_packet.duration_ms;
+  uint32_t systole_fadeout_time_micros = 300 * ladder_packet.duration_ms;
+  uint32_t diastole_time_micros = 350 * ladder_packet.duration_ms;
+  uint32_t diastole_fadein_time_micros = 0;
+  uint32_t diastole_on_time_micros = 100 * ladder_packet.duration_ms;
+  uint32_t diastole_fadeout_time_micros = 450 * ladder_packet.duration_ms;
+
+  diastole_color = adjustBrightness(new_color, ladder_packet.option);
+  if (((delta_time_micros) >= diastole_time_micros) && (diastole_fadein_time_micros > 0) && ((delta_time_micros - diastole_time_micros) <= (diastole_fadein_time_micros))) {
+    new_color = adjustBrightness(diastole_color, 255 * (delta_time_micros - diastole_time_micros)  / diastole_fadein_time_micros);
+  } else if (((delta_time_micros) >= diastole_time_micros) && ((delta_time_micros - diastole_time_micros) < (diastole_fadein_time_micros + diastole_on_time_micros))) {
+    new_color = diastole_color;
+  } else if (((delta_time_micros) >= diastole_time_micros) && (diastole_fadeout_time_micros > 0) && ((delta_time_micros - diastole_time_micros) < (diastole_fadein_time_micros + diastole_on_time_micros + diastole_fadeout_time_micros))) {
+    new_color = adjustBrightness(diastole_color, 255 * (diastole_time_micros
+    + diastole_fadeout_time_micros - ((delta_time_micros) - diastole_fadein_time_micros - diastole_on_time_micros)) / diastole_fadeout_time_micros);
+  } else if ((delta_time_micros) >= (diastole_time_micros + diastole_time_micros + diastole_on_time_micros + diastole_fadeout_time_micros)) {
+    new_color = CRGB::Black;
+  } else if ((delta_time_micros >= 0) && (systole_fadein_time_micros > 0) && (delta_time_micros < systole_fadein_time_micros)) {
+    new_color = adjustBrightness(new_color, 255 * delta_time_micros / systole_fadein_time_micros);
+  } else if ((delta_time_micros >= 0) && (delta_time_micros < (systole_fadein_time_micros + systole_on_time_micros))) {
+  } else if ((delta_time_micros >= 0) && (systole_fadeout_time_micros > 0) && (delta_time_micros < (systole_fadein_time_micros + systole_on_time_micros + systole_fadeout_time_micros))) {
+    new_color = adjustBrightness(new_color, 255 * (systole_fadeout_time_micros - (delta_time_micros - systole_fadein_time_micros - systole_on_time_micros)) / systole_fadeout_time_micros);
+  } else {
+    new_color = CRGB::Black;
+  }
+  return new_color;
+}
+
+
+// Ladder of effectBreath
+static struct CRGB breathLadder(uint8_t lr, int32_t delta_time_micros) {
+  struct CRGB new_color = packetColor(lr);
+  uint32_t breath_fadein_time_micros = 350 * ladder_packet.duration_ms;
+  uint32_t breath_on_time_micros = 100 * ladder_packet.duration_ms;
+  uint32_t breath_fadeout_time_micros = 350 * ladder_packet.duration_ms;
+
+  if ((delta_time_micros >= 0) && (breath_fadein_time_micros > 0) && (delta_time_micros < breath_fadein_time_micros)) {
+    new_color = adjustBrightness(new_color, 63 + (192 * delta_time_micros / breath_fadein_time_micros));
+  } else if ((delta_time_micros >= 0) && (delta_time_micros < (breath_fadein_time_micros + breath_on_time_micros))) {
+  } else if ((delta_time_micros >= 0) && (breath_fadeout_time_micros > 0) && (delta_time_micros < (breath_fadein_time_micros + breath_on_time_micros + breath_fadeout_time_micros))) {
+    new_color = adjustBrightness(new_color, 63 + (192 * (breath_fadeout_time_micros - (delta_time_micros - breath_fadein_time_micros - breath_on_time_micros)) / breath_fadeout_time_micros));
+  } else {
+    new_color = adjustBrightness(new_color, 63);
+  }
+  return new_color;
+}
+
+
+// Ladder of effectVueMeter (both_ways) and of effectWaveBack
+static struct CRGB rankLadder(struct CRGB new_color, int32_t delta_time_micros, boolean both_ways) {
+  uint32_t shift_delay_micros;
+  uint32_t fadein_time_micros = 0;
+  uint32_t fadeout_time_micros;
+  uint32_t on_time_micros;
+  uint32_t rank_start_delay_micros;
+  uint8_t ways = both_ways ? 2 : 1;
+
+  shift_delay_micros = 1000 * (ladder_packet.duration_ms - ladder_packet.option) / (ways * (ladder_ranks - 1));
+  rank_start_delay_micros = (ladder_rank - 1) * shift_delay_micros;
+  fadeout_time_micros = shift_delay_micros;
+  on_time_micros = (1000 * ladder_packet.option) + (ways * (ladder_ranks - ladder_rank) * shift_delay_micros);
+  if (ladder_rank > 1) {
+    fadein_time_micros = shift_delay_micros;
+    rank_start_delay_micros = rank_start_delay_micros - fadein_time_micros;
+  }
+  if (!both_ways) {
+    on_time_micros = on_time_micros + rank_start_delay_micros;
+  }
+
+  if ((delta_time_micros >= rank_start_delay_micros) && (fadein_time_micros > 0) && (delta_time_micros < (rank_start_delay_micros + fadein_time_micros))) {
+    new_color = adjustBrightness(new_color, 255 * (delta_time_micros - rank_start_delay_micros) / fadein_time_micros);
+  } else if ((delta_time_micros >= rank_start_delay_micros) && (delta_time_micros < (rank_start_delay_micros + fadein_time_micros + on_time_micros))) {
+  } else if ((delta_time_micros >= rank_start_delay_micros) && (fadeout_time_micros > 0) && (delta_time_micros < (rank_start_delay_micros + fadein_time_micros + on_time_micros + fadeout_time_micros))) {
+    new_color = adjustBrightness(new_color, 255 * (fadeout_time_micros - (delta_time_micros - rank_start_delay_micros - fadein_time_micros - on_time_micros)) / fadeout_time_micros);
+  } else {
+    new_color = CRGB::Black;
+  }
+  return new_color;
+}
+
+
+static struct CRGB vueMeterLadder(uint8_t lr, int32_t delta_time_micros) {
+  return rankLadder(((ladder_ranks - ladder_rank) <= 1) ? CRGB(CRGB::Red) : CRGB(CRGB::Green), delta_time_micros, true);
+}
+
+
+static struct CRGB waveBackLadder(uint8_t lr, int32_t delta_time_micros) {
+  return rankLadder(CRGB::Blue, delta_time_micros, false);
+}
+
+
+// Is the rendered channel the gamma correction of a level within tolerance of the ladder level?
+static boolean isClose(uint8_t ladder, uint8_t rendered, uint8_t tolerance) {
+  uint8_t low = pgm_read_byte(&gamma8[(ladder > tolerance) ? (ladder - tolerance) : 0]);
+  uint8_t high = pgm_read_byte(&gamma8[(ladder < (255 - tolerance)) ? (ladder + tolerance) : 255]);
+
+  return (rendered >= low) && (rendered <= high);
+}
+
+
+// Render the effect every millisecond for length_micros, and compare both strips with the ladder
+static void checkLadder(const char *name, ladder_color ladder, boolean repeat, uint32_t length_micros, uint8_t tolerance) {
+  struct CRGB *strips[2] = {left_leds, right_leds};
+  struct CRGB expected;
+  struct CRGB *rendered;
+  uint32_t frames = 0;
+  uint32_t rounded = 0;
+  uint32_t errors = 0;
+  int32_t delta_time_micros;
+
+  effects.setRanks(ladder_ranks);
+  effects.setMyRank(ladder_rank);
+  effects.setLightData(packet_id++, &ladder_packet);
+  for (uint32_t time_micros = 0; time_micros < length_micros; time_micros += TEST_FRAME_MICROS) {
+    effects.updateLight(micros());
+    delta_time_micros = repeat ? (time_micros % (1000 * ladder_packet.duration_ms)) : time_micros;
+    for (uint8_t lr = 0; lr < 2; lr++) {
+      expected = ladder(lr, delta_time_micros);
+      rendered = &strips[lr][0];
+      frames++;
+      if ((rendered->r != pgm_read_byte(&gamma8[expected.r])) || (rendered->g != pgm_read_byte(&gamma8[expected.g])) || (rendered->b != pgm_read_byte(&gamma8[expected.b]))) {
+        rounded++;
+      }
+      if (!isClose(expected.r, rendered->r, tolerance) || !isClose(expected.g, rendered->g, tolerance) || !isClose(expected.b, rendered->b, tolerance)) {
+        if (0 == errors) {
+          printf("%s: first error at %u us, strip %u, ladder %02X%02X%02X, rendered %02X%02X%02X\n", name, time_micros, lr,
+                 expected.r, expected.g, expected.b, rendered->r, rendered->g, rendered->b);
+        }
+        errors++;
+      }
+    }
+    mls_host_advance_micros(TEST_FRAME_MICROS);
+  }
+  printf("%-40s %6u frames, %5u away from the ladder, %u out of tolerance\n", name, frames, rounded, errors);
+  CHECK_EQUAL(0, errors);
+}
+
+
+static void setLadderPacket(uint8_t effect, uint16_t duration_ms, uint16_t option, uint32_t left_color, uint32_t right_color, uint8_t fadein, uint8_t on, uint8_t fadeout) {
+  memset(&ladder_packet, 0, sizeof(ladder_packet));
+  ladder_packet.effect = effect;
+  ladder_packet.duration_ms = duration_ms;
+  ladder_packet.option = option;
+  ladder_packet.left_color_r = left_color >> 16; ladder_packet.left_color_g = left_color >> 8; ladder_packet.left_color_b = left_color;
+  ladder_packet.right_color_r = right_color >> 16; ladder_packet.right_color_g = right_color >> 8; ladder_packet.right_color_b = right_color;
+  ladder_packet.left_fadein_time = fadein; ladder_packet.left_on_time = on; ladder_packet.left_fadeout_time = fadeout;
+  ladder_packet.right_fadein_time = fadein; ladder_packet.right_on_time = on; ladder_packet.right_fadeout_time = fadeout;
+  ladder_ranks = 4;
+  ladder_rank = 1;
+}
+
+
+static void testFlash() {
+  const uint8_t fades[][3] = {{2, 3, 5}, {0, 3, 35}, {10, 0, 10}, {25, 5, 50}, {1, 1, 1}, {100, 50, 200}};
+  char name[64];
+
+  for (uint8_t i = 0; i < (sizeof(fades) / sizeof(fades[0])); i++) {
+    setLadderPacket(EFFECT_FLASH, 0, 0, 0xFFFFFF, 0xFF8000, fades[i][0], fades[i][1], fades[i][2]);
+    snprintf(name, sizeof(name), "Flash %u/%u/%u ms", 10 * fades[i][0], 10 * fades[i][1], 10 * fades[i][2]);
+    checkLadder(name, flashLadder, false, 10000 * (fades[i][0] + fades[i][1] + fades[i][2] + 2), TEST_TOLERANCE);
+  }
+  setLadderPacket(EFFECT_FLASH_YELLOW, 0, 0, 0, 0, 0, 0, 0);
+  checkLadder("Flash yellow", flashYellowLadder, false, 400000, TEST_TOLERANCE);
+}
+
+
+static void testHeartbeat() {
+  const uint16_t durations[] = {200, 1000, 2500};
+  const uint16_t options[] = {128, 224, 255};
+  char name[64];
+
+  for (uint8_t d = 0; d < (sizeof(durations) / sizeof(durations[0])); d++) {
+    for (uint8_t o = 0; o < (sizeof(options) / sizeof(options[0])); o++) {
+      setLadderPacket(EFFECT_HEARTBEAT, durations[d], options[o], 0xFFFFFF, 0xFF8000, 0, 0, 0);
+      snprintf(name, sizeof(name), "Heartbeat %u ms, diastole %u", durations[d], options[o]);
+      checkLadder(name, heartbeatLadder, true, 2000 * durations[d], TEST_DIASTOLE_TOLERANCE);
+    }
+  }
+}
+
+
+static void testBreath() {
+  const uint16_t durations[] = {100, 1000, 5000};
+  char name[64];
+
+  for (uint8_t d = 0; d < (sizeof(durations) / sizeof(durations[0])); d++) {
+    setLadderPacket(EFFECT_BREATH, durations[d], 0, 0xFFFFFF, 0xFF8000, 0, 0, 0);
+    snprintf(name, sizeof(name), "Breath %u ms", durations[d]);
+    checkLadder(name, breathLadder, true, 2000 * durations[d], TEST_TOLERANCE);
+  }
+}
+
+
+// Every rank of 4 and 7 ranks
+static void testRanks(uint8_t effect, const char *effect_name, ladder_color ladder) {
+  const uint16_t timings[][2] = {{120, 30}, {300, 50}, {1000, 100}};
+  const uint8_t ranks[] = {4, 7};
+  char name[64];
+
+  for (uint8_t t = 0; t < (sizeof(timings) / sizeof(timings[0])); t++) {
+    for (uint8_t r = 0; r < sizeof(ranks); r++) {
+      for (uint8_t rank = 1; rank <= ranks[r]; rank++) {
+        setLadderPacket(effect, timings[t][0], timings[t][1], 0, 0, 0, 0, 0);
+        ladder_ranks = ranks[r];
+        ladder_rank = rank;
+        snprintf(name, sizeof(name), "%s %u/%u ms, rank %u of %u", effect_name, timings[t][0], timings[t][1], rank, ranks[r]);
+        checkLadder(name, ladder, false, 1000 * (timings[t][0] + 20), TEST_TOLERANCE);
+      }
+    }
+  }
+}
+
+
+int main(int argc, char **argv) {
+  mls_host_set_micros(1000000);
+  CHECK(effects.begin(&arena, TEST_LEDS));
+  effects.setColumns(1);
+  effects.setMyColumn(1);
+
+  testFlash();
+  testHeartbeat();
+  testBreath();
+  testRanks(EFFECT_VUE_METER, "Vue meter", vueMeterLadder);
+  testRanks(EFFECT_WAVE_BACK, "Wave back", waveBackLadder);
+
+  MLS_TEST_END();
+}
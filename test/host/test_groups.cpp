@@ -0,0 +1,290 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_groups.cpp
+ * @brief MlsGroups and MlsWire::peekAddress: early receive filtering
+ *
+ * The membership bitmap of a device (rank, column, sections and the
+ * group all) decides which unicast and group packets the receive
+ * callback keeps. The address is read by MlsWire::peekAddress in the
+ * fixed, compact and short fire packets, without decoding them.
+ *
+ * A per column light of the master costs one packet per column group,
+ * and each device of the band keeps only the packet of its column.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_groups.h"
+#include "mls_light_effects.h"
+#include "mls_repeater.h"
+#include "mls_wire.h"
+#include <string.h>
+#include <vector>
+
+#define TEST_MY_ID     17
+#define TEST_MY_RANK   5
+#define TEST_MY_COLUMN 3
+
+struct SENT_GROUP_PACKET {
+  uint8_t type;
+  uint8_t group_id;
+  struct LIGHT_PACKET light;
+};
+
+static std::vector<struct SENT_GROUP_PACKET> sent;
+
+
+// Group sender of the sketch (mlsmesh_send_group_packet), captured
+static boolean captureGroupPacket(const uint8_t packetType, const uint8_t groupId, const uint8_t *data) {
+  struct SENT_GROUP_PACKET packet;
+
+  packet.type = packetType | MLS_TYPE_MODIFIER_GROUP;
+  packet.group_id = groupId;
+  memcpy(packet.light.raw, data, LIGHT_PACKET_SIZE);
+  sent.push_back(packet);
+  return true;
+}
+
+
+// Device id in the band (the master has the id 0)
+static uint8_t deviceIdOf(uint8_t rank, uint8_t column) {
+  return 1 + ((rank - 1) * 4) + (column - 1);
+}
+
+
+// Number of group ids of which the device is a member
+static uint16_t countMemberships(MlsGroups *groups) {
+  uint16_t memberships = 0;
+
+  for (uint16_t group_id = 0; group_id < 256; group_id++) {
+    if (groups->isMember(group_id)) {
+      memberships++;
+    }
+  }
+  return memberships;
+}
+
+
+static void testUnicast() {
+  MlsGroups groups;
+
+  CHECK(groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_UNICAST, TEST_MY_ID, TEST_MY_ID));
+  CHECK(!groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_UNICAST, TEST_MY_ID + 1, TEST_MY_ID));
+  CHECK(!groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_UNICAST, 0, TEST_MY_ID));
+  // The unicast id is a device id, not a group id
+  CHECK(!groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_UNICAST, MLS_GROUP_ALL, TEST_MY_ID));
+  // Without modifier, the destination is ignored
+  CHECK(groups.accepts(MLS_TYPE_LIGHT_DATA, TEST_MY_ID + 1, TEST_MY_ID));
+  CHECK_EQUAL(MLS_TYPE_LIGHT_DATA, MlsGroups::getType(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_UNICAST));
+  CHECK_EQUAL(MLS_TYPE_ARM_DATA, MlsGroups::getType(MLS_TYPE_ARM_DATA | MLS_TYPE_MODIFIER_GROUP));
+}
+
+
+// The column 0 (no column) never joins a column group
+static void testColumns() {
+  MlsGroups groups;
+
+  groups.setMembership(TEST_MY_RANK, 0, 0);
+  for (uint8_t column = 0; column < 64; column++) {
+    CHECK(!groups.isMember(MLS_GROUP_COLUMN(column)));
+  }
+  CHECK(!groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_COLUMN(0), TEST_MY_ID));
+  CHECK_EQUAL(2, countMemberships(&groups));
+
+  groups.setMembership(TEST_MY_RANK, TEST_MY_COLUMN, 0);
+  for (uint8_t column = 0; column < 64; column++) {
+    CHECK_EQUAL(TEST_MY_COLUMN == column, groups.isMember(MLS_GROUP_COLUMN(column)));
+  }
+  CHECK(groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_COLUMN(TEST_MY_COLUMN), TEST_MY_ID));
+  CHECK(!groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_COLUMN(TEST_MY_COLUMN + 1), TEST_MY_ID));
+  CHECK_EQUAL(3, countMemberships(&groups));
+}
+
+
+static void testRanksAndSections() {
+  MlsGroups groups;
+  uint32_t sections = (1UL << 0) | (1UL << 2) | (1UL << 31);
+
+  groups.setMembership(TEST_MY_RANK, TEST_MY_COLUMN, sections);
+  for (uint8_t rank = 0; rank < 64; rank++) {
+    CHECK_EQUAL(TEST_MY_RANK == rank, groups.isMember(MLS_GROUP_RANK(rank)));
+  }
+  for (uint8_t section = 0; section < MLS_GROUP_SECTIONS; section++) {
+    CHECK_EQUAL(0 != (sections & (1UL << section)), groups.isMember(MLS_GROUP_SECTION(section)));
+  }
+  CHECK(groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_RANK(TEST_MY_RANK), TEST_MY_ID));
+  CHECK(!groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_RANK(TEST_MY_RANK + 1), TEST_MY_ID));
+  CHECK(groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_SECTION(31), TEST_MY_ID));
+  CHECK(!groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_SECTION(1), TEST_MY_ID));
+  CHECK_EQUAL(6, countMemberships(&groups));
+
+  // The rank 0 has its group, a new membership replaces the previous one
+  groups.setMembership(0, 0, 0);
+  CHECK(groups.isMember(MLS_GROUP_RANK(0)));
+  CHECK(!groups.isMember(MLS_GROUP_RANK(TEST_MY_RANK)));
+  CHECK(!groups.isMember(MLS_GROUP_SECTION(31)));
+  CHECK_EQUAL(2, countMemberships(&groups));
+
+  // The ranks and the columns above 63 have no group, they are not aliased to the rank or the column minus 64
+  groups.setMembership(64 + TEST_MY_RANK, 64 + TEST_MY_COLUMN, 0);
+  CHECK(!groups.isMember(MLS_GROUP_RANK(TEST_MY_RANK)));
+  CHECK(!groups.isMember(MLS_GROUP_COLUMN(TEST_MY_COLUMN)));
+  CHECK(!groups.accepts(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_RANK(TEST_MY_RANK), TEST_MY_ID));
+  CHECK_EQUAL(1, countMemberships(&groups));
+  groups.setMembership(MLS_GROUP_MAX_RANK, MLS_GROUP_MAX_COLUMN, 0);
+  CHECK(groups.isMember(MLS_GROUP_RANK(MLS_GROUP_MAX_RANK)));
+  CHECK(groups.isMember(MLS_GROUP_COLUMN(MLS_GROUP_MAX_COLUMN)));
+}
+
+
+// One packet per column group, each device of a band of 4 columns and 10 ranks keeps the packet of its column only
+static void testColumnLights() {
+  static const uint8_t palette[][3] = {{255, 0, 0}, {0, 255, 0}, {0, 0, 255}};
+  struct LIGHT_PACKET light;
+  MlsGroups groups;
+  uint8_t kept;
+  uint8_t color;
+
+  memset(light.raw, 0, LIGHT_PACKET_SIZE);
+  light.effect = EFFECT_FLASH;
+  light.repeat_counter = 7;
+  light.left_on_time = 3;
+  light.right_fadeout_time = 35;
+  sent.clear();
+  CHECK_EQUAL(4, MlsGroups::sendColumnLights(captureGroupPacket, &light, 4, palette, 3));
+  CHECK_EQUAL(4, sent.size());
+  for (uint8_t column = 1; column <= 4; column++) {
+    CHECK_EQUAL(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, sent[column - 1].type);
+    CHECK_EQUAL(MLS_GROUP_COLUMN(column), sent[column - 1].group_id);
+  }
+
+  for (uint8_t rank = 1; rank <= 10; rank++) {
+    for (uint8_t column = 1; column <= 4; column++) {
+      groups.setMembership(rank, column, 0);
+      kept = 0;
+      for (size_t i = 0; i < sent.size(); i++) {
+        if (groups.accepts(sent[i].type, sent[i].group_id, deviceIdOf(rank, column))) {
+          kept++;
+          // Palette color of the column (the fourth column has the first color again), the rest of the light is unchanged
+          color = (column - 1) % 3;
+          CHECK_EQUAL(0, memcmp(palette[color], sent[i].light.left_color_raw, 3));
+          CHECK_EQUAL(0, memcmp(palette[color], sent[i].light.right_color_raw, 3));
+          CHECK_EQUAL(EFFECT_FLASH, sent[i].light.effect);
+          CHECK_EQUAL(7, sent[i].light.repeat_counter);
+          CHECK_EQUAL(35, sent[i].light.right_fadeout_time);
+        }
+      }
+      CHECK_EQUAL(1, kept);
+    }
+  }
+
+  // No group above the column 63
+  sent.clear();
+  CHECK_EQUAL(MLS_GROUP_MAX_COLUMN, MlsGroups::sendColumnLights(captureGroupPacket, &light, 70, palette, 3));
+  CHECK_EQUAL(MLS_GROUP_MAX_COLUMN, sent.size());
+}
+
+
+// The group all is set by the constructor and by every membership
+static void testAll() {
+  MlsGroups groups;
+
+  CHECK(groups.isMember(MLS_GROUP_ALL));
+  CHECK_EQUAL(2, countMemberships(&groups));
+  groups.setMembership(TEST_MY_RANK, TEST_MY_COLUMN, 0xFFFFFFFF);
+  CHECK(groups.isMember(MLS_GROUP_ALL));
+  CHECK(groups.accepts(MLS_TYPE_ACTION_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_ALL, TEST_MY_ID));
+  CHECK(groups.accepts(MLS_TYPE_ACTION_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_ALL, 0));
+
+  CHECK_EQUAL(0, groups.getFiltered());
+  groups.countFiltered();
+  groups.countFiltered();
+  CHECK_EQUAL(2, groups.getFiltered());
+}
+
+
+static void addressedPacket(struct MLS_PACKET *packet, uint8_t type, uint8_t destination_id) {
+  memset(packet->raw, 0, MLS_PACKET_SIZE);
+  memcpy(packet->IID, "MLS", 3);
+  packet->TYPE = type;
+  packet->SENDER_ID = 0;
+  packet->DESTINATION_ID = destination_id;
+  packet->PACKET_ID = 0x1234;
+  packet->MASTER_TIME = 123456789;
+  memset(packet->REPEATERS_ID, MLSMESH_NO_REPEATER, MLSMESH_MAX_REPEATERS);
+}
+
+
+static void testPeekAddress() {
+  MlsWire wire;
+  MlsGroups groups;
+  struct MLS_PACKET packet;
+  struct MLS_FIRE_PACKET fire_packet;
+  uint8_t buffer[MLSMESH_WIRE_MAX_SIZE];
+  uint8_t length;
+  uint8_t type;
+  uint8_t destination_id;
+
+  groups.setMembership(TEST_MY_RANK, TEST_MY_COLUMN, 0);
+
+  // Fixed packet
+  addressedPacket(&packet, MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_RANK(TEST_MY_RANK + 1));
+  MlsWire::peekAddress(packet.raw, MLS_PACKET_SIZE, &type, &destination_id);
+  CHECK_EQUAL(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, type);
+  CHECK_EQUAL(MLS_GROUP_RANK(TEST_MY_RANK + 1), destination_id);
+  CHECK(!groups.accepts(type, destination_id, TEST_MY_ID));
+
+  // Compact packets, with and without destination
+  addressedPacket(&packet, MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_UNICAST, TEST_MY_ID);
+  length = wire.encode(&packet, buffer);
+  CHECK(MlsWire::isCompact(buffer, length));
+  MlsWire::peekAddress(buffer, length, &type, &destination_id);
+  CHECK_EQUAL(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_UNICAST, type);
+  CHECK_EQUAL(TEST_MY_ID, destination_id);
+  CHECK(groups.accepts(type, destination_id, TEST_MY_ID));
+  CHECK(!groups.accepts(type, destination_id, TEST_MY_ID + 1));
+
+  addressedPacket(&packet, MLS_TYPE_ACTION_DATA, 0);
+  length = wire.encode(&packet, buffer);
+  MlsWire::peekAddress(buffer, length, &type, &destination_id);
+  CHECK_EQUAL(MLS_TYPE_ACTION_DATA, type);
+  CHECK_EQUAL(0, destination_id);
+  CHECK(groups.accepts(type, destination_id, TEST_MY_ID));
+
+  // A compact header without its destination section has no destination
+  addressedPacket(&packet, MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, MLS_GROUP_COLUMN(TEST_MY_COLUMN));
+  length = wire.encode(&packet, buffer);
+  MlsWire::peekAddress(buffer, MLSMESH_WIRE_HEADER_SIZE, &type, &destination_id);
+  CHECK_EQUAL(MLS_TYPE_LIGHT_DATA | MLS_TYPE_MODIFIER_GROUP, type);
+  CHECK_EQUAL(0, destination_id);
+
+  // Short fire packet: no address (the byte of DESTINATION_ID in the fixed packet is in its PACKET_ID)
+  memset(fire_packet.raw, 0, MLS_FIRE_PACKET_SIZE);
+  memcpy(fire_packet.IID, "MLS", 3);
+  fire_packet.TYPE = MLS_TYPE_FIRE_DATA;
+  fire_packet.PACKET_ID = 0x1234;
+  fire_packet.MASTER_TIME = 123456789;
+  fire_packet.ARM_ID = 3;
+  fire_packet.REPEAT_COUNTER = 42;
+  CHECK_EQUAL(15, MLS_FIRE_PACKET_SIZE);
+  CHECK(!MlsWire::isCompact(fire_packet.raw, MLS_FIRE_PACKET_SIZE));
+  MlsWire::peekAddress(fire_packet.raw, MLS_FIRE_PACKET_SIZE, &type, &destination_id);
+  CHECK_EQUAL(0, type);
+  CHECK_EQUAL(0, destination_id);
+  CHECK(groups.accepts(type, destination_id, TEST_MY_ID));
+}
+
+
+int main(int argc, char **argv) {
+  testUnicast();
+  testColumns();
+  testRanksAndSections();
+  testAll();
+  testColumnLights();
+  testPeekAddress();
+
+  MLS_TEST_END();
+}
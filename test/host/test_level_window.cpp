@@ -0,0 +1,152 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_level_window.cpp
+ * @brief MlsLevelWindow: equivalence with a brute force window
+ *
+ * The reference is the previous code of the beat detector: the last SIZE
+ * levels in a ring (0 before the window is full), the mean summed as
+ * level / SIZE over the whole ring, and the maximum scanned over the
+ * ring. After each level, the mean and the maximum of MlsLevelWindow must
+ * be exactly the same, for several window sizes and level sequences
+ * (random, monotonic, constant, single spikes, extreme values, and the
+ * block levels of a kick track).
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_level_window.h"
+#include "mls_config.h"
+#include <math.h>
+#include <vector>
+
+
+// Full scan of the window, like the beat detector before MlsLevelWindow
+template <uint16_t SIZE>
+class BruteForceWindow {
+
+  private:
+    uint32_t levels[SIZE];
+    uint32_t count;
+
+  public:
+    BruteForceWindow() {
+      this->clear();
+    }
+
+    void clear() {
+      memset(this->levels, 0, sizeof(this->levels));
+      this->count = 0;
+    }
+
+    void add(uint32_t level) {
+      this->levels[this->count % SIZE] = level;
+      this->count++;
+    }
+
+    uint32_t getMean() {
+      uint32_t mean = 0;
+      for (uint16_t i = 0; i < SIZE; i++) {
+        mean = mean + (this->levels[i] / SIZE);
+      }
+      return mean;
+    }
+
+    uint32_t getMax() {
+      uint32_t max_level = 0;
+      for (uint16_t i = 0; i < SIZE; i++) {
+        if (this->levels[i] > max_level) {
+          max_level = this->levels[i];
+        }
+      }
+      return max_level;
+    }
+};
+
+
+// Number of levels whose mean or maximum differ from the brute force window
+template <uint16_t SIZE>
+static uint32_t compare(const std::vector<uint32_t> &levels) {
+  MlsLevelWindow<SIZE> window;
+  BruteForceWindow<SIZE> reference;
+  uint32_t differences = 0;
+
+  for (size_t i = 0; i < levels.size(); i++) {
+    window.add(levels[i]);
+    reference.add(levels[i]);
+    if ((window.getMean() != reference.getMean()) || (window.getMax() != reference.getMax())) {
+      differences++;
+    }
+  }
+  CHECK_EQUAL(levels.size(), window.getCount());
+
+  // Same results again after a clear
+  window.clear();
+  reference.clear();
+  CHECK_EQUAL(0, window.getMean());
+  CHECK_EQUAL(0, window.getMax());
+  for (size_t i = 0; i < min(levels.size(), (size_t) (3 * SIZE)); i++) {
+    window.add(levels[levels.size() - 1 - i]);
+    reference.add(levels[levels.size() - 1 - i]);
+    if ((window.getMean() != reference.getMean()) || (window.getMax() != reference.getMax())) {
+      differences++;
+    }
+  }
+  return differences;
+}
+
+
+template <uint16_t SIZE>
+static void compareAll(const std::vector<std::vector<uint32_t> > &sequences) {
+  for (size_t i = 0; i < sequences.size(); i++) {
+    CHECK_EQUAL(0, compare<SIZE>(sequences[i]));
+  }
+}
+
+
+// Block levels of a kick track (120 BPM, noise floor), the mean absolute sample of each block like the I2S task
+static std::vector<uint32_t> kickLevels() {
+  std::vector<uint32_t> levels;
+  uint32_t sample = 0;
+  int32_t value;
+  uint32_t mean;
+  double t;
+
+  randomSeed(21);
+  for (uint32_t block = 0; block < 2000; block++) {
+    mean = 0;
+    for (uint16_t i = 0; i < I2S_BLOCK_SIZE; i++, sample++) {
+      t = fmod((double) sample / I2S_SAMPLE_RATE, 0.5);
+      value = (int32_t) lrint(((0.01 * ((random(2001) - 1000) / 1000.0)) + ((t < 0.3) ? (0.5 * exp(-t / 0.08) * sin(2 * PI * 60 * t)) : 0)) * 8388607) << 8;
+      mean += abs(value) / I2S_BLOCK_SIZE;
+    }
+    levels.push_back(constrain(mean, 1, 0x10000000));
+  }
+  return levels;
+}
+
+
+int main(int argc, char **argv) {
+  std::vector<std::vector<uint32_t> > sequences(7);
+
+  randomSeed(1);
+  for (uint32_t i = 0; i < 2000; i++) {
+    sequences[0].push_back(random(0, 1000000));
+    sequences[1].push_back(i * 1000);
+    sequences[2].push_back((2000 - i) * 1000);
+    sequences[3].push_back(12345);
+    sequences[4].push_back((0 == (i % 257)) ? 5000000 : random(0, 1000));
+    sequences[5].push_back((0 == (i % 3)) ? 0xFFFFFFFF : random(0, 2));
+  }
+  sequences[6] = kickLevels();
+
+  compareAll<1>(sequences);
+  compareAll<2>(sequences);
+  compareAll<7>(sequences);
+  compareAll<64>(sequences);
+  compareAll<I2S_ROLLING_MEAN_SIZE>(sequences);
+  compareAll<1000>(sequences);
+  MLS_TEST_END();
+}
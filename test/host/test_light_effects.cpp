@@ -0,0 +1,650 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_light_effects.cpp
+ * @brief Golden frames of MlsLightEffects, stepped by the virtual clock
+ *
+ * Each effect is started at a known time and rendered every
+ * TEST_FRAME_MICROS (or a multiple for the long fades). The frames are
+ * compared with golden frames rendered by the renderer before the
+ * envelopes: a change of an effect, of the envelopes or of the gamma
+ * table shows up here. "--dump" prints the frames in the format of the
+ * golden tables.
+ *
+ * The envelope rounds the level of a fade to the nearest level, the
+ * renderer before the envelopes rounded it down: the frames of the fades
+ * are checked within TEST_FADE_TOLERANCE level before the gamma
+ * correction, the other frames are exact.
+ *
+ * The recording LED driver checks that only the changed frames are
+ * sent to the strips. An armed flash, fired later, renders the flash
+ * frames with the envelope compiled at arm time.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_light_effects.h"
+#include "mls_recording_led_driver.h"
+#include <string.h>
+
+#define TEST_LEDS          8
+#define TEST_FRAME_MICROS  10000
+#define TEST_START_MICROS  1000000
+#define TEST_FADE_TOLERANCE 1       // Levels before the gamma correction
+
+static MlsArena arena;
+static struct CRGB left_leds[TEST_LEDS];
+static struct CRGB right_leds[TEST_LEDS];
+static MlsLightEffects effects(TEST_LEDS, left_leds, right_leds);
+static MlsRecordingLedDriver led_driver;
+static boolean dump = false;
+
+
+static struct LIGHT_PACKET lightPacket(uint8_t effect, uint16_t duration_ms, uint16_t option, uint32_t left_color, uint32_t right_color, uint8_t fadein, uint8_t on, uint8_t fadeout) {
+  struct LIGHT_PACKET packet;
+
+  memset(&packet, 0, sizeof(packet));
+  packet.effect = effect;
+  packet.duration_ms = duration_ms;
+  packet.option = option;
+  packet.left_color_r = left_color >> 16; packet.left_color_g = left_color >> 8; packet.left_color_b = left_color;
+  packet.right_color_r = right_color >> 16; packet.right_color_g = right_color >> 8; packet.right_color_b = right_color;
+  packet.left_fadein_time = fadein; packet.left_on_time = on; packet.left_fadeout_time = fadeout;
+  packet.right_fadein_time = fadein; packet.right_on_time = on; packet.right_fadeout_time = fadeout;
+  return packet;
+}
+
+
+static uint32_t rgb(struct CRGB color) {
+  return ((uint32_t) color.r << 16) | ((uint32_t) color.g << 8) | color.b;
+}
+
+
+// Is each channel the gamma correction of a level within tolerance of a level of the golden channel?
+static boolean isClose(uint32_t golden, uint32_t actual, uint8_t tolerance) {
+  for (uint8_t shift = 0; shift < 24; shift += 8) {
+    uint8_t golden_channel = golden >> shift;
+    uint8_t actual_channel = actual >> shift;
+    int16_t golden_min = 256, golden_max = -1, actual_min = 256, actual_max = -1;
+    for (int16_t level = 0; level < 256; level++) {
+      if (gamma8[level] == golden_channel) {
+        golden_min = min(golden_min, level); golden_max = max(golden_max, level);
+      }
+      if (gamma8[level] == actual_channel) {
+        actual_min = min(actual_min, level); actual_max = max(actual_max, level);
+      }
+    }
+    if ((actual_min > (golden_max + tolerance)) || (golden_min > (actual_max + tolerance))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// Render the frames of an effect started now, every frame_micros, and compare the first LED of both strips
+static void checkUniformFrames(const char *name, uint16_t packet_id, struct LIGHT_PACKET packet, const uint32_t golden[][2], uint8_t frames, uint32_t frame_micros, uint8_t tolerance) {
+  effects.setLightData(packet_id, &packet);
+  if (dump) {
+    printf("  // %s\n", name);
+  }
+  for (uint8_t frame = 0; frame < frames; frame++) {
+    effects.updateLight(micros());
+    if (dump) {
+      printf("  {0x%06X, 0x%06X},\n", rgb(left_leds[0]), rgb(right_leds[0]));
+    } else if (0 == tolerance) {
+      CHECK_EQUAL(golden[frame][0], rgb(left_leds[0]));
+      CHECK_EQUAL(golden[frame][1], rgb(right_leds[0]));
+    } else {
+      CHECK(isClose(golden[frame][0], rgb(left_leds[0]), tolerance));
+      CHECK(isClose(golden[frame][1], rgb(right_leds[0]), tolerance));
+    }
+    for (uint8_t i = 1; i < TEST_LEDS; i++) {
+      CHECK_EQUAL(rgb(left_leds[0]), rgb(left_leds[i]));
+      CHECK_EQUAL(rgb(right_leds[0]), rgb(right_leds[i]));
+    }
+    mls_host_advance_micros(frame_micros);
+  }
+}
+
+
+// Flash: 20 ms fade in, 30 ms on, 50 ms fade out
+static const uint32_t golden_flash[][2] = {
+  {0x000000, 0x000000},
+  {0x240000, 0x000024},
+  {0xFF0000, 0x0000FF},
+  {0xFF0000, 0x0000FF},
+  {0xFF0000, 0x0000FF},
+  {0xFF0000, 0x0000FF},
+  {0x890000, 0x000089},
+  {0x3D0000, 0x00003D},
+  {0x140000, 0x000014},
+  {0x030000, 0x000003},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// Fixed: 50 ms fade in, then on
+static const uint32_t golden_fixed[][2] = {
+  {0x000000, 0x000000},
+  {0x000300, 0x030303},
+  {0x001400, 0x141414},
+  {0x003D00, 0x3D3D3D},
+  {0x008900, 0x898989},
+  {0x00FF00, 0xFFFFFF},
+  {0x00FF00, 0xFFFFFF},
+  {0x00FF00, 0xFFFFFF},
+};
+
+
+// Flip flop flash repeated every 120 ms: red 20 ms fade in, 30 ms on on the left,
+// blue 80 ms on, 40 ms fade out on the right, colors and times swapped on each repeat
+static const uint32_t golden_flip_flop[][2] = {
+  {0x000000, 0x0000FF},
+  {0x240000, 0x0000FF},
+  {0xFF0000, 0x0000FF},
+  {0xFF0000, 0x0000FF},
+  {0xFF0000, 0x0000FF},
+  {0x000000, 0x0000FF},
+  {0x000000, 0x0000FF},
+  {0x000000, 0x0000FF},
+  {0x000000, 0x0000FF},
+  {0x000000, 0x000072},
+  {0x000000, 0x000025},
+  {0x000000, 0x000005},
+  {0x0000FF, 0x000000},
+  {0x0000FF, 0x240000},
+  {0x0000FF, 0xFF0000},
+  {0x0000FF, 0xFF0000},
+  {0x0000FF, 0xFF0000},
+  {0x0000FF, 0x000000},
+  {0x0000FF, 0x000000},
+  {0x0000FF, 0x000000},
+  {0x0000FF, 0x000000},
+  {0x000072, 0x000000},
+  {0x000025, 0x000000},
+  {0x000005, 0x000000},
+};
+
+
+// Heartbeat repeated every 200 ms, diastole at half brightness: red on the left, green on the right
+static const uint32_t golden_heartbeat[][2] = {
+  {0x000000, 0x000000},
+  {0xFF0000, 0x00FF00},
+  {0xFF0000, 0x00FF00},
+  {0xFF0000, 0x00FF00},
+  {0x980000, 0x009800},
+  {0x520000, 0x005200},
+  {0x240000, 0x002400},
+  {0x250000, 0x002500},
+  {0x250000, 0x002500},
+  {0x250000, 0x002500},
+  {0x1A0000, 0x001A00},
+  {0x120000, 0x001200},
+  {0x0C0000, 0x000C00},
+  {0x070000, 0x000700},
+  {0x040000, 0x000400},
+  {0x020000, 0x000200},
+  {0x010000, 0x000100},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0xFF0000, 0x00FF00},
+};
+
+// Breath repeated every 100 ms, between 25% and full brightness: blue on the left, orange on the right
+static const uint32_t golden_breath[][2] = {
+  {0x000005, 0x050100},
+  {0x00001D, 0x1D0400},
+  {0x000055, 0x550C00},
+  {0x0000B8, 0xB81A00},
+  {0x0000FF, 0xFF2500},
+  {0x0000B8, 0xB81A00},
+  {0x000055, 0x550C00},
+  {0x00001D, 0x1D0400},
+  {0x000005, 0x050100},
+  {0x000005, 0x050100},
+  {0x000005, 0x050100},
+  {0x00001D, 0x1D0400},
+};
+
+// Vue meter of 120 ms, 30 ms minimum on time, seen by rank 3 of 4 (red, starts one shift later)
+static const uint32_t golden_vue_meter_rank3[][2] = {
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x0C0000, 0x0C0000},
+  {0xFF0000, 0xFF0000},
+  {0xFF0000, 0xFF0000},
+  {0xFF0000, 0xFF0000},
+  {0xFF0000, 0xFF0000},
+  {0xFF0000, 0xFF0000},
+  {0xFF0000, 0xFF0000},
+  {0xFF0000, 0xFF0000},
+  {0x0C0000, 0x0C0000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// Wave back of 120 ms, 30 ms minimum on time, seen by rank 3 of 4 (starts two shifts later)
+static const uint32_t golden_wave_back_rank3[][2] = {
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x00000C, 0x00000C},
+  {0x000052, 0x000052},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+};
+
+// Vue meter seen by rank 1 of 4 (green, on until the last rank is done)
+static const uint32_t golden_vue_meter_rank1[][2] = {
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x002500, 0x002500},
+  {0x000200, 0x000200},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// Wave back seen by rank 1 of 4 (no fade in)
+static const uint32_t golden_wave_back_rank1[][2] = {
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x0000FF, 0x0000FF},
+  {0x000052, 0x000052},
+  {0x00000C, 0x00000C},
+  {0x000000, 0x000000},
+};
+
+// 3 steps, every 40 ms: the beat of rank 1 (repeat counter 1), 30 ms on, 350 ms fade out
+static const uint32_t golden_three_steps[][2] = {
+  {0x00FF00, 0xFF0000},
+  {0x00E900, 0xE90000},
+  {0x00A400, 0xA40000},
+  {0x006E00, 0x6E0000},
+  {0x004500, 0x450000},
+  {0x002700, 0x270000},
+  {0x001400, 0x140000},
+  {0x000700, 0x070000},
+  {0x000200, 0x020000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// 3 steps, next beat (repeat counter 2): rank 1 stays off
+static const uint32_t golden_three_steps_next[][2] = {
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// 3 steps alternate, every 40 ms: even beat of rank 1 in green (repeat counter 4)
+static const uint32_t golden_three_steps_alternate[][2] = {
+  {0x00FF00, 0x00FF00},
+  {0x00E900, 0x00E900},
+  {0x00A400, 0x00A400},
+  {0x006E00, 0x006E00},
+  {0x004500, 0x004500},
+  {0x002700, 0x002700},
+  {0x001400, 0x001400},
+  {0x000700, 0x000700},
+  {0x000200, 0x000200},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// 3 steps alternate, odd beat of rank 1 in red (repeat counter 7)
+static const uint32_t golden_three_steps_alternate_odd[][2] = {
+  {0xFF0000, 0xFF0000},
+  {0xE90000, 0xE90000},
+  {0xA40000, 0xA40000},
+  {0x6E0000, 0x6E0000},
+  {0x450000, 0x450000},
+  {0x270000, 0x270000},
+  {0x140000, 0x140000},
+  {0x070000, 0x070000},
+  {0x020000, 0x020000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// Rainbow rank beat, every 40 ms: hue of rank 1 on beat 1
+static const uint32_t golden_rainbow_rank_beat[][2] = {
+  {0x00FFE7, 0x00FFE7},
+  {0x00E9D2, 0x00E9D2},
+  {0x00A494, 0x00A494},
+  {0x006E63, 0x006E63},
+  {0x00453E, 0x00453E},
+  {0x002723, 0x002723},
+  {0x001412, 0x001412},
+  {0x000707, 0x000707},
+  {0x000202, 0x000202},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// Rainbow rank beat: hue of rank 1 on beat 2
+static const uint32_t golden_rainbow_rank_beat_next[][2] = {
+  {0x1B00FF, 0x1B00FF},
+  {0x1800E9, 0x1800E9},
+  {0x1100A4, 0x1100A4},
+  {0x0B006E, 0x0B006E},
+  {0x070045, 0x070045},
+  {0x040027, 0x040027},
+  {0x020014, 0x020014},
+  {0x010007, 0x010007},
+  {0x000002, 0x000002},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// Strobe repeated every 60 ms: white, 30 ms on
+static const uint32_t golden_strobe[][2] = {
+  {0xFFFFFF, 0xFFFFFF},
+  {0xFFFFFF, 0xFFFFFF},
+  {0xFFFFFF, 0xFFFFFF},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0xFFFFFF, 0xFFFFFF},
+  {0xFFFFFF, 0xFFFFFF},
+  {0xFFFFFF, 0xFFFFFF},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0xFFFFFF, 0xFFFFFF},
+};
+
+// Flash yellow, every 40 ms: 30 ms on, 350 ms fade out
+static const uint32_t golden_flash_yellow[][2] = {
+  {0xFF4B00, 0xFF4B00},
+  {0xE94400, 0xE94400},
+  {0xA43100, 0xA43100},
+  {0x6E2000, 0x6E2000},
+  {0x451400, 0x451400},
+  {0x270B00, 0x270B00},
+  {0x140600, 0x140600},
+  {0x070200, 0x070200},
+  {0x020000, 0x020000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+// Firefly, every 200 ms, random seed 1: a firefly on each strip after some gaps
+static const uint32_t golden_firefly[][2] = {
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x070007},
+  {0x000000, 0x2E002E},
+  {0x000000, 0x8E008E},
+  {0x000000, 0xFF00FF},
+  {0x000316, 0xFF00FF},
+  {0x03169C, 0x7C007C},
+  {0x0525FF, 0x100010},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0525FF, 0x000000},
+  {0x0520E1, 0x000000},
+};
+
+// Stars, every 50 ms, random seed 1: a star on the right strip
+static const uint32_t golden_stars[][2] = {
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x272727},
+  {0x000000, 0xFCFCFC},
+  {0x000000, 0xDADADA},
+  {0x000000, 0xBABABA},
+  {0x000000, 0x9E9E9E},
+  {0x000000, 0x878787},
+  {0x000000, 0x707070},
+  {0x000000, 0x5C5C5C},
+  {0x000000, 0x4A4A4A},
+  {0x000000, 0x3C3C3C},
+  {0x000000, 0x2F2F2F},
+  {0x000000, 0x232323},
+  {0x000000, 0x1A1A1A},
+  {0x000000, 0x131313},
+  {0x000000, 0x0D0D0D},
+  {0x000000, 0x080808},
+  {0x000000, 0x050505},
+  {0x000000, 0x030303},
+  {0x000000, 0x010101},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+  {0x000000, 0x000000},
+};
+
+
+// Progress: one LED on every 3 LEDs, shifted every 100 ms (300 ms period) (golden frames of the left strip)
+static const uint32_t golden_progress[][TEST_LEDS] = {
+  {0xFF2500, 0x000000, 0x000000, 0xFF2500, 0x000000, 0x000000, 0xFF2500, 0x000000},
+  {0x000000, 0xFF2500, 0x000000, 0x000000, 0xFF2500, 0x000000, 0x000000, 0xFF2500},
+  {0x000000, 0x000000, 0xFF2500, 0x000000, 0x000000, 0xFF2500, 0x000000, 0x000000},
+  {0xFF2500, 0x000000, 0x000000, 0xFF2500, 0x000000, 0x000000, 0xFF2500, 0x000000},
+};
+
+
+static void testProgress() {
+  struct LIGHT_PACKET packet = lightPacket(EFFECT_PROGRESS, 300, 3, 0xFF8000, 0x00FF00, 0, 0, 0);
+
+  effects.setLightData(3, &packet);
+  if (dump) {
+    printf("  // Progress\n");
+  }
+  for (uint8_t frame = 0; frame < 4; frame++) {
+    effects.updateLight(micros());
+    if (dump) {
+      printf("  {");
+      for (uint8_t i = 0; i < TEST_LEDS; i++) {
+        printf("0x%06X%s", rgb(left_leds[i]), (i < (TEST_LEDS - 1)) ? ", " : "},\n");
+      }
+    } else {
+      for (uint8_t i = 0; i < TEST_LEDS; i++) {
+        CHECK_EQUAL(golden_progress[frame][i], rgb(left_leds[i]));
+      }
+    }
+    mls_host_advance_micros(100000);
+  }
+}
+
+
+// Golden frames of the other effects, rendered by the renderer before the envelopes
+static void testEffects() {
+  struct LIGHT_PACKET packet;
+
+  checkUniformFrames("Heartbeat", 10, lightPacket(EFFECT_HEARTBEAT, 200, 128, 0xFF0000, 0x00FF00, 0, 0, 0), golden_heartbeat, 22, TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+  checkUniformFrames("Breath", 11, lightPacket(EFFECT_BREATH, 100, 0, 0x0000FF, 0xFF8000, 0, 0, 0), golden_breath, 12, TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+  effects.setMyRank(3);
+  checkUniformFrames("Vue meter rank 3", 12, lightPacket(EFFECT_VUE_METER, 120, 30, 0, 0, 0, 0, 0), golden_vue_meter_rank3, 16, TEST_FRAME_MICROS, 0);
+  checkUniformFrames("Wave back rank 3", 13, lightPacket(EFFECT_WAVE_BACK, 120, 30, 0, 0, 0, 0, 0), golden_wave_back_rank3, 16, TEST_FRAME_MICROS, 0);
+  effects.setMyRank(1);
+  checkUniformFrames("Vue meter rank 1", 14, lightPacket(EFFECT_VUE_METER, 120, 30, 0, 0, 0, 0, 0), golden_vue_meter_rank1, 16, TEST_FRAME_MICROS, 0);
+  checkUniformFrames("Wave back rank 1", 15, lightPacket(EFFECT_WAVE_BACK, 120, 30, 0, 0, 0, 0, 0), golden_wave_back_rank1, 16, TEST_FRAME_MICROS, 0);
+
+  packet = lightPacket(EFFECT_3_STEPS, 0, 0, 0, 0, 0, 0, 0);
+  packet.repeat_counter = 1;
+  checkUniformFrames("3 steps", 16, packet, golden_three_steps, 11, 4 * TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+  packet.repeat_counter = 2;
+  checkUniformFrames("3 steps next beat", 17, packet, golden_three_steps_next, 3, 4 * TEST_FRAME_MICROS, 0);
+  packet = lightPacket(EFFECT_3_STEPS_ALTERNATE, 0, 0, 0, 0, 0, 0, 0);
+  packet.repeat_counter = 4;
+  checkUniformFrames("3 steps alternate", 18, packet, golden_three_steps_alternate, 11, 4 * TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+  packet.repeat_counter = 7;
+  checkUniformFrames("3 steps alternate 3 beats later", 19, packet, golden_three_steps_alternate_odd, 11, 4 * TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+  packet = lightPacket(EFFECT_RAINBOW_RANK_BEAT, 0, 0, 0, 0, 0, 0, 0);
+  packet.repeat_counter = 1;
+  checkUniformFrames("Rainbow rank beat", 20, packet, golden_rainbow_rank_beat, 11, 4 * TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+  packet.repeat_counter = 2;
+  checkUniformFrames("Rainbow rank beat next beat", 21, packet, golden_rainbow_rank_beat_next, 11, 4 * TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+
+  checkUniformFrames("Strobe", 22, lightPacket(EFFECT_STROBE, 60, 0, 0, 0, 0, 0, 0), golden_strobe, 13, TEST_FRAME_MICROS, 0);
+  checkUniformFrames("Flash yellow", 23, lightPacket(EFFECT_FLASH_YELLOW, 0, 0, 0, 0, 0, 0, 0), golden_flash_yellow, 11, 4 * TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+  randomSeed(1);
+  checkUniformFrames("Firefly", 24, lightPacket(EFFECT_FIREFLY, 1, 0, 0, 0, 0, 0, 0), golden_firefly, 40, 20 * TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+  randomSeed(1);
+  checkUniformFrames("Stars", 25, lightPacket(EFFECT_STARS, 1, 0, 0, 0, 0, 0, 0), golden_stars, 40, 5 * TEST_FRAME_MICROS, TEST_FADE_TOLERANCE);
+}
+
+
+// Frames sent to the strips by the flash: the unchanged frames (on time, end) are not sent
+static void testRecordedFrames() {
+  struct LIGHT_PACKET packet = lightPacket(EFFECT_FLASH, 0, 0, 0xFF0000, 0x0000FF, 2, 3, 5);
+  const uint8_t sent_frames[] = {0, 1, 2, 6, 7, 8, 9, 10};
+  uint32_t start_micros = micros();
+
+  led_driver.clear();
+  effects.setLightData(4, &packet);
+  for (uint8_t frame = 0; frame < 12; frame++) {
+    effects.updateLight(micros());
+    mls_host_advance_micros(TEST_FRAME_MICROS);
+  }
+  CHECK_EQUAL(12, led_driver.getShows());
+  CHECK_EQUAL(sizeof(sent_frames), led_driver.getFrames());
+  for (uint8_t i = 0; (i < sizeof(sent_frames)) && (i < led_driver.getFrames()); i++) {
+    const struct MLS_RECORDED_FRAME &recorded = led_driver.getFrame(i);
+    CHECK_EQUAL(start_micros + (sent_frames[i] * TEST_FRAME_MICROS), recorded.time_micros);
+    CHECK(recorded.changed[0] && recorded.changed[1]);
+    CHECK_EQUAL(TEST_LEDS, recorded.strip[0].size());
+    CHECK_EQUAL(golden_flash[sent_frames[i]][0], rgb(recorded.strip[0][TEST_LEDS - 1]));
+    CHECK_EQUAL(golden_flash[sent_frames[i]][1], rgb(recorded.strip[1][TEST_LEDS - 1]));
+  }
+}
+
+
+// Armed flash, fired later with its packet id: the envelope compiled at arm time is kept, the frames are the flash ones
+static void testArmedFlash() {
+  struct LIGHT_PACKET packet = lightPacket(EFFECT_FLASH, 0, 0, 0xFF0000, 0x0000FF, 2, 3, 5);
+  uint16_t render_compilations;
+
+  effects.armLightData(7, &packet);
+  mls_host_advance_micros(TEST_FRAME_MICROS);
+  effects.updateLight(micros());
+  render_compilations = effects.getRenderCompilations();
+  CHECK(!effects.fireLightData(8, 0, 6, 0));
+  CHECK(effects.fireLightData(7, 0, 6, 0));
+  for (uint8_t frame = 0; frame < 12; frame++) {
+    effects.updateLight(micros());
+    CHECK_EQUAL(golden_flash[frame][0], rgb(left_leds[0]));
+    CHECK_EQUAL(golden_flash[frame][1], rgb(right_leds[0]));
+    mls_host_advance_micros(TEST_FRAME_MICROS);
+  }
+  CHECK_EQUAL(render_compilations, effects.getRenderCompilations());
+
+  // A new rank after the arm compiles the envelope again on the render path
+  effects.armLightData(9, &packet);
+  effects.setMyRank(2);
+  CHECK(effects.fireLightData(9, 0, 7, 0));
+  effects.updateLight(micros());
+  CHECK_EQUAL(render_compilations + 2, effects.getRenderCompilations());
+  effects.setMyRank(1);
+}
+
+
+int main(int argc, char **argv) {
+  struct LIGHT_PACKET packet;
+
+  dump = (argc > 1) && (strcmp(argv[1], "--dump") == 0);
+  mls_host_set_micros(TEST_START_MICROS);
+  randomSeed(1);
+  CHECK(effects.begin(&arena, TEST_LEDS));
+  led_driver.begin(left_leds, right_leds, TEST_LEDS, &arena);
+  effects.setLedDriver(&led_driver);
+  effects.setRanks(4);
+  effects.setColumns(2);
+  effects.setMyRank(1);
+  effects.setMyColumn(0);
+
+  checkUniformFrames("Flash", 1, lightPacket(EFFECT_FLASH, 0, 0, 0xFF0000, 0x0000FF, 2, 3, 5), golden_flash, 12, TEST_FRAME_MICROS, 0);
+  checkUniformFrames("Fixed", 2, lightPacket(EFFECT_FIXED, 0, 0, 0x00FF00, 0xFFFFFF, 5, 0, 0), golden_fixed, 8, TEST_FRAME_MICROS, 0);
+  packet = lightPacket(EFFECT_FLASH, 120, 0, 0xFF0000, 0x0000FF, 2, 3, 0);
+  packet.effect_modifier = MODIFIER_FLIP_FLOP | MODIFIER_REPEAT;
+  packet.right_fadein_time = 0; packet.right_on_time = 8; packet.right_fadeout_time = 4;
+  checkUniformFrames("Flip flop", 5, packet, golden_flip_flop, 24, TEST_FRAME_MICROS, 0);
+  testEffects();
+  testProgress();
+  if (!dump) {
+    testRecordedFrames();
+    testArmedFlash();
+  }
+
+  MLS_TEST_END();
+}
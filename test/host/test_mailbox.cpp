@@ -0,0 +1,150 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_mailbox.cpp
+ * @brief MlsMailbox: order, overrun of the oldest item, torn reads
+ *
+ * Two light data pushed before the same frame must be popped in order.
+ * A full mailbox overwrites its oldest item, and the consumer goes on
+ * with the oldest item still there. A torn read (sequence number odd,
+ * the producer is writing the slot, or changed, the slot has been
+ * written again during the copy) is counted, and the consumer goes on
+ * with the next item. The torn slots are forced by a subclass, as the
+ * producer of the other core would leave them.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_mailbox.h"
+
+#define TEST_MAILBOX_SIZE 4
+
+
+struct TEST_ITEM {
+  uint32_t value;
+  uint8_t payload[60];
+};
+
+
+class TestMailbox : public MlsMailbox<struct TEST_ITEM, TEST_MAILBOX_SIZE> {
+
+  public:
+    // Sequence number of the slot of an item, as left by the producer
+    void setSequence(uint32_t index, uint32_t sequence) {
+      this->slots[index % TEST_MAILBOX_SIZE].sequence = sequence;
+    }
+};
+
+
+static void push(TestMailbox *mailbox, uint32_t value) {
+  struct TEST_ITEM item;
+
+  item.value = value;
+  memset(item.payload, value, sizeof(item.payload));
+  mailbox->push(&item);
+}
+
+
+// Pop an item, and check that its payload is not mixed with another item
+static boolean pop(TestMailbox *mailbox, uint32_t *value) {
+  struct TEST_ITEM item;
+
+  if (!mailbox->pop(&item)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < sizeof(item.payload); i++) {
+    CHECK_EQUAL((uint8_t) item.value, item.payload[i]);
+  }
+  *value = item.value;
+  return true;
+}
+
+
+static void testOrder() {
+  TestMailbox mailbox;
+  uint32_t value = 0;
+
+  CHECK(!pop(&mailbox, &value));
+  push(&mailbox, 1);
+  push(&mailbox, 2);
+  CHECK_EQUAL(2, mailbox.available());
+  CHECK(pop(&mailbox, &value));
+  CHECK_EQUAL(1, value);
+  CHECK(pop(&mailbox, &value));
+  CHECK_EQUAL(2, value);
+  CHECK(!pop(&mailbox, &value));
+  CHECK_EQUAL(0, mailbox.getOverruns());
+  CHECK_EQUAL(0, mailbox.getRetries());
+  CHECK_EQUAL(2, mailbox.getHighWater());
+}
+
+
+static void testOverrun() {
+  TestMailbox mailbox;
+  uint32_t value = 0;
+
+  for (uint32_t i = 1; i <= (TEST_MAILBOX_SIZE + 1); i++) {
+    push(&mailbox, i);
+  }
+  CHECK_EQUAL(1, mailbox.getOverruns());
+  CHECK_EQUAL(TEST_MAILBOX_SIZE, mailbox.getHighWater());
+  CHECK_EQUAL(TEST_MAILBOX_SIZE, mailbox.available());
+  // The first item has been overwritten
+  for (uint32_t i = 2; i <= (TEST_MAILBOX_SIZE + 1); i++) {
+    CHECK(pop(&mailbox, &value));
+    CHECK_EQUAL(i, value);
+  }
+  CHECK(!pop(&mailbox, &value));
+  CHECK_EQUAL(0, mailbox.getRetries());
+
+  // Still in order after the wrap of the slots
+  push(&mailbox, 10);
+  CHECK(pop(&mailbox, &value));
+  CHECK_EQUAL(10, value);
+}
+
+
+static void testTornReads() {
+  TestMailbox mailbox;
+  uint32_t value = 0;
+
+  // Item 0 still being written (odd sequence number), item 1 is popped instead
+  push(&mailbox, 1);
+  push(&mailbox, 2);
+  mailbox.setSequence(0, 1);
+  CHECK(pop(&mailbox, &value));
+  CHECK_EQUAL(2, value);
+  CHECK_EQUAL(1, mailbox.getRetries());
+
+  // Item 2 written again in the meantime (sequence number of item 2 + SIZE), item 3 is popped instead
+  push(&mailbox, 3);
+  push(&mailbox, 4);
+  mailbox.setSequence(2, 2 * (2 + TEST_MAILBOX_SIZE + 1));
+  CHECK(pop(&mailbox, &value));
+  CHECK_EQUAL(4, value);
+  CHECK_EQUAL(2, mailbox.getRetries());
+
+  // The only waiting item is torn, nothing is popped
+  push(&mailbox, 5);
+  mailbox.setSequence(4, (2 * 4) + 1);
+  CHECK(!pop(&mailbox, &value));
+  CHECK_EQUAL(3, mailbox.getRetries());
+  CHECK_EQUAL(0, mailbox.available());
+
+  // The next item is read normally
+  push(&mailbox, 6);
+  CHECK(pop(&mailbox, &value));
+  CHECK_EQUAL(6, value);
+  CHECK_EQUAL(3, mailbox.getRetries());
+  CHECK_EQUAL(0, mailbox.getOverruns());
+}
+
+
+int main(int argc, char **argv) {
+  testOrder();
+  testOverrun();
+  testTornReads();
+  MLS_TEST_END();
+}
@@ -0,0 +1,181 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_onset.cpp
+ * @brief MlsOnsetDetector and MlsBeatDetector on a synthetic mix: latency, precision and recall
+ *
+ * The mix is built at I2S_SAMPLE_RATE, like the I2S samples (24 bits,
+ * left aligned): a kick on each beat (decaying 60 Hz burst), a snare on
+ * each offbeat (decaying white noise, much louder than the kick in the
+ * treble), a continuous 440 Hz tone (brass) and a noise floor. The kicks
+ * are the labels.
+ *
+ * The mix goes hop by hop through MlsOnsetDetector: each kick must give
+ * an onset before the end of its first full hop. The onsets out of the
+ * hops of a kick (loud snares, whose bass band is not empty, and the
+ * noise floor after the last kick) are counted, they are left to the
+ * hold-off of the beat detector. The mix then goes through
+ * MlsBeatDetector, and the beats are evaluated with
+ * MlsBeatEvaluator: no false beat is accepted. The decision latency (end
+ * of the hop of the beat - kick) and the error of the onset time are
+ * printed with the precision and the recall of each case.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_beat_detector.h"
+#include "mls_beat_eval.h"
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+#define TEST_SECONDS     30.0
+#define TEST_FIRST_BEAT  0.25
+
+struct ONSET_CASE {
+  uint16_t bpm;
+  double kick;                          // Peak amplitudes (full scale: 1.0)
+  double snare;
+  double tone;
+  double noise;
+};
+
+static const struct ONSET_CASE cases[] = {
+  {120, 0.5, 0.0, 0.0, 0.01},
+  {120, 0.5, 0.4, 0.1, 0.01},
+  {100, 0.4, 0.6, 0.2, 0.02},
+  {150, 0.5, 0.5, 0.2, 0.01},
+};
+
+
+// Mix of the case in I2S samples, and the kick times
+static std::vector<int32_t> mix(const struct ONSET_CASE *test_case, std::vector<uint32_t> *kicks_micros) {
+  std::vector<double> signal((size_t) (TEST_SECONDS * I2S_SAMPLE_RATE), 0.0);
+  std::vector<int32_t> samples;
+  double period = 60.0 / test_case->bpm;
+  double value;
+
+  randomSeed(test_case->bpm);
+  for (size_t i = 0; i < signal.size(); i++) {
+    signal[i] = (test_case->noise * ((random(2001) - 1000) / 1000.0)) + (test_case->tone * sin((2 * PI * 440 * i) / I2S_SAMPLE_RATE));
+  }
+  for (double beat = TEST_FIRST_BEAT; beat < (TEST_SECONDS - 0.5); beat += period) {
+    size_t kick_start = (size_t) (beat * I2S_SAMPLE_RATE);
+    size_t snare_start = (size_t) ((beat + (period / 2)) * I2S_SAMPLE_RATE);
+    kicks_micros->push_back((uint32_t) lrint(((double) kick_start * 1000000) / I2S_SAMPLE_RATE));
+    for (size_t i = 0; ((kick_start + i) < signal.size()) && (i < (0.3 * I2S_SAMPLE_RATE)); i++) {
+      double t = (double) i / I2S_SAMPLE_RATE;
+      signal[kick_start + i] += test_case->kick * exp(-t / 0.08) * sin(2 * PI * 60 * t);
+    }
+    for (size_t i = 0; ((snare_start + i) < signal.size()) && (i < (0.15 * I2S_SAMPLE_RATE)); i++) {
+      double t = (double) i / I2S_SAMPLE_RATE;
+      signal[snare_start + i] += test_case->snare * exp(-t / 0.03) * ((random(2001) - 1000) / 1000.0);
+    }
+  }
+  for (size_t i = 0; i < signal.size(); i++) {
+    value = max(-1.0, min(1.0, signal[i]));
+    samples.push_back((int32_t) lrint(value * 8388607) << 8);
+  }
+  return samples;
+}
+
+
+static size_t kickSample(uint32_t kick_micros) {
+  return (size_t) (((uint64_t) kick_micros * I2S_SAMPLE_RATE) / 1000000);
+}
+
+
+// Onset of each kick before the end of its first full hop (the level of the next hop may
+// still rise), and some offbeat onsets at most
+static void testOnsets(const struct ONSET_CASE *test_case) {
+  std::vector<uint32_t> kicks_micros;
+  std::vector<int32_t> samples = mix(test_case, &kicks_micros);
+  MlsOnsetDetector detector;
+  int32_t hop[I2S_BLOCK_SIZE];
+  std::vector<boolean> kick_detected(kicks_micros.size(), false);
+  size_t kick = 0;
+  size_t hop_end;
+  uint32_t detected = 0;
+  uint32_t offbeat_onsets = 0;
+  uint32_t warm_up_onsets = 0;
+  uint32_t latency_sum = 0;
+  uint32_t max_latency = 0;
+
+  for (size_t start = 0; (start + I2S_BLOCK_SIZE) <= samples.size(); start += I2S_BLOCK_SIZE) {
+    memcpy(hop, &samples[start], sizeof(hop));
+    hop_end = start + I2S_BLOCK_SIZE;
+    // Last kick started before the end of the hop
+    while (((kick + 1) < kicks_micros.size()) && (kickSample(kicks_micros[kick + 1]) < hop_end)) {
+      kick++;
+    }
+    if (!detector.process(hop, I2S_BLOCK_SIZE)) {
+      continue;
+    }
+    if (hop_end <= kickSample(kicks_micros[0])) {
+      // Noise floor while the threshold window is still empty
+      warm_up_onsets++;
+    } else if (hop_end <= (kickSample(kicks_micros[kick]) + (3 * I2S_BLOCK_SIZE))) {
+      if (!kick_detected[kick]) {
+        kick_detected[kick] = true;
+        detected++;
+        latency_sum += hop_end - kickSample(kicks_micros[kick]);
+        max_latency = max(max_latency, (uint32_t) (hop_end - kickSample(kicks_micros[kick])));
+      }
+    } else {
+      offbeat_onsets++;
+    }
+  }
+  printf("%3u BPM, kick %.1f, snare %.1f, tone %.1f: onsets of %2u/%2u kicks, %2u offbeat, %u in the warm up, latency mean %4.1f ms, max %4.1f ms\n",
+         test_case->bpm, test_case->kick, test_case->snare, test_case->tone, detected, (unsigned) kicks_micros.size(), offbeat_onsets, warm_up_onsets,
+         (latency_sum * 1000.0) / (max(detected, (uint32_t) 1) * I2S_SAMPLE_RATE), (max_latency * 1000.0) / I2S_SAMPLE_RATE);
+  CHECK_EQUAL(kicks_micros.size(), detected);
+  CHECK((2 * offbeat_onsets) <= kicks_micros.size());
+  CHECK(max_latency < (2 * I2S_BLOCK_SIZE));
+}
+
+
+// Beats of MlsBeatDetector, evaluated against the kicks
+static void testBeats(const struct ONSET_CASE *test_case) {
+  std::vector<uint32_t> kicks_micros;
+  std::vector<int32_t> samples = mix(test_case, &kicks_micros);
+  std::vector<uint32_t> beats_micros;
+  std::vector<uint32_t> decisions_micros;
+  MlsBeatDetector detector;
+  MlsBeatEvaluator onset_evaluator;
+  MlsBeatEvaluator decision_evaluator;
+  struct I2S_BEAT beat;
+  int32_t hop[I2S_BLOCK_SIZE];
+  uint32_t hop_end_micros;
+
+  for (size_t start = 0; (start + I2S_BLOCK_SIZE) <= samples.size(); start += I2S_BLOCK_SIZE) {
+    memcpy(hop, &samples[start], sizeof(hop));
+    hop_end_micros = (uint32_t) (((uint64_t) (start + I2S_BLOCK_SIZE) * 1000000) / I2S_SAMPLE_RATE);
+    if (detector.process(hop, I2S_BLOCK_SIZE, hop_end_micros, &beat)) {
+      beats_micros.push_back(beat.onset_micros);
+      decisions_micros.push_back(hop_end_micros);
+    }
+  }
+  onset_evaluator.add(beats_micros, kicks_micros);
+  decision_evaluator.add(decisions_micros, kicks_micros);
+  printf("%3u BPM, kick %.1f, snare %.1f, tone %.1f: %2u kicks, precision %.3f, recall %.3f, decision latency %5.1f ms, onset time error %+5.1f ms\n",
+         test_case->bpm, test_case->kick, test_case->snare, test_case->tone, (unsigned) kicks_micros.size(),
+         onset_evaluator.getPrecision(), onset_evaluator.getRecall(),
+         decision_evaluator.getMeanLatencyMicros() / 1000, onset_evaluator.getMeanLatencyMicros() / 1000);
+  CHECK_EQUAL(0, onset_evaluator.getFalsePositives());
+  CHECK(onset_evaluator.getRecall() >= 0.95);
+  // A beat is decided at the end of the hop of the attack, or of the next one
+  CHECK(decision_evaluator.getMeanLatencyMicros() > 0);
+  CHECK(decision_evaluator.getMeanLatencyMicros() <= ((2 * I2S_BLOCK_SIZE * 1000000.0) / I2S_SAMPLE_RATE));
+  CHECK(fabs(onset_evaluator.getMeanLatencyMicros()) <= ((I2S_BLOCK_SIZE * 1000000.0) / I2S_SAMPLE_RATE));
+}
+
+
+int main(int argc, char **argv) {
+  for (uint8_t i = 0; i < (sizeof(cases) / sizeof(cases[0])); i++) {
+    testOnsets(&cases[i]);
+    testBeats(&cases[i]);
+  }
+  MLS_TEST_END();
+}
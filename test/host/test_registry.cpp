@@ -0,0 +1,261 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_registry.cpp
+ * @brief MlsRegistry: add, search, nextStale, full registry, reply queue and file
+ *
+ * A full registry (the master and MLSMESH_MAX_DEVICES - 1 devices, with
+ * MAC addresses which differ only by their last bytes, like a batch of
+ * boards) is compared with a reference map after each change: ids,
+ * searches, rank and column lists. The devices over the limit are
+ * refused, without any change of the registry. The stale scan, the MAC
+ * suffix collisions, the reply queue and the registry file (append,
+ * partial record, other master) are then checked.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_registry.h"
+#include "SPIFFS.h"
+#include <map>
+#include <vector>
+
+#define TEST_FILE "/test_registry.bin"
+
+
+static void makeMac(uint16_t n, uint8_t *mac) {
+  mac[0] = 0x24;
+  mac[1] = 0x0A;
+  mac[2] = 0xC4;
+  mac[3] = 0x5F;
+  mac[4] = (uint8_t) (n >> 8);
+  mac[5] = (uint8_t) n;
+}
+
+
+// Number of devices in the rank list and in the column list of a device
+static void checkLists(MlsRegistry *registry, std::map<uint8_t, uint8_t> *expected_ranks, std::map<uint8_t, uint8_t> *expected_columns) {
+  std::map<uint8_t, uint8_t>::iterator it;
+  uint8_t count;
+
+  for (it = expected_ranks->begin(); it != expected_ranks->end(); it++) {
+    count = 0;
+    for (uint8_t id = registry->firstInRank(it->first); MLSMESH_UNKNOWN_DEVICE != id; id = registry->nextInRank(id)) {
+      CHECK_EQUAL(it->first, registry->getRank(id));
+      count++;
+    }
+    CHECK_EQUAL(it->second, count);
+  }
+  for (it = expected_columns->begin(); it != expected_columns->end(); it++) {
+    count = 0;
+    for (uint8_t id = registry->firstInColumn(it->first); MLSMESH_UNKNOWN_DEVICE != id; id = registry->nextInColumn(id)) {
+      CHECK_EQUAL(it->first, registry->getColumn(id));
+      count++;
+    }
+    CHECK_EQUAL(it->second, count);
+  }
+}
+
+
+static void testAddSearch() {
+  MlsRegistry *registry = new MlsRegistry();
+  std::map<uint8_t, uint8_t> ranks;
+  std::map<uint8_t, uint8_t> columns;
+  uint8_t mac[6];
+  uint8_t id;
+
+  for (uint16_t n = 0; n < MLSMESH_MAX_DEVICES; n++) {
+    makeMac(n, mac);
+    CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry->search(mac));
+    id = registry->add(mac, n / 10, n % 10);
+    CHECK_EQUAL(n, id);
+    CHECK_EQUAL(n + 1, registry->getNumberOfDevices());
+    ranks[n / 10]++;
+    columns[n % 10]++;
+    // The id of a registered device is kept
+    CHECK_EQUAL(id, registry->add(mac, 99, 99));
+    CHECK_EQUAL(n + 1, registry->getNumberOfDevices());
+  }
+  for (uint16_t n = 0; n < MLSMESH_MAX_DEVICES; n++) {
+    makeMac(n, mac);
+    CHECK_EQUAL(n, registry->search(mac));
+    CHECK(memcmp(registry->getMac(n), mac, 6) == 0);
+    CHECK_EQUAL(n / 10, registry->getRank(n));
+    CHECK_EQUAL(n % 10, registry->getColumn(n));
+  }
+  checkLists(registry, &ranks, &columns);
+  // The hash table is never more than half full: short probe sequences
+  CHECK(registry->getProbes() < (2 * registry->getSearches()));
+
+  // Full registry: the new devices are refused, nothing is changed
+  for (uint16_t n = MLSMESH_MAX_DEVICES; n < (MLSMESH_MAX_DEVICES + 50); n++) {
+    makeMac(n, mac);
+    CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry->add(mac, 1, 1));
+    CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry->search(mac));
+  }
+  CHECK_EQUAL(MLSMESH_MAX_DEVICES, registry->getNumberOfDevices());
+  checkLists(registry, &ranks, &columns);
+  makeMac(MLSMESH_MAX_DEVICES - 1, mac);
+  CHECK_EQUAL(MLSMESH_MAX_DEVICES - 1, registry->add(mac, 1, 1));
+  CHECK_EQUAL(MLSMESH_MAX_DEVICES - 1, registry->search(mac));
+
+  registry->clear();
+  CHECK_EQUAL(0, registry->getNumberOfDevices());
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry->search(mac));
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry->firstInRank(1));
+  delete registry;
+}
+
+
+static void testNextStale() {
+  MlsRegistry registry;
+  std::vector<uint8_t> stale;
+  uint8_t mac[6];
+
+  for (uint8_t n = 0; n < 8; n++) {
+    makeMac(n, mac);
+    registry.add(mac, 1, n);
+  }
+  // Devices never heard are stale, the master is never returned
+  CHECK_EQUAL(1, registry.nextStale(0, 1000, 30000));
+  for (uint8_t id = 1; id < 8; id++) {
+    registry.setRssi(id, -60, (id % 2) ? 1000 : 40000);
+  }
+  registry.setRssi(200, -60, 1000);
+  CHECK_EQUAL(-127, registry.getRssi(200));
+
+  // At 45 s with a maximum age of 30 s: the devices heard at 1 s
+  for (uint8_t id = registry.nextStale(0, 45000, 30000); MLSMESH_UNKNOWN_DEVICE != id; id = registry.nextStale(id, 45000, 30000)) {
+    stale.push_back(id);
+  }
+  CHECK_EQUAL(4, stale.size());
+  CHECK_EQUAL(1, stale[0]);
+  CHECK_EQUAL(7, stale[3]);
+  CHECK(!registry.isStale(2, 45000, 30000));
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry.nextStale(7, 45000, 30000));
+
+  // Across the wraparound of millis()
+  registry.setRssi(1, -60, 0xFFFFF000);
+  CHECK(!registry.isStale(1, 0x00001000, 30000));
+  CHECK(registry.isStale(1, 0x00010000, 30000));
+  // A measure at 0 ms is not "never heard"
+  registry.setRssi(2, -60, 0);
+  CHECK(!registry.isStale(2, 1000, 30000));
+}
+
+
+// Devices with the same MAC suffix (the master is never marked)
+static void testSuffixes() {
+  MlsRegistry registry;
+  uint8_t mac[6];
+
+  makeMac(0, mac);
+  registry.add(mac, 0, 0);
+  mac[0] = 0x30;
+  registry.add(mac, 1, 1);
+  CHECK(!registry.isSuffixShared(0));
+  CHECK(!registry.isSuffixShared(1));
+  CHECK_EQUAL(0, registry.getSuffixCollisions());
+  mac[0] = 0x31;
+  registry.add(mac, 1, 2);
+  mac[0] = 0x32;
+  registry.add(mac, 1, 3);
+  CHECK(registry.isSuffixShared(1));
+  CHECK(registry.isSuffixShared(2));
+  CHECK(registry.isSuffixShared(3));
+  CHECK_EQUAL(3, registry.getSuffixCollisions());
+  // The older devices get a full reply again
+  CHECK_EQUAL(1, registry.nextReply());
+  CHECK_EQUAL(2, registry.nextReply());
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry.nextReply());
+  makeMac(7, mac);
+  registry.add(mac, 1, 4);
+  CHECK(!registry.isSuffixShared(4));
+  CHECK(!registry.isSuffixShared(200));
+}
+
+
+static void testReplyQueue() {
+  MlsRegistry registry;
+  uint8_t mac[6];
+
+  for (uint8_t n = 0; n < 5; n++) {
+    makeMac(n, mac);
+    registry.add(mac, 1, 1);
+  }
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry.nextReply());
+  registry.queueReply(3);
+  registry.queueReply(1);
+  registry.queueReply(3);
+  registry.queueReply(9);
+  CHECK_EQUAL(3, registry.nextReply());
+  CHECK_EQUAL(1, registry.nextReply());
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, registry.nextReply());
+  // The queue indexes wrap around
+  for (uint16_t i = 0; i < 600; i++) {
+    registry.queueReply(1 + (i % 4));
+    CHECK_EQUAL(1 + (i % 4), registry.nextReply());
+  }
+}
+
+
+static void testFile() {
+  MlsRegistry *registry = new MlsRegistry();
+  MlsRegistry *loaded = new MlsRegistry();
+  uint8_t master_mac[6];
+  uint8_t mac[6];
+
+  SPIFFS.remove(TEST_FILE);
+  CHECK(!loaded->load(TEST_FILE, master_mac));
+
+  makeMac(0, master_mac);
+  registry->add(master_mac, 0, 0);
+  for (uint8_t n = 1; n < 40; n++) {
+    makeMac(n, mac);
+    registry->add(mac, n / 4, n % 4);
+  }
+  CHECK(registry->save(TEST_FILE));
+  CHECK(!registry->save(TEST_FILE));
+  // Appended devices
+  for (uint8_t n = 40; n < 45; n++) {
+    makeMac(n, mac);
+    registry->add(mac, 7, 7);
+  }
+  CHECK(registry->save(TEST_FILE));
+  CHECK_EQUAL(sizeof(struct REGISTRY_FILE_HEADER) + (45 * sizeof(struct REGISTRY_RECORD)), SPIFFS.getData(TEST_FILE)->size());
+
+  CHECK(loaded->load(TEST_FILE, master_mac));
+  CHECK_EQUAL(45, loaded->getNumberOfDevices());
+  for (uint8_t n = 0; n < 45; n++) {
+    makeMac(n, mac);
+    CHECK_EQUAL(n, loaded->search(mac));
+    CHECK_EQUAL(registry->getRank(n), loaded->getRank(n));
+  }
+  // Nothing new to save after a load
+  CHECK(!loaded->save(TEST_FILE));
+
+  // Partial record written during a reset: ignored
+  SPIFFS.getData(TEST_FILE)->resize(SPIFFS.getData(TEST_FILE)->size() - 3);
+  CHECK(loaded->load(TEST_FILE, master_mac));
+  CHECK_EQUAL(44, loaded->getNumberOfDevices());
+
+  // Registry file of another master
+  makeMac(1000, mac);
+  CHECK(!loaded->load(TEST_FILE, mac));
+  CHECK_EQUAL(0, loaded->getNumberOfDevices());
+  SPIFFS.remove(TEST_FILE);
+  delete registry;
+  delete loaded;
+}
+
+
+int main(int argc, char **argv) {
+  testAddSearch();
+  testNextStale();
+  testSuffixes();
+  testReplyQueue();
+  testFile();
+  MLS_TEST_END();
+}
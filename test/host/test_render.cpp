@@ -0,0 +1,212 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_render.cpp
+ * @brief MlsRender: frame period, deadlines and statistics on the virtual clock
+ *
+ * The loop of TaskUpdateLight is stepped on the virtual clock: start of
+ * the frame, render time, end of the frame, then a wait of getWaitTicks()
+ * ticks (vTaskDelay, the notification timeout), or less when a new light
+ * data wakes the task up. The wait is rounded up to the tick: the frames
+ * start on their deadline or up to one tick after it, without drift. An
+ * early wake-up must not move the next deadline, a frame starting late
+ * is the regular frame, and only a frame ending after its deadline
+ * counts as a missed deadline.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_render.h"
+
+#define TEST_START_MICROS   1000000
+#define TEST_RENDER_MICROS  2000
+#define TEST_FRAMES         1000
+
+
+// One frame of TaskUpdateLight, rendered in render_micros, and the number of ticks to wait after it
+static TickType_t runFrame(MlsRender *render, uint32_t render_micros, boolean waiting, uint32_t waiting_start_micros) {
+  render->startFrame(micros());
+  mls_host_advance_micros(render_micros);
+  render->endFrame(micros());
+  return render->getWaitTicks(micros(), waiting, waiting_start_micros);
+}
+
+
+static void testFramePeriod() {
+  MlsRender render(NUM_LEDS_PER_STRIP);
+  uint32_t refresh_micros;
+
+  // 18 LEDs: refresh of 840 us, 12 refreshes per frame
+  CHECK_EQUAL(10080, render.getFramePeriodMicros());
+  render.setLedsPerStrip(NUM_LEDS_PER_STRIP_MASTER);
+  CHECK_EQUAL(10350, render.getFramePeriodMicros());
+  for (uint16_t leds = 1; leds <= 400; leds++) {
+    render.setLedsPerStrip(leds);
+    refresh_micros = (leds * LED_WS2812B_LED_MICROS) + LED_WS2812B_RESET_MICROS;
+    CHECK(render.getFramePeriodMicros() >= LIGHT_MIN_FRAME_MICROS);
+    CHECK(render.getFramePeriodMicros() < (LIGHT_MIN_FRAME_MICROS + refresh_micros));
+    CHECK_EQUAL(0, render.getFramePeriodMicros() % refresh_micros);
+  }
+}
+
+
+// Regular frames: one frame per period, started up to one tick after the deadline
+static void testDeadlines() {
+  MlsRender render(NUM_LEDS_PER_STRIP);
+  uint32_t period_micros = render.getFramePeriodMicros();
+  uint32_t first_deadline_micros = 0;
+  uint32_t last_start_micros = 0;
+  TickType_t ticks;
+
+  mls_host_set_micros(TEST_START_MICROS);
+  for (uint32_t frame = 0; frame < TEST_FRAMES; frame++) {
+    if (frame > 1) {
+      CHECK((micros() - last_start_micros) > (period_micros - 1000));
+      CHECK((micros() - last_start_micros) < (period_micros + 1000));
+    }
+    if (frame > 0) {
+      // No drift from the first deadline, and never before the deadline
+      CHECK(((int32_t) (micros() - (first_deadline_micros + (frame - 1) * period_micros))) >= 0);
+      CHECK(((int32_t) (micros() - (first_deadline_micros + (frame - 1) * period_micros))) < 1000);
+    }
+    last_start_micros = micros();
+    ticks = runFrame(&render, TEST_RENDER_MICROS, false, 0);
+    // (the first frame has no deadline, the next one is one period after its end)
+    if (0 == frame) {
+      first_deadline_micros = micros() + period_micros;
+    }
+    CHECK(ticks <= (((0 == frame) ? (period_micros + 999) : (period_micros - TEST_RENDER_MICROS + 999)) / 1000));
+    vTaskDelay(ticks);
+  }
+  CHECK_EQUAL(TEST_FRAMES, render.getFrames());
+  CHECK_EQUAL(0, render.getMissedDeadlines());
+  CHECK_EQUAL(1000000 / period_micros, render.getFps());
+  CHECK_EQUAL(TEST_RENDER_MICROS, render.getFrameMinMicros());
+  CHECK_EQUAL(TEST_RENDER_MICROS, render.getFrameAvgMicros());
+  CHECK_EQUAL(TEST_RENDER_MICROS, render.getFrameMaxMicros());
+}
+
+
+// Frames woken up before the deadline, by a new light data or by the start time of a waiting effect
+static void testEarlyWakeUps() {
+  MlsRender render(NUM_LEDS_PER_STRIP);
+  uint32_t period_micros = render.getFramePeriodMicros();
+  uint32_t regular_start_micros;
+  uint32_t waiting_start_micros;
+  TickType_t ticks;
+
+  mls_host_set_micros(TEST_START_MICROS);
+  for (uint8_t frame = 0; frame < 10; frame++) {
+    vTaskDelay(runFrame(&render, TEST_RENDER_MICROS, false, 0));
+  }
+  ticks = runFrame(&render, TEST_RENDER_MICROS, false, 0);
+  regular_start_micros = micros() + (1000 * ticks);
+
+  // A new light data, in the middle of the wait: the early frame keeps the deadline
+  vTaskDelay(ticks / 2);
+  ticks = runFrame(&render, 500, false, 0);
+  vTaskDelay(ticks);
+  CHECK(((int32_t) (micros() - regular_start_micros)) > -1000);
+  CHECK(((int32_t) (micros() - regular_start_micros)) < 1000);
+  ticks = runFrame(&render, TEST_RENDER_MICROS, false, 0);
+  regular_start_micros = micros() + (1000 * ticks);
+
+  // A waiting effect starting before the deadline: wake-up at its start time (rounded up to the tick)
+  waiting_start_micros = micros() + 3000;
+  CHECK_EQUAL(3, render.getWaitTicks(micros(), true, waiting_start_micros));
+  CHECK_EQUAL(4, render.getWaitTicks(micros(), true, waiting_start_micros + 1));
+  CHECK_EQUAL(1, render.getWaitTicks(micros(), true, micros() + 1));
+  CHECK_EQUAL(ticks, render.getWaitTicks(micros(), true, regular_start_micros + period_micros));
+  CHECK_EQUAL(0, render.getWaitTicks(micros(), true, micros() - 1000));
+  vTaskDelay(render.getWaitTicks(micros(), true, waiting_start_micros));
+  CHECK_EQUAL(waiting_start_micros, micros());
+  ticks = runFrame(&render, TEST_RENDER_MICROS, false, 0);
+  vTaskDelay(ticks);
+  CHECK(((int32_t) (micros() - regular_start_micros)) > -1000);
+  CHECK(((int32_t) (micros() - regular_start_micros)) < 1000);
+
+  CHECK_EQUAL(0, render.getMissedDeadlines());
+  CHECK_EQUAL(500, render.getFrameMinMicros());
+  CHECK_EQUAL(TEST_RENDER_MICROS, render.getFrameMaxMicros());
+}
+
+
+// Frames ending after their deadline: one missed deadline per late frame, the next deadline is one period later
+static void testMissedDeadlines() {
+  MlsRender render(NUM_LEDS_PER_STRIP);
+  uint32_t period_micros = render.getFramePeriodMicros();
+  TickType_t ticks;
+
+  mls_host_set_micros(TEST_START_MICROS);
+  // The first frame has no deadline
+  vTaskDelay(runFrame(&render, period_micros + 5000, false, 0));
+  CHECK_EQUAL(0, render.getMissedDeadlines());
+  for (uint8_t frame = 0; frame < 10; frame++) {
+    vTaskDelay(runFrame(&render, TEST_RENDER_MICROS, false, 0));
+  }
+  CHECK_EQUAL(0, render.getMissedDeadlines());
+
+  // Frame of 2.5 periods: the missed frames are skipped, not counted
+  ticks = runFrame(&render, (5 * period_micros) / 2, false, 0);
+  CHECK_EQUAL(1, render.getMissedDeadlines());
+  CHECK_EQUAL((period_micros + 999) / 1000, ticks);
+  vTaskDelay(ticks);
+
+  // Frame ending just after its deadline (the frame starts up to one tick after the previous one)
+  ticks = runFrame(&render, TEST_RENDER_MICROS, false, 0);
+  vTaskDelay(ticks);
+  ticks = runFrame(&render, period_micros + 1000, false, 0);
+  CHECK_EQUAL(2, render.getMissedDeadlines());
+  vTaskDelay(ticks);
+
+  // Back to regular frames
+  for (uint8_t frame = 0; frame < 100; frame++) {
+    vTaskDelay(runFrame(&render, TEST_RENDER_MICROS, false, 0));
+  }
+  CHECK_EQUAL(2, render.getMissedDeadlines());
+  CHECK_EQUAL((5 * period_micros) / 2, render.getFrameMaxMicros());
+
+  render.resetStatistics();
+  CHECK_EQUAL(0, render.getFrames());
+  CHECK_EQUAL(0, render.getMissedDeadlines());
+  CHECK_EQUAL(0, render.getFrameMinMicros());
+  CHECK_EQUAL(0, render.getFrameMaxMicros());
+}
+
+
+// Frames starting slightly late (the tick of the wait, a busy core): regular frames, the deadlines stay on the grid
+static void testLateStarts() {
+  MlsRender render(NUM_LEDS_PER_STRIP);
+  uint32_t period_micros = render.getFramePeriodMicros();
+  uint32_t wake_up_micros;
+  TickType_t ticks;
+
+  mls_host_set_micros(TEST_START_MICROS);
+  for (uint8_t frame = 0; frame < 10; frame++) {
+    vTaskDelay(runFrame(&render, TEST_RENDER_MICROS, false, 0));
+  }
+  wake_up_micros = micros();
+  for (uint8_t frame = 0; frame < 10; frame++) {
+    // Start 900 us after the wake-up
+    mls_host_advance_micros(900);
+    ticks = runFrame(&render, TEST_RENDER_MICROS, false, 0);
+    vTaskDelay(ticks);
+    // The next wake-up is on the next deadline (up to one tick after), not one period after the late start
+    CHECK(((int32_t) (micros() - (wake_up_micros + ((frame + 1) * period_micros)))) > -1000);
+    CHECK(((int32_t) (micros() - (wake_up_micros + ((frame + 1) * period_micros)))) < 1000);
+  }
+  CHECK_EQUAL(0, render.getMissedDeadlines());
+}
+
+
+int main(int argc, char **argv) {
+  testFramePeriod();
+  testDeadlines();
+  testEarlyWakeUps();
+  testMissedDeadlines();
+  testLateStarts();
+
+  MLS_TEST_END();
+}
@@ -0,0 +1,281 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_repeater.cpp
+ * @brief MlsRepeater: election on a replayed RSSI trace, propagation, and time slots
+ *
+ * A band of 10 ranks of 4 columns reports its RSSI every 10 s, like the
+ * topology keep alive. The trace starts with a tight block, then the band
+ * is stretched (the last ranks are at the edge of the master coverage),
+ * then the band is tight again, and finally the last rank is lost. The
+ * repeaters elected at the end of each phase are compared with the
+ * expected ones.
+ *
+ * After each election, a master packet is propagated through the band
+ * with the RSSI matrix of the phase (the path loss between two ranks is
+ * the one between the master and a rank at the same distance, and the
+ * last rank is out of reach once lost). A copy is heard if the link is
+ * at least MLSMESH_REPEATER_MIN_RSSI. The delivery ratio per rank, the
+ * worst delivery latency and the worst hop latency (from the first copy
+ * received by a repeater to its forward) are printed.
+ *
+ * The wave of a master packet through the elected repeaters is then
+ * replayed with the virtual clock.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_repeater.h"
+
+#define TEST_RANKS      10
+#define TEST_COLUMNS    4
+#define TEST_REPORT_MS  10000
+#define TEST_DEVICES    (1 + (TEST_RANKS * TEST_COLUMNS))
+#define TEST_NO_LINK    -127
+
+enum { TRACE_TIGHT, TRACE_STRETCHED, TRACE_LOST };
+
+struct TRACE_PHASE {
+  uint32_t end_ms;                     // Last report of the phase, and election
+  uint8_t shape;
+  uint8_t first_rank;                  // Expected repeaters: all the devices of these ranks
+  uint8_t ranks;
+};
+
+static const struct TRACE_PHASE trace[] = {
+  {30000, TRACE_TIGHT, 1, 0},          // Every device hears the master well
+  {60000, TRACE_STRETCHED, 6, 3},      // Ranks 9 and 10 are below -80 dBm, the 12 weakest others are the ranks 6 to 8
+  {80000, TRACE_TIGHT, 1, 0},
+  {110000, TRACE_LOST, 1, 0},          // The last rank was heard 30 s ago, not stale yet
+  {120000, TRACE_LOST, 7, 3},          // The last rank is lost, the 12 weakest devices are the ranks 7 to 9
+};
+
+
+// Id of a device of the band (the master has the id 0)
+static uint8_t deviceId(uint8_t rank, uint8_t column) {
+  return 1 + ((rank - 1) * TEST_COLUMNS) + (column - 1);
+}
+
+
+static void registerBand(MlsRegistry *registry) {
+  uint8_t mac[6] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x00};
+
+  registry->add(mac, 0, 0);
+  for (uint8_t rank = 1; rank <= TEST_RANKS; rank++) {
+    for (uint8_t column = 1; column <= TEST_COLUMNS; column++) {
+      mac[4] = rank;
+      mac[5] = column;
+      registry->add(mac, rank, column);
+    }
+  }
+}
+
+
+// RSSI of the link between two ranks (rank 0: master) in the trace shape
+static int8_t linkRssi(uint8_t shape, uint8_t from_rank, uint8_t to_rank) {
+  uint8_t distance = (from_rank > to_rank) ? (from_rank - to_rank) : (to_rank - from_rank);
+
+  if ((TRACE_LOST == shape) && ((TEST_RANKS == from_rank) || (TEST_RANKS == to_rank))) {
+    return TEST_NO_LINK;
+  }
+  return (TRACE_STRETCHED == shape) ? (-40 - (5 * distance)) : (-40 - (2 * distance));
+}
+
+
+// RSSI reports of the band from start_ms to end_ms (included)
+static void replayTrace(MlsRegistry *registry, uint32_t start_ms, uint32_t end_ms, uint8_t shape) {
+  for (uint32_t now_ms = start_ms; now_ms <= end_ms; now_ms += TEST_REPORT_MS) {
+    for (uint8_t rank = 1; rank <= TEST_RANKS; rank++) {
+      int8_t rssi = linkRssi(shape, 0, rank);
+      if (TEST_NO_LINK == rssi) {
+        continue;
+      }
+      for (uint8_t column = 1; column <= TEST_COLUMNS; column++) {
+        registry->setRssi(deviceId(rank, column), rssi, now_ms);
+      }
+    }
+  }
+}
+
+
+// The repeaters of the packet are the 4 devices of each expected rank, in rank order
+static void checkRepeaters(MlsRepeater *repeater, uint8_t first_rank, uint8_t ranks) {
+  struct MLS_PACKET packet;
+  uint8_t i = 0;
+
+  repeater->fillPacket(&packet);
+  CHECK_EQUAL(ranks * TEST_COLUMNS, repeater->getNumberOfRepeaters());
+  CHECK_EQUAL(0, packet.REPEATER_POSITION);
+  for (uint8_t rank = first_rank; rank < (first_rank + ranks); rank++) {
+    for (uint8_t column = 1; column <= TEST_COLUMNS; column++) {
+      CHECK_EQUAL(deviceId(rank, column), packet.REPEATERS_ID[i++]);
+    }
+  }
+  while (i < MLSMESH_MAX_REPEATERS) {
+    CHECK_EQUAL(MLSMESH_NO_REPEATER, packet.REPEATERS_ID[i++]);
+  }
+}
+
+
+// Copy of a packet sent from a rank (0: master), received by the devices which hear it
+static void deliver(MlsRepeater *devices, uint32_t *received_micros, uint8_t shape, uint8_t from_rank, struct MLS_PACKET *packet) {
+  for (uint8_t id = 1; id < TEST_DEVICES; id++) {
+    uint8_t rank = 1 + ((id - 1) / TEST_COLUMNS);
+    if (linkRssi(shape, from_rank, rank) < MLSMESH_REPEATER_MIN_RSSI) {
+      continue;
+    }
+    if (MLSMESH_REPEATER_NO_SLOT == received_micros[id]) {
+      received_micros[id] = micros();
+    }
+    devices[id].learnRepeaters(packet, id);
+    devices[id].schedule(packet, micros());
+  }
+}
+
+
+// Wave of a master packet through the band and its elected repeaters, slot by slot
+static void testPropagation(MlsRepeater *master, uint8_t phase) {
+  MlsRepeater devices[TEST_DEVICES];
+  uint32_t received_micros[TEST_DEVICES];
+  struct MLS_PACKET packet;
+  uint8_t shape = trace[phase].shape;
+  uint32_t t0 = 3000000 + (phase * 1000000);
+  uint32_t worst_delivery_micros = 0;
+  uint32_t worst_hop_micros = 0;
+
+  memset(packet.raw, 0, MLS_PACKET_SIZE);
+  packet.SENDER_ID = 0;
+  packet.PACKET_ID = phase;
+  master->fillPacket(&packet);
+  for (uint8_t id = 0; id < TEST_DEVICES; id++) {
+    received_micros[id] = MLSMESH_REPEATER_NO_SLOT;
+  }
+
+  mls_host_set_micros(t0);
+  deliver(devices, received_micros, shape, 0, &packet);
+  for (uint8_t slot = 1; slot <= MLSMESH_MAX_REPEATERS; slot++) {
+    mls_host_set_micros(t0 + (slot * MLSMESH_REPEATER_SLOT_US));
+    for (uint8_t id = 1; id < TEST_DEVICES; id++) {
+      if (devices[id].nextPacket(&packet, micros())) {
+        if ((micros() - received_micros[id]) > worst_hop_micros) {
+          worst_hop_micros = micros() - received_micros[id];
+        }
+        deliver(devices, received_micros, shape, 1 + ((id - 1) / TEST_COLUMNS), &packet);
+      }
+    }
+  }
+
+  printf("Phase %u, %2u repeaters: delivery per rank", phase + 1, master->getNumberOfRepeaters());
+  for (uint8_t rank = 1; rank <= TEST_RANKS; rank++) {
+    uint8_t delivered = 0;
+    for (uint8_t column = 1; column <= TEST_COLUMNS; column++) {
+      uint32_t received = received_micros[deviceId(rank, column)];
+      if (MLSMESH_REPEATER_NO_SLOT != received) {
+        delivered++;
+        if ((received - t0) > worst_delivery_micros) {
+          worst_delivery_micros = received - t0;
+        }
+      }
+    }
+    printf(" %3u%%", (100 * delivered) / TEST_COLUMNS);
+    // The last rank is only lost because it is out of reach
+    CHECK_EQUAL(((TRACE_LOST == shape) && (TEST_RANKS == rank)) ? 0 : TEST_COLUMNS, delivered);
+  }
+  printf(", worst delivery latency %5u us, worst hop latency %5u us\n", worst_delivery_micros, worst_hop_micros);
+  CHECK(worst_delivery_micros <= (master->getNumberOfRepeaters() * MLSMESH_REPEATER_SLOT_US));
+  CHECK(worst_hop_micros <= (master->getNumberOfRepeaters() * MLSMESH_REPEATER_SLOT_US));
+}
+
+
+static void testElection(MlsRegistry *registry, MlsRepeater *master) {
+  uint32_t start_ms = TEST_REPORT_MS;
+
+  registerBand(registry);
+  CHECK_EQUAL(1 + (TEST_RANKS * TEST_COLUMNS), registry->getNumberOfDevices());
+
+  for (uint8_t phase = 0; phase < (sizeof(trace) / sizeof(trace[0])); phase++) {
+    replayTrace(registry, start_ms, trace[phase].end_ms, trace[phase].shape);
+    master->elect(registry, trace[phase].end_ms);
+    checkRepeaters(master, trace[phase].first_rank, trace[phase].ranks);
+    testPropagation(master, phase);
+    start_ms = trace[phase].end_ms + TEST_REPORT_MS;
+  }
+}
+
+
+// Master packet forwarded by the repeaters 1 and 5 of the list, in their time slots
+static void testWave(MlsRepeater *master) {
+  MlsRepeater first;
+  MlsRepeater fifth;
+  MlsRepeater listener;
+  struct MLS_PACKET packet;
+  struct MLS_PACKET forwarded;
+  uint32_t t0 = 2000000;
+
+  memset(packet.raw, 0, MLS_PACKET_SIZE);
+  packet.SENDER_ID = 0;
+  packet.PACKET_ID = 42;
+  master->fillPacket(&packet);
+
+  first.learnRepeaters(&packet, packet.REPEATERS_ID[0]);
+  fifth.learnRepeaters(&packet, packet.REPEATERS_ID[4]);
+  listener.learnRepeaters(&packet, deviceId(1, 1));
+  CHECK_EQUAL(1, first.getMyPosition());
+  CHECK_EQUAL(5, fifth.getMyPosition());
+  CHECK_EQUAL(0, listener.getMyPosition());
+  CHECK_EQUAL(12, listener.getNumberOfRepeaters());
+
+  // Everybody receives the original packet
+  mls_host_set_micros(t0);
+  first.schedule(&packet, micros());
+  fifth.schedule(&packet, micros());
+  listener.schedule(&packet, micros());
+  CHECK_EQUAL(MLSMESH_REPEATER_SLOT_US, first.getWaitMicros(micros()));
+  CHECK_EQUAL(5 * MLSMESH_REPEATER_SLOT_US, fifth.getWaitMicros(micros()));
+  CHECK_EQUAL(MLSMESH_REPEATER_NO_SLOT, listener.getWaitMicros(micros()));
+  CHECK(!first.nextPacket(&forwarded, micros()));
+
+  // The slot of the first repeater
+  mls_host_advance_micros(MLSMESH_REPEATER_SLOT_US - 1);
+  CHECK(!first.nextPacket(&forwarded, micros()));
+  CHECK_EQUAL(1, first.getWaitMicros(micros()));
+  mls_host_advance_micros(1);
+  CHECK(first.nextPacket(&forwarded, micros()));
+  CHECK_EQUAL(MLSMESH_REPEATER_NO_SLOT, first.getWaitMicros(micros()));
+  CHECK_EQUAL(1, forwarded.REPEATER_POSITION & MLSMESH_REPEATER_POSITION_MASK);
+  CHECK_EQUAL(42, forwarded.PACKET_ID);
+  CHECK_EQUAL(MLSMESH_REPEATER_SLOT_US, first.getHopLatencyMicros(&forwarded));
+
+  // The copy of the first repeater reschedules the fifth one in the same slot
+  fifth.schedule(&forwarded, micros());
+  CHECK_EQUAL(1, fifth.getOverwrittenPackets());
+  CHECK_EQUAL(4 * MLSMESH_REPEATER_SLOT_US, fifth.getWaitMicros(micros()));
+  // The wave is already behind the first repeater
+  first.schedule(&forwarded, micros());
+  CHECK_EQUAL(MLSMESH_REPEATER_NO_SLOT, first.getWaitMicros(micros()));
+
+  mls_host_set_micros(t0 + (5 * MLSMESH_REPEATER_SLOT_US));
+  CHECK_EQUAL(0, fifth.getWaitMicros(micros()));
+  CHECK(fifth.nextPacket(&forwarded, micros()));
+  CHECK_EQUAL(5, forwarded.REPEATER_POSITION & MLSMESH_REPEATER_POSITION_MASK);
+  CHECK(!fifth.nextPacket(&forwarded, micros()));
+  CHECK_EQUAL(1, first.getForwardedPackets());
+  CHECK_EQUAL(1, fifth.getForwardedPackets());
+
+  // A new list without me
+  fifth.clear();
+  CHECK_EQUAL(0, fifth.getMyPosition());
+  CHECK_EQUAL(0, fifth.getNumberOfRepeaters());
+}
+
+
+int main(int argc, char **argv) {
+  static MlsRegistry registry;
+  MlsRepeater master;
+
+  testElection(&registry, &master);
+  testWave(&master);
+  MLS_TEST_END();
+}
@@ -0,0 +1,185 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_replay.cpp
+ * @brief MlsReplayWindow: wraparound, reordering, bursts and restarts
+ *
+ * The hand written cases cover the wraparound of the packet ids, the
+ * reordered copies inside the window, the duplicates of the repeaters,
+ * the bursts of lost packets and the restart of a sender. A random
+ * stream (losses, copies and jitter, across several wraparounds) is then
+ * compared with a reference model which remembers every packet id.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_replay.h"
+#include <set>
+
+
+static void testIsNewer() {
+  CHECK(MlsReplayWindow::isNewer(1, 0));
+  CHECK(!MlsReplayWindow::isNewer(0, 1));
+  CHECK(!MlsReplayWindow::isNewer(7, 7));
+  CHECK(MlsReplayWindow::isNewer(0, 65535));
+  CHECK(MlsReplayWindow::isNewer(5, 65530));
+  CHECK(!MlsReplayWindow::isNewer(65530, 5));
+  CHECK(MlsReplayWindow::isNewer(32767, 0));
+  CHECK(!MlsReplayWindow::isNewer(32768, 0));
+}
+
+
+static void testWraparound() {
+  MlsReplayWindow replay;
+
+  for (uint32_t id = 65530; id < 65546; id++) {
+    CHECK(replay.isNew(3, (uint16_t) id));
+  }
+  CHECK_EQUAL(9, replay.getNewestId(3));
+  // Copies of the packets before the wraparound
+  CHECK(!replay.isNew(3, 65535));
+  CHECK(!replay.isNew(3, 65530));
+  CHECK(!replay.isNew(3, 0));
+  CHECK_EQUAL(3, replay.getDuplicates());
+  CHECK_EQUAL(0, replay.getTooOld());
+  CHECK_EQUAL(0, replay.getResyncs());
+}
+
+
+static void testReordering() {
+  MlsReplayWindow replay;
+
+  CHECK(replay.isNew(1, 100));
+  CHECK(replay.isNew(1, 103));
+  // Late copies inside the window, accepted once
+  CHECK(replay.isNew(1, 102));
+  CHECK(replay.isNew(1, 101));
+  CHECK(!replay.isNew(1, 101));
+  CHECK_EQUAL(2, replay.getReordered());
+  CHECK_EQUAL(103, replay.getNewestId(1));
+
+  // The last packet id of the window, and the first one out of it
+  CHECK(replay.isNew(1, 103 + MLSMESH_REPLAY_WINDOW));
+  CHECK(!replay.isNew(1, 103));
+  CHECK_EQUAL(1, replay.getTooOld());
+  CHECK(replay.isNew(1, 104));
+  CHECK(!replay.isNew(1, 104));
+  CHECK_EQUAL(3, replay.getReordered());
+  CHECK_EQUAL(2, replay.getDuplicates());
+}
+
+
+// Copies of the repeaters, then a burst of lost packets larger than the window
+static void testBursts() {
+  MlsReplayWindow replay;
+
+  for (uint16_t id = 500; id < 520; id++) {
+    CHECK(replay.isNew(0, id));
+    for (uint8_t copy = 0; copy < 12; copy++) {
+      CHECK(!replay.isNew(0, id));
+    }
+  }
+  CHECK_EQUAL(20 * 12, replay.getDuplicates());
+
+  // 100 packets lost: the window restarts from the newest one
+  CHECK(replay.isNew(0, 620));
+  CHECK(!replay.isNew(0, 619 - MLSMESH_REPLAY_WINDOW));
+  CHECK(replay.isNew(0, 619));
+  CHECK(replay.isNew(0, 621 - MLSMESH_REPLAY_WINDOW));
+  CHECK_EQUAL(1, replay.getTooOld());
+  CHECK_EQUAL(2, replay.getReordered());
+  CHECK_EQUAL(0, replay.getResyncs());
+}
+
+
+// A sender restarted with another random first id, and a new device with the same id
+static void testRestart() {
+  MlsReplayWindow replay;
+
+  CHECK(replay.isNew(7, 40000));
+  CHECK(replay.isNew(7, 40001));
+  CHECK(!replay.isNew(7, 40001 - MLSMESH_REPLAY_RESYNC_GAP + 1));
+  CHECK_EQUAL(1, replay.getTooOld());
+  CHECK(replay.isNew(7, 40001 - MLSMESH_REPLAY_RESYNC_GAP));
+  CHECK_EQUAL(1, replay.getResyncs());
+  CHECK_EQUAL(40001 - MLSMESH_REPLAY_RESYNC_GAP, replay.getNewestId(7));
+
+  replay.clear(7);
+  CHECK(replay.isNew(7, 12));
+  CHECK_EQUAL(1, replay.getResyncs());
+  // The other senders are independent
+  CHECK(replay.isNew(8, 12));
+  CHECK(!replay.isNew(7, 12));
+  CHECK(!replay.isNew(8, 12));
+  // Unregistered devices are never filtered
+  CHECK(replay.isNew(0xFF, 12));
+  CHECK(replay.isNew(0xFF, 12));
+}
+
+
+// Reference model: every packet id is remembered, the window only decides for the old ones
+static void testRandomStream() {
+  MlsReplayWindow replay;
+  std::set<uint32_t> received;
+  uint32_t newest = 0;
+  uint32_t sent = 60000;
+  uint32_t errors = 0;
+  uint32_t accepted = 0;
+  boolean first = true;
+
+  randomSeed(12);
+  for (uint32_t i = 0; i < 200000; i++) {
+    uint32_t id;
+    boolean expected;
+    long event = random(100);
+
+    if (event < 70) {
+      // Next packet of the sender (some are lost)
+      sent += 1 + ((random(10) == 0) ? random(40) : 0);
+      id = sent;
+    } else {
+      // Late copy (repeater or reordered packet), sometimes out of the window
+      id = sent - random(2 * MLSMESH_REPLAY_WINDOW);
+      if (first || (id > sent)) {
+        continue;
+      }
+    }
+    if (first || (id > newest)) {
+      expected = true;
+    } else if ((newest - id) >= MLSMESH_REPLAY_WINDOW) {
+      expected = false;
+    } else {
+      expected = (received.count(id) == 0);
+    }
+    if (replay.isNew(5, (uint16_t) id) != expected) {
+      errors++;
+    }
+    if (expected) {
+      accepted++;
+      received.insert(id);
+      if (first || (id > newest)) {
+        newest = id;
+      }
+      first = false;
+    }
+    if ((uint16_t) newest != replay.getNewestId(5)) {
+      errors++;
+    }
+  }
+  CHECK_EQUAL(0, errors);
+  CHECK(sent > (60000 + 3 * 65536));
+  CHECK(accepted > 100000);
+}
+
+
+int main(int argc, char **argv) {
+  testIsNewer();
+  testWraparound();
+  testReordering();
+  testBursts();
+  testRestart();
+  testRandomStream();
+  MLS_TEST_END();
+}
@@ -0,0 +1,163 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_tempo.cpp
+ * @brief MlsTempo: playout error of the predicted and reactive beats
+ *
+ * Replay of the loop of the master on a simulated show: 120 BPM during
+ * 60 s, then 115 BPM during 60 s. The onsets have +/- 10 ms of jitter,
+ * 10% of the kicks are missed, there is a false onset every 4 s, and
+ * each onset reaches the loop 12 ms after the kick (hop and detection).
+ *
+ * Like in the sketch, a beat is sent after its onset when the tempo is
+ * not locked (played the playout delay later), and the predicted beats
+ * are sent the playout delay before them (played on the predicted beat,
+ * with the MASTER_TIME of the packet not later than its send). The
+ * playout error is the distance to the nearest real beat.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_tempo.h"
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#define TEST_PLAYOUT_DELAY_US   12000 // 3 repeaters
+#define TEST_DETECTION_US       12000
+#define TEST_JITTER_US          10000
+#define TEST_LOOP_US            1000
+
+struct TEST_ONSET {
+  uint32_t onset_micros;
+  uint32_t available_micros;
+};
+
+struct TEST_PLAYOUT {
+  uint32_t beats;
+  double error_sum;
+  uint32_t error_max;
+};
+
+
+static uint32_t playoutError(const std::vector<uint32_t> &beats, uint32_t playout_micros) {
+  std::vector<uint32_t>::const_iterator next = std::lower_bound(beats.begin(), beats.end(), playout_micros);
+  uint32_t error = 0xFFFFFFFF;
+
+  if (next != beats.end()) {
+    error = *next - playout_micros;
+  }
+  if ((next != beats.begin()) && ((playout_micros - *(next - 1)) < error)) {
+    error = playout_micros - *(next - 1);
+  }
+  return error;
+}
+
+
+static void addPlayout(struct TEST_PLAYOUT *playout, uint32_t error) {
+  playout->beats++;
+  playout->error_sum += error;
+  playout->error_max = std::max(playout->error_max, error);
+}
+
+
+static void testShow() {
+  MlsTempo tempo;
+  std::vector<uint32_t> beats;
+  std::vector<struct TEST_ONSET> onsets;
+  struct TEST_PLAYOUT reactive = {0, 0, 0};
+  struct TEST_PLAYOUT predicted = {0, 0, 0};
+  uint32_t early_master_times = 0;
+  uint32_t start_micros = 5000000;
+  uint32_t end_micros = start_micros + 120000000;
+  uint32_t next_false_micros = start_micros + 4000000;
+  size_t next_onset = 0;
+  double beat = start_micros;
+  uint32_t beat_micros;
+
+  // The show, and its onsets in time order
+  randomSeed(24);
+  while (beat < end_micros) {
+    struct TEST_ONSET onset;
+    beats.push_back((uint32_t) beat);
+    if (random(10) != 0) {
+      onset.onset_micros = (uint32_t) beat + random(2 * TEST_JITTER_US + 1) - TEST_JITTER_US;
+      onset.available_micros = onset.onset_micros + TEST_DETECTION_US;
+      onsets.push_back(onset);
+    }
+    if (beat > next_false_micros) {
+      onset.onset_micros = next_false_micros + 100000 + random(200000);
+      onset.available_micros = onset.onset_micros + TEST_DETECTION_US;
+      onsets.push_back(onset);
+      next_false_micros += 4000000;
+    }
+    beat += (beat < (start_micros + 60000000)) ? 500000.0 : (60000000.0 / 115);
+  }
+  std::sort(onsets.begin(), onsets.end(), [](const struct TEST_ONSET &a, const struct TEST_ONSET &b) {
+    return a.available_micros < b.available_micros;
+  });
+
+  // Loop of the master
+  for (uint32_t now = start_micros; now < end_micros; now += TEST_LOOP_US) {
+    while ((next_onset < onsets.size()) && (onsets[next_onset].available_micros <= now)) {
+      uint32_t onset_micros = onsets[next_onset++].onset_micros;
+      boolean locked = tempo.isLocked(onset_micros);
+      tempo.addOnset(onset_micros);
+      if (!(locked && tempo.isLocked(onset_micros))) {
+        addPlayout(&reactive, playoutError(beats, now + TEST_PLAYOUT_DELAY_US));
+      }
+    }
+    if (tempo.isBeatDue(now, TEST_PLAYOUT_DELAY_US, &beat_micros)) {
+      CHECK_EQUAL(tempo.getNextBeat(now), beat_micros);
+      if (((int32_t) ((beat_micros - TEST_PLAYOUT_DELAY_US) - now)) > 0) {
+        early_master_times++;
+      }
+      addPlayout(&predicted, playoutError(beats, beat_micros));
+    }
+  }
+
+  printf("Show: %u beats, %u onsets\n", (unsigned) beats.size(), (unsigned) onsets.size());
+  printf("  predicted: %u beats, mean error %.1f ms, max %.1f ms\n", predicted.beats,
+         predicted.error_sum / std::max(predicted.beats, (uint32_t) 1) / 1000, predicted.error_max / 1000.0);
+  printf("  reactive:  %u beats, mean error %.1f ms, max %.1f ms\n", reactive.beats,
+         reactive.error_sum / std::max(reactive.beats, (uint32_t) 1) / 1000, reactive.error_max / 1000.0);
+  printf("  tempo: %u BPM, %u hits, %u misses\n", tempo.getBpm(), tempo.getHits(), tempo.getMisses());
+
+  CHECK_EQUAL(0, early_master_times);
+  CHECK(predicted.beats > (beats.size() * 8 / 10));
+  CHECK((predicted.error_sum / predicted.beats) < 6000);
+  CHECK((reactive.error_sum / reactive.beats) > 20000);
+  CHECK_EQUAL(115, tempo.getBpm());
+}
+
+
+// The beat is announced once, the lead time before it
+static void testBeatDue() {
+  MlsTempo tempo;
+  uint32_t beat_micros = 0;
+  uint32_t now;
+
+  for (uint8_t i = 0; i < 8; i++) {
+    tempo.addOnset(1000000 + (i * 500000));
+  }
+  now = 1000000 + (7 * 500000);
+  CHECK(tempo.isLocked(now));
+  CHECK_EQUAL(120, tempo.getBpm());
+  CHECK(!tempo.isBeatDue(now + 400000, 50000, &beat_micros));
+  CHECK(tempo.isBeatDue(now + 450000, 50000, &beat_micros));
+  CHECK_EQUAL(now + 500000, beat_micros);
+  CHECK(!tempo.isBeatDue(now + 460000, 50000, &beat_micros));
+  CHECK(tempo.isBeatDue(now + 950000, 50000, &beat_micros));
+  CHECK_EQUAL(now + 1000000, beat_micros);
+  // Back to the reactive mode without onsets
+  CHECK(!tempo.isBeatDue(now + (I2S_TEMPO_MAX_SILENT_BEATS * 500000) + 1, 50000, &beat_micros));
+}
+
+
+int main(int argc, char **argv) {
+  testBeatDue();
+  testShow();
+  MLS_TEST_END();
+}
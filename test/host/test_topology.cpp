@@ -0,0 +1,266 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_topology.cpp
+ * @brief Subscription storm of 50, 200 and 400 devices, with MAC suffix collisions
+ *
+ * All the devices start together, and subscribe like the sketch: first
+ * request at a random time in SUBSCRIBE_FIRST_WINDOW_MS, then retries
+ * with an exponential backoff and a random jitter. The master registers
+ * the requests, and sends its topology replies every
+ * MLSMESH_TOPOLOGY_BATCH_MS. Each broadcast is lost by a device with a
+ * TEST_LOSS_PERCENT probability, and the requests sent in the same
+ * millisecond collide and are all lost.
+ *
+ * Some devices have the same last 3 bytes of MAC address as an older
+ * device (each device has its own rank and column in the band). At the
+ * end, no registered device may have the id of another device, and the
+ * devices over MLSMESH_MAX_DEVICES must still be waiting for an id: a
+ * device never keeps the id of a batch reply for another device with the
+ * same MAC suffix. A batch reply is only taken with the rank and the
+ * column of the device, and a refused request gets a full reply without
+ * id, which takes back an id taken before.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_registry.h"
+#include <stdio.h>
+#include <vector>
+
+#define TEST_LOSS_PERCENT   10
+#define TEST_COLLISION_EACH 20          // One device in 20 has the MAC suffix of an older one
+#define TEST_DURATION_MS    120000
+
+struct SIM_DEVICE {
+  uint8_t mac[6];
+  uint8_t rank;
+  uint8_t column;
+  uint8_t id;                           // 0xFF: subscribing
+  boolean request_sent;
+  uint32_t last_request_ms;
+  uint32_t delay_ms;
+  uint32_t backoff_ms;
+  uint32_t registered_ms;
+};
+
+
+static boolean received() {
+  return random(0, 100) >= TEST_LOSS_PERCENT;
+}
+
+
+static void makeDevices(std::vector<struct SIM_DEVICE> *devices, uint16_t count) {
+  struct SIM_DEVICE device;
+
+  for (uint16_t i = 0; i < count; i++) {
+    device.mac[0] = 0x24;
+    device.mac[1] = 0x0A;
+    device.mac[2] = 0xC4;
+    device.mac[3] = (uint8_t) random(0, 256);
+    device.mac[4] = (uint8_t) (i >> 8);
+    device.mac[5] = (uint8_t) i;
+    if ((i > 0) && (0 == (i % TEST_COLLISION_EACH))) {
+      // Same suffix as an older device, other OUI
+      memcpy(&device.mac[3], &(*devices)[random(0, i)].mac[3], 3);
+      device.mac[2] = (uint8_t) (i / TEST_COLLISION_EACH);
+    }
+    device.rank = 1 + (i / 8);
+    device.column = 1 + (i % 8);
+    device.id = 0xFF;
+    device.request_sent = false;
+    device.last_request_ms = 0;
+    device.delay_ms = random(0, SUBSCRIBE_FIRST_WINDOW_MS);
+    device.backoff_ms = SUBSCRIBE_RETRY_TIME_MS;
+    device.registered_ms = 0;
+    devices->push_back(device);
+  }
+}
+
+
+// Topology request received by the master (MLS_TOPOLOGY_REQUEST in the sketch)
+// A refused device (registry full) gets a full reply without id, broadcast at once
+static void masterRequest(MlsRegistry *registry, std::vector<struct SIM_DEVICE> *devices, const struct SIM_DEVICE *device) {
+  struct TOPOLOGY_PACKET refusal_packet;
+  uint8_t device_id = registry->search(device->mac);
+
+  if (MLSMESH_UNKNOWN_DEVICE == device_id) {
+    device_id = registry->add(device->mac, device->rank, device->column);
+    if (MLSMESH_UNKNOWN_DEVICE == device_id) {
+      MlsRegistry::fillRefusal(device->mac, &refusal_packet);
+      for (size_t d = 0; d < devices->size(); d++) {
+        if (received() && (memcmp((*devices)[d].mac, refusal_packet.mac, 6) == 0)) {
+          (*devices)[d].id = refusal_packet.device_id;
+        }
+      }
+      return;
+    }
+  }
+  registry->queueReply(device_id);
+}
+
+
+// Topology replies of the master (mlsmesh_send_topology_batch in the sketch), broadcast to the devices
+static void masterReplies(MlsRegistry *registry, std::vector<struct SIM_DEVICE> *devices, uint32_t now_ms) {
+  struct TOPOLOGY_BATCH_PACKET batch_packet;
+  struct TOPOLOGY_PACKET reply_packet;
+  uint8_t full_reply_id;
+  uint8_t replies = registry->fillBatch(&batch_packet, &full_reply_id);
+
+  if (MLSMESH_UNKNOWN_DEVICE != full_reply_id) {
+    registry->fillReply(full_reply_id, &reply_packet);
+  }
+  for (size_t d = 0; d < devices->size(); d++) {
+    struct SIM_DEVICE *device = &(*devices)[d];
+    if ((replies > 0) && received() && (0xFF == device->id) && device->request_sent) {
+      for (uint8_t i = 0; i < MLS_TOPOLOGY_BATCH_SIZE; i++) {
+        if ((0xFF != batch_packet.replies[i].device_id) && (memcmp(&device->mac[3], batch_packet.replies[i].mac_suffix, 3) == 0) &&
+            (device->rank == batch_packet.replies[i].rank) && (device->column == batch_packet.replies[i].column)) {
+          device->id = batch_packet.replies[i].device_id;
+          device->registered_ms = now_ms;
+        }
+      }
+    }
+    if ((MLSMESH_UNKNOWN_DEVICE != full_reply_id) && received() && (memcmp(device->mac, reply_packet.mac, 6) == 0)) {
+      if (0xFF == device->id) {
+        device->registered_ms = now_ms;
+      }
+      device->id = reply_packet.device_id;
+    }
+  }
+}
+
+
+static void simulate(uint16_t count) {
+  MlsRegistry *registry = new MlsRegistry();
+  std::vector<struct SIM_DEVICE> devices;
+  std::vector<size_t> requests;
+  uint8_t master_mac[6] = {0x24, 0x0A, 0xC4, 0xFF, 0xFF, 0xFF};
+  uint16_t expected = min((uint16_t) (MLSMESH_MAX_DEVICES - 1), count);
+  uint16_t registered = 0;
+  uint16_t wrong = 0;
+  uint16_t waiting = 0;
+  uint16_t taken = 0;
+  uint32_t sent = 0;
+  uint32_t lost = 0;
+  uint32_t last_registered_ms = 0;
+
+  randomSeed(count);
+  registry->add(master_mac, 0, 0);
+  makeDevices(&devices, count);
+
+  for (uint32_t now_ms = 0; now_ms < TEST_DURATION_MS; now_ms++) {
+    // Subscription requests of the devices still without id
+    requests.clear();
+    for (size_t d = 0; d < devices.size(); d++) {
+      struct SIM_DEVICE *device = &devices[d];
+      if ((0xFF == device->id) && ((now_ms - device->last_request_ms) > device->delay_ms)) {
+        requests.push_back(d);
+        device->request_sent = true;
+        device->last_request_ms = now_ms;
+        device->delay_ms = random(device->backoff_ms / 2, device->backoff_ms);
+        if (device->backoff_ms < SUBSCRIBE_MAX_BACKOFF_MS) {
+          device->backoff_ms = 2 * device->backoff_ms;
+        }
+      }
+    }
+    sent += requests.size();
+    if (requests.size() > 1) {
+      lost += requests.size();
+    } else if ((1 == requests.size()) && received()) {
+      masterRequest(registry, &devices, &devices[requests[0]]);
+    } else {
+      lost += requests.size();
+    }
+    if (0 == (now_ms % MLSMESH_TOPOLOGY_BATCH_MS)) {
+      masterReplies(registry, &devices, now_ms);
+    }
+  }
+
+  for (size_t d = 0; d < devices.size(); d++) {
+    uint8_t id = registry->search(devices[d].mac);
+    if (0xFF == devices[d].id) {
+      waiting++;
+    } else if (MLSMESH_UNKNOWN_DEVICE == id) {
+      // Unregistered device with the id of a device with the same suffix
+      taken++;
+    } else if (devices[d].id != id) {
+      wrong++;
+    } else {
+      registered++;
+      last_registered_ms = max(last_registered_ms, devices[d].registered_ms);
+    }
+  }
+  printf("%3u devices: %3u registered in %6.1f s, %3u waiting, %u taken ids, %u wrong ids, %u suffix collisions, %u requests (%u lost)\n",
+         count, registered, last_registered_ms / 1000.0, waiting, taken, wrong, registry->getSuffixCollisions(), sent, lost);
+  CHECK_EQUAL(0, wrong);
+  CHECK_EQUAL(0, taken);
+  CHECK_EQUAL(expected, registered);
+  CHECK_EQUAL(count - expected, waiting);
+  CHECK_EQUAL(expected + 1, registry->getNumberOfDevices());
+  CHECK(registry->getSuffixCollisions() > 0);
+  delete registry;
+}
+
+
+// Two devices with the same suffix: no batch reply, a full reply for each device
+static void testFullReplies() {
+  MlsRegistry registry;
+  struct TOPOLOGY_BATCH_PACKET batch_packet;
+  struct TOPOLOGY_PACKET reply_packet;
+  uint8_t master_mac[6] = {0x24, 0x0A, 0xC4, 0xFF, 0xFF, 0xFF};
+  uint8_t mac_a[6] = {0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56};
+  uint8_t mac_b[6] = {0x30, 0xAE, 0xA4, 0x12, 0x34, 0x56};
+  uint8_t mac_c[6] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01};
+  uint8_t full_reply_id;
+
+  registry.add(master_mac, 0, 0);
+  registry.queueReply(registry.add(mac_a, 1, 2));
+  CHECK_EQUAL(1, registry.fillBatch(&batch_packet, &full_reply_id));
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, full_reply_id);
+  CHECK_EQUAL(1, batch_packet.replies[0].device_id);
+  CHECK_EQUAL(0xFF, batch_packet.replies[1].device_id);
+  CHECK(!registry.isSuffixShared(1));
+
+  // The second device may have taken the batch reply of the first one
+  registry.queueReply(registry.add(mac_b, 3, 4));
+  registry.queueReply(registry.add(mac_c, 5, 6));
+  CHECK(registry.isSuffixShared(1));
+  CHECK(registry.isSuffixShared(2));
+  CHECK(!registry.isSuffixShared(3));
+  CHECK_EQUAL(1, registry.getSuffixCollisions());
+
+  CHECK_EQUAL(0, registry.fillBatch(&batch_packet, &full_reply_id));
+  CHECK_EQUAL(1, full_reply_id);
+  registry.fillReply(full_reply_id, &reply_packet);
+  CHECK_EQUAL(MLS_TOPOLOGY_REPLY, reply_packet.type);
+  CHECK_EQUAL(1, reply_packet.device_id);
+  CHECK(memcmp(reply_packet.mac, mac_a, 6) == 0);
+  CHECK_EQUAL(1, reply_packet.rank);
+  CHECK_EQUAL(2, reply_packet.column);
+
+  CHECK_EQUAL(0, registry.fillBatch(&batch_packet, &full_reply_id));
+  CHECK_EQUAL(2, full_reply_id);
+  CHECK_EQUAL(1, registry.fillBatch(&batch_packet, &full_reply_id));
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, full_reply_id);
+  CHECK_EQUAL(3, batch_packet.replies[0].device_id);
+  CHECK_EQUAL(0, registry.fillBatch(&batch_packet, &full_reply_id));
+  CHECK_EQUAL(MLSMESH_UNKNOWN_DEVICE, full_reply_id);
+
+  // Full reply without id for a refused device
+  MlsRegistry::fillRefusal(mac_b, &reply_packet);
+  CHECK_EQUAL(MLS_TOPOLOGY_REPLY, reply_packet.type);
+  CHECK_EQUAL(0xFF, reply_packet.device_id);
+  CHECK(memcmp(reply_packet.mac, mac_b, 6) == 0);
+}
+
+
+int main(int argc, char **argv) {
+  testFullReplies();
+  simulate(50);
+  simulate(200);
+  simulate(400);
+  MLS_TEST_END();
+}
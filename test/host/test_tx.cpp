@@ -0,0 +1,213 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_tx.cpp
+ * @brief MlsTxScheduler: priorities, MASTER_TIME stamp, idle state, late completions and enqueue from an interrupt
+ *
+ * The frames sent by esp_now_send are captured by the hook of the host
+ * shim, the send callback is called by the test.
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_tx.h"
+#include <vector>
+
+static std::vector<std::vector<uint8_t> > sent;
+
+
+static esp_err_t captureSend(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+  sent.push_back(std::vector<uint8_t>(data, data + len));
+  return ESP_OK;
+}
+
+
+static uint32_t sentTime(size_t index, uint8_t offset) {
+  uint32_t master_time;
+
+  memcpy(&master_time, &sent[index][offset], sizeof(master_time));
+  return master_time;
+}
+
+
+// The MASTER_TIME is the enqueue time plus the time spent in the queue
+static void testStamp() {
+  MlsTxScheduler tx;
+  uint8_t frame[20];
+  uint32_t master_time;
+
+  sent.clear();
+  memset(frame, 0, sizeof(frame));
+  mls_host_set_micros(1000000);
+
+  // Sent immediately: the radio is free
+  master_time = micros();
+  memcpy(&frame[4], &master_time, sizeof(master_time));
+  CHECK(tx.enqueue(MLS_TX_BEAT, frame, sizeof(frame), 4));
+  CHECK_EQUAL(1, sent.size());
+  CHECK_EQUAL(1000000, sentTime(0, 4));
+  CHECK(tx.isBusy());
+  CHECK(!tx.isIdle());
+
+  // Waiting 2.5 ms for the frame in flight
+  mls_host_advance_micros(500);
+  master_time = micros();
+  memcpy(&frame[4], &master_time, sizeof(master_time));
+  CHECK(tx.enqueue(MLS_TX_BEAT, frame, sizeof(frame), 4));
+  // A forwarded frame keeps its MASTER_TIME
+  CHECK(tx.enqueue(MLS_TX_BEAT, frame, sizeof(frame)));
+  CHECK_EQUAL(1, sent.size());
+  mls_host_advance_micros(2500);
+  tx.onSent(true);
+  tx.pump();
+  CHECK_EQUAL(2, sent.size());
+  CHECK_EQUAL(1003000, sentTime(1, 4));
+  mls_host_advance_micros(1000);
+  tx.onSent(true);
+  tx.pump();
+  CHECK_EQUAL(3, sent.size());
+  CHECK_EQUAL(1000500, sentTime(2, 4));
+  CHECK(!tx.isIdle());
+  tx.onSent(true);
+  CHECK(tx.isIdle());
+
+  // The MASTER_TIME must be inside the frame
+  CHECK(!tx.enqueue(MLS_TX_BEAT, frame, sizeof(frame), sizeof(frame) - 2));
+}
+
+
+// Highest priority class first, rate limited classes wait for their tokens
+static void testPriorities() {
+  MlsTxScheduler tx;
+  struct MLS_TX_STATS stats;
+  uint8_t frame[2];
+
+  sent.clear();
+  mls_host_set_micros(5000000);
+  tx.setRate(MLS_TX_KEEP_ALIVE, 2, 1);
+  frame[0] = MLS_TX_KEEP_ALIVE;
+  tx.enqueue(MLS_TX_KEEP_ALIVE, frame, 2);
+  frame[0] = MLS_TX_KEEP_ALIVE;
+  tx.enqueue(MLS_TX_KEEP_ALIVE, frame, 2);
+  frame[0] = MLS_TX_COMMAND;
+  tx.enqueue(MLS_TX_COMMAND, frame, 2);
+  frame[0] = MLS_TX_BEAT;
+  tx.enqueue(MLS_TX_BEAT, frame, 2);
+  for (uint8_t i = 0; i < 4; i++) {
+    mls_host_advance_micros(1000);
+    tx.onSent(true);
+    tx.pump();
+  }
+  // Keep alive, beat, command, and the second keep alive waits for a token (500 ms)
+  CHECK_EQUAL(3, sent.size());
+  CHECK_EQUAL(MLS_TX_KEEP_ALIVE, sent[0][0]);
+  CHECK_EQUAL(MLS_TX_BEAT, sent[1][0]);
+  CHECK_EQUAL(MLS_TX_COMMAND, sent[2][0]);
+  CHECK_EQUAL(1, tx.getWaiting(MLS_TX_KEEP_ALIVE));
+  mls_host_advance_micros(500000);
+  tx.pump();
+  CHECK_EQUAL(4, sent.size());
+  CHECK(!tx.isIdle());
+  tx.onSent(true);
+  CHECK(tx.isIdle());
+
+  // Statistics of the last full second, with the longest wait in the queue
+  mls_host_advance_micros(1000000);
+  tx.pump();
+  tx.getLastSecond(MLS_TX_KEEP_ALIVE, &stats);
+  CHECK_EQUAL(2, stats.sent);
+  CHECK_EQUAL(504000, stats.max_delay_micros);
+  tx.getLastSecond(MLS_TX_BEAT, &stats);
+  CHECK_EQUAL(1, stats.sent);
+  CHECK_EQUAL(1000, stats.max_delay_micros);
+}
+
+
+// The late completion of a timed out frame does not end the next frame in flight, and is charged to its own class
+static void testLateCompletion() {
+  MlsTxScheduler tx;
+  struct MLS_TX_STATS stats;
+  uint8_t frame[2];
+
+  sent.clear();
+  mls_host_set_micros(10000000);
+  frame[0] = MLS_TX_KEEP_ALIVE;
+  tx.enqueue(MLS_TX_KEEP_ALIVE, frame, 2);
+  frame[0] = MLS_TX_BEAT;
+  tx.enqueue(MLS_TX_BEAT, frame, 2);
+  mls_host_advance_micros(MLS_TX_DONE_TIMEOUT_US + 1);
+  tx.pump();
+  CHECK_EQUAL(1, tx.getTimeouts());
+  CHECK_EQUAL(2, sent.size());
+  CHECK(tx.isBusy());
+
+  // Late (failed) completion of the keep alive: the beat is still in flight
+  tx.onSent(false);
+  CHECK(tx.isBusy());
+  CHECK_EQUAL(1, tx.getLateCompletions());
+  frame[0] = MLS_TX_COMMAND;
+  tx.enqueue(MLS_TX_COMMAND, frame, 2);
+  CHECK_EQUAL(2, sent.size());
+  tx.onSent(true);
+  CHECK(!tx.isBusy());
+  tx.pump();
+  CHECK_EQUAL(3, sent.size());
+  tx.onSent(true);
+  CHECK(tx.isIdle());
+
+  // A completion without frame in flight is ignored
+  tx.onSent(false);
+  CHECK(tx.isIdle());
+  mls_host_advance_micros(1000000);
+  tx.pump();
+  tx.getLastSecond(MLS_TX_KEEP_ALIVE, &stats);
+  CHECK_EQUAL(1, stats.failures);
+  tx.getLastSecond(MLS_TX_BEAT, &stats);
+  CHECK_EQUAL(0, stats.failures);
+
+  // The completion of a timed out frame never comes: the completion of the next frame is ignored once, then in sync again
+  tx.enqueue(MLS_TX_BEAT, frame, 2);
+  mls_host_advance_micros(MLS_TX_DONE_TIMEOUT_US + 1);
+  tx.enqueue(MLS_TX_BEAT, frame, 2);
+  CHECK_EQUAL(5, sent.size());
+  tx.onSent(true);
+  CHECK(tx.isBusy());
+  mls_host_advance_micros(MLS_TX_DONE_TIMEOUT_US + 1);
+  tx.enqueue(MLS_TX_BEAT, frame, 2);
+  CHECK_EQUAL(6, sent.size());
+  CHECK_EQUAL(3, tx.getTimeouts());
+  tx.onSent(true);
+  CHECK(tx.isIdle());
+  CHECK_EQUAL(2, tx.getLateCompletions());
+}
+
+
+// From the LoRa interrupt, the frame is queued with the interrupt critical section, and sent by the next pump
+static void testEnqueueFromIsr() {
+  MlsTxScheduler tx;
+  uint8_t frame[2] = {MLS_TX_COMMAND, 0};
+  uint32_t isr_critical_sections = mls_host_get_isr_critical_sections();
+
+  sent.clear();
+  mls_host_set_isr_context(true);
+  CHECK(tx.enqueue(MLS_TX_COMMAND, frame, 2));
+  mls_host_set_isr_context(false);
+  CHECK_EQUAL(isr_critical_sections + 1, mls_host_get_isr_critical_sections());
+  CHECK_EQUAL(0, sent.size());
+  CHECK_EQUAL(1, tx.getWaiting(MLS_TX_COMMAND));
+  tx.pump();
+  CHECK_EQUAL(1, sent.size());
+  CHECK_EQUAL(isr_critical_sections + 1, mls_host_get_isr_critical_sections());
+}
+
+
+int main(int argc, char **argv) {
+  mls_host_set_send_hook(captureSend);
+  testStamp();
+  testPriorities();
+  testLateCompletion();
+  testEnqueueFromIsr();
+  MLS_TEST_END();
+}
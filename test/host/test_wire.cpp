@@ -0,0 +1,237 @@
+/**********************************************************************
+ *
+ * MovingLightShow package - Synchronized LED strips for musicians
+ * https://MovingLightShow.art
+ *
+ * @file  test_wire.cpp
+ * @brief MlsWire: round trip, truncated packets, and airtime saved per type
+ *
+ * The packets are built like mlsmesh_send_packet_to() does, for each
+ * packet type of the firmware, and random packets cover the other field
+ * combinations: the decoded packet must be the original one. Every
+ * truncated or extended copy of an encoded packet must be rejected.
+ *
+ * The report gives the airtime of each packet type in the fixed format
+ * and in the compact format (MlsTxScheduler::getAirtimeMicros).
+ *
+ **********************************************************************/
+#include "mls_test.h"
+#include "mls_host.h"
+#include "mls_wire.h"
+#include "mls_repeater.h"
+#include "mls_tx.h"
+#include "mls_groups.h"
+#include "mls_light_effects.h"
+
+struct WIRE_SAMPLE {
+  const char *name;
+  struct MLS_PACKET packet;
+};
+
+
+// Original packet, with the fields set by mlsmesh_send_packet_to()
+static void firmwarePacket(struct MLS_PACKET *packet, uint8_t type, uint8_t sender_id, uint8_t repeaters, const uint8_t *data) {
+  memset(packet->raw, 0, MLS_PACKET_SIZE);
+  memcpy(packet->IID, "MLS", 3);
+  packet->TYPE = type;
+  packet->PACKET_ID = 4242;
+  packet->SENDER_ID = sender_id;
+  packet->NUMBER_OF_COLUMNS = 4;
+  packet->NUMBER_OF_RANKS = 10;
+  packet->COMMAND = 102;
+  packet->COMMAND_SENDER_ID = 17;
+  packet->COMMAND_PACKET_ID = 77;
+  packet->RSSI0 = (0 == sender_id) ? 0 : -67;
+  packet->MASTER_TIME = 123456789;
+  memset(packet->REPEATERS_ID, MLSMESH_NO_REPEATER, MLSMESH_MAX_REPEATERS);
+  for (uint8_t i = 0; i < repeaters; i++) {
+    packet->REPEATERS_ID[i] = 21 + i;
+  }
+  memcpy(packet->DATA, data, MLS_DATA_SIZE);
+}
+
+
+static uint8_t buildSamples(struct WIRE_SAMPLE *samples) {
+  struct LIGHT_PACKET light;
+  struct TOPOLOGY_PACKET topology;
+  struct TOPOLOGY_BATCH_PACKET batch;
+  struct ACTION_PACKET action;
+  struct STATE_BEACON_PACKET beacon;
+  uint8_t n = 0;
+
+  memset(light.raw, 0, LIGHT_PACKET_SIZE);
+  light.effect = EFFECT_FLASH;
+  light.repeat_counter = 12;
+  light.left_color_r = 255;
+  light.right_color_r = 255;
+  light.left_on_time = 10;
+  light.right_on_time = 10;
+  light.left_fadeout_time = 20;
+  light.right_fadeout_time = 20;
+  samples[n].name = "LIGHT DATA (beat)";
+  firmwarePacket(&samples[n++].packet, MLS_TYPE_LIGHT_DATA, 0, 6, light.raw);
+  samples[n].name = "ARM DATA";
+  firmwarePacket(&samples[n++].packet, MLS_TYPE_ARM_DATA, 0, 6, light.raw);
+
+  memset(light.raw, 0, LIGHT_PACKET_SIZE);
+  light.effect = EFFECT_KEEP_ALIVE;
+  samples[n].name = "LIGHT DATA (keep alive)";
+  firmwarePacket(&samples[n++].packet, MLS_TYPE_LIGHT_DATA, 0, 6, light.raw);
+
+  memset(topology.raw, 0, TOPOLOGY_PACKET_SIZE);
+  topology.type = MLS_TOPOLOGY_REQUEST;
+  topology.device_id = 0xFF;
+  memcpy(topology.mac, "\x24\x0A\xC4\x12\x34\x56", 6);
+  topology.rank = 3;
+  topology.column = 2;
+  samples[n].name = "TOPOLOGY DATA (request)";
+  firmwarePacket(&samples[n++].packet, MLS_TYPE_TOPOLOGY_DATA, 0xFF, 0, topology.raw);
+
+  memset(topology.raw, 0, TOPOLOGY_PACKET_SIZE);
+  topology.type = MLS_TOPOLOGY_KEEP_ALIVE;
+  topology.device_id = 17;
+  samples[n].name = "TOPOLOGY DATA (RSSI report)";
+  firmwarePacket(&samples[n++].packet, MLS_TYPE_TOPOLOGY_DATA, 17, 0, topology.raw);
+
+  memset(batch.raw, 0, TOPOLOGY_BATCH_PACKET_SIZE);
+  batch.type = MLS_TOPOLOGY_BATCH_REPLY;
+  for (uint8_t i = 0; i < MLS_TOPOLOGY_BATCH_SIZE; i++) {
+    memcpy(batch.replies[i].mac_suffix, "\x12\x34\x56", 3);
+    batch.replies[i].device_id = 30 + i;
+    batch.replies[i].rank = 3;
+    batch.replies[i].column = 1 + i;
+  }
+  samples[n].name = "TOPOLOGY DATA (batch reply)";
+  firmwarePacket(&samples[n++].packet, MLS_TYPE_TOPOLOGY_DATA, 0, 6, batch.raw);
+
+  memset(beacon.raw, 0, STATE_BEACON_PACKET_SIZE);
+  beacon.action = MLS_ACTION_STATE_BEACON;
+  beacon.effect = EFFECT_FLASH;
+  beacon.repeat_counter = 12;
+  memcpy(beacon.left_color_raw, "\xFF\x00\x00", 3);
+  memcpy(beacon.right_color_raw, "\xFF\x00\x00", 3);
+  beacon.start_master_time = 123000000;
+  samples[n].name = "ACTION DATA (state beacon)";
+  firmwarePacket(&samples[n++].packet, MLS_TYPE_ACTION_DATA, 0, 6, beacon.raw);
+
+  memset(action.raw, 0, ACTION_PACKET_SIZE);
+  action.action = MLS_ACTION_REBOOT;
+  samples[n].name = "ACTION DATA (unicast reboot)";
+  firmwarePacket(&samples[n].packet, MLS_TYPE_ACTION_DATA | MLS_TYPE_MODIFIER_UNICAST, 0, 6, action.raw);
+  samples[n++].packet.DESTINATION_ID = 17;
+
+  return n;
+}
+
+
+static void checkRoundTrip(MlsWire *wire, struct MLS_PACKET *packet) {
+  uint8_t buffer[MLSMESH_WIRE_MAX_SIZE + 1];
+  struct MLS_PACKET decoded;
+  uint8_t type;
+  uint8_t destination_id;
+  uint8_t length = wire->encode(packet, buffer);
+
+  CHECK(length <= MLSMESH_WIRE_MAX_SIZE);
+  CHECK(MlsWire::isCompact(buffer, length));
+  CHECK(wire->decode(buffer, length, &decoded));
+  CHECK(0 == memcmp(packet->raw, decoded.raw, MLS_PACKET_SIZE));
+  MlsWire::peekAddress(buffer, length, &type, &destination_id);
+  CHECK_EQUAL(packet->TYPE, type);
+  CHECK_EQUAL(packet->DESTINATION_ID, destination_id);
+
+  // Truncated or extended copies
+  for (uint8_t i = 0; i < length; i++) {
+    CHECK(!wire->decode(buffer, i, &decoded));
+  }
+  buffer[length] = 0;
+  CHECK(!wire->decode(buffer, length + 1, &decoded));
+}
+
+
+static void testSamples(MlsWire *wire, struct WIRE_SAMPLE *samples, uint8_t number_of_samples) {
+  struct MLS_PACKET decoded;
+  uint8_t type;
+  uint8_t destination_id;
+
+  for (uint8_t i = 0; i < number_of_samples; i++) {
+    checkRoundTrip(wire, &samples[i].packet);
+    // The fixed format is not compact, and keeps its address
+    CHECK(!MlsWire::isCompact(samples[i].packet.raw, MLS_PACKET_SIZE));
+    MlsWire::peekAddress(samples[i].packet.raw, MLS_PACKET_SIZE, &type, &destination_id);
+    CHECK_EQUAL(samples[i].packet.TYPE, type);
+    CHECK_EQUAL(samples[i].packet.DESTINATION_ID, destination_id);
+    CHECK(!wire->decode(samples[i].packet.raw, MLS_PACKET_SIZE, &decoded));
+  }
+}
+
+
+// Random packets, most fields with their default value (the sections are omitted)
+static void testRandomPackets(MlsWire *wire) {
+  struct MLS_PACKET packet;
+  uint8_t buffer[MLSMESH_WIRE_MAX_SIZE];
+  struct MLS_PACKET decoded;
+  uint8_t length;
+  uint32_t errors = 0;
+
+  randomSeed(18);
+  for (uint16_t i = 0; i < 10000; i++) {
+    memset(packet.raw, 0, MLS_PACKET_SIZE);
+    memset(packet.REPEATERS_ID, MLSMESH_NO_REPEATER, MLSMESH_MAX_REPEATERS);
+    for (uint8_t j = 0; j < (MLS_PACKET_SIZE - 1); j++) {
+      if (random(4) == 0) {
+        packet.raw[j] = random(256);
+      }
+    }
+    packet.TYPE &= ~MLSMESH_WIRE_VERSION_FLAG;
+    length = wire->encode(&packet, buffer);
+    if ((!wire->decode(buffer, length, &decoded)) || (0 != memcmp(packet.raw, decoded.raw, MLS_PACKET_SIZE))) {
+      errors++;
+    }
+  }
+  CHECK_EQUAL(0, errors);
+}
+
+
+static void testVersion(MlsWire *wire, struct MLS_PACKET *packet) {
+  uint8_t buffer[MLSMESH_WIRE_MAX_SIZE];
+  struct MLS_PACKET decoded;
+  uint16_t errors = wire->getDecodeErrors();
+  uint8_t length = wire->encode(packet, buffer);
+
+  buffer[3] = MLSMESH_WIRE_VERSION_FLAG | (MLSMESH_WIRE_VERSION + 1);
+  CHECK(!wire->decode(buffer, length, &decoded));
+  CHECK_EQUAL(errors + 1, wire->getDecodeErrors());
+}
+
+
+// Airtime of each packet type, fixed and compact formats
+static void reportAirtime(struct WIRE_SAMPLE *samples, uint8_t number_of_samples) {
+  MlsWire wire;
+  uint8_t buffer[MLSMESH_WIRE_MAX_SIZE];
+  uint32_t fixed_micros = MlsTxScheduler::getAirtimeMicros(MLS_PACKET_SIZE);
+
+  printf("%-30s %6s %6s %8s %8s %6s\n", "Packet type", "fixed", "wire", "fixed us", "wire us", "saved");
+  for (uint8_t i = 0; i < number_of_samples; i++) {
+    uint8_t length = wire.encode(&samples[i].packet, buffer);
+    uint32_t wire_micros = MlsTxScheduler::getAirtimeMicros(length);
+    printf("%-30s %6u %6u %8u %8u %5.1f%%\n", samples[i].name, MLS_PACKET_SIZE, length, fixed_micros, wire_micros,
+           100.0 * (fixed_micros - wire_micros) / fixed_micros);
+    CHECK(wire_micros < fixed_micros);
+  }
+  printf("%-30s %6u %6s %8u\n", "FIRE DATA (short packet)", MLS_FIRE_PACKET_SIZE, "-", MlsTxScheduler::getAirtimeMicros(MLS_FIRE_PACKET_SIZE));
+  CHECK_EQUAL(2, wire.getEncodedPackets(MLS_TYPE_LIGHT_DATA));
+  CHECK(wire.getAverageSize(MLS_TYPE_LIGHT_DATA) < MLS_PACKET_SIZE);
+}
+
+
+int main(int argc, char **argv) {
+  MlsWire wire;
+  struct WIRE_SAMPLE samples[16];
+  uint8_t number_of_samples = buildSamples(samples);
+
+  testSamples(&wire, samples, number_of_samples);
+  testRandomPackets(&wire);
+  testVersion(&wire, &samples[0].packet);
+  reportAirtime(samples, number_of_samples);
+  MLS_TEST_END();
+}